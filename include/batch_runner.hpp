@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "directory_cache.hpp"
+#include "download_job.hpp"
+#include "destination_pool.hpp"
+#include "durability.hpp"
+#include "event_stream.hpp"
+#include "memory_budget.hpp"
+#include "pack.hpp"
+#include "network_cache.hpp"
+#include "path_selector.hpp"
+#include "progress_aggregator.hpp"
+#include "part_locks.hpp"
+#include "single_flight.hpp"
+#include "transfer_engine.hpp"
+
+/**
+ * Totals for a finished batch.
+ */
+struct BatchSummary
+{
+    size_t succeeded = 0;
+    size_t failed = 0;
+    std::vector<size_t> failedJobs; // Indices into the job list, in no particular order
+    std::vector<std::string> locations; // Per job: where its output ended up ("" if it failed)
+};
+
+/**
+ * Downloads a manifest of jobs.
+ *
+ * By default jobs run one after another while a Prefetcher probes the next
+ * ones in the background, so each transfer starts on a warm connection with
+ * its size already known. Each finished file then goes through the
+ * post-download Pipeline (verify, decompress, extract, move, notify) on a
+ * WorkStealingPool, so the next download starts while the previous file is
+ * still being processed. With config.shards > 0 the batch is handed to the
+ * sharded TransferEngine instead and runs concurrently. With several
+ * --interface values, transfers are spread over them by a PathSelector.
+ * All transfer and pipeline buffers draw from one MemoryBudget. With
+ * config.singleFlight, a URL listed by several jobs is fetched once and
+ * shared with the others, and .part files are locked against other
+ * processes (see PartLocks). With config.discoverChecksums, jobs without a
+ * checksum are verified against one published next to them (see
+ * ChecksumDiscovery) or announced in their response headers. With
+ * config.eventStream, every job's start, progress, retries, checksum check
+ * and outcome are also written as NDJSON (see EventStream).
+ */
+class BatchRunner
+{
+public:
+    /**
+     * @param config Retry/timeout/look-ahead settings (copied)
+     * @param networkCache Persistent metadata cache (may be null)
+     */
+    BatchRunner(DownloadConfig config, std::shared_ptr<NetworkCache> networkCache);
+
+    /**
+     * Download every job and run it through its pipeline.
+     * Failures are reported and counted; the batch keeps going.
+     */
+    BatchSummary run(const std::vector<DownloadJob> &jobs);
+
+private:
+    /**
+     * One download at a time on a single HttpClient (config.shards == 0).
+     */
+    BatchSummary runSequential(const std::vector<DownloadJob> &jobs);
+
+    /**
+     * Run the batch on the sharded TransferEngine (config.shards > 0).
+     */
+    BatchSummary runSharded(const std::vector<DownloadJob> &jobs);
+
+    /**
+     * Fetch each distinct URL once, then link or copy it to the duplicates.
+     */
+    BatchSummary runCoalesced(const std::vector<DownloadJob> &jobs);
+
+    /**
+     * runSharded or runSequential, as configured.
+     */
+    BatchSummary dispatch(const std::vector<DownloadJob> &jobs);
+
+    /**
+     * Print a job's final outcome, and send it as a complete event.
+     * Thread-safe (called from pipeline workers).
+     *
+     * @return result.success
+     */
+    bool reportResult(const DownloadJob &job, const TransferResult &result) const;
+
+    /**
+     * Print bytes, transfers and throughput estimate per local path.
+     */
+    void printPathStats() const;
+
+    /**
+     * Print current and peak buffer memory per stage, and arena reuse.
+     */
+    void printMemoryStats() const;
+
+    /**
+     * Print files, free space and write throughput per destination root.
+     */
+    void printPlacementStats() const;
+
+    DownloadConfig config_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    std::shared_ptr<PathSelector> paths_; // Null unless --interface was given
+    std::shared_ptr<MemoryBudget> memory_;
+    std::shared_ptr<Durability> durability_; // Null for --durability none
+    std::shared_ptr<DestinationPool> destinations_; // Null unless --dest-root was given
+    std::shared_ptr<PackWriter> pack_;               // Null unless --pack was given
+    std::shared_ptr<DirectoryCache> directories_;    // Null unless --bulk was given
+    std::shared_ptr<PartLocks> partLocks_;           // Null unless --single-flight was given
+    std::shared_ptr<EventStream> events_;            // Null unless --events was given
+    std::shared_ptr<ProgressAggregator> progress_;   // During run(): feeds the progress bar or events_
+};
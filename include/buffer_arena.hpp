@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class BufferArena;
+
+/**
+ * Move-only handle to a buffer from the BufferArena.
+ *
+ * Moving the handle passes the memory along without copying it; destroying
+ * it (from any thread) gives the buffer back to the arena.
+ */
+class ArenaBuffer
+{
+public:
+    ArenaBuffer() = default;
+    ~ArenaBuffer() { reset(); }
+
+    ArenaBuffer(ArenaBuffer &&other) noexcept;
+    ArenaBuffer &operator=(ArenaBuffer &&other) noexcept;
+    ArenaBuffer(const ArenaBuffer &) = delete;
+    ArenaBuffer &operator=(const ArenaBuffer &) = delete;
+
+    char *data() const { return data_; }
+    size_t size() const { return size_; } // As requested (the slot may be larger)
+    bool empty() const { return data_ == nullptr; }
+
+    /**
+     * Return the buffer to the arena now; the handle becomes empty.
+     */
+    void reset();
+
+private:
+    friend class BufferArena;
+    struct Block;
+
+    ArenaBuffer(Block *block, char *data, size_t size) : block_(block), data_(data), size_(size) {}
+
+    Block *block_ = nullptr; // Null for oversized buffers (plain heap)
+    char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * Process-wide pool of I/O buffers in fixed size classes.
+ *
+ * Buffers are carved out of 2 MiB slabs (optionally huge pages) that are
+ * never given back, so steady-state transfers allocate nothing from the
+ * heap. Each thread keeps its own free list per size class; a buffer freed
+ * on another thread goes onto its owner's lock-free return stack and is
+ * picked up the next time the owner runs dry. A thread's lists are adopted
+ * by the next new thread after it exits.
+ */
+class BufferArena
+{
+public:
+    struct Stats
+    {
+        size_t slabs = 0;
+        size_t hugePageSlabs = 0; // Actually backed by huge pages (hugetlbfs, or THP per /proc/self/smaps)
+        size_t allocations = 0;
+        size_t localReuses = 0; // Served from the calling thread's own free list
+        size_t remoteFrees = 0; // Freed on a thread other than the owner
+        size_t oversized = 0;   // Larger than the biggest class; plain heap
+    };
+
+    /**
+     * The arena (created on first use, lives until exit).
+     */
+    static BufferArena &instance();
+
+    /**
+     * Back new slabs with huge pages where the OS allows it (Linux: hugetlbfs
+     * pages, falling back to transparent huge pages). Call before the first
+     * allocation for it to cover every slab.
+     */
+    void useHugePages(bool enabled) { hugePages_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * A buffer of at least bytes, from the smallest class that fits.
+     * Never throws: it is called from libcurl's C callbacks.
+     *
+     * @return An empty handle if a new slab (or an oversized buffer) can't be had
+     */
+    ArenaBuffer allocate(size_t bytes);
+
+    Stats stats() const;
+
+    static constexpr size_t SLAB_SIZE = 2 * 1024 * 1024;
+
+private:
+    friend class ArenaBuffer;
+    using Block = ArenaBuffer::Block;
+    struct ThreadCache;
+
+    BufferArena() = default;
+    ~BufferArena();
+
+    void free(Block *block);
+    ThreadCache &cache();
+    bool refill(ThreadCache &cache, size_t sizeClass);
+    bool carveSlab(size_t sizeClass); // mutex_ held
+    char *mapSlab();                   // Null if the mapping fails (mutex_ held)
+
+    static constexpr std::array<size_t, 4> CLASS_SIZES = {16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024};
+    static constexpr size_t REFILL_BATCH = 8;     // Blocks moved from the shared list at once
+    static constexpr size_t LOCAL_LIMIT = 64;     // Per class; beyond this, blocks go back to the shared list
+
+    std::atomic<bool> hugePages_{false};
+
+    mutable std::mutex mutex_;
+    std::array<std::vector<Block *>, CLASS_SIZES.size()> spare_;  // Not owned by any thread
+    std::vector<std::unique_ptr<Block[]>> blockTables_;           // Descriptor storage, one per slab
+    std::vector<std::unique_ptr<ThreadCache>> caches_;
+    std::vector<ThreadCache *> orphans_; // Caches whose thread has exited
+    std::vector<const char *> thpSlabs_; // Slabs madvise()d for transparent huge pages: may or may not get them
+
+    std::atomic<size_t> slabs_{0};
+    std::atomic<size_t> hugePageSlabs_{0}; // hugetlbfs (MAP_HUGETLB) slabs only
+    std::atomic<size_t> allocations_{0};
+    std::atomic<size_t> localReuses_{0};
+    std::atomic<size_t> remoteFrees_{0};
+    std::atomic<size_t> oversized_{0};
+};
@@ -6,7 +6,8 @@
 
 /**
  * File integrity verification using cryptographic hashes.
- * Supports SHA-256 (extensible to MD5, SHA-1 later).
+ * Supports SHA-256, SHA-1 and MD5 (the latter two only for checksums that
+ * servers publish, e.g. Content-MD5).
  */
 class ChecksumVerifier
 {
@@ -17,8 +18,8 @@ public:
     enum class Algorithm
     {
         SHA256,
-        MD5, // For future implementation
-        SHA1 // For future implementation
+        MD5,
+        SHA1
     };
 
     /**
@@ -31,6 +32,19 @@ public:
      */
     static std::string computeSHA256(const std::filesystem::path &filePath);
 
+    /**
+     * Compute a file's hash with any supported algorithm.
+     *
+     * @return Hex-encoded hash string
+     * @throws std::runtime_error if file cannot be read
+     */
+    static std::string computeDigest(const std::filesystem::path &filePath, Algorithm algorithm);
+
+    /**
+     * Lower-case name as used in checksum strings ("sha256", "md5", "sha1").
+     */
+    static const char *algorithmName(Algorithm algorithm);
+
     /**
      * Verify a file matches an expected checksum.
      *
@@ -53,6 +67,16 @@ public:
      */
     static std::pair<Algorithm, std::string> parseChecksum(const std::string &checksumStr);
 
+    /**
+     * Move a file that failed verification into a "quarantine" directory
+     * next to it, so it can't be mistaken for a good download.
+     *
+     * @param filePath File to move
+     * @return New location of the file
+     * @throws std::filesystem::filesystem_error if the move fails
+     */
+    static std::filesystem::path quarantine(const std::filesystem::path &filePath);
+
 private:
     /**
      * Convert binary data to hex string.
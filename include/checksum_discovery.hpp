@@ -0,0 +1,97 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "download_job.hpp"
+#include "network_cache.hpp"
+
+/**
+ * Decode base64 (with padding) to lower-case hex.
+ *
+ * @return "" if text isn't base64 of exactly bytes bytes
+ */
+std::string base64ToHex(const std::string &text, size_t bytes);
+
+/**
+ * Parse a digest a server sent with a response, as "algorithm:hexhash".
+ *
+ * Understands Repr-Digest and Content-Digest (RFC 9530, "sha-256=:BASE64:"),
+ * the older Digest header (RFC 3230, "SHA-256=BASE64") and Content-MD5.
+ * SHA-256 is preferred when several algorithms are offered.
+ *
+ * @param name Header name (any case)
+ * @return std::nullopt for other headers or unsupported algorithms
+ */
+std::optional<std::string> parseDigestHeader(const std::string &name, const std::string &value);
+
+/**
+ * The best digest the last response on a transfer announced (see
+ * parseDigestHeader), read with curl_easy_header once the headers are in.
+ *
+ * @param partial The response is a range: only digests of the whole
+ *                representation (Repr-Digest, Digest) apply
+ */
+std::optional<std::string> announcedDigest(CURL *easy, bool partial);
+
+/**
+ * Parse a sums file in sha256sum format ("HASH  name" or "HASH *name") or
+ * BSD format ("SHA256 (name) = HASH").
+ *
+ * @return File name (as listed, without a leading "./") -> lower-case hex hash
+ */
+std::map<std::string, std::string> parseSumsFile(const std::string &text);
+
+/**
+ * Finds published SHA-256 checksums for batch jobs that have none.
+ *
+ * Each directory's "SHA256SUMS" is fetched once and kept for every job in
+ * that directory. When a directory has none, "<file>.sha256" is tried per
+ * file, until PER_FILE_PROBES files in a row turn out to have none.
+ * Directories are fetched on one handle, so they share its connections.
+ * A checksum found this way is verified against the streaming hash like
+ * one from the manifest.
+ */
+class ChecksumDiscovery
+{
+public:
+    struct Stats
+    {
+        size_t directories = 0;  // Directories asked for a SHA256SUMS
+        size_t sumsFiles = 0;    // Of those, ones that had it
+        size_t perFileProbes = 0;
+        size_t found = 0;        // Jobs that got a checksum
+    };
+
+    /**
+     * @param timeoutSeconds Per sums file
+     * @param caCertFile Extra CA bundle (may be empty)
+     * @param networkCache Persistent metadata cache (may be null)
+     */
+    ChecksumDiscovery(int timeoutSeconds, std::string caCertFile, std::shared_ptr<NetworkCache> networkCache);
+
+    /**
+     * Set expectedChecksum on every job without one whose file is listed.
+     *
+     * @return Number of jobs that got a checksum
+     */
+    size_t fill(std::vector<DownloadJob> &jobs);
+
+    const Stats &stats() const { return stats_; }
+
+    static constexpr size_t PER_FILE_PROBES = 3;
+
+private:
+    // Body of url, or nullopt if it couldn't be fetched
+    std::optional<std::string> fetch(CURL *curl, const std::string &url);
+
+    int timeoutSeconds_;
+    std::string caCertFile_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    Stats stats_;
+};
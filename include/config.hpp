@@ -2,6 +2,10 @@
 
 #include <string>
 #include <optional> // C++17 feature for optional values
+#include <vector>
+
+#include "durability.hpp"
+#include "page_cache.hpp"
 
 /**
  * Configuration for the download manager.
@@ -9,10 +13,44 @@
  */
 struct DownloadConfig
 {
-    // Required parameters
+    // Required parameters (unless a manifest is given with --input-file)
     std::string url;
     std::string destination;
 
+    // Batch mode: manifest with one "URL DESTINATION [checksum]" per line
+    std::string inputFile;
+    int prefetchDepth = 4; // Max look-ahead K for probing queued jobs (0 = off)
+
+    // Sharded engine: N event-loop threads, each running several transfers (0 = sequential)
+    int shards = 0;
+    int transfersPerShard = 8;
+    bool pinThreads = false; // Pin shard i to CPU i (Linux)
+    int postProcessThreads = 0; // Post-download pipeline workers (0 = one per hardware thread)
+    int maxOpenFiles = 0;       // Output descriptors kept open by the engine (0 = half the fd limit)
+    int memoryBudgetMb = 0;     // Receive + write + post-processing buffers together (0 = unlimited)
+    bool hugePages = false;     // Back the buffer arena with huge pages (Linux)
+    int diskLatencyMs = 0;      // Sync latency that cuts a volume's concurrent transfers (0 = off)
+    PageCachePolicy pageCache = PageCachePolicy::Normal; // Keep big downloads out of the page cache
+    DurabilityMode durability = DurabilityMode::None;    // Sync finished files before their final rename
+    int durabilityBatch = 256;  // Batched durability: files per group commit
+    int durabilityWindowMs = 200; // Batched durability: longest a finished file waits for its group
+    std::string scratchDir;     // Write .part files here and move them on completion (empty = next to the destination)
+
+    // Post-download pipeline: default stages, per-stage concurrency, backpressure
+    std::string pipelineSpec;             // e.g. "verify,decompress,extract,move:/data"
+    std::vector<std::string> stageLimits; // "stage=N" entries
+    int pipelineBacklog = 32;             // Hold downloads while this many files await processing
+
+    // Follow mode: keep appending what a growing remote file gains (single URL only)
+    bool follow = false;
+    int followMinIntervalMs = 1000;  // Poll interval while the file grows
+    int followMaxIntervalMs = 60000; // Poll interval it backs off to while it doesn't
+    int followForSeconds = 0;        // Stop following after this long (0 = until interrupted)
+
+    // Mirror mode: URL is a directory index, DESTINATION the local root (new or changed files only)
+    bool mirror = false;
+    int mirrorParallel = 8; // Listing pages fetched at once
+
     // Optional parameters with sensible defaults
     int maxRetries = 3;       // Default: 3 retries (from TASK-006)
     int timeoutSeconds = 300; // Default: 5 minutes (300 seconds)
@@ -20,6 +58,50 @@ struct DownloadConfig
     // Checksum verification (optional)
     std::optional<std::string> expectedChecksum; // Format: "sha256:abc123..."
 
+    // Persistent network metadata cache (DNS, redirects, TLS sessions, Alt-Svc, HSTS)
+    std::string cacheDir;           // Empty: NetworkCache::defaultDirectory()
+    bool disableNetworkCache = false;
+
+    // Receive path: opt-in kTLS / zero-copy, CA bundle, cost reporting
+    bool kernelTls = false;
+    bool zeroCopy = false; // splice() fast path for plain http:// URLs
+    std::string caCertFile; // Replaces the system trust store (empty = system store)
+    bool showStats = false; // Print bytes / CPU-per-GB / offload state per transfer
+
+    // Local interfaces / source addresses to spread transfers over (CURLOPT_INTERFACE)
+    std::vector<std::string> interfaces;
+
+    // Destination roots to spread batch files over (one per disk); manifest destinations are relative to them
+    std::vector<std::string> destinationRoots;
+    std::string placementIndex; // File -> root mapping (empty = ".placement-index" in the first root)
+
+    // Pack mode: store small downloads as objects in large segment files (empty = normal files)
+    std::string packDir;
+    int packSegmentMb = 1024;
+
+    // Bulk small-file mode: cached directory descriptors, no per-file resume probe or statvfs
+    bool bulk = false;
+
+    // Store downloads as seekable zstd ("<destination>.zst"), compressed on the way to disk
+    bool storeZstd = false;
+    int zstdLevel = 3;
+    int zstdThreads = 0;     // zstd compression threads shared by all transfers (0 = one per hardware thread)
+    int zstdFrameKb = 2048;  // Uncompressed bytes per independently readable frame
+
+    // Fetch each URL once: duplicate batch jobs share one transfer, and processes
+    // writing the same destination wait for each other instead of racing on its .part
+    bool singleFlight = false;
+
+    // Find checksums for batch jobs without one: SHA256SUMS / <file>.sha256 next to
+    // the files, and Repr-Digest / Content-Digest / Digest / Content-MD5 response headers
+    bool discoverChecksums = false;
+
+    // NDJSON event stream for orchestrators: "fd:N", "unix:PATH" or a file (empty = none).
+    // Replaces the text progress bar
+    std::string eventStream;
+    // How often transfer progress is sampled for the progress bar and the event stream
+    int progressIntervalMs = 250;
+
     // Flags
     bool showVersion = false; // Display version and exit
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+#include <curl/curl.h>
+
+/**
+ * RAII wrapper for a libcurl share handle.
+ *
+ * Easy handles attached to the same share reuse each other's DNS entries,
+ * TLS sessions and open connections, even across threads. That lets a
+ * connection warmed up by one handle be picked up by another.
+ */
+class CurlShare
+{
+public:
+    CurlShare();
+    ~CurlShare() = default;
+
+    // The lock callbacks capture 'this', so the object must stay put
+    CurlShare(const CurlShare &) = delete;
+    CurlShare &operator=(const CurlShare &) = delete;
+
+    /**
+     * Attach an easy handle to this share (CURLOPT_SHARE).
+     */
+    void attach(CURL *curl) const;
+
+    CURLSH *get() const { return share_.get(); }
+
+private:
+    static void lockCallback(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+    static void unlockCallback(CURL *handle, curl_lock_data data, void *userptr);
+
+    // One mutex per shared data type, so DNS lookups don't block connection reuse
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> mutexes_;
+    std::unique_ptr<CURLSH, decltype(&curl_share_cleanup)> share_;
+};
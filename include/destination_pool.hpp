@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DiskAdmission;
+
+/**
+ * Spreads a batch's files over several destination roots (one per disk).
+ *
+ * Job destinations are taken as paths relative to a root; one that would
+ * leave the root ("../x") is refused. Each new file goes to the root with
+ * the most credit under smooth weighted round-robin. A root's weight is
+ * its measured write throughput times its share of free space. Both are
+ * sampled at most every REFRESH_INTERVAL (statvfs, so files preallocated
+ * by then are counted against their root). Roots below MIN_FREE_BYTES get
+ * no new files. Every placement is appended to an index file, so a later
+ * run (a resume, a re-download) finds each file on the root it was given,
+ * with one hash lookup. The index is flushed on the same interval; entries
+ * lost to a crash are found again on disk. Thread-safe.
+ */
+class DestinationPool
+{
+public:
+    struct RootStats
+    {
+        std::string root;
+        size_t files = 0;                   // Files routed here this run
+        unsigned long long availableBytes = 0;
+        double bytesPerSecond = 0.0;        // Last write throughput seen (0 = not measured)
+    };
+
+    /**
+     * @param roots Root directories (created if missing)
+     * @param indexPath Placement index (empty = ".placement-index" in the first root)
+     * @throws std::invalid_argument if roots is empty
+     * @throws std::runtime_error if the index cannot be opened for appending
+     */
+    explicit DestinationPool(std::vector<std::filesystem::path> roots, std::filesystem::path indexPath = {});
+
+    /**
+     * Full path for a job destination.
+     *
+     * @param destination Path relative to a root (a leading '/' is ignored)
+     * @param disks Throughput source (null = place by free space only)
+     * @return nullopt if the destination would end up outside the root
+     */
+    std::optional<std::filesystem::path> place(const std::string &destination, DiskAdmission *disks = nullptr);
+
+    std::vector<RootStats> snapshot() const;
+
+    static constexpr unsigned long long MIN_FREE_BYTES = 256ULL * 1024 * 1024;
+    static constexpr std::chrono::milliseconds REFRESH_INTERVAL{1000};
+
+private:
+    struct Root
+    {
+        RootStats stats;
+        double credit = 0.0; // Smooth weighted round-robin state
+        std::optional<size_t> volume; // DiskAdmission volume, looked up once
+    };
+
+    // Root a file from an older run (or a lost index) is on; -1 if none. Reads only
+    // the root list, which never changes, so it runs without mutex_
+    long findOnDisk(const std::string &relative) const;
+    size_t chooseRoot(DiskAdmission *disks);
+    // Free space, throughput and the index file, every REFRESH_INTERVAL (mutex_ held)
+    void refresh(DiskAdmission *disks);
+
+    mutable std::mutex mutex_;
+    std::vector<Root> roots_;
+    std::unordered_map<std::string, size_t> index_; // Relative path -> root
+    std::ofstream indexOut_;
+    std::optional<std::chrono::steady_clock::time_point> refreshedAt_;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+ * Limits concurrent transfers per destination filesystem to what its disk
+ * can absorb.
+ *
+ * Writers report the bytes they wrote, in batches folded off the write
+ * path, and how long each sync point took: an fdatasync of a finished
+ * file, or a wait for writeback under drop-behind. When the disk falls
+ * behind, those waits grow long before anything fails. A volume whose
+ * average sync latency over a window goes above the target loses a quarter
+ * of its transfer slots. A volume that stays below the target (or has no
+ * syncs to measure) with every slot busy gains one slot back. Network
+ * intake then follows what the disk sustains instead of piling up dirty
+ * pages. Thread-safe.
+ */
+class DiskAdmission
+{
+public:
+    struct VolumeStats
+    {
+        std::string example; // First destination directory seen on the volume
+        size_t limit = 0;
+        size_t peakActive = 0;
+        size_t throttles = 0;          // Times the limit was cut
+        double bytesPerSecond = 0.0;   // EWMA of bytes written per wall-clock second
+        double latencyMs = 0.0;        // EWMA of the average sync latency (0 = no syncs yet)
+        unsigned long long bytes = 0;
+    };
+
+    /**
+     * @param maxActive Slots per volume before any throttling (at least 1)
+     * @param latencyTarget Average sync latency that triggers a cut (0 = never throttle)
+     */
+    DiskAdmission(size_t maxActive, std::chrono::milliseconds latencyTarget);
+
+    /**
+     * Volume id for a destination directory (the device of its nearest existing ancestor).
+     */
+    size_t volumeFor(const std::filesystem::path &directory);
+
+    /**
+     * Take a transfer slot on the volume.
+     *
+     * @return false if the volume is at its current limit
+     */
+    bool tryAdmit(size_t volume);
+
+    void release(size_t volume);
+
+    /**
+     * Report bytes written to the volume since the last report. Callers
+     * batch these (a shard folds its writes every few milliseconds).
+     */
+    void recordWrite(size_t volume, unsigned long long bytes);
+
+    /**
+     * Report one sync point on the volume that took seconds.
+     */
+    void recordSync(size_t volume, double seconds);
+
+    std::vector<VolumeStats> snapshot() const;
+
+private:
+    struct Volume
+    {
+        dev_t device = 0;
+        VolumeStats stats;
+        size_t active = 0;
+        bool measured = false;        // Has a rate
+        bool latencyMeasured = false; // Has a sync latency
+
+        // Current measurement window
+        std::chrono::steady_clock::time_point windowStart;
+        unsigned long long windowBytes = 0;
+        size_t windowSyncs = 0;
+        double windowSyncSeconds = 0.0;
+    };
+
+    // Close the window if it is over: fold it into the estimates and adjust the limit (mutex_ held)
+    void closeWindowIfDue(Volume &volume);
+
+    const size_t maxActive_;
+    const double latencyTargetMs_;
+
+    mutable std::mutex mutex_;
+    std::vector<Volume> volumes_;
+    std::unordered_map<std::string, size_t> directories_; // Directories already resolved to a volume
+
+    static constexpr std::chrono::milliseconds WINDOW{500};
+    static constexpr double EWMA_WEIGHT = 0.3;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * One entry of a batch download: where to fetch from and where to save.
+ */
+struct DownloadJob
+{
+    std::string url;
+    std::string destination;
+    std::optional<std::string> expectedChecksum; // Format: "sha256:abc123..."
+    std::string pipeline; // Post-download stages (see parsePipeline); empty = batch default
+};
+
+/**
+ * Load a batch manifest.
+ *
+ * One job per line: "URL DESTINATION [algorithm:hexhash] [pipeline=STAGES]",
+ * separated by whitespace. Blank lines and lines starting with '#' are ignored.
+ *
+ * @param manifestPath Path to the manifest file
+ * @return Jobs in file order
+ * @throws std::runtime_error if the file cannot be read or a line is malformed
+ */
+std::vector<DownloadJob> loadManifest(const std::filesystem::path &manifestPath);
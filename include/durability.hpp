@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class DiskAdmission;
+
+/**
+ * How hard to try to keep a completed file intact across a power loss.
+ */
+enum class DurabilityMode
+{
+    None,    // Plain rename; the data may still only be in the page cache
+    PerFile, // fdatasync the file, rename it, fsync its directory
+    Batched  // Group commit: writeback started for many files at once, one fsync per directory
+};
+
+const char *durabilityModeName(DurabilityMode mode);
+
+/**
+ * Moves finished downloads to their final names so that a name never
+ * points at data that isn't on disk yet.
+ *
+ * The order is always data sync, rename, directory sync. A crash therefore
+ * leaves either the complete file or the .part file, never a final name
+ * over zero-filled blocks. In batched mode, files queue up to
+ * batchFiles or batchWindow. Writeback is then started for all of them
+ * (Linux) before each is fdatasynced, every file is renamed, and each
+ * distinct directory is fsynced once. Files staged on another filesystem (see stagingPath())
+ * are first copied next to their destination by the calling thread.
+ * Thread-safe.
+ */
+class Durability
+{
+public:
+    using DoneFn = std::function<void(bool ok, const std::string &error)>;
+
+    struct Stats
+    {
+        size_t files = 0;
+        size_t batches = 0;
+        size_t dataSyncs = 0;      // Files synced (fdatasync(), F_FULLFSYNC on macOS)
+        size_t directorySyncs = 0;
+        size_t copiedAcross = 0;   // Staged on another filesystem
+    };
+
+    /**
+     * @param mode Durability mode
+     * @param batchFiles Batched: commit as soon as this many files wait
+     * @param batchWindow Batched: commit a non-empty batch after this long
+     */
+    explicit Durability(DurabilityMode mode, size_t batchFiles = 256,
+                        std::chrono::milliseconds batchWindow = std::chrono::milliseconds(200));
+
+    // Commits whatever is still queued
+    ~Durability();
+
+    Durability(const Durability &) = delete;
+    Durability &operator=(const Durability &) = delete;
+
+    DurabilityMode mode() const { return mode_; }
+
+    /**
+     * Report how long each file sync took to disks (its volume's sync
+     * latency). Call before publishing anything.
+     */
+    void setDiskAdmission(std::shared_ptr<DiskAdmission> disks) { disks_ = std::move(disks); }
+
+    /**
+     * Make staged durable and rename it to to, now. Batched mode commits a
+     * batch of one (for callers that can't wait for a group).
+     *
+     * @param error Set when false is returned
+     */
+    bool publish(const std::filesystem::path &staged, const std::filesystem::path &to, std::string &error);
+
+    /**
+     * Like publish(), but batched mode queues the file and calls done from
+     * the commit thread once its group is durable. Other modes call done
+     * before returning.
+     */
+    void publishAsync(const std::filesystem::path &staged, const std::filesystem::path &to, DoneFn done);
+
+    /**
+     * Copy a file staged on another filesystem next to to (bringAlongside())
+     * and update from. publish() and publishAsync() do this themselves; a
+     * caller that limits how many copies run at once can do it up front.
+     */
+    bool stage(std::filesystem::path &from, const std::filesystem::path &to, std::string &error);
+
+    Stats stats() const;
+
+private:
+    struct Pending
+    {
+        std::filesystem::path from;
+        std::filesystem::path to;
+        DoneFn done;
+        std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    void commitLoop();
+    void commitBatch(std::deque<Pending> &batch);
+    bool syncFile(const std::filesystem::path &path, std::string &error);
+    void syncDirectory(const std::filesystem::path &directory);
+
+    const DurabilityMode mode_;
+    const size_t batchFiles_;
+    const std::chrono::milliseconds batchWindow_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Pending> queue_;
+    bool stopping_ = false;
+    Stats stats_;
+    std::shared_ptr<DiskAdmission> disks_;
+    std::thread committer_; // Batched mode only
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "progress_aggregator.hpp"
+
+/**
+ * Machine-readable progress: one JSON object per line (NDJSON) on a file
+ * descriptor, a unix socket or a file.
+ *
+ *   {"event":"start","ms":12,"job":3,"url":"...","destination":"..."}
+ *   {"event":"progress","ms":500,"job":3,"bytes":1048576,"total":4194304,"bytes_per_sec":2097152,"eta_ms":1500}
+ *   {"event":"retry","ms":730,"job":3,"attempt":1,"delay_ms":1000,"error":"..."}
+ *   {"event":"verify","ms":2210,"job":3,"ok":true,"checksum":"sha256:...","streamed":true}
+ *   {"event":"complete","ms":2211,"job":3,"ok":true,"bytes":4194304,"retries":1,"location":"...","error":""}
+ *   {"event":"done","ms":2300,"succeeded":9,"failed":1}
+ *
+ * "ms" counts from when the stream was opened. "total" and "eta_ms" are -1
+ * while unknown; "bytes_per_sec" is smoothed. "job" is the job's index in
+ * the batch. Progress lines come from a ProgressAggregator sample (see
+ * sample()), one per transfer that moved. Lifecycle events are formatted
+ * by their caller. Both go into one of two buffers that are allocated up
+ * front. Every interval the writer thread swaps them and writes the full
+ * one with a single write(). Callers never write or wait for the writer:
+ * a buffer half full wakes it early, and a line that doesn't fit is
+ * dropped (and counted). A consumer that goes away breaks the stream
+ * without raising SIGPIPE. Thread-safe.
+ */
+class EventStream
+{
+public:
+    struct Stats
+    {
+        size_t events = 0;     // Lines written (all kinds)
+        size_t bytes = 0;
+        size_t dropped = 0;    // Lines lost to a write error, a full buffer, or longer than a buffer
+    };
+
+    /**
+     * @param target "fd:N" (an inherited descriptor, left open), "unix:PATH"
+     *               (a listening stream socket) or a file path (appended to)
+     * @param interval How often buffered lines are written
+     * @throws std::runtime_error if the target can't be opened
+     */
+    EventStream(const std::string &target, std::chrono::milliseconds interval);
+
+    // Writes everything still buffered
+    ~EventStream();
+
+    EventStream(const EventStream &) = delete;
+    EventStream &operator=(const EventStream &) = delete;
+
+    /**
+     * Start a batch whose slot i (the i-th job handed to the engine or
+     * client) is reported as job jobIds[i]. Call while no transfer is running.
+     *
+     * @param jobIds Empty: every slot is reported as its own number
+     */
+    void beginBatch(std::vector<size_t> jobIds = {});
+
+    void start(size_t slot, std::string_view url, std::string_view destination);
+
+    /**
+     * Frontend for a ProgressAggregator: a progress line per listed
+     * transfer, formatted straight into the buffer (no allocation).
+     */
+    void sample(const ProgressSample &sample);
+
+    void retry(size_t slot, int attempt, long delayMs, std::string_view error);
+
+    /**
+     * @param checksum "algorithm:hex" that was checked
+     * @param streamed Compared against the digest computed while receiving
+     *                 (the file wasn't read again)
+     */
+    void verify(size_t slot, bool ok, std::string_view checksum, bool streamed);
+
+    /**
+     * Final outcome of a job, after post-processing.
+     */
+    void complete(size_t slot, bool ok, long long bytes, int retries, std::string_view location,
+                  std::string_view error);
+
+    /**
+     * End of the batch: everything buffered, then a "done" line, written
+     * out at once. The "done" line bypasses the buffer, so it is never
+     * dropped for lack of room.
+     */
+    void finish(size_t succeeded, size_t failed);
+
+    Stats stats() const;
+
+    static constexpr size_t BUFFER_BYTES = 256 * 1024;
+
+private:
+    struct Buffer
+    {
+        std::unique_ptr<char[]> data;
+        size_t used = 0;
+    };
+
+    using Line = fmt::memory_buffer; // Inline storage: no allocation for ordinary lines
+
+    // Opening of every line: {"event":"<name>","ms":N,"job":N
+    void openLine(Line &line, const char *name, size_t slot) const;
+    // Append to the filling buffer, or drop the line if it is full
+    void emit(const Line &line);
+    // Half full: have the writer go now rather than at its interval (mutex_ held)
+    void wakeWriterIfFilling();
+    // Swap buffers and write out the full one
+    void flush();
+    // flush() with writeMutex_ already held
+    void drain();
+    // Write to the target, counting the lines (writeMutex_ held)
+    void writeAll(const char *data, size_t length);
+    long long elapsedMs() const;
+    size_t jobId(size_t slot) const;
+    void writerLoop();
+
+    int fd_ = -1;
+    bool ownsFd_ = false;
+    bool isSocket_ = false;
+    const std::chrono::milliseconds interval_;
+    const std::chrono::steady_clock::time_point opened_;
+
+    std::vector<size_t> jobIds_;
+
+    mutable std::mutex mutex_; // Filling buffer, stats
+    std::mutex writeMutex_;    // Held across swap + write, so lines leave in order
+    Buffer filling_;
+    Buffer draining_;
+    Stats stats_;
+    bool broken_ = false;      // A write failed; later lines are dropped (writeMutex_)
+
+    std::condition_variable wake_;
+    bool flushWanted_ = false;
+    bool stopping_ = false;
+    std::thread writer_;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <sys/types.h>
+
+#include "directory_cache.hpp"
+#include "page_cache.hpp"
+
+/**
+ * Bounded set of open output files, closed least-recently-used first.
+ *
+ * Writers address files by path and offset (pwrite), so a descriptor can be
+ * closed while its transfer is idle and transparently reopened on the next
+ * write. This keeps thousands of concurrent or paused transfers under
+ * RLIMIT_NOFILE. Files are assumed to be written front to back, which
+ * lets the cache apply a PageCachePolicy to each of them. Not thread-safe:
+ * each shard owns its own cache.
+ */
+class FdCache
+{
+public:
+    struct Stats
+    {
+        size_t hits = 0;      // Write found its file already open
+        size_t opens = 0;     // open() calls (first use or reopen after eviction)
+        size_t evictions = 0; // Descriptors closed to make room
+
+        Stats &operator+=(const Stats &other)
+        {
+            hits += other.hits;
+            opens += other.opens;
+            evictions += other.evictions;
+            return *this;
+        }
+    };
+
+    /**
+     * @param capacity Max descriptors kept open at once (at least 1)
+     * @param policy Page-cache treatment of the written data
+     * @param directories Open files relative to these cached directories (null = by full path)
+     */
+    explicit FdCache(size_t capacity, PageCachePolicy policy = PageCachePolicy::Normal,
+                     std::shared_ptr<DirectoryCache> directories = nullptr);
+
+    // Closes every cached descriptor
+    ~FdCache();
+
+    FdCache(const FdCache &) = delete;
+    FdCache &operator=(const FdCache &) = delete;
+
+    /**
+     * Write all of data at offset, opening (creating) the file if needed.
+     * With PageCachePolicy::Direct, writes whose address, length and offset
+     * are DIRECT_ALIGNMENT-aligned bypass the page cache.
+     *
+     * @return false on error (errno is set)
+     */
+    bool writeAt(const std::string &path, const char *data, size_t length, off_t offset);
+
+    /**
+     * Create the file if missing and cut it to length.
+     *
+     * @return false on error (errno is set)
+     */
+    bool truncate(const std::string &path, off_t length);
+
+    /**
+     * Allocate disk blocks for [offset, offset + length) without changing
+     * the file size, so free space reflects the whole download up front and
+     * a resume still starts at the real end of the data. Linux only;
+     * elsewhere, and on filesystems without support, a no-op.
+     *
+     * @return false on error such as ENOSPC (errno is set)
+     */
+    bool reserve(const std::string &path, off_t offset, off_t length);
+
+    /**
+     * Close the file's descriptor if cached (call before renaming it).
+     * Under drop-behind or direct, waits for the file's writeback to finish.
+     */
+    void close(const std::string &path);
+
+    const Stats &stats() const { return stats_; }
+
+    /**
+     * Seconds spent waiting for writeback (drop-behind and direct) since the
+     * last call: how far behind the disk is.
+     */
+    double takeSyncSeconds() { return std::exchange(syncSeconds_, 0.0); }
+
+    /**
+     * Raise the soft RLIMIT_NOFILE as far as the hard limit allows.
+     *
+     * @return The soft limit now in effect (0 if unknown)
+     */
+    static size_t raiseOpenFileLimit();
+
+    static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+private:
+    struct Entry
+    {
+        int fd = -1;
+        std::list<std::string>::iterator position; // In lru_
+        WriteBehind behind;
+        bool directCapable = false; // Opened with O_DIRECT (the filesystem accepted it)
+        bool directOn = false;      // O_DIRECT currently set on fd
+    };
+
+    // Entry for path, opened at offset if new and marked most recently used; null on error
+    Entry *acquire(const std::string &path, off_t offset);
+    void closeEntry(Entry &entry);
+    int openFile(const std::string &path, int flags);
+
+    size_t capacity_;
+    PageCachePolicy policy_;
+    std::shared_ptr<DirectoryCache> directories_;
+    std::list<std::string> lru_; // Front = most recently used
+    std::unordered_map<std::string, Entry> entries_;
+    Stats stats_;
+    double syncSeconds_ = 0.0;
+};
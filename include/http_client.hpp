@@ -5,6 +5,48 @@
 #include <curl/curl.h>
 #include <chrono>
 #include <filesystem>
+#include <optional>
+
+#include "curl_share.hpp"
+#include "durability.hpp"
+#include "event_stream.hpp"
+#include "native_http.hpp"
+#include "network_cache.hpp"
+#include "page_cache.hpp"
+#include "progress_aggregator.hpp"
+
+/**
+ * What a HEAD probe learned about a remote file before downloading it.
+ */
+struct RemoteMetadata
+{
+    std::string effectiveUrl;     // URL after following redirects
+    curl_off_t contentLength = -1; // -1 if the server didn't say
+    bool acceptsRanges = false;   // Server advertised "Accept-Ranges: bytes"
+};
+
+/**
+ * Cost of the last completed transfer, for comparing receive paths.
+ */
+struct TransferStats
+{
+    curl_off_t bytes = 0;         // Body bytes received in this run (excludes resumed prefix)
+    double cpuSeconds = 0.0;      // User + system CPU of the downloading thread
+    bool nativePath = false;      // Served by NativeHttpClient instead of libcurl
+    bool kernelTlsActive = false; // Kernel decrypted the body (kTLS RX)
+    bool zeroCopyActive = false;  // Body spliced socket -> file without userspace copies
+
+    double cpuSecondsPerGB() const
+    {
+        return bytes > 0 ? cpuSeconds * (1024.0 * 1024.0 * 1024.0) / static_cast<double>(bytes) : 0.0;
+    }
+};
+
+/**
+ * One-line summary of a transfer's cost, e.g.
+ * "1024.00 MB received, CPU 0.82 s (0.82 s/GB), receive path: native + kTLS".
+ */
+std::string formatTransferStats(const TransferStats &stats);
 
 /**
  * HTTP client for downloading files using libcurl.
@@ -14,8 +56,38 @@ class HttpClient
 {
 public:
     HttpClient();
+
+    /**
+     * Create a client that reuses network metadata from previous runs.
+     * Cached addresses, TLS sessions and Alt-Svc/HSTS hints are applied here.
+     *
+     * @param networkCache Shared persistent cache (nullptr disables caching)
+     */
+    explicit HttpClient(std::shared_ptr<NetworkCache> networkCache);
+
     ~HttpClient();
 
+    /**
+     * Error classification for retry logic.
+     * Transient errors are temporary (network issues) and worth retrying.
+     * Permanent errors are unrecoverable (404, invalid URL) and should fail immediately.
+     */
+    enum class ErrorType
+    {
+        Transient, // Temporary failure - retry might succeed
+        Permanent, // Permanent failure - retrying won't help
+        Unknown    // Uncertain - treat conservatively as transient
+    };
+
+    /**
+     * Classify a CURL error to determine if retry is appropriate.
+     *
+     * @param code CURL error code from failed operation
+     * @param httpCode HTTP status code (0 if no HTTP response received)
+     * @return ErrorType indicating whether to retry
+     */
+    static ErrorType classifyError(CURLcode code, long httpCode);
+
     // Delete copy operations (CURL handles aren't copyable)
     HttpClient(const HttpClient &) = delete;
     HttpClient &operator=(const HttpClient &) = delete;
@@ -29,9 +101,102 @@ public:
      *
      * @param url HTTP/HTTPS URL to download
      * @param destination Local file path to save
+     * @param prefetched Metadata from an earlier probe; skips the HEAD request
      * @return true on success, false on failure
      */
-    bool downloadFile(const std::string &url, const std::string &destination, int timeoutSeconds = 300);
+    bool downloadFile(const std::string &url, const std::string &destination, int timeoutSeconds = 300,
+                      const RemoteMetadata *prefetched = nullptr);
+
+    /**
+     * Send a HEAD request: resolves, connects and handshakes as a side effect,
+     * so the connection is warm for whoever reuses it (see setShare).
+     *
+     * @param url HTTP/HTTPS URL to probe
+     * @param metadata Filled with size, range support and effective URL
+     * @param timeoutSeconds Overall timeout for the probe
+     * @return true if the server answered with a non-error status
+     */
+    bool probe(const std::string &url, RemoteMetadata &metadata, int timeoutSeconds = 30);
+
+    /**
+     * Share DNS cache, TLS sessions and connections with other clients.
+     * The share must outlive this client.
+     */
+    void setShare(const CurlShare &share) { share.attach(curl_.get()); }
+
+    /**
+     * Opt in to kernel TLS receive offload for HTTPS downloads.
+     * Uses NativeHttpClient (OpenSSL socket BIO); falls back to libcurl
+     * whenever the native path can't complete the transfer.
+     */
+    void setKernelTls(bool enabled) { kernelTls_ = enabled; }
+
+    /**
+     * Opt in to the zero-copy fast path for plain http:// downloads
+     * (NativeHttpClient + splice()). Falls back to libcurl like setKernelTls.
+     */
+    void setZeroCopy(bool enabled) { zeroCopy_ = enabled; }
+
+    /**
+     * Trust an extra CA bundle (e.g. a local test server's self-signed cert).
+     * Peer verification stays enabled.
+     */
+    void setCaCertFile(const std::string &path);
+
+    /**
+     * Send requests through a specific local interface or source address
+     * (CURLOPT_INTERFACE syntax, e.g. "eth1" or "10.0.0.2"; empty = default).
+     * Disables the native receive paths, which don't bind their sockets.
+     */
+    void setInterface(const std::string &interfaceName);
+
+    /**
+     * Keep downloaded data out of the page cache (drop-behind; "direct" is
+     * treated as drop-behind on this path). Not applied to the native paths.
+     */
+    void setPageCachePolicy(PageCachePolicy policy) { pageCachePolicy_ = policy; }
+
+    /**
+     * Sync the file and its directory around the final rename (null = plain
+     * rename). Batched mode syncs each file on its own here; callers that
+     * want group commit use setLeavePartFile() and land files themselves.
+     */
+    void setDurability(std::shared_ptr<Durability> durability) { durability_ = std::move(durability); }
+
+    /**
+     * Stop after the size check and leave the finished .part file for the
+     * caller to rename (see getLastOutputPath()).
+     */
+    void setLeavePartFile(bool leave) { leavePartFile_ = leave; }
+
+    /**
+     * Write .part files into this directory (e.g. fast local NVMe or tmpfs)
+     * instead of next to the destination (empty = next to it). Publishing
+     * copies them over when the destination is on another filesystem.
+     */
+    void setScratchDir(const std::filesystem::path &directory) { scratchDir_ = directory; }
+
+    /**
+     * Report the next downloads' byte counts to progress and their retries
+     * to events, as slot slot (either may be null; both null = no progress).
+     */
+    void setProgress(std::shared_ptr<ProgressAggregator> progress, std::shared_ptr<EventStream> events, size_t slot)
+    {
+        progress_ = std::move(progress);
+        events_ = std::move(events);
+        progressSlot_ = slot;
+    }
+
+    /**
+     * Where the last successful download's data is: the destination, or its
+     * .part file when setLeavePartFile(true) is in effect.
+     */
+    const std::filesystem::path &getLastOutputPath() const { return lastOutputPath_; }
+
+    /**
+     * Bytes, CPU time and offload state of the last successful download.
+     */
+    const TransferStats &getLastTransferStats() const { return lastStats_; }
 
     /**
      * Get detailed error message from last operation.
@@ -40,6 +205,13 @@ public:
 
     int getRetryCount() const { return retryCount_; }
 
+    /**
+     * Whether the last failed download failed on a transient network error
+     * (as opposed to an HTTP status or a local problem): only those say
+     * something about the network path it took.
+     */
+    bool lastFailureWasNetwork() const { return lastFailureWasNetwork_; }
+
     /**
      * Set maximum retry attempts for transient errors.
      * @param maxRetries Number of retry attempts (default: 3)
@@ -53,19 +225,14 @@ private:
     // Last error message
     std::string lastError_;
 
-    int retryCount_ = 0;
+    // Persistent network metadata (DNS, redirects, TLS sessions); may be null
+    std::shared_ptr<NetworkCache> networkCache_;
 
-    /**
-     * Error classification for retry logic.
-     * Transient errors are temporary (network issues) and worth retrying.
-     * Permanent errors are unrecoverable (404, invalid URL) and should fail immediately.
-     */
-    enum class ErrorType
-    {
-        Transient, // Temporary failure - retry might succeed
-        Permanent, // Permanent failure - retrying won't help
-        Unknown    // Uncertain - treat conservatively as transient
-    };
+    // CURLOPT_RESOLVE list must outlive every transfer that uses it
+    std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)> resolveList_{nullptr, curl_slist_free_all};
+
+    int retryCount_ = 0;
+    bool lastFailureWasNetwork_ = false;
 
     /**
      * Static callback for libcurl to write downloaded data.
@@ -80,8 +247,9 @@ private:
     static size_t writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata);
 
     /**
-     * Static progress callback for libcurl.
-     * Called periodically during download to report progress.
+     * Static progress callback for libcurl, installed only while the size
+     * is unknown: checks disk space once the response tells it. Progress
+     * itself is counted in writeCallback.
      *
      * @param clientp User data pointer (we pass 'this')
      * @param dltotal Total bytes to download (0 if unknown)
@@ -96,22 +264,6 @@ private:
                                 curl_off_t ultotal,
                                 curl_off_t ulnow);
 
-    /**
-     * Format bytes into human-readable string (e.g., "52.3 MB")
-     *
-     * @param bytes Number of bytes
-     * @return Formatted string
-     */
-    std::string formatBytes(curl_off_t bytes) const;
-
-    /**
-     * Format duration into human-readable string (e.g., "2m 30s")
-     *
-     * @param seconds Duration in seconds
-     * @return Formatted string
-     */
-    std::string formatDuration(long seconds) const;
-
     /**
      * Get human-readable HTTP status text for a status code.
      *
@@ -141,33 +293,75 @@ private:
      * Generate the .part filename for a destination path.
      *
      * @param destination Final destination path
-     * @return Path with .part extension added
+     * @return "<destination>.part", or its name in the scratch directory
      */
     std::filesystem::path makePartPath(const std::filesystem::path &destination) const;
 
     /**
-     * Classify a CURL error to determine if retry is appropriate.
+     * Whether the opt-in native receive paths (kTLS / splice) cover this URL.
+     */
+    bool wantsNativePath(const std::string &url) const;
+
+    /**
+     * One pass of downloadFile once the .part is checked: fetch into it
+     * (native path or libcurl) and finalize it.
      *
-     * @param code CURL error code from failed operation
-     * @param httpCode HTTP status code (0 if no HTTP response received)
-     * @return ErrorType indicating whether to retry
+     * @param restart Set (with false returned) when the server ignored the
+     *        range and the .part was dropped: call again to start over
      */
-    ErrorType classifyError(CURLcode code, long httpCode) const;
+    bool transferToPart(const std::string &url, const std::filesystem::path &partPath,
+                        const std::filesystem::path &finalPath, int timeoutSeconds,
+                        const RemoteMetadata *prefetched, bool &restart);
 
-    std::chrono::steady_clock::time_point startTime_;
-    curl_off_t lastDownloaded_ = 0;
-    std::chrono::steady_clock::time_point lastProgressTime_;
-    std::chrono::steady_clock::time_point lastPrintedTime_;
+    /**
+     * Try the native receive path (kTLS or splice). nullopt means "not handled, use
+     * libcurl"; otherwise the download finished with the given result.
+     */
+    std::optional<bool> downloadNative(const std::string &url,
+                                       const std::filesystem::path &partPath,
+                                       const std::filesystem::path &finalPath,
+                                       int timeoutSeconds);
+
+    /**
+     * Check the .part size against the expected total and rename it into
+     * place (through durability_ when set).
+     *
+     * @param expectedTotal Full file size, or <= 0 if unknown (check skipped)
+     */
+    bool finalizeDownload(const std::filesystem::path &partPath,
+                          const std::filesystem::path &finalPath,
+                          curl_off_t expectedTotal);
+
+    /**
+     * Replace the handle's CURLOPT_RESOLVE list.
+     *
+     * @param entries "host:port:address" pins or "-host:port" removals
+     */
+    void setResolveEntries(const std::vector<std::string> &entries);
 
     // Track if we've checked disk space (to do it once in progress callback if HEAD failed)
     bool diskSpaceChecked_ = false;
-    bool isTerminalOutput_ = true;
-    double lastPrintedPercentage_ = -1.0;
-    std::filesystem::path currentDestination_;
+    std::filesystem::path currentDestination_; // The .part file being written
 
     // Resume support: offset to resume from (0 = start from beginning)
     curl_off_t resumeOffset_ = 0;
 
+    // Receive path options and per-transfer cost
+    bool kernelTls_ = false;
+    bool zeroCopy_ = false;
+    std::string caCertFile_;
+    std::string interface_;
+    PageCachePolicy pageCachePolicy_ = PageCachePolicy::Normal;
+    std::shared_ptr<Durability> durability_;
+    bool leavePartFile_ = false;
+    std::filesystem::path scratchDir_;
+    std::shared_ptr<ProgressAggregator> progress_;
+    std::shared_ptr<EventStream> events_;
+    size_t progressSlot_ = 0;
+    ProgressAggregator::Counter *progressCounter_ = nullptr; // The current download's, from begin()
+    std::filesystem::path lastOutputPath_;
+    TransferStats lastStats_;
+
     // Retry configuration
     int maxRetryAttempts_ = 3;                          // Configurable (default: 3)
     static constexpr int INITIAL_RETRY_DELAY_MS = 1000; // 1 second
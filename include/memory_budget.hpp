@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * One memory limit shared by every buffer a download passes through.
+ *
+ * Stages draw from the budget before allocating and give the bytes back
+ * when they free them. A stage that cannot wait (the curl write callback)
+ * uses tryAcquire() and pauses its transfer on failure; one that can (a
+ * post-processing worker) blocks in acquire(). Current and peak usage are
+ * tracked per stage even when the budget is unlimited. Thread-safe.
+ */
+class MemoryBudget
+{
+public:
+    enum class Stage
+    {
+        Receive,     // libcurl receive buffers of running transfers
+        WriteBuffer, // Write-coalescing buffers in front of the disk (and pack bodies)
+        PostProcess  // Pipeline stage buffers (decompress, extract)
+    };
+
+    struct StageUsage
+    {
+        const char *name = "";
+        size_t current = 0;
+        size_t peak = 0;
+    };
+
+    /**
+     * Holds bytes drawn with acquire() and gives them back when destroyed.
+     */
+    class Reservation
+    {
+    public:
+        Reservation(MemoryBudget *budget, Stage stage, size_t bytes);
+        ~Reservation();
+
+        Reservation(const Reservation &) = delete;
+        Reservation &operator=(const Reservation &) = delete;
+
+    private:
+        MemoryBudget *budget_;
+        Stage stage_;
+        size_t bytes_;
+    };
+
+    /**
+     * @param limit Bytes all stages may hold together (0 = unlimited)
+     */
+    explicit MemoryBudget(size_t limit);
+
+    /**
+     * Draw bytes if they fit, leaving at least headroom bytes unused.
+     *
+     * @return false if the budget is exhausted (nothing is drawn)
+     */
+    bool tryAcquire(Stage stage, size_t bytes, size_t headroom = 0);
+
+    /**
+     * Draw bytes, waiting for other stages to release memory if needed.
+     * Requests larger than the whole budget are charged as the whole budget.
+     *
+     * @return Bytes actually drawn (pass this to release())
+     */
+    size_t acquire(Stage stage, size_t bytes);
+
+    void release(Stage stage, size_t bytes);
+
+    /**
+     * Count a transfer paused because the budget was exhausted.
+     */
+    void countPause();
+
+    size_t limit() const { return limit_; }
+    size_t pauses() const;
+    std::vector<StageUsage> usage() const;
+
+    static const char *stageName(Stage stage);
+
+private:
+    static constexpr size_t STAGE_COUNT = 3;
+
+    // Book bytes against a stage (mutex_ held)
+    void charge(Stage stage, size_t bytes);
+
+    const size_t limit_;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t inUse_ = 0;
+    size_t pauses_ = 0;
+    std::array<size_t, STAGE_COUNT> current_{};
+    std::array<size_t, STAGE_COUNT> peak_{};
+};
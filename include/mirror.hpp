@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "download_job.hpp"
+#include "network_cache.hpp"
+
+/**
+ * One link of an HTTP directory index (Apache, nginx or lighttpd autoindex,
+ * python -m http.server, ...).
+ */
+struct IndexEntry
+{
+    std::string href;     // As linked (still percent-encoded), without a trailing '/'
+    std::string name;     // Decoded file or directory name
+    bool directory = false;
+    std::string modified; // Date and time as listed, e.g. "2024-01-31 17:05" ("" if not shown)
+    std::string size;     // Size as listed, e.g. "1234" or "1.2M" ("" if not shown or a directory)
+};
+
+/**
+ * Parse the entries of a directory index page. Links that leave the
+ * directory (parent, absolute or sorting links) are skipped.
+ */
+std::vector<IndexEntry> parseIndexPage(const std::string &html);
+
+/**
+ * Whether a listed size ("1234", "12K", "1.2M") can describe bytes.
+ * Abbreviated sizes match within their rounding.
+ */
+bool listedSizeMatches(const std::string &listed, std::uintmax_t bytes);
+
+/**
+ * Settings for mirroring a directory index.
+ */
+struct MirrorOptions
+{
+    size_t parallel = 8;      // Listing pages fetched at once
+    int maxRetries = 3;       // Per listing page
+    int timeoutSeconds = 60;  // Per listing page
+    size_t maxDepth = 64;     // Directory levels below the base (guards against link loops)
+    std::string caCertFile;
+    std::filesystem::path statePath; // Empty: ".mirror-state" in the local root
+};
+
+/**
+ * Mirrors an autoindex tree into a local directory, incrementally.
+ *
+ * plan() crawls the listing pages breadth-first on several threads. The
+ * threads share DNS, TLS sessions and connections. The plan is a download
+ * job for each listed file that is new or whose listed date or size
+ * changed since the last run. The state file records, per mirrored file,
+ * the date and size its listing showed when it was fetched. On a first
+ * run over an existing tree, a local file whose size fits the listing is
+ * adopted instead of fetched. commit() records the jobs that finished.
+ * Files that failed are marked pending: they are fetched again next time
+ * and their local copies are never adopted. Files gone from the listing
+ * are dropped from the state (their local copies are left alone).
+ * Listings that show neither dates nor sizes (python -m http.server) can
+ * only reveal new files.
+ */
+class Mirror
+{
+public:
+    struct Stats
+    {
+        size_t pages = 0;        // Listing pages fetched
+        size_t pageFailures = 0; // Pages that couldn't be fetched (their subtree is skipped)
+        size_t directories = 0;
+        size_t files = 0;        // Files listed
+        size_t unchanged = 0;    // Same date and size as last run
+        size_t adopted = 0;      // Already present locally, first seen now
+        size_t queued = 0;       // New or changed: in the plan
+        size_t removed = 0;      // In the state but no longer listed
+    };
+
+    /**
+     * @param baseUrl URL of the top listing page ('/' is appended if missing)
+     * @param root Local directory the tree is mirrored into
+     */
+    Mirror(std::string baseUrl, std::filesystem::path root, MirrorOptions options,
+           std::shared_ptr<NetworkCache> networkCache = nullptr);
+
+    /**
+     * Crawl the tree and return jobs for new or changed files.
+     */
+    std::vector<DownloadJob> plan();
+
+    /**
+     * Record the outcome of the planned jobs and save the state.
+     *
+     * @param failedJobs Indices into plan()'s jobs that didn't complete
+     * @return false if the state file couldn't be written
+     */
+    bool commit(const std::vector<size_t> &failedJobs);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    struct Fingerprint
+    {
+        std::string modified;
+        std::string size;
+        bool pending = false; // Planned but not fetched: the local copy can't be trusted
+        // Same listing (pending aside)
+        bool operator==(const Fingerprint &other) const
+        {
+            return modified == other.modified && size == other.size;
+        }
+    };
+
+    struct ListedFile
+    {
+        std::string path; // Relative to root, '/'-separated, decoded
+        std::string url;
+        Fingerprint listed;
+    };
+
+    struct Crawl; // Work queue shared by the crawl threads
+
+    void crawlWorker(Crawl &crawl);
+    void loadState();
+
+    std::string baseUrl_;
+    std::filesystem::path root_;
+    MirrorOptions options_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    std::map<std::string, Fingerprint> state_;  // As loaded
+    std::map<std::string, Fingerprint> next_;   // What the state will say after commit()
+    std::vector<ListedFile> planned_;           // Parallel to plan()'s jobs
+    Stats stats_;
+};
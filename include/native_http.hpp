@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <curl/curl.h>
+#include <openssl/ssl.h>
+
+/**
+ * Minimal HTTP/1.1 GET client on raw sockets.
+ *
+ * Used for fast paths libcurl can't offer:
+ * - kernel TLS (kTLS): OpenSSL only enables it on its own socket BIO, which
+ *   libcurl replaces with a custom one
+ * - zero-copy plain HTTP: after the headers, the body is moved from the
+ *   socket to the file with splice() through a pipe, never entering userspace
+ *
+ * Only the simple case is handled: a single GET answered with 200/206 and a
+ * Content-Length (or close-delimited) body. Anything else (redirects, errors,
+ * chunked encoding) makes fetch() return false before the body is touched,
+ * and the caller falls back to libcurl.
+ */
+class NativeHttpClient
+{
+public:
+    struct Options
+    {
+        bool kernelTls = false;  // Ask OpenSSL for kTLS (SSL_OP_ENABLE_KTLS)
+        bool zeroCopy = false;   // splice() plain-HTTP bodies (Linux)
+        std::string caCertFile;  // Empty: system default trust store
+        int timeoutSeconds = 300;
+    };
+
+    struct Response
+    {
+        long httpCode = 0;
+        curl_off_t contentLength = -1; // Body bytes in this response (-1 if close-delimited)
+        curl_off_t bytesWritten = 0;
+        bool kernelTlsActive = false;  // Kernel decrypted the body (kTLS RX)
+        bool zeroCopyActive = false;   // Body was spliced socket -> pipe -> file
+    };
+
+    // Called as the body arrives; return false to abort the transfer
+    using ProgressFn = std::function<bool(curl_off_t bodyTotal, curl_off_t bodyNow)>;
+
+    explicit NativeHttpClient(Options options);
+    ~NativeHttpClient();
+
+    NativeHttpClient(const NativeHttpClient &) = delete;
+    NativeHttpClient &operator=(const NativeHttpClient &) = delete;
+
+    /**
+     * Whether this client can handle the URL at all (scheme check only).
+     */
+    static bool supports(const std::string &url);
+
+    /**
+     * Whether the running kernel offers the "tls" upper layer protocol.
+     */
+    static bool kernelTlsAvailable();
+
+    /**
+     * GET a URL and append its body to an open file descriptor.
+     *
+     * @param url URL to fetch
+     * @param fd Output file positioned at resumeOffset (not O_APPEND:
+     *           splice() refuses append-mode targets)
+     * @param resumeOffset Bytes already on disk; reset to 0 (and the file
+     *                     truncated) if the server ignores the Range header
+     * @param response Filled with status and transfer details
+     * @param progress Progress hook, may be empty
+     * @return true if the body was fully received; false means "use libcurl"
+     */
+    bool fetch(const std::string &url, int fd, curl_off_t &resumeOffset,
+               Response &response, const ProgressFn &progress);
+
+    const std::string &getLastError() const { return lastError_; }
+
+private:
+    /**
+     * Move body bytes socket -> pipe -> file with splice(), no userspace copy.
+     *
+     * @param length Bytes to move, or -1 to read until the peer closes
+     * @return false on error (lastError_ set)
+     */
+    bool spliceBody(int socketFd, int fd, curl_off_t length, Response &response,
+                    const ProgressFn &progress, std::chrono::steady_clock::time_point deadline);
+
+    Options options_;
+    std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> sslContext_;
+    std::string lastError_;
+
+    // Large reads amortize syscalls and kTLS record handling
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+    static constexpr int PIPE_SIZE = 1024 * 1024; // Requested F_SETPIPE_SZ for splice
+    static constexpr size_t MAX_HEADER_BYTES = 64 * 1024;
+};
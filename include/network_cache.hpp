@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <curl/curl.h>
+
+/**
+ * Persistent cache of network metadata learned by previous runs.
+ *
+ * Resolved addresses, redirect targets and TLS session tickets are kept in a
+ * small tab-separated file with a per-entry expiry time. Alt-Svc and HSTS
+ * hints are delegated to libcurl's own cache files in the same directory.
+ * One instance may be shared by several HttpClient objects (thread-safe).
+ */
+class NetworkCache
+{
+public:
+    /**
+     * Load the cache from a directory (created on first save).
+     *
+     * @param cacheDir Directory holding the cache files
+     */
+    explicit NetworkCache(std::filesystem::path cacheDir);
+
+    // Saves pending changes (errors are reported, never thrown)
+    ~NetworkCache();
+
+    NetworkCache(const NetworkCache &) = delete;
+    NetworkCache &operator=(const NetworkCache &) = delete;
+
+    /**
+     * Default cache location: $XDG_CACHE_HOME/download_manager,
+     * falling back to ~/.cache/download_manager.
+     */
+    static std::filesystem::path defaultDirectory();
+
+    /**
+     * Configure a CURL handle with everything the cache knows:
+     * Alt-Svc/HSTS files and stored TLS sessions.
+     *
+     * @param curl Handle to configure
+     */
+    void applyTo(CURL *curl);
+
+    /**
+     * Entries for CURLOPT_RESOLVE ("host:port:address") that are still valid.
+     */
+    std::vector<std::string> resolveEntries() const;
+
+    /**
+     * Cached redirect target for a URL, if one is known and not expired.
+     */
+    std::optional<std::string> lookupRedirect(const std::string &url) const;
+
+    /**
+     * Record what a finished transfer learned: the address it connected to,
+     * where the URL redirected, and the TLS sessions held by the handle.
+     *
+     * @param curl Handle that just completed a transfer
+     * @param requestedUrl URL originally asked for (before cached redirects)
+     */
+    void captureFrom(CURL *curl, const std::string &requestedUrl);
+
+    /**
+     * Drop the cached address for the host of a URL (e.g. after connect failure).
+     *
+     * @return The "host:port" key that was dropped, so callers can also evict
+     *         it from a handle's DNS cache ("-host:port" in CURLOPT_RESOLVE)
+     */
+    std::optional<std::string> forgetAddress(const std::string &url);
+
+    /**
+     * Drop the cached redirect for a URL (e.g. the cached target stopped working).
+     */
+    void forgetRedirect(const std::string &url);
+
+    /**
+     * Write the cache file atomically (temp file + rename).
+     */
+    void save();
+
+private:
+    struct Entry
+    {
+        std::string value;
+        std::int64_t expiresAt = 0; // Unix time in seconds
+    };
+
+    using EntryMap = std::unordered_map<std::string, Entry>;
+
+    void load();
+    static std::int64_t nowSeconds();
+    static std::optional<std::string> hostKey(const std::string &url);
+    void exportTlsSessions(CURL *curl);
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    static CURLcode exportSessionCallback(CURL *handle, void *userptr,
+                                          const char *sessionKey,
+                                          const unsigned char *shmac, size_t shmacLen,
+                                          const unsigned char *sdata, size_t sdataLen,
+                                          curl_off_t validUntil, int ietfTlsId,
+                                          const char *alpn, size_t earlydataMax);
+#endif
+
+    std::filesystem::path cacheDir_;
+    std::filesystem::path cacheFile_;
+
+    mutable std::mutex mutex_;
+    EntryMap addresses_; // "host:port" -> IP address
+    EntryMap redirects_; // requested URL -> effective URL
+    EntryMap sessions_;  // TLS session key -> "hex(shmac):hex(sdata)"
+    bool dirty_ = false;
+
+    // Entry lifetimes: addresses follow typical DNS TTLs, CDN redirects are
+    // fairly stable, session tickets carry their own expiry from the server.
+    static constexpr std::int64_t ADDRESS_TTL_SECONDS = 5 * 60;
+    static constexpr std::int64_t REDIRECT_TTL_SECONDS = 60 * 60;
+    static constexpr std::int64_t SESSION_TTL_SECONDS = 24 * 60 * 60;
+};
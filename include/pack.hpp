@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * One object stored in a pack.
+ */
+struct PackEntry
+{
+    std::string name;      // Job destination, as given in the manifest
+    std::uint32_t segment = 0;
+    std::uint64_t offset = 0;
+    std::uint64_t length = 0;
+    std::string sha256;    // Hex digest of the object
+};
+
+/**
+ * Segment file name for a segment number ("segment-000001.pack").
+ */
+std::string packSegmentName(std::uint32_t segment);
+
+/**
+ * Appends many small objects to a few large segment files, so storing a
+ * million downloads costs a handful of inodes instead of a million creates
+ * and renames.
+ *
+ * A pack is a directory with segment files and an "index" text file. The
+ * index has one line per object: "segment TAB offset TAB length TAB sha256
+ * TAB name". Appends write the data at once but only queue their index
+ * line. commit() fdatasyncs the segments written since the last commit and
+ * then appends and syncs the queued lines, so the index never refers to
+ * data that isn't on disk. A commit happens every commitEvery objects, on
+ * request and on destruction. An append is reported done by the commit that
+ * indexes it. A failed commit keeps its objects queued for the next one and
+ * fails all of them. A crash loses at most the uncommitted objects (their
+ * bytes stay in the segment as unreferenced padding). Thread-safe.
+ */
+class PackWriter
+{
+public:
+    struct Stats
+    {
+        size_t objects = 0;       // Appended this run
+        unsigned long long bytes = 0;
+        size_t segments = 0;      // Segment files written this run
+        size_t commits = 0;
+    };
+
+    // Whether the object is indexed on disk; called on the committing thread
+    using DoneFn = std::function<void(bool ok, const std::string &error)>;
+
+    /**
+     * Open (or create) a pack, loading its index so finished objects can be skipped.
+     *
+     * @param segmentBytes Start a new segment once the current one reaches this size
+     * @param commitEvery Commit the index after this many appends
+     * @throws std::runtime_error if the directory or index cannot be opened
+     */
+    explicit PackWriter(std::filesystem::path directory, std::uint64_t segmentBytes = 1ULL << 30,
+                        size_t commitEvery = 4096);
+
+    ~PackWriter();
+
+    PackWriter(const PackWriter &) = delete;
+    PackWriter &operator=(const PackWriter &) = delete;
+
+    const std::filesystem::path &directory() const { return directory_; }
+
+    /**
+     * Whether the index (committed or queued) already has this name.
+     */
+    bool contains(const std::string &name) const;
+
+    /**
+     * Store an object. A name stored again replaces the earlier entry.
+     *
+     * @param done Called once by the commit that indexes the object (or fails to)
+     * @param error Set when false is returned
+     * @return false if the name can't be indexed or the write failed; done is not called then
+     */
+    bool append(const std::string &name, const char *data, size_t length, const std::string &sha256, DoneFn done,
+                std::string &error);
+
+    /**
+     * Make every append so far durable and indexed. On failure the objects
+     * stay queued for the next commit to retry.
+     */
+    bool commit(std::string &error);
+
+    /**
+     * Appends whose done callback hasn't been called yet.
+     */
+    size_t unreported() const;
+
+    Stats stats() const;
+
+    // Objects are held in memory until appended; larger ones belong in normal files
+    static constexpr size_t MAX_OBJECT_BYTES = 16 * 1024 * 1024;
+
+private:
+    // Segment to write length bytes into, rolling over when full (mutex_ held); -1 on error
+    int reserve(size_t length, std::uint32_t &segment, std::uint64_t &offset, std::string &error);
+
+    // Sync the segments, then append and sync the index lines (commitMutex_ held)
+    bool writeIndex(const std::vector<PackEntry> &entries, const std::vector<int> &dirtyFds, std::string &error);
+
+    struct Queued
+    {
+        PackEntry entry;
+        DoneFn done; // Empty once called (a failed commit queues the entry again)
+    };
+
+    const std::filesystem::path directory_;
+    const std::uint64_t segmentBytes_;
+    const size_t commitEvery_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, PackEntry> index_;
+    std::vector<Queued> queued_;        // Appended, not yet in the index file
+    size_t unreported_ = 0;             // Queued entries with a done callback
+    std::vector<int> segmentFds_;       // By segment number; -1 = not open
+    std::vector<bool> dirty_;           // Has queued entries written since the last commit
+    std::uint32_t current_ = 0;         // Segment being filled (0 = none yet)
+    std::uint64_t currentSize_ = 0;
+    Stats stats_;
+
+    std::mutex commitMutex_; // Serializes commits; taken before mutex_
+    int indexFd_ = -1;
+    bool indexTorn_ = false; // A failed commit left part of a line in the index (commitMutex_)
+};
+
+/**
+ * Read side of a pack (for listing and extraction).
+ */
+class PackReader
+{
+public:
+    /**
+     * @throws std::runtime_error if the pack has no readable index
+     */
+    explicit PackReader(std::filesystem::path directory);
+
+    /**
+     * Live entries in index order (replaced entries are dropped).
+     */
+    const std::vector<PackEntry> &entries() const { return entries_; }
+
+    /**
+     * Read an object and check it against its recorded SHA-256.
+     *
+     * @param error Set when false is returned
+     */
+    bool read(const PackEntry &entry, std::string &data, std::string &error) const;
+
+private:
+    std::filesystem::path directory_;
+    std::vector<PackEntry> entries_;
+};
+
+/**
+ * Parse one index line; false if it is malformed (e.g. torn by a crash).
+ */
+bool parsePackIndexLine(const std::string &line, PackEntry &entry);
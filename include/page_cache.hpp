@@ -0,0 +1,56 @@
+#pragma once
+
+#include <sys/types.h>
+
+/**
+ * How downloaded data may use the page cache.
+ */
+enum class PageCachePolicy
+{
+    Normal,     // Leave it to the kernel
+    DropBehind, // Write back and evict pages shortly behind the write frontier
+    Direct      // O_DIRECT for aligned blocks; the unaligned rest is dropped behind
+};
+
+/**
+ * Keeps one sequentially written file from filling the page cache.
+ *
+ * Every WINDOW bytes, writeback of the newest window is started without
+ * waiting, and the window before it (which has had a whole window's time to
+ * reach the disk) is waited for and evicted with POSIX_FADV_DONTNEED. So at
+ * most two windows of the file are cached at any time, and the writer
+ * rarely blocks. A no-op for PageCachePolicy::Normal and outside Linux.
+ */
+class WriteBehind
+{
+public:
+    explicit WriteBehind(PageCachePolicy policy = PageCachePolicy::Normal) : policy_(policy) {}
+
+    /**
+     * Writing (re)starts at offset; nothing before it is tracked.
+     */
+    void reset(off_t offset);
+
+    /**
+     * Whether wrote(end) would issue writeback: a writer that buffers in
+     * userspace must flush first, so the ranges match what is in the file.
+     */
+    bool due(off_t end) const { return policy_ != PageCachePolicy::Normal && end - started_ >= WINDOW; }
+
+    /**
+     * Data up to end has been written through fd.
+     */
+    void wrote(int fd, off_t end);
+
+    /**
+     * The file is done (or being closed): flush what is left and drop it all.
+     */
+    void finish(int fd);
+
+    static constexpr off_t WINDOW = 8 * 1024 * 1024;
+
+private:
+    PageCachePolicy policy_;
+    off_t dropped_ = 0; // Everything before this has been evicted
+    off_t started_ = 0; // Writeback was started for [dropped_, started_)
+};
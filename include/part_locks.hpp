@@ -0,0 +1,79 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+/**
+ * Cross-process claims on in-progress downloads.
+ *
+ * Before a process writes "<destination>.part" it takes an exclusive flock
+ * on "<destination>.part.lock" and holds it until the file has landed or
+ * the transfer has failed. A second process that finds the lock taken
+ * leaves the job waiting and asks again later. The lock is released when
+ * the first process is done. If the destination was replaced in the
+ * meantime, the second process takes that file instead of fetching it
+ * again. Otherwise (the first one failed) it continues from the .part it
+ * left behind. Lock files are removed while still locked, and a claim
+ * re-checks that the file it locked is still the one on disk. A lock
+ * taken on a file that was just removed is therefore never mistaken for
+ * the real one. Thread-safe.
+ */
+class PartLocks
+{
+public:
+    enum class Claim
+    {
+        Owned,   // This process fetches it; release() when done
+        Busy,    // Another process is fetching it; ask again after POLL_INTERVAL_MS
+        Finished // Another process landed it while we waited; nothing to fetch
+    };
+
+    struct Stats
+    {
+        size_t claims = 0;   // Locks taken
+        size_t waits = 0;    // Jobs that found another process on their file
+        size_t finished = 0; // Waiting jobs the other process fetched for us
+    };
+
+    PartLocks() = default;
+    ~PartLocks();
+
+    PartLocks(const PartLocks &) = delete;
+    PartLocks &operator=(const PartLocks &) = delete;
+
+    /**
+     * Try to claim the download of destination, staged at partPath.
+     * Filesystems without flock support are not coordinated (Owned).
+     */
+    Claim tryClaim(const std::filesystem::path &partPath, const std::filesystem::path &destination);
+
+    /**
+     * Give up a claim from tryClaim (no-op if partPath isn't held).
+     */
+    void release(const std::filesystem::path &partPath);
+
+    Stats stats() const;
+
+    static constexpr long POLL_INTERVAL_MS = 200;
+
+private:
+    // The destination as it was when another process was first seen on it
+    struct Seen
+    {
+        bool exists = false;
+        dev_t device = 0;
+        ino_t inode = 0;
+        struct timespec modified{};
+    };
+
+    static Seen look(const std::filesystem::path &path);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, int> held_;   // partPath -> locked descriptor
+    std::unordered_map<std::string, Seen> waiting_; // partPath -> destination when the wait began
+    Stats stats_;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+/**
+ * Spreads transfers over several local interfaces / source addresses
+ * (CURLOPT_INTERFACE values such as "eth1" or "10.0.0.2"; "if!"/"host!"
+ * prefixes are accepted and stripped).
+ *
+ * Each path keeps an EWMA of the throughput its transfers achieved. A new
+ * transfer goes to the path with the best throughput per active transfer,
+ * so a path that is twice as fast ends up carrying about twice as many
+ * concurrent transfers. Untried paths are tried first. Thread-safe.
+ */
+class PathSelector
+{
+public:
+    struct PathStats
+    {
+        std::string name;
+        size_t transfers = 0;
+        size_t failures = 0;
+        curl_off_t bytes = 0;
+        double bytesPerSecond = 0.0; // Current EWMA estimate
+    };
+
+    /**
+     * @param interfaces Interface names or local addresses, one per path
+     * @throws std::invalid_argument if the list is empty
+     */
+    explicit PathSelector(std::vector<std::string> interfaces);
+
+    /**
+     * Pick a path for a new transfer and count it as active.
+     * Every choose() must be paired with record() or recordFailure().
+     *
+     * @return Path index
+     */
+    size_t choose();
+
+    /**
+     * CURLOPT_INTERFACE value for a path.
+     */
+    const std::string &interfaceName(size_t path) const { return paths_[path].stats.name; }
+
+    /**
+     * A transfer on this path finished: fold its throughput into the estimate.
+     */
+    void record(size_t path, curl_off_t bytes, double seconds);
+
+    /**
+     * A transfer on this path failed: halve the estimate so it gets less work.
+     */
+    void recordFailure(size_t path);
+
+    std::vector<PathStats> snapshot() const;
+
+private:
+    struct Path
+    {
+        PathStats stats;
+        size_t active = 0;
+        bool measured = false;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Path> paths_;
+
+    static constexpr double EWMA_WEIGHT = 0.3;        // Weight of the newest sample
+    static constexpr size_t MAX_EXPLORE_FAILURES = 3; // Unmeasured path given up on after this
+};
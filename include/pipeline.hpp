@@ -0,0 +1,168 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "download_job.hpp"
+#include "directory_cache.hpp"
+#include "durability.hpp"
+#include "event_stream.hpp"
+#include "memory_budget.hpp"
+#include "transfer_engine.hpp"
+#include "work_stealing_pool.hpp"
+
+/**
+ * One step of the post-download chain.
+ */
+struct PipelineStage
+{
+    enum class Kind
+    {
+        Verify,     // Check the job's checksum; quarantine on mismatch
+        Land,       // Rename "<destination>.part" to the destination
+        Decompress, // gzip: "x.gz" -> "x" (the compressed file is removed)
+        Extract,    // tar: unpack into argument dir (default: next to the archive)
+        Move,       // Move the current output into argument dir
+        Notify      // Run argument as a command with the output path and URL
+    };
+
+    Kind kind = Kind::Verify;
+    std::string argument; // Text after ':' in the spec ("" if none)
+};
+
+/**
+ * Parse a pipeline spec: comma-separated stages, each "name[:argument]",
+ * e.g. "verify,decompress,extract:/data/unpacked,notify:/usr/local/bin/hook".
+ * Verify and Land always run first (in that order) whether listed or not.
+ *
+ * @throws std::runtime_error on an unknown stage or a missing argument
+ */
+std::vector<PipelineStage> parsePipeline(const std::string &spec);
+
+/**
+ * Lower-case stage name as used in specs and --stage-limit.
+ */
+const char *stageName(PipelineStage::Kind kind);
+
+/**
+ * Runs each downloaded job through its stages on a WorkStealingPool.
+ *
+ * Every stage has its own concurrency limit (e.g. at most 2 extractions at
+ * once); jobs waiting for a busy stage queue in front of it. backlog() lets
+ * the downloader stop starting transfers while post-processing catches up.
+ */
+class Pipeline
+{
+public:
+    using DoneFn = std::function<void(TransferResult)>;
+
+    /**
+     * @param pool Workers that run the stages (must outlive the pipeline)
+     * @param defaultSpec Stages for jobs without their own pipeline
+     * @param stageLimits Max concurrent runs per stage (missing = pool size)
+     * @param onDone Called from a pool thread when a job leaves the pipeline;
+     *               result.location says where the output ended up
+     * @param memory Budget the stage buffers are drawn from (null = untracked)
+     * @param durability How Land publishes files (null = plain rename). In
+     *                   batched mode a landing job gives up its Land slot
+     *                   while it waits for its group commit.
+     * @param directories Without durability, Land renames relative to these
+     *                    cached directories (null = by full path)
+     */
+    Pipeline(WorkStealingPool &pool, const std::string &defaultSpec,
+             std::map<PipelineStage::Kind, size_t> stageLimits, DoneFn onDone,
+             std::shared_ptr<MemoryBudget> memory = nullptr, std::shared_ptr<Durability> durability = nullptr,
+             std::shared_ptr<DirectoryCache> directories = nullptr);
+
+    /**
+     * Queue a downloaded job.
+     *
+     * @param job The job (must stay alive until onDone is called for it)
+     * @param result Download result (success == true)
+     * @param current Where the file is now (.part file or destination)
+     * @param verifyOnly Run only the verify stage (a file someone else already post-processed)
+     */
+    void submit(const DownloadJob &job, TransferResult result, const std::filesystem::path &current,
+                bool verifyOnly = false);
+
+    /**
+     * Report each checksum check as a verify event for result.jobIndex
+     * (null = don't). Set before the first submit().
+     */
+    void setEventStream(std::shared_ptr<EventStream> events) { events_ = std::move(events); }
+
+    /**
+     * Jobs inside the pipeline (queued or running).
+     */
+    size_t backlog() const;
+
+    /**
+     * Block until backlog() < limit.
+     */
+    void waitForBacklogBelow(size_t limit);
+
+    /**
+     * Parse "--stage-limit" values like "extract=2".
+     *
+     * @throws std::runtime_error on malformed input
+     */
+    static std::map<PipelineStage::Kind, size_t> parseStageLimits(const std::vector<std::string> &limits);
+
+private:
+    struct Item
+    {
+        const DownloadJob *job = nullptr;
+        TransferResult result;
+        std::vector<PipelineStage> stages;
+        size_t next = 0;
+        std::filesystem::path current;
+    };
+
+    struct StageQueue
+    {
+        size_t limit = 0;
+        size_t running = 0;
+        std::deque<Item> waiting;
+    };
+
+    // Start as many waiting items as the stage's limit allows (mutex_ held)
+    void dispatch(PipelineStage::Kind kind);
+    void runStage(Item item);
+    // Queue item for its next stage, or finish it when it failed or is done
+    void advance(Item item, bool ok);
+    void finish(Item &item);
+
+    bool verify(Item &item);
+    bool land(Item &item);
+    // Batched durability: hand the file to the group commit and return at once
+    void landDeferred(Item item);
+    bool decompress(Item &item);
+    bool extract(Item &item, const std::string &targetDir);
+    static bool move(Item &item, const std::string &targetDir);
+    static bool notify(Item &item, const std::string &command);
+
+    WorkStealingPool &pool_;
+    std::vector<PipelineStage> defaultStages_;
+    DoneFn onDone_;
+    std::shared_ptr<MemoryBudget> memory_;
+    std::shared_ptr<Durability> durability_;
+    std::shared_ptr<DirectoryCache> directories_;
+    std::shared_ptr<EventStream> events_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable drained_;
+    std::map<PipelineStage::Kind, StageQueue> stages_;
+    size_t backlog_ = 0;
+
+    static constexpr size_t TAR_BLOCK = 512;
+    static constexpr size_t COPY_BUFFER_SIZE = 1024 * 1024;
+    static constexpr unsigned GZIP_BUFFER_SIZE = 256 * 1024; // zlib's input buffer
+};
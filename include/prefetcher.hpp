@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "curl_share.hpp"
+#include "download_job.hpp"
+#include "http_client.hpp"
+#include "network_cache.hpp"
+
+/**
+ * Look-ahead stage for batch downloads.
+ *
+ * While job N downloads, background workers send HEAD probes for the next K
+ * queued jobs. The probe resolves, connects and handshakes through a shared
+ * CURL share handle, so the download of job N+1 starts on a warm connection
+ * and already knows the file size and effective URL.
+ *
+ * K adapts to how fast the queue is drained: it doubles whenever a job is
+ * taken before its probe started, and shrinks when probed results sit so long
+ * that their connections are likely to have gone idle.
+ */
+class Prefetcher
+{
+public:
+    /**
+     * Start the look-ahead workers.
+     *
+     * @param jobs Batch being downloaded (must outlive the prefetcher)
+     * @param share Share handle also attached to the downloading client
+     * @param networkCache Persistent metadata cache (may be null)
+     * @param maxLookahead Upper bound for K
+     * @param caCertFile Extra CA bundle for the probing clients (may be empty)
+     */
+    Prefetcher(const std::vector<DownloadJob> &jobs, const CurlShare &share,
+               std::shared_ptr<NetworkCache> networkCache, size_t maxLookahead,
+               std::string caCertFile = "");
+
+    // Stops and joins the workers
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+
+    /**
+     * Claim the probe result for a job that is about to start.
+     * Waits for a probe already in flight (cheaper than a second HEAD), but
+     * never for one that hasn't started yet.
+     *
+     * @param index Job index, called in increasing order
+     * @return Probed metadata, or nullopt if no usable probe exists
+     */
+    std::optional<RemoteMetadata> take(size_t index);
+
+    /**
+     * Current look-ahead depth K.
+     */
+    size_t lookahead() const;
+
+private:
+    enum class SlotState
+    {
+        Pending, // Not probed yet
+        Probing, // A worker is sending the HEAD request
+        Ready,   // Metadata available
+        Failed,  // Probe failed; the download will report the real error
+        Taken    // Consumed by the downloader
+    };
+
+    struct Slot
+    {
+        SlotState state = SlotState::Pending;
+        RemoteMetadata metadata;
+        std::chrono::steady_clock::time_point readyAt;
+    };
+
+    void workerLoop();
+
+    const std::vector<DownloadJob> &jobs_;
+    const CurlShare &share_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    const size_t maxLookahead_;
+    const std::string caCertFile_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable workAvailable_; // Workers wait for window changes
+    std::condition_variable probeDone_;     // take() waits for in-flight probes
+    std::vector<Slot> slots_;
+    size_t consumed_ = 0; // Jobs handed to the downloader so far
+    size_t lookahead_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> workers_;
+
+    // Results older than this probably sit on a connection the server closed
+    static constexpr std::chrono::seconds STALE_AFTER{20};
+    static constexpr size_t MAX_WORKERS = 4;
+    static constexpr int PROBE_TIMEOUT_SECONDS = 30;
+};
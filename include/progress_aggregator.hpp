@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * One transfer as of a sample.
+ */
+struct TransferProgress
+{
+    size_t slot = 0;
+    long long bytes = 0;         // Received so far (resumed bytes included)
+    long long total = -1;        // Full size, -1 if unknown
+    double bytesPerSecond = 0.0; // Smoothed (EWMA)
+    double etaSeconds = -1.0;    // -1 if unknown
+    bool finished = false;       // The transfer ended; this is its last sample
+};
+
+/**
+ * What the aggregator hands its frontends.
+ */
+struct ProgressSample
+{
+    std::chrono::milliseconds elapsed{0}; // Since the aggregator started
+    bool periodic = true;                 // false: only transfers that just ended are listed
+    std::vector<TransferProgress> transfers; // Transfers that moved, started or ended since the last sample
+    size_t active = 0;                    // Transfers running
+    long long bytes = 0;                  // Received by every transfer so far (not counting resumed bytes)
+    double bytesPerSecond = 0.0;          // Smoothed aggregate rate
+};
+
+/**
+ * Collects progress for every transfer and reports it from one thread.
+ *
+ * A transfer only stores its byte count into its own cache-line-sized
+ * counter (one relaxed store, no clock reads, no locks, no formatting).
+ * Counters are pooled: there are only as many as transfers ever ran at
+ * once. Every interval the aggregator thread reads the running ones,
+ * turns the deltas into EWMA speeds and ETAs and passes one
+ * ProgressSample to each frontend (progress bar, event stream, ...).
+ * end() only takes a transfer's final numbers; they are reported by the
+ * aggregator thread or by whoever calls reportEnded() first, so a
+ * frontend can be made to see them before anything the caller prints or
+ * emits next. Frontends are never called concurrently.
+ */
+class ProgressAggregator
+{
+public:
+    using Frontend = std::function<void(const ProgressSample &)>;
+
+    /**
+     * A running transfer's counter, written only by that transfer; padded
+     * so neighbours' stores don't share a line. Stays at its address for
+     * the aggregator's lifetime, so writing it needs no lock.
+     */
+    struct alignas(64) Counter
+    {
+        explicit Counter(size_t index) : index(index) {}
+
+        std::atomic<long long> bytes{0};
+        std::atomic<long long> total{-1};
+        const size_t index; // Into the aggregator's tracks
+    };
+
+    /**
+     * @param interval Time between samples
+     * @param smoothing Weight of the newest rate in the EWMA (0 < smoothing <= 1)
+     */
+    explicit ProgressAggregator(std::chrono::milliseconds interval, double smoothing = 0.3);
+
+    // Stops the sampling thread
+    ~ProgressAggregator();
+
+    ProgressAggregator(const ProgressAggregator &) = delete;
+    ProgressAggregator &operator=(const ProgressAggregator &) = delete;
+
+    /**
+     * Called with every sample, on the aggregator thread (or the thread
+     * calling reportEnded()).
+     */
+    void addFrontend(Frontend frontend);
+
+    /**
+     * A transfer starts (or starts over).
+     *
+     * @param slot Reported as TransferProgress::slot (the job's index in its batch)
+     * @param bytes Already on disk (resumed), not counted as received
+     * @param total Full size, or -1 if unknown
+     * @return The transfer's counter, for update(), setTotal() and end()
+     */
+    Counter *begin(size_t slot, long long bytes, long long total);
+
+    /**
+     * Hot path: the transfer now has bytes of its file.
+     */
+    void update(Counter *counter, long long bytes)
+    {
+        counter->bytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    void setTotal(Counter *counter, long long total)
+    {
+        counter->total.store(total, std::memory_order_relaxed);
+    }
+
+    /**
+     * The transfer is over (either way). Its final numbers are taken now
+     * and reported with the next sample or reportEnded(); no frontend runs
+     * on the calling thread. The counter goes back to the pool. No-op if
+     * it isn't running.
+     */
+    void end(Counter *counter);
+
+    /**
+     * Report every transfer end()ed so far before returning, from this
+     * thread unless the aggregator thread is already at it.
+     */
+    void reportEnded();
+
+    // EWMA step: smoothing weighs the newest rate
+    static double smooth(double previous, double rate, double smoothing)
+    {
+        return smoothing * rate + (1.0 - smoothing) * previous;
+    }
+
+    // Seconds left at bytesPerSecond: 0 once complete, -1 if unknown
+    static double eta(long long bytes, long long total, double bytesPerSecond);
+
+private:
+    // The aggregator's view of a counter
+    struct Track
+    {
+        size_t slot = 0;
+        bool running = false;
+        bool fresh = false;    // Not reported since begin()
+        size_t activeAt = 0;   // Position in active_ while running
+        long long lastBytes = 0;
+        double bytesPerSecond = 0.0;
+        bool measured = false; // bytesPerSecond holds a rate
+        std::chrono::steady_clock::time_point begun;
+    };
+
+    void samplerLoop();
+    // Report the ended transfers, then measure the running ones (publishMutex_ held)
+    void sampleAll();
+    // Report the ended transfers (publishMutex_ held)
+    void publishEnded();
+    // Read a counter; seconds = time since the last sample (0 = keep its rate). Appends
+    // to out unless there is nothing new to report (mutex_ held)
+    void measure(size_t index, double seconds, bool finished, std::vector<TransferProgress> &out);
+    // Fill in the totals (mutex_ held)
+    void fillTotals();
+    // Call every frontend with sample_ (publishMutex_ held)
+    void publish();
+
+    const std::chrono::milliseconds interval_;
+    const double smoothing_;
+    const std::chrono::steady_clock::time_point started_;
+
+    std::mutex publishMutex_; // Frontends, sample_; taken before mutex_
+    std::vector<Frontend> frontends_;
+    ProgressSample sample_; // Reused: its vector keeps its capacity between samples
+
+    std::mutex mutex_; // Everything below
+    std::deque<Counter> counters_;   // Grows to the most transfers running at once; never moves one
+    std::vector<Track> tracks_;      // tracks_[i] belongs to counters_[i]
+    std::vector<size_t> active_;     // Running counters: all the sampler walks
+    std::vector<size_t> idle_;       // Counters free for the next begin()
+    std::vector<TransferProgress> ended_; // Final numbers not reported yet
+    std::chrono::steady_clock::time_point lastSample_;
+    long long received_ = 0;
+    double bytesPerSecond_ = 0.0;
+
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread sampler_;
+};
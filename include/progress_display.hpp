@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "progress_aggregator.hpp"
+
+/**
+ * Format bytes into human-readable string (e.g., "52.3 MB")
+ */
+std::string formatBytes(long long bytes);
+
+/**
+ * Format duration into human-readable string (e.g., "2m 30s"; "unknown" if negative)
+ */
+std::string formatDuration(long seconds);
+
+/**
+ * Progress bar frontend of a ProgressAggregator.
+ *
+ * On a terminal the bar is redrawn in place on every sample. Otherwise
+ * (piped to a file) a line is printed at most once per second and when a
+ * transfer ends. With one transfer running it shows that transfer's bar,
+ * size, speed and ETA; with several, a summary line for all of them.
+ */
+class ProgressDisplay
+{
+public:
+    ProgressDisplay();
+
+    void render(const ProgressSample &sample);
+
+    static constexpr std::chrono::milliseconds PIPED_INTERVAL{1000};
+
+private:
+    bool isTerminalOutput_;
+    std::chrono::milliseconds lastPrinted_{-PIPED_INTERVAL};
+};
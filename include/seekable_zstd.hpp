@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+class WorkStealingPool;
+
+/**
+ * Compresses whole zstd frames for every SeekableZstdWriter of a run.
+ *
+ * Frames are independent, so any thread can compress any of them in one
+ * call. A fixed set of threads does so with compressor contexts kept for
+ * reuse: a run costs one context per thread, however many transfers are
+ * compressing. Thread-safe.
+ */
+class ZstdFramePool
+{
+public:
+    struct Options
+    {
+        int level = 3;
+        size_t threads = 0;                  // Compression threads (0 = one per hardware thread)
+        size_t frameBytes = 2 * 1024 * 1024; // Uncompressed bytes per frame: the unit of random access
+    };
+
+    /**
+     * One frame: input goes in, the compressed frame (with its content checksum)
+     * comes out on a pool thread. `done` is set last.
+     */
+    struct Frame
+    {
+        std::string input;
+        std::string output;
+        std::string error;
+        std::atomic<bool> done{false};
+    };
+
+    /**
+     * @throws std::runtime_error if zstd rejects the level (or isn't built in)
+     */
+    explicit ZstdFramePool(const Options &options);
+    ~ZstdFramePool();
+
+    ZstdFramePool(const ZstdFramePool &) = delete;
+    ZstdFramePool &operator=(const ZstdFramePool &) = delete;
+
+    size_t frameBytes() const { return frameBytes_; }
+
+    /**
+     * Queue a frame; onDone runs on the compressing thread once frame->done is set.
+     */
+    void submit(std::shared_ptr<Frame> frame, std::function<void()> onDone);
+
+    // Contexts created so far (at most one per thread)
+    size_t contexts() const;
+
+private:
+    using Context = std::unique_ptr<ZSTD_CCtx_s, size_t (*)(ZSTD_CCtx_s *)>;
+
+    void compress(Frame &frame);
+
+    const int level_;
+    const size_t frameBytes_;
+    mutable std::mutex mutex_;
+    std::vector<Context> idle_; // Contexts not in use by a thread right now
+    size_t created_ = 0;
+    std::unique_ptr<WorkStealingPool> threads_; // Last: its workers use the members above
+};
+
+/**
+ * Streams data into zstd "seekable format" output: a series of independent
+ * frames, one per frameBytes of input, followed by a seek table in a
+ * skippable frame at the very end. Any zstd decoder reads the file as a
+ * whole. Seekable-aware readers (zstd's contrib/seekable_format, t2sz,
+ * ...) find the frame holding an uncompressed offset from the table and
+ * decode only that frame.
+ *
+ * Every frame carries zstd's content checksum, and the seek table repeats
+ * it per frame (the low 32 bits of XXH64 of the uncompressed frame). The
+ * SHA-256 of the whole uncompressed stream can be stored in its own
+ * skippable frame just before the seek table (see seal()).
+ *
+ * Full frames are compressed on a ZstdFramePool, so neither write() nor
+ * the end of the stream ever waits for the compressor: finished frames
+ * are handed back, in order, by write() and collect(). Not thread-safe:
+ * one writer per stream.
+ */
+class SeekableZstdWriter
+{
+public:
+    /**
+     * @param onFrameDone Runs on a pool thread whenever one of this stream's
+     *        frames is ready for collect() (may outlive the writer)
+     */
+    SeekableZstdWriter(std::shared_ptr<ZstdFramePool> pool, std::function<void()> onFrameDone);
+    ~SeekableZstdWriter();
+
+    SeekableZstdWriter(const SeekableZstdWriter &) = delete;
+    SeekableZstdWriter &operator=(const SeekableZstdWriter &) = delete;
+
+    /**
+     * Take length bytes, queueing each full frame, and append the frames that
+     * are ready to out.
+     *
+     * @param error Set when false is returned
+     */
+    bool write(const char *data, size_t length, std::string &out, std::string &error);
+
+    /**
+     * MAX_FRAMES_IN_FLIGHT frames are still compressing: stop writing until
+     * collect() has taken some.
+     */
+    bool busy() const { return inFlight_.size() >= MAX_FRAMES_IN_FLIGHT; }
+
+    /**
+     * Append the frames finished so far, in stream order, to out; after
+     * seal(), the last one is followed by the trailer.
+     */
+    bool collect(std::string &out, std::string &error);
+
+    /**
+     * End the stream: queue the last frame. The SHA-256 frame (if sha256 is
+     * not empty) and the seek table follow it once collect() gets there.
+     *
+     * @param sha256 Hex digest of the uncompressed stream ("" = none)
+     */
+    void seal(const std::string &sha256);
+
+    /**
+     * Sealed and collected to the end of the seek table.
+     */
+    bool done() const { return sealed_ && inFlight_.empty() && trailerWritten_; }
+
+    std::uint64_t inputBytes() const { return inputBytes_; }
+    std::uint64_t outputBytes() const { return outputBytes_; }
+
+    // Skippable-frame magic of the seek table, and of the frame holding "sha256:<hex>"
+    static constexpr std::uint32_t SEEK_TABLE_MAGIC = 0x184D2A5E;
+    static constexpr std::uint32_t CHECKSUM_FRAME_MAGIC = 0x184D2A50;
+    static constexpr std::uint32_t SEEKABLE_MAGIC = 0x8F92EAB1; // Seek table footer
+    static constexpr size_t MAX_FRAMES_IN_FLIGHT = 2;
+
+private:
+    struct Entry
+    {
+        std::uint32_t compressedBytes = 0;
+        std::uint32_t uncompressedBytes = 0;
+        std::uint32_t checksum = 0;
+    };
+
+    void submitFrame();
+    void appendSkippableFrame(std::uint32_t magic, const std::string &payload, std::string &out);
+
+    std::shared_ptr<ZstdFramePool> pool_;
+    std::function<void()> onFrameDone_;
+    std::string input_; // The frame being filled
+    std::deque<std::shared_ptr<ZstdFramePool::Frame>> inFlight_; // Oldest first
+    std::vector<Entry> entries_;
+    std::string sha256_;
+    std::uint64_t inputBytes_ = 0;
+    std::uint64_t outputBytes_ = 0;
+    bool sealed_ = false;
+    bool trailerWritten_ = false;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <curl/curl.h>
+#include <openssl/evp.h>
+
+#include "buffer_arena.hpp"
+#include "download_job.hpp"
+#include "fd_cache.hpp"
+#include "network_cache.hpp"
+#include "part_locks.hpp"
+#include "spsc_queue.hpp"
+#include "transfer_engine.hpp"
+
+/**
+ * A job handed to a shard, tagged with its position in the batch.
+ */
+struct ShardJob
+{
+    size_t index = 0;
+    DownloadJob job;
+};
+
+/**
+ * One event loop of the TransferEngine.
+ *
+ * Everything a transfer touches (multi handle, easy handles, output file
+ * descriptors, write buffers, SHA-256 contexts) belongs to the shard thread. The engine
+ * thread talks to it only through the inbox/outbox SPSC queues.
+ *
+ * A successful result means the body is complete and size-checked in
+ * "<destination>.part"; the engine finalizes it off this thread.
+ */
+class Shard
+{
+public:
+    /**
+     * @param id Shard number (also the core it is pinned to, modulo core count)
+     * @param options Engine settings
+     * @param networkCache Persistent metadata cache (may be null)
+     * @param onResultReady Called from the shard thread after publishing a result
+     */
+    Shard(size_t id, const EngineOptions &options, std::shared_ptr<NetworkCache> networkCache,
+          std::function<void()> onResultReady);
+
+    // Joins the thread (see join())
+    ~Shard();
+
+    // Pack mode: the smallest memory budget a transfer can always draw a whole body from
+    static constexpr size_t MIN_PACK_BUDGET = PackWriter::MAX_OBJECT_BYTES + CURL_MAX_WRITE_SIZE;
+
+    Shard(const Shard &) = delete;
+    Shard &operator=(const Shard &) = delete;
+
+    /**
+     * Launch the event loop thread.
+     */
+    void start();
+
+    /**
+     * Engine thread: queue a job. Leaves the job untouched and returns false
+     * if the inbox is full.
+     */
+    bool trySubmit(ShardJob &job);
+
+    /**
+     * Engine thread: collect a finished job, if any.
+     */
+    std::optional<TransferResult> tryPopResult();
+
+    /**
+     * Engine thread: no more jobs will be submitted; the loop exits once idle.
+     */
+    void finish();
+
+    /**
+     * Engine thread: finish() and wait for the event loop to exit.
+     */
+    void join();
+
+    /**
+     * Engine thread: accepted jobs held back because their volume is at its
+     * admission limit (as of the shard's last pass). They don't occupy a
+     * download slot, so the engine doesn't count them against its window.
+     */
+    size_t waitingForDisk() const { return waitingForDisk_.load(std::memory_order_relaxed); }
+
+    /**
+     * Output descriptor cache counters (only stable after join()).
+     */
+    const FdCache::Stats &fileCacheStats() const { return fileCache_.stats(); }
+
+private:
+    struct Transfer;
+    struct Wakeup;
+
+    void eventLoop();
+    void pinToCore() const;
+    void acceptJobs();
+    void startPending();
+    // Resume offset and hash for whatever .part is on disk now
+    void probeResume(Transfer &transfer);
+    // Cross-process lock on the .part (Owned when not coordinating); publishes Finished jobs
+    PartLocks::Claim claimPart(Transfer &transfer);
+    void startDueRetries();
+    bool startAttempt(Transfer &transfer);
+    void completeTransfer(CURL *easy, CURLcode result);
+    // Everything after the body is complete (and, compressed, after its last frame is out)
+    void finishTransfer(std::unique_ptr<Transfer> transfer, CURLcode result);
+    void publish(Transfer &transfer, TransferResult result);
+    void flushUnsent();
+    long pollTimeoutMs() const;
+
+    static size_t writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata);
+    bool flushBuffer(Transfer &transfer);
+
+    // Per attempt: a slot on the destination volume and a receive buffer;
+    // the write buffer is drawn on the first write
+    bool admit(Transfer &transfer);
+    bool reserveReceiveBuffer();
+    void releaseAdmission(Transfer &transfer);
+    bool allocateWriteBuffer(Transfer &transfer);
+    void freeWriteBuffer(Transfer &transfer);
+    void resumePaused();
+    bool writeOut(Transfer &transfer, const char *data, size_t length);
+    // Close the .part's descriptor (waiting for its writeback under drop-behind)
+    void closeFile(Transfer &transfer);
+    // Report writeback waits, and (every DISK_REPORT_MS, or when forced) the bytes written
+    void reportDisk(size_t volume);
+    void foldDiskBytes(bool force);
+    // Coalesce data into the write buffer, flushing it whenever it fills
+    bool bufferOut(Transfer &transfer, const char *data, size_t length);
+    // No checksum in the manifest: take one from the response headers, hashing the body for it if possible
+    void adoptAnnouncedChecksum(Transfer &transfer);
+    // Compressed output: buffer the frames the pool has finished
+    bool collectCompressed(Transfer &transfer);
+    // Compressed output: queue the last frame (the checksum and seek table follow it)
+    void sealCompressed(Transfer &transfer);
+    // Resume transfers paused on their compressor, and finish sealed ones whose frames are all out
+    void driveCompressors();
+
+    // Pack mode: bodies collect in memory and go to the engine with the result to be
+    // appended to the pack. A body's full size is charged to the budget before its
+    // first byte, so no transfer ever waits for memory partway through an object
+    size_t receivePacked(Transfer &transfer, const char *data, size_t length);
+    bool reserveBody(Transfer &transfer, size_t bytes);
+    // The announced length (at most MAX_OBJECT_BYTES), or MAX_OBJECT_BYTES if unknown
+    size_t fullBodyBytes(Transfer &transfer) const;
+
+    const size_t id_;
+    const EngineOptions options_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    std::function<void()> onResultReady_;
+
+    // Cross-thread: engine -> shard and shard -> engine
+    SpscQueue<ShardJob> inbox_;
+    SpscQueue<TransferResult> outbox_;
+    std::atomic<bool> finishing_{false};
+    std::atomic<size_t> waitingForDisk_{0};
+
+    // Shard-thread state (never touched by other threads once started)
+    std::unique_ptr<CURLM, decltype(&curl_multi_cleanup)> multi_;
+    std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)> resolveList_;
+    std::unordered_map<CURL *, std::unique_ptr<Transfer>> active_;
+    std::vector<std::unique_ptr<Transfer>> waitingRetry_;
+    std::deque<TransferResult> unsent_; // Results that didn't fit in the outbox yet
+    FdCache fileCache_;                 // .part descriptors, reopened on demand
+    std::deque<std::unique_ptr<Transfer>> pending_; // Accepted, waiting for a slot
+    std::vector<Transfer *> paused_;    // Active transfers waiting for write-buffer (or body) memory
+    std::vector<Transfer *> compressing_; // Active transfers paused until their frames are collected
+    std::vector<std::pair<std::unique_ptr<Transfer>, CURLcode>> sealing_; // Done; last frames compressing
+    std::shared_ptr<Wakeup> wakeup_;    // Lets frame-pool threads interrupt the poll
+    bool admissionBlocked_ = false;     // A job or retry waited for memory or a volume slot
+    std::vector<unsigned long long> diskBytes_; // By volume: written, not yet reported to options_.disks
+    std::chrono::steady_clock::time_point diskReportedAt_;
+
+    std::thread thread_;
+
+    static constexpr size_t QUEUE_CAPACITY = 4096;
+    static constexpr size_t WRITE_BUFFER_SIZE = 256 * 1024; // Coalesce small callbacks
+    static constexpr size_t RECEIVE_BUFFER_SIZE = CURL_MAX_WRITE_SIZE; // CURLOPT_BUFFERSIZE
+    static constexpr long BUDGET_RETRY_MS = 5;
+    static constexpr int INITIAL_RETRY_DELAY_MS = 1000;
+    static constexpr long MAX_POLL_MS = 100;
+    static constexpr long DISK_REPORT_MS = 50;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "download_job.hpp"
+
+/**
+ * A batch with duplicate URLs folded together: each distinct fetch is run
+ * once and its result is handed to the other jobs that asked for it.
+ */
+struct FlightPlan
+{
+    std::vector<DownloadJob> leaders;           // One job per distinct fetch, in first-seen order
+    std::vector<size_t> leaderJob;              // leaders[i] is jobs[leaderJob[i]]
+    std::vector<std::vector<size_t>> followers; // Per leader: indices of the jobs served by its result
+
+    size_t duplicates() const;
+};
+
+/**
+ * Group jobs that fetch the same URL with the same checksum and pipeline.
+ * Only jobs whose stages end with the landed file (verify, land) are
+ * grouped. A job that decompresses, extracts, moves or announces its file
+ * runs on its own.
+ *
+ * @param defaultSpec Pipeline of jobs without their own
+ */
+FlightPlan coalesceJobs(const std::vector<DownloadJob> &jobs, const std::string &defaultSpec);
+
+/**
+ * Give target the content of an already downloaded file: a hard link when
+ * both are on one filesystem, otherwise a copy. Either way the target is
+ * written aside and renamed into place.
+ *
+ * @param linked Set to whether a link (not a copy) was made
+ * @param error Set when false is returned
+ */
+bool shareDownload(const std::filesystem::path &source, const std::filesystem::path &target, bool &linked,
+                   std::string &error);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * Classic ring buffer: the producer only writes tail_, the consumer only
+ * writes head_, and each side caches the other's index so the common case
+ * touches no shared cache line at all.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    /**
+     * @param capacity Maximum number of queued items (rounded up to a power of two)
+     */
+    explicit SpscQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        slots_ = std::make_unique<std::optional<T>[]>(size);
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    /**
+     * Producer side: enqueue if there is room.
+     *
+     * @return false if the queue is full (item is left untouched)
+     */
+    bool tryPush(T &item)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ > mask_)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ > mask_)
+            {
+                return false;
+            }
+        }
+
+        slots_[tail & mask_].emplace(std::move(item));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side: dequeue the oldest item, if any.
+     */
+    std::optional<T> tryPop()
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_)
+        {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_)
+            {
+                return std::nullopt;
+            }
+        }
+
+        std::optional<T> &slot = slots_[head & mask_];
+        std::optional<T> item(std::move(slot));
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release);
+        return item;
+    }
+
+    /**
+     * Approximate number of queued items (exact only from a quiescent state).
+     */
+    size_t sizeApprox() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    // Separate cache lines so producer and consumer don't false-share
+    static constexpr size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0}; // Written by consumer
+    size_t cachedTail_ = 0;                           // Consumer's view of tail_
+
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0}; // Written by producer
+    size_t cachedHead_ = 0;                           // Producer's view of head_
+
+    alignas(CACHE_LINE) size_t mask_ = 0;
+    std::unique_ptr<std::optional<T>[]> slots_;
+};
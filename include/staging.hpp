@@ -0,0 +1,28 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+/**
+ * Where a download is written before it is published.
+ *
+ * Without a scratch directory this is "<destination>.part" next to the
+ * destination. With one, it is "<name>.<hash of destination>.part" inside
+ * the scratch directory (64-bit FNV-1a of the absolute path). The name is
+ * the same on every run and every build, so an interrupted download still
+ * resumes.
+ */
+std::filesystem::path stagingPath(const std::filesystem::path &destination, const std::filesystem::path &scratchDir);
+
+/**
+ * Make a staged file renameable onto to.
+ *
+ * When from lives on another filesystem than to's directory, it is copied
+ * to "<to>.part" (copy_file_range, or read/write where the kernel refuses a
+ * cross-filesystem copy), the original is removed and from is updated to
+ * the copy. A rename then publishes it atomically. Does nothing when both
+ * are on the same filesystem.
+ *
+ * @param error Set when false is returned (from is then left where it was)
+ */
+bool bringAlongside(std::filesystem::path &from, const std::filesystem::path &to, std::string &error);
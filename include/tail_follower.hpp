@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "network_cache.hpp"
+
+/**
+ * Settings for following a growing remote file.
+ */
+struct FollowOptions
+{
+    std::chrono::milliseconds minInterval{1000};  // Poll this often while the file keeps growing
+    std::chrono::milliseconds maxInterval{60000}; // Back off to this while it doesn't
+    std::chrono::seconds duration{0};             // Stop after this long (0 = until stop())
+    int maxFailures = 3;                          // Consecutive failed polls tolerated before giving up
+    int timeoutSeconds = 300;                     // Per poll
+    std::string caCertFile;
+};
+
+/**
+ * Keeps a local copy of a growing remote file (a log, an append-only data
+ * file) up to date with range requests, like "tail -f" over HTTP.
+ *
+ * Each poll asks for "bytes=<local size - overlap>-", with If-None-Match
+ * when the last ETag is known, so an unchanged file costs one 304. The
+ * overlap bytes must match the local tail. A mismatch, a Content-Range
+ * total below the local size, or a 416 saying so means the remote file was
+ * truncated or rotated. The local copy is then kept as "<destination>.N"
+ * and the new file is fetched from byte 0. A server that ignores ranges
+ * (200) is checked against the whole local copy the same way.
+ *
+ * The poll interval halves toward minInterval whenever data arrives and
+ * doubles toward maxInterval when it doesn't. One curl handle serves
+ * every poll, so its connection is reused between polls. The last ETag
+ * is kept in "<destination>.follow" for the next run. New data is written
+ * straight into the destination, so readers can tail it.
+ */
+class TailFollower
+{
+public:
+    struct Stats
+    {
+        size_t polls = 0;
+        size_t unchanged = 0;   // 304, 416 at the local size, or nothing past the overlap
+        size_t grew = 0;        // Polls that appended data
+        size_t rotations = 0;   // Truncations or replacements detected
+        size_t failures = 0;
+        size_t connections = 0; // New connections opened (the rest reused one)
+        curl_off_t bytes = 0;   // Bytes appended (overlap checks excluded)
+    };
+
+    /**
+     * @throws std::runtime_error if the curl handle can't be created
+     */
+    TailFollower(std::string url, std::filesystem::path destination, FollowOptions options,
+                 std::shared_ptr<NetworkCache> networkCache = nullptr);
+
+    TailFollower(const TailFollower &) = delete;
+    TailFollower &operator=(const TailFollower &) = delete;
+
+    /**
+     * Poll until options.duration has passed or stop() is called.
+     *
+     * @param error Set when false is returned (maxFailures polls failed in a row)
+     */
+    bool run(std::string &error);
+
+    /**
+     * One poll: bring the local copy up to date with the remote file.
+     *
+     * @param error Set when false is returned
+     */
+    bool pollOnce(std::string &error);
+
+    // Ends run() at its next wait; callable from any thread
+    void stop();
+
+    const Stats &stats() const { return stats_; }
+    std::chrono::milliseconds interval() const { return interval_; }
+
+    // Bytes before the local end that every range request re-reads to detect replacement
+    static constexpr curl_off_t OVERLAP_BYTES = 4096;
+
+private:
+    // State of one request, filled in by the curl callbacks
+    struct Poll
+    {
+        TailFollower *owner = nullptr;
+        int fd = -1;
+        curl_off_t localSize = 0;
+        curl_off_t position = -1; // Remote offset of the next body byte (-1 = not decided yet)
+        bool mismatch = false;    // Body disagreed with the local copy
+        std::string contentRange;
+        std::string etag;
+        std::vector<char> local;  // Scratch for reading back the local copy
+        curl_off_t appended = 0;
+        std::string writeError;
+    };
+
+    enum class Outcome
+    {
+        Unchanged,
+        Grew,
+        Replaced // Truncated or rotated remotely; refetch from byte 0
+    };
+
+    bool request(curl_off_t localSize, Outcome &outcome, std::string &error);
+    // Move the local copy aside as "<destination>.N" with the first free N
+    bool rotateLocal(std::string &error);
+    void loadState();
+    void saveState() const;
+
+    static size_t writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata);
+    static size_t headerCallback(char *buffer, size_t size, size_t nitems, void *userdata);
+    size_t receive(Poll &poll, const char *data, size_t length);
+
+    std::string url_;
+    std::filesystem::path destination_;
+    FollowOptions options_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl_;
+    std::string etag_; // Of the remote file as the local copy last saw it
+    std::chrono::milliseconds interval_;
+    Stats stats_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+};
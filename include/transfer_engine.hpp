@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "destination_pool.hpp"
+#include "disk_admission.hpp"
+#include "download_job.hpp"
+#include "directory_cache.hpp"
+#include "durability.hpp"
+#include "event_stream.hpp"
+#include "fd_cache.hpp"
+#include "memory_budget.hpp"
+#include "network_cache.hpp"
+#include "pack.hpp"
+#include "part_locks.hpp"
+#include "seekable_zstd.hpp"
+#include "path_selector.hpp"
+#include "progress_aggregator.hpp"
+
+/**
+ * Settings for the sharded transfer engine.
+ */
+struct EngineOptions
+{
+    size_t shardCount = 1;         // Event loops (one thread each)
+    bool pinThreads = false;       // Pin shard i to core i (Linux)
+    size_t maxActivePerShard = 8;  // Concurrent transfers per event loop
+    int maxRetries = 3;            // Attempts in total, as HttpClient::setMaxRetries counts them
+    int timeoutSeconds = 300;
+    std::string caCertFile;        // Extra CA bundle (may be empty)
+    size_t postProcessThreads = 0; // Pipeline workers (0 = one per hardware thread)
+
+    // Post-download pipeline (see parsePipeline / Pipeline::parseStageLimits)
+    std::string pipelineSpec;             // Default stages for jobs without their own
+    std::vector<std::string> stageLimits; // "stage=N" entries
+    size_t pipelineBacklog = 32;          // Stop starting downloads at this many queued files
+
+    // Local interfaces to spread transfers over (null = default route)
+    std::shared_ptr<PathSelector> paths;
+
+    // Output descriptors kept open across all shards (0 = half the RLIMIT_NOFILE soft limit)
+    size_t maxOpenFiles = 0;
+    PageCachePolicy pageCache = PageCachePolicy::Normal;
+
+    // Shared by receive, write and post-processing buffers (null = unlimited, still tracked)
+    std::shared_ptr<MemoryBudget> memory;
+
+    // Transfers per destination filesystem, cut while its writes stall (null = built from below)
+    std::shared_ptr<DiskAdmission> disks;
+    std::chrono::milliseconds diskLatencyTarget{0}; // Sync latency that cuts a volume's transfers; 0 = measure only
+
+    // How the pipeline's Land stage publishes files (null = plain rename)
+    std::shared_ptr<Durability> durability;
+    std::filesystem::path scratchDir; // .part files go here (empty = next to the destination)
+
+    // Spread files over several roots; destinations are relative to the chosen root (null = as given)
+    std::shared_ptr<DestinationPool> destinations;
+    bool preallocate = false; // Reserve each file's blocks once its size is known
+
+    // Store bodies as objects in this pack instead of files; they skip the pipeline and are
+    // appended on the post-processing pool (null = files)
+    std::shared_ptr<PackWriter> pack;
+
+    // Bulk small-file mode: metadata calls relative to cached directories, no resume probe (null = plain paths)
+    std::shared_ptr<DirectoryCache> directories;
+
+    // Store files as seekable zstd "<destination>.zst", compressed on the way to disk (false = as received)
+    bool storeZstd = false;
+    ZstdFramePool::Options zstd;
+    std::shared_ptr<ZstdFramePool> zstdFrames; // Compresses every shard's frames (null = built from zstd)
+    // Lock each .part against other processes fetching the same file (null = don't coordinate)
+    std::shared_ptr<PartLocks> partLocks;
+    // Verify jobs without a checksum against the one their response headers announce
+    // (Repr-Digest, Content-Digest, Digest, Content-MD5)
+    bool discoverChecksums = false;
+    // Start and retry events for each job, by its index in the batch (null = none)
+    std::shared_ptr<EventStream> events;
+    // Byte counts of each job's transfer, slot = index in the batch (null = not counted)
+    std::shared_ptr<ProgressAggregator> progress;
+};
+
+/**
+ * Outcome of one job, reported back from the shard that ran it.
+ */
+struct TransferResult
+{
+    size_t jobIndex = 0;
+    bool success = false;
+    std::string error;
+    curl_off_t bytes = 0;  // Body bytes received (all attempts)
+    int retries = 0;
+    std::string sha256;    // Streaming digest of the file ("" if not computed)
+    std::string streamedChecksum;  // "algorithm:hex" when the streaming digest wasn't SHA-256
+    std::string announcedChecksum; // "algorithm:hex" from the response headers, for jobs without one
+    std::string location;  // Where the output ended up after post-processing
+                           // (set by a shard when there is nothing left to post-process)
+    std::string packedBody;   // Pack mode: the object, for the engine to append (empty once stored)
+    size_t packedCharge = 0;  // Memory budget (WriteBuffer stage) held by packedBody
+};
+
+/**
+ * Thread-per-core download engine.
+ *
+ * Jobs are assigned to N shards by host hash, so all transfers to one host
+ * share a shard's connection cache. Each shard is a libcurl multi event loop
+ * on its own (optionally pinned) thread that owns its connections, write
+ * buffers and hash state outright. Jobs and results cross threads through a
+ * pair of SPSC queues per shard (jobs in, results out). Receiving, hashing,
+ * buffering and writing a chunk touch only shard-owned state. Shared locks
+ * are taken per attempt or less often:
+ * - MemoryBudget, when an attempt draws its buffers (or a pack body its reservation)
+ * - BufferArena, when a thread's cache of free buffers runs dry
+ * - PathSelector, when an attempt picks its interface and reports how it went
+ * - DiskAdmission, for volume slots, at sync points, and when a shard folds
+ *   its byte counts (every few milliseconds)
+ *
+ * CPU-side post-processing (checksum verification, the rename into place,
+ * decompression, extraction, ...) runs through a Pipeline on a
+ * WorkStealingPool, never on a shard thread. When the pipeline backs up,
+ * new jobs are held back instead of being downloaded.
+ */
+class TransferEngine
+{
+public:
+    using ResultHandler = std::function<void(const TransferResult &)>;
+
+    /**
+     * @param options Shard count, pinning and per-transfer settings
+     * @param networkCache Persistent metadata cache (may be null)
+     * @throws std::invalid_argument if a pack's objects can't fit the memory budget
+     */
+    TransferEngine(EngineOptions options, std::shared_ptr<NetworkCache> networkCache);
+
+    /**
+     * Download all jobs, calling onResult on the calling thread as each finishes
+     * (in completion order). A job succeeds only once every pipeline stage
+     * has; result.location is where its output ended up. Returns once every
+     * job has been reported.
+     */
+    void run(const std::vector<DownloadJob> &jobs, const ResultHandler &onResult);
+
+    /**
+     * Shard index for a URL (hash of its host).
+     */
+    size_t shardFor(const std::string &url) const;
+
+    /**
+     * Output descriptor cache churn of the last run(), summed over shards.
+     */
+    const FdCache::Stats &fileCacheStats() const { return fileCacheStats_; }
+
+    /**
+     * Per-volume write throughput, latency and transfer limits.
+     */
+    const DiskAdmission &diskAdmission() const { return *options_.disks; }
+
+    /**
+     * Descriptors each shard may keep open (after resolving maxOpenFiles).
+     */
+    size_t openFilesPerShard() const { return options_.maxOpenFiles / options_.shardCount; }
+
+private:
+    // Pack mode: verify a finished object and append it (a pool worker; may fdatasync).
+    // onStored gets the result once a commit has indexed the object, or on failure
+    void storePacked(const DownloadJob &job, TransferResult result, size_t volume,
+                     const std::function<void(TransferResult)> &onStored);
+
+    EngineOptions options_;
+    std::shared_ptr<NetworkCache> networkCache_;
+    FdCache::Stats fileCacheStats_;
+
+    // Idle wake-up for the collecting thread only; shards ring it after
+    // publishing results. Never touched on the data path.
+    std::mutex doorbellMutex_;
+    std::condition_variable doorbell_;
+
+    static constexpr size_t MAX_DEFAULT_OPEN_FILES = 65536;
+    // Jobs handed to shards but not reported, in download windows: bounds how many
+    // can wait for a throttled volume outside the window
+    static constexpr size_t MAX_OUTSTANDING_WINDOWS = 8;
+};
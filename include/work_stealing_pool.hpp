@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed-size thread pool for CPU-bound post-processing (hashing, renames,
+ * later decompression/extraction), kept off the network threads.
+ *
+ * Every worker has its own deque: it pushes and pops at the back (newest
+ * task first, still warm in cache) while idle workers steal from the front
+ * of someone else's deque. Each deque has its own small lock, so submitters
+ * and workers only contend when they touch the same worker.
+ */
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param threadCount Worker threads (0 = one per hardware thread)
+     */
+    explicit WorkStealingPool(size_t threadCount = 0);
+
+    // Runs every queued task, then joins the workers
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /**
+     * Queue a task. From a worker thread it goes to that worker's own deque,
+     * otherwise round-robin. Exceptions escaping a task are reported and dropped.
+     */
+    void submit(Task task);
+
+    /**
+     * Block until every submitted task has finished.
+     */
+    void waitIdle();
+
+    size_t threadCount() const { return threads_.size(); }
+
+    /**
+     * Tasks run by a worker other than the one they were queued on.
+     */
+    size_t stealCount() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, Task &task);
+    bool steal(size_t thief, Task &task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<size_t> nextWorker_{0};
+    std::atomic<size_t> queued_{0};     // Submitted, not yet started
+    std::atomic<size_t> unfinished_{0}; // Submitted, not yet finished
+    std::atomic<size_t> steals_{0};
+
+    // Only for sleeping/waking; never held while running a task
+    std::mutex sleepMutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable idle_;
+    bool stopping_ = false;
+};
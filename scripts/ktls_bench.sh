@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+#
+# Compare CPU cost per GB of HTTPS downloads with and without kernel TLS
+# receive offload, against a local TLS test server.
+#
+# Usage: scripts/ktls_bench.sh [path/to/download_manager] [size_mb]
+#
+# Needs: openssl (certificate), python3 (HTTPS server), the 'tls' kernel
+# module for offload (modprobe tls). kTLS RX is most widely supported with
+# TLS 1.2 + AES-GCM, so the server is pinned to that.
+
+set -euo pipefail
+
+BIN=${1:-build/bin/download_manager}
+SIZE_MB=${2:-1024}
+PORT=${PORT:-8443}
+
+WORK=$(mktemp -d)
+SERVER_PID=""
+cleanup() {
+    [[ -n "$SERVER_PID" ]] && kill "$SERVER_PID" 2>/dev/null || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+    -addext subjectAltName=DNS:localhost \
+    -keyout "$WORK/key.pem" -out "$WORK/cert.pem" 2>/dev/null
+head -c "${SIZE_MB}M" /dev/urandom > "$WORK/payload.bin"
+
+python3 - "$WORK" "$PORT" <<'PY' &
+import http.server, ssl, sys, functools
+root, port = sys.argv[1], int(sys.argv[2])
+handler = functools.partial(http.server.SimpleHTTPRequestHandler, directory=root)
+server = http.server.ThreadingHTTPServer(("127.0.0.1", port), handler)
+ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+ctx.set_ciphers("ECDHE-RSA-AES128-GCM-SHA256")
+ctx.load_cert_chain(f"{root}/cert.pem", f"{root}/key.pem")
+server.socket = ctx.wrap_socket(server.socket, server_side=True)
+server.serve_forever()
+PY
+SERVER_PID=$!
+sleep 1
+
+run() {
+    local label=$1
+    shift
+    rm -f "$WORK/out.bin"
+    local line
+    line=$("$BIN" --no-net-cache --cacert "$WORK/cert.pem" --stats "$@" \
+        "https://localhost:$PORT/payload.bin" "$WORK/out.bin" | grep 's/GB')
+    echo "$label: ${line#"${line%%[![:space:]]*}"}" >&2
+    # Extract the "N.NN s/GB" figure
+    sed -E 's/.*\(([0-9.]+) s\/GB\).*/\1/' <<<"$line"
+}
+
+BASELINE=$(run "libcurl  ")
+OFFLOAD=$(run "--ktls   " --ktls)
+
+python3 -c "
+b, o = float('$BASELINE'), float('$OFFLOAD')
+print(f'CPU per GB: {b:.2f} s -> {o:.2f} s ({(o - b) / b * 100:+.1f}%)' if b else 'no baseline')
+"
@@ -0,0 +1,613 @@
+#include "batch_runner.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include <fmt/core.h>
+
+#include "buffer_arena.hpp"
+#include "checksum_discovery.hpp"
+#include "curl_share.hpp"
+#include "http_client.hpp"
+#include "pipeline.hpp"
+#include "prefetcher.hpp"
+#include "progress_display.hpp"
+#include "staging.hpp"
+#include "transfer_engine.hpp"
+#include "work_stealing_pool.hpp"
+
+BatchRunner::BatchRunner(DownloadConfig config, std::shared_ptr<NetworkCache> networkCache)
+    : config_(std::move(config)), networkCache_(std::move(networkCache)),
+      memory_(std::make_shared<MemoryBudget>(static_cast<size_t>(config_.memoryBudgetMb) * 1024 * 1024))
+{
+    if (!config_.interfaces.empty())
+    {
+        paths_ = std::make_shared<PathSelector>(config_.interfaces);
+    }
+    if (!config_.destinationRoots.empty())
+    {
+        destinations_ = std::make_shared<DestinationPool>(
+            std::vector<std::filesystem::path>(config_.destinationRoots.begin(), config_.destinationRoots.end()),
+            config_.placementIndex);
+    }
+    if (!config_.packDir.empty())
+    {
+        pack_ = std::make_shared<PackWriter>(config_.packDir,
+                                             static_cast<std::uint64_t>(config_.packSegmentMb) * 1024 * 1024);
+    }
+    if (config_.bulk)
+    {
+        directories_ = std::make_shared<DirectoryCache>();
+    }
+    if (config_.singleFlight)
+    {
+        partLocks_ = std::make_shared<PartLocks>();
+    }
+    if (!config_.eventStream.empty())
+    {
+        events_ = std::make_shared<EventStream>(config_.eventStream,
+                                                std::chrono::milliseconds(config_.progressIntervalMs));
+    }
+    if (config_.durability != DurabilityMode::None)
+    {
+        durability_ = std::make_shared<Durability>(config_.durability, static_cast<size_t>(config_.durabilityBatch),
+                                                   std::chrono::milliseconds(config_.durabilityWindowMs));
+    }
+}
+
+BatchSummary BatchRunner::run(const std::vector<DownloadJob> &jobs)
+{
+    if (pack_ && config_.shards == 0)
+    {
+        // Objects are collected in memory by the engine's shards; the sequential client writes files
+        fmt::print("Pack mode runs on the sharded engine (--shards 1)\n");
+        config_.shards = 1;
+    }
+    if (directories_ && config_.shards == 0)
+    {
+        fmt::print("Bulk mode runs on the sharded engine (--shards 1)\n");
+        config_.shards = 1;
+    }
+    if (config_.storeZstd && config_.shards == 0)
+    {
+        fmt::print("Compressed output runs on the sharded engine (--shards 1)\n");
+        config_.shards = 1;
+    }
+    std::vector<DownloadJob> withChecksums;
+    if (config_.discoverChecksums)
+    {
+        withChecksums = jobs;
+        ChecksumDiscovery discovery(config_.timeoutSeconds, config_.caCertFile, networkCache_);
+        discovery.fill(withChecksums);
+        const ChecksumDiscovery::Stats &stats = discovery.stats();
+        fmt::print("Checksums: {} found for {} directories ({} with SHA256SUMS, {} per-file lookups)\n",
+                   stats.found, stats.directories, stats.sumsFiles, stats.perFileProbes);
+    }
+    const std::vector<DownloadJob> &batch = config_.discoverChecksums ? withChecksums : jobs;
+
+    // One sampling thread for every transfer's progress: the sequential client's bar, or the events
+    if (events_ || config_.shards == 0)
+    {
+        progress_ = std::make_shared<ProgressAggregator>(std::chrono::milliseconds(config_.progressIntervalMs));
+        if (events_)
+        {
+            progress_->addFrontend([events = events_](const ProgressSample &sample) { events->sample(sample); });
+        }
+        else
+        {
+            auto display = std::make_shared<ProgressDisplay>();
+            progress_->addFrontend([display](const ProgressSample &sample) { display->render(sample); });
+        }
+    }
+    if (events_)
+    {
+        events_->beginBatch();
+    }
+    BatchSummary summary = config_.singleFlight && !pack_ ? runCoalesced(batch) : dispatch(batch);
+    progress_.reset();
+    if (events_)
+    {
+        events_->finish(summary.succeeded, summary.failed);
+    }
+    if (paths_)
+    {
+        printPathStats();
+    }
+    if (config_.showStats && destinations_)
+    {
+        printPlacementStats();
+    }
+    if (config_.showStats && pack_)
+    {
+        const PackWriter::Stats stats = pack_->stats();
+        fmt::print("Pack {}: {} objects, {:.2f} MB in {} segment(s), {} index commits\n",
+                   pack_->directory().string(), stats.objects, static_cast<double>(stats.bytes) / (1024.0 * 1024.0),
+                   stats.segments, stats.commits);
+    }
+    if (config_.showStats && directories_)
+    {
+        const DirectoryCache::Stats stats = directories_->stats();
+        fmt::print("Metadata: {} syscalls for {} files ({:.2f} per file): {} directory opens, {} mkdirs, "
+                   "{} file opens, {} renames, {} space queries\n",
+                   stats.syscalls(), stats.files,
+                   stats.files > 0 ? static_cast<double>(stats.syscalls()) / static_cast<double>(stats.files) : 0.0,
+                   stats.directoryOpens, stats.mkdirs, stats.fileOpens, stats.renames, stats.spaceQueries);
+    }
+    if (config_.showStats || memory_->limit() != 0)
+    {
+        printMemoryStats();
+    }
+    if (config_.showStats && partLocks_)
+    {
+        const PartLocks::Stats stats = partLocks_->stats();
+        fmt::print("Part locks: {} taken, {} files found busy in another process, {} fetched there for us\n",
+                   stats.claims, stats.waits, stats.finished);
+    }
+    if (config_.showStats && events_)
+    {
+        const EventStream::Stats stats = events_->stats();
+        fmt::print("Events: {} lines ({:.1f} KB) written, {} dropped\n", stats.events,
+                   static_cast<double>(stats.bytes) / 1024.0, stats.dropped);
+    }
+    if (config_.showStats && durability_)
+    {
+        const Durability::Stats stats = durability_->stats();
+        fmt::print("Durability ({}): {} files in {} batches, {} data syncs, {} directory syncs, "
+                   "{} copied from scratch\n",
+                   durabilityModeName(durability_->mode()), stats.files, stats.batches, stats.dataSyncs,
+                   stats.directorySyncs, stats.copiedAcross);
+    }
+    return summary;
+}
+
+BatchSummary BatchRunner::dispatch(const std::vector<DownloadJob> &jobs)
+{
+    return config_.shards > 0 ? runSharded(jobs) : runSequential(jobs);
+}
+
+BatchSummary BatchRunner::runCoalesced(const std::vector<DownloadJob> &jobs)
+{
+    const FlightPlan plan = coalesceJobs(jobs, config_.pipelineSpec);
+    if (plan.duplicates() == 0)
+    {
+        return dispatch(jobs);
+    }
+    fmt::print("Single-flight: {} jobs need {} distinct fetches\n", jobs.size(), plan.leaders.size());
+    if (events_)
+    {
+        events_->beginBatch(plan.leaderJob);
+    }
+    const BatchSummary fetched = dispatch(plan.leaders);
+    if (events_)
+    {
+        events_->beginBatch(); // Followers are reported by their own index
+    }
+
+    BatchSummary summary;
+    summary.locations.resize(jobs.size());
+    std::vector<bool> failed(plan.leaders.size(), false);
+    for (size_t index : fetched.failedJobs)
+    {
+        failed[index] = true;
+    }
+    auto fail = [&](size_t job, const std::string &error)
+    {
+        ++summary.failed;
+        summary.failedJobs.push_back(job);
+        if (events_)
+        {
+            events_->complete(job, false, 0, 0, "", error);
+        }
+    };
+
+    size_t linked = 0;
+    size_t copied = 0;
+    for (size_t i = 0; i < plan.leaders.size(); ++i)
+    {
+        const DownloadJob &leader = jobs[plan.leaderJob[i]];
+        if (failed[i])
+        {
+            // The leader's own complete event went out when it failed
+            ++summary.failed;
+            summary.failedJobs.push_back(plan.leaderJob[i]);
+            for (size_t follower : plan.followers[i])
+            {
+                fmt::print(stderr, "✗ {}: not fetched (shared with {})\n", jobs[follower].destination,
+                           leader.destination);
+                fail(follower, "not fetched (shared with " + leader.destination + ")");
+            }
+            continue;
+        }
+
+        const std::string &source = fetched.locations[i];
+        ++summary.succeeded;
+        summary.locations[plan.leaderJob[i]] = source;
+        for (size_t follower : plan.followers[i])
+        {
+            // Placed and named the way the follower would have been downloaded
+            std::filesystem::path target = jobs[follower].destination;
+            if (destinations_)
+            {
+                std::optional<std::filesystem::path> pooled = destinations_->place(target);
+                if (!pooled)
+                {
+                    fmt::print(stderr, "✗ {}: outside the destination roots\n", jobs[follower].destination);
+                    fail(follower, "Destination is outside the destination roots");
+                    continue;
+                }
+                target = *pooled;
+            }
+            if (config_.storeZstd)
+            {
+                target += ".zst";
+            }
+
+            bool wasLinked = false;
+            std::string error;
+            if (!shareDownload(source, target, wasLinked, error))
+            {
+                fmt::print(stderr, "✗ {}: {}\n", jobs[follower].url, error);
+                fail(follower, error);
+                continue;
+            }
+            ++(wasLinked ? linked : copied);
+            fmt::print("✓ {} ({} {})\n", target.string(), wasLinked ? "linked to" : "copied from", source);
+            ++summary.succeeded;
+            summary.locations[follower] = target.string();
+            if (events_)
+            {
+                events_->complete(follower, true, 0, 0, target.string(), "");
+            }
+        }
+    }
+    fmt::print("Single-flight: {} duplicate jobs served from {} fetches ({} linked, {} copied)\n",
+               plan.duplicates(), plan.leaders.size(), linked, copied);
+    return summary;
+}
+
+BatchSummary BatchRunner::runSequential(const std::vector<DownloadJob> &jobs)
+{
+    BatchSummary summary;
+    summary.locations.resize(jobs.size());
+
+    // Declaration order matters: the prefetcher's clients and ours must be
+    // gone before the share handle they are attached to is cleaned up
+    CurlShare share;
+    HttpClient client(networkCache_);
+    client.setShare(share);
+    client.setMaxRetries(config_.maxRetries);
+    client.setKernelTls(config_.kernelTls);
+    client.setZeroCopy(config_.zeroCopy);
+    client.setPageCachePolicy(config_.pageCache);
+    client.setScratchDir(config_.scratchDir);
+    client.setLeavePartFile(true); // The pipeline's Land stage renames it (with group commit if batched)
+    client.setCaCertFile(config_.caCertFile);
+
+    std::unique_ptr<Prefetcher> prefetcher;
+    if (config_.prefetchDepth > 0)
+    {
+        prefetcher = std::make_unique<Prefetcher>(jobs, share, networkCache_,
+                                                  static_cast<size_t>(config_.prefetchDepth),
+                                                  config_.caCertFile);
+    }
+
+    // Post-processing runs on the pool, off the download thread; counters are shared with it
+    std::atomic<size_t> succeeded{0};
+    std::atomic<size_t> failed{0};
+    std::mutex summaryMutex;
+    auto recordFailure = [&](size_t index)
+    {
+        ++failed;
+        std::lock_guard<std::mutex> lock(summaryMutex);
+        summary.failedJobs.push_back(index);
+    };
+    auto recordSuccess = [&](size_t index, const std::string &location)
+    {
+        ++succeeded;
+        std::lock_guard<std::mutex> lock(summaryMutex);
+        summary.locations[index] = location;
+    };
+    // Pooled destinations are resolved per job; the pipeline keeps references into this
+    std::vector<DownloadJob> placed = jobs;
+    auto releasePart = [&](size_t index)
+    {
+        if (partLocks_)
+        {
+            partLocks_->release(stagingPath(placed[index].destination, config_.scratchDir));
+        }
+    };
+    WorkStealingPool postProcessing(static_cast<size_t>(config_.postProcessThreads));
+    Pipeline pipeline(postProcessing, config_.pipelineSpec, Pipeline::parseStageLimits(config_.stageLimits),
+                      [&](TransferResult result)
+                      {
+                          releasePart(result.jobIndex);
+                          if (!reportResult(jobs[result.jobIndex], result))
+                          {
+                              recordFailure(result.jobIndex);
+                              return;
+                          }
+                          recordSuccess(result.jobIndex, result.location);
+                      },
+                      memory_, durability_);
+    pipeline.setEventStream(events_);
+
+    // Jobs another process is fetching go to the back of the queue instead of holding up the rest
+    std::deque<size_t> queue(jobs.size());
+    std::iota(queue.begin(), queue.end(), size_t{0});
+    std::vector<bool> deferred(jobs.size(), false);
+    size_t busyInARow = 0;
+    while (!queue.empty())
+    {
+        const size_t i = queue.front();
+        queue.pop_front();
+        DownloadJob &job = placed[i];
+        if (destinations_ && !deferred[i])
+        {
+            std::optional<std::filesystem::path> pooled = destinations_->place(job.destination);
+            if (!pooled)
+            {
+                const std::string error = "Destination is outside the destination roots";
+                fmt::print(stderr, "✗ {}: {}\n", job.destination, error);
+                if (events_)
+                {
+                    events_->complete(i, false, 0, 0, "", error);
+                }
+                recordFailure(i);
+                continue;
+            }
+            job.destination = pooled->string();
+        }
+        if (!deferred[i])
+        {
+            fmt::print("[{}/{}] {} -> {}\n", i + 1, jobs.size(), job.url, job.destination);
+        }
+
+        if (partLocks_)
+        {
+            // Another process writing this destination: come back to it rather than race on the .part
+            const std::filesystem::path partPath = stagingPath(job.destination, config_.scratchDir);
+            const PartLocks::Claim claim = partLocks_->tryClaim(partPath, job.destination);
+            if (claim == PartLocks::Claim::Busy)
+            {
+                if (!deferred[i])
+                {
+                    fmt::print("  Another process is fetching {}; coming back to it\n", job.destination);
+                    deferred[i] = true;
+                }
+                queue.push_back(i);
+                // Nothing left but jobs others hold: wait before asking again
+                if (++busyInARow >= queue.size())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(PartLocks::POLL_INTERVAL_MS));
+                    busyInARow = 0;
+                }
+                continue;
+            }
+            busyInARow = 0;
+            if (claim == PartLocks::Claim::Finished)
+            {
+                // Landed and post-processed by the other process; only checked against our checksum
+                TransferResult done;
+                done.jobIndex = i;
+                done.success = true;
+                done.location = job.destination;
+                if (job.expectedChecksum)
+                {
+                    pipeline.submit(job, std::move(done), job.destination, true);
+                    continue;
+                }
+                reportResult(job, done);
+                recordSuccess(i, done.location);
+                continue;
+            }
+        }
+
+        std::optional<RemoteMetadata> metadata;
+        if (prefetcher)
+        {
+            metadata = prefetcher->take(i);
+        }
+
+        size_t path = 0;
+        if (paths_)
+        {
+            path = paths_->choose();
+            client.setInterface(paths_->interfaceName(path));
+        }
+        const auto started = std::chrono::steady_clock::now();
+        if (events_)
+        {
+            events_->start(i, job.url, job.destination);
+        }
+        client.setProgress(progress_, events_, i);
+
+        const bool ok = client.downloadFile(job.url, job.destination, config_.timeoutSeconds,
+                                            metadata ? &*metadata : nullptr);
+        if (paths_)
+        {
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+            // HTTP errors and local failures say nothing about the path, as in the sharded engine
+            if (!ok && client.lastFailureWasNetwork())
+            {
+                paths_->recordFailure(path);
+            }
+            else
+            {
+                paths_->record(path, ok ? client.getLastTransferStats().bytes : 0, elapsed.count());
+            }
+        }
+
+        if (!ok)
+        {
+            fmt::print(stderr, "✗ Download failed: {}\n", client.getLastError());
+            if (events_)
+            {
+                events_->complete(i, false, 0, 0, "", client.getLastError());
+            }
+            releasePart(i);
+            recordFailure(i);
+            continue;
+        }
+
+        if (config_.showStats)
+        {
+            fmt::print("  {}\n", formatTransferStats(client.getLastTransferStats()));
+        }
+
+        // Backpressure: don't start the next download while post-processing is behind
+        pipeline.waitForBacklogBelow(static_cast<size_t>(std::max(1, config_.pipelineBacklog)));
+
+        TransferResult downloaded;
+        downloaded.jobIndex = i;
+        downloaded.success = true;
+        downloaded.bytes = client.getLastTransferStats().bytes;
+        downloaded.retries = client.getRetryCount();
+        pipeline.submit(job, std::move(downloaded), client.getLastOutputPath());
+    }
+
+    pipeline.waitForBacklogBelow(1);
+    summary.succeeded = succeeded;
+    summary.failed = failed;
+    return summary;
+}
+
+BatchSummary BatchRunner::runSharded(const std::vector<DownloadJob> &jobs)
+{
+    BatchSummary summary;
+    summary.locations.resize(jobs.size());
+
+    EngineOptions options;
+    options.shardCount = static_cast<size_t>(config_.shards);
+    options.maxActivePerShard = static_cast<size_t>(config_.transfersPerShard);
+    options.pinThreads = config_.pinThreads;
+    options.maxRetries = config_.maxRetries;
+    options.timeoutSeconds = config_.timeoutSeconds;
+    options.caCertFile = config_.caCertFile;
+    options.postProcessThreads = static_cast<size_t>(config_.postProcessThreads);
+    options.pipelineSpec = config_.pipelineSpec;
+    options.stageLimits = config_.stageLimits;
+    options.pipelineBacklog = static_cast<size_t>(std::max(1, config_.pipelineBacklog));
+    options.paths = paths_;
+    options.maxOpenFiles = static_cast<size_t>(config_.maxOpenFiles);
+    options.memory = memory_;
+    options.pageCache = config_.pageCache;
+    options.diskLatencyTarget = std::chrono::milliseconds(config_.diskLatencyMs);
+    options.durability = durability_;
+    options.scratchDir = config_.scratchDir;
+    options.destinations = destinations_;
+    options.preallocate = destinations_ != nullptr;
+    options.pack = pack_;
+    options.directories = directories_;
+    options.storeZstd = config_.storeZstd;
+    options.zstd.level = config_.zstdLevel;
+    options.zstd.threads = static_cast<size_t>(config_.zstdThreads);
+    options.zstd.frameBytes = static_cast<size_t>(config_.zstdFrameKb) * 1024;
+    options.partLocks = partLocks_;
+    options.discoverChecksums = config_.discoverChecksums;
+    options.events = events_;
+    options.progress = progress_;
+
+    fmt::print("Running {} jobs on {} shard(s), up to {} transfers each\n",
+               jobs.size(), options.shardCount, options.maxActivePerShard);
+
+    TransferEngine engine(options, networkCache_);
+    engine.run(jobs, [&](const TransferResult &result)
+               {
+        if (!reportResult(jobs[result.jobIndex], result))
+        {
+            ++summary.failed;
+            summary.failedJobs.push_back(result.jobIndex);
+            return;
+        }
+        ++summary.succeeded;
+        summary.locations[result.jobIndex] = result.location; });
+
+    if (config_.showStats)
+    {
+        const FdCache::Stats &files = engine.fileCacheStats();
+        fmt::print("Output files: {} opens, {} cached writes, {} evictions ({} descriptors per shard)\n",
+                   files.opens, files.hits, files.evictions, engine.openFilesPerShard());
+        for (const DiskAdmission::VolumeStats &volume : engine.diskAdmission().snapshot())
+        {
+            fmt::print("Volume {}: {:.2f} MB written, {:.2f} MB/s, {:.2f} ms/sync, "
+                       "limit {} (peak {} active, cut {} times)\n",
+                       volume.example, static_cast<double>(volume.bytes) / (1024.0 * 1024.0),
+                       volume.bytesPerSecond / (1024.0 * 1024.0), volume.latencyMs, volume.limit,
+                       volume.peakActive, volume.throttles);
+        }
+    }
+    return summary;
+}
+
+void BatchRunner::printMemoryStats() const
+{
+    if (memory_->limit() == 0)
+    {
+        fmt::print("\nBuffer memory (unlimited):\n");
+    }
+    else
+    {
+        fmt::print("\nBuffer memory (budget {:.1f} MB, {} pauses):\n",
+                   static_cast<double>(memory_->limit()) / (1024.0 * 1024.0), memory_->pauses());
+    }
+    for (const MemoryBudget::StageUsage &stage : memory_->usage())
+    {
+        fmt::print("  {:<14} current {:>8.2f} MB, peak {:>8.2f} MB\n", stage.name,
+                   static_cast<double>(stage.current) / (1024.0 * 1024.0),
+                   static_cast<double>(stage.peak) / (1024.0 * 1024.0));
+    }
+
+    const BufferArena::Stats arena = BufferArena::instance().stats();
+    fmt::print("  arena: {} slabs ({} on huge pages), {} buffers handed out, {} reused in-thread, "
+               "{} returned cross-thread, {} oversized\n",
+               arena.slabs, arena.hugePageSlabs, arena.allocations, arena.localReuses, arena.remoteFrees,
+               arena.oversized);
+}
+
+bool BatchRunner::reportResult(const DownloadJob &job, const TransferResult &result) const
+{
+    if (events_)
+    {
+        events_->complete(result.jobIndex, result.success, result.bytes, result.retries,
+                          result.success && result.location.empty() ? job.destination : result.location,
+                          result.error);
+    }
+    if (!result.success)
+    {
+        fmt::print(stderr, "✗ {}: {}\n", job.url, result.error);
+        return false;
+    }
+
+    fmt::print("✓ {} ({:.2f} MB{})\n", result.location.empty() ? job.destination : result.location,
+               static_cast<double>(result.bytes) / (1024.0 * 1024.0),
+               result.retries > 0 ? fmt::format(", {} retries", result.retries) : "");
+    return true;
+}
+
+void BatchRunner::printPlacementStats() const
+{
+    fmt::print("\nDestination roots:\n");
+    for (const DestinationPool::RootStats &stats : destinations_->snapshot())
+    {
+        fmt::print("  {:<32} {:>6} files, {:>10.2f} GB free, {:>8.2f} MB/s\n", stats.root, stats.files,
+                   static_cast<double>(stats.availableBytes) / (1024.0 * 1024.0 * 1024.0),
+                   stats.bytesPerSecond / (1024.0 * 1024.0));
+    }
+}
+
+void BatchRunner::printPathStats() const
+{
+    fmt::print("\nPer-path throughput:\n");
+    for (const PathSelector::PathStats &stats : paths_->snapshot())
+    {
+        fmt::print("  {:<24} {:>5} transfers, {:>3} failed, {:>10.2f} MB, {:>8.2f} MB/s\n",
+                   stats.name, stats.transfers, stats.failures,
+                   static_cast<double>(stats.bytes) / (1024.0 * 1024.0),
+                   stats.bytesPerSecond / (1024.0 * 1024.0));
+    }
+}
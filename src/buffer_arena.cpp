@@ -0,0 +1,335 @@
+#include "buffer_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    /**
+     * How many of the given slabs the kernel has actually backed with
+     * transparent huge pages: per mapping in /proc/self/smaps, at most
+     * AnonHugePages / slab size of the slabs inside it.
+     */
+    size_t countTransparentHugeSlabs(std::vector<const char *> slabs, size_t slabSize)
+    {
+        size_t backed = 0;
+#ifdef __linux__
+        std::sort(slabs.begin(), slabs.end());
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        size_t inMapping = 0;
+        while (std::getline(smaps, line))
+        {
+            unsigned long start = 0;
+            unsigned long end = 0;
+            unsigned long hugeKb = 0;
+            if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2)
+            {
+                inMapping = static_cast<size_t>(
+                    std::lower_bound(slabs.begin(), slabs.end(), reinterpret_cast<const char *>(end)) -
+                    std::lower_bound(slabs.begin(), slabs.end(), reinterpret_cast<const char *>(start)));
+            }
+            else if (inMapping > 0 && std::sscanf(line.c_str(), "AnonHugePages: %lu kB", &hugeKb) == 1)
+            {
+                backed += std::min(inMapping, static_cast<size_t>(hugeKb) * 1024 / slabSize);
+                inMapping = 0;
+            }
+        }
+#else
+        (void)slabs;
+        (void)slabSize;
+#endif
+        return backed;
+    }
+}
+
+struct ArenaBuffer::Block
+{
+    char *data = nullptr;
+    size_t sizeClass = 0;
+    std::atomic<BufferArena::ThreadCache *> owner{nullptr}; // Cache that handed it out
+    Block *next = nullptr;                                   // Link in a return stack
+};
+
+/**
+ * One thread's free lists. Only the owning thread touches `free`; other
+ * threads push onto `returned`, which the owner empties in one exchange.
+ */
+struct BufferArena::ThreadCache
+{
+    std::array<std::vector<Block *>, CLASS_SIZES.size()> free;
+    std::array<std::atomic<Block *>, CLASS_SIZES.size()> returned{};
+};
+
+ArenaBuffer::ArenaBuffer(ArenaBuffer &&other) noexcept
+    : block_(other.block_), data_(other.data_), size_(other.size_)
+{
+    other.block_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+ArenaBuffer &ArenaBuffer::operator=(ArenaBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        block_ = other.block_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.block_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void ArenaBuffer::reset()
+{
+    if (block_)
+    {
+        BufferArena::instance().free(block_);
+    }
+    else
+    {
+        delete[] data_;
+    }
+    block_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+BufferArena &BufferArena::instance()
+{
+    // Deliberately leaked: buffers may still be returned by threads and
+    // static objects that outlive main(); the OS reclaims the slabs
+    static BufferArena *arena = new BufferArena();
+    return *arena;
+}
+
+BufferArena::~BufferArena() = default;
+
+BufferArena::ThreadCache &BufferArena::cache()
+{
+    // Hands the cache (and whatever it holds) to the next new thread on exit
+    struct Slot
+    {
+        ThreadCache *cache = nullptr;
+
+        ~Slot()
+        {
+            if (cache)
+            {
+                BufferArena &arena = instance();
+                std::lock_guard<std::mutex> lock(arena.mutex_);
+                arena.orphans_.push_back(cache);
+            }
+        }
+    };
+    thread_local Slot slot;
+
+    if (!slot.cache)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!orphans_.empty())
+        {
+            slot.cache = orphans_.back();
+            orphans_.pop_back();
+        }
+        else
+        {
+            caches_.push_back(std::make_unique<ThreadCache>());
+            slot.cache = caches_.back().get();
+        }
+    }
+    return *slot.cache;
+}
+
+ArenaBuffer BufferArena::allocate(size_t bytes)
+{
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+
+    const auto fits = std::lower_bound(CLASS_SIZES.begin(), CLASS_SIZES.end(), bytes);
+    if (fits == CLASS_SIZES.end())
+    {
+        oversized_.fetch_add(1, std::memory_order_relaxed);
+        char *data = new (std::nothrow) char[bytes];
+        return data ? ArenaBuffer(nullptr, data, bytes) : ArenaBuffer();
+    }
+    const auto sizeClass = static_cast<size_t>(fits - CLASS_SIZES.begin());
+
+    ThreadCache &local = cache();
+    std::vector<Block *> &free = local.free[sizeClass];
+    if (free.empty())
+    {
+        if (!refill(local, sizeClass))
+        {
+            return ArenaBuffer(); // Out of memory: the caller fails or waits, nothing throws
+        }
+    }
+    else
+    {
+        localReuses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Block *block = free.back();
+    free.pop_back();
+    return ArenaBuffer(block, block->data, bytes);
+}
+
+void BufferArena::free(Block *block)
+{
+    ThreadCache &local = cache();
+    ThreadCache *owner = block->owner.load(std::memory_order_relaxed);
+    if (owner != &local)
+    {
+        // Another thread's buffer: hand it back without touching its free list
+        remoteFrees_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic<Block *> &returned = owner->returned[block->sizeClass];
+        block->next = returned.load(std::memory_order_relaxed);
+        while (!returned.compare_exchange_weak(block->next, block, std::memory_order_release,
+                                               std::memory_order_relaxed))
+        {
+        }
+        return;
+    }
+
+    std::vector<Block *> &free = local.free[block->sizeClass];
+    free.push_back(block);
+    if (free.size() > LOCAL_LIMIT)
+    {
+        // Don't let one thread hoard what others could use
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Block *> &spare = spare_[block->sizeClass];
+        for (size_t i = 0; i < LOCAL_LIMIT / 2; ++i)
+        {
+            free.back()->owner.store(nullptr, std::memory_order_relaxed);
+            spare.push_back(free.back());
+            free.pop_back();
+        }
+    }
+}
+
+bool BufferArena::refill(ThreadCache &local, size_t sizeClass)
+{
+    std::vector<Block *> &free = local.free[sizeClass];
+
+    // Buffers other threads freed on our behalf come first
+    Block *returned = local.returned[sizeClass].exchange(nullptr, std::memory_order_acquire);
+    for (; returned; returned = returned->next)
+    {
+        free.push_back(returned);
+    }
+    if (!free.empty())
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Block *> &spare = spare_[sizeClass];
+    if (spare.empty() && !carveSlab(sizeClass))
+    {
+        return false;
+    }
+    const size_t take = std::min(REFILL_BATCH, spare.size());
+    for (size_t i = 0; i < take; ++i)
+    {
+        spare.back()->owner.store(&local, std::memory_order_relaxed);
+        free.push_back(spare.back());
+        spare.pop_back();
+    }
+    return true;
+}
+
+bool BufferArena::carveSlab(size_t sizeClass)
+{
+    char *slab = mapSlab();
+    if (!slab)
+    {
+        return false;
+    }
+    const size_t count = SLAB_SIZE / CLASS_SIZES[sizeClass];
+
+    std::unique_ptr<Block[]> blocks(new (std::nothrow) Block[count]);
+    if (!blocks)
+    {
+        return false; // The slab stays mapped but unused; the next carve maps another
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        blocks[i].data = slab + i * CLASS_SIZES[sizeClass];
+        blocks[i].sizeClass = sizeClass;
+        spare_[sizeClass].push_back(&blocks[i]);
+    }
+    blockTables_.push_back(std::move(blocks));
+    slabs_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+char *BufferArena::mapSlab()
+{
+#ifdef __linux__
+    if (hugePages_.load(std::memory_order_relaxed))
+    {
+        // Reserved hugetlbfs pages first (SLAB_SIZE is one 2 MiB page)
+        void *huge = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED)
+        {
+            hugePageSlabs_.fetch_add(1, std::memory_order_relaxed);
+            return static_cast<char *>(huge);
+        }
+
+        // Otherwise ask for transparent huge pages on a 2 MiB-aligned region
+        void *raw = mmap(nullptr, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        const auto start = reinterpret_cast<uintptr_t>(raw);
+        const uintptr_t aligned = (start + SLAB_SIZE - 1) & ~(uintptr_t{SLAB_SIZE} - 1);
+        if (aligned > start)
+        {
+            munmap(raw, aligned - start);
+        }
+        munmap(reinterpret_cast<void *>(aligned + SLAB_SIZE), start + 2 * SLAB_SIZE - aligned - SLAB_SIZE);
+        // Only a request: stats() checks which slabs the kernel really backed
+        if (madvise(reinterpret_cast<void *>(aligned), SLAB_SIZE, MADV_HUGEPAGE) == 0)
+        {
+            thpSlabs_.push_back(reinterpret_cast<const char *>(aligned));
+        }
+        return reinterpret_cast<char *>(aligned);
+    }
+
+    void *slab = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return slab == MAP_FAILED ? nullptr : static_cast<char *>(slab);
+#else
+    return new (std::nothrow) char[SLAB_SIZE];
+#endif
+}
+
+BufferArena::Stats BufferArena::stats() const
+{
+    Stats result;
+    result.slabs = slabs_.load(std::memory_order_relaxed);
+    std::vector<const char *> thpSlabs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        thpSlabs = thpSlabs_;
+    }
+    result.hugePageSlabs = hugePageSlabs_.load(std::memory_order_relaxed) +
+                           countTransparentHugeSlabs(std::move(thpSlabs), SLAB_SIZE);
+    result.allocations = allocations_.load(std::memory_order_relaxed);
+    result.localReuses = localReuses_.load(std::memory_order_relaxed);
+    result.remoteFrees = remoteFrees_.load(std::memory_order_relaxed);
+    result.oversized = oversized_.load(std::memory_order_relaxed);
+    return result;
+}
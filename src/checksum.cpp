@@ -12,6 +12,25 @@
 #include <openssl/sha.h>
 
 std::string ChecksumVerifier::computeSHA256(const std::filesystem::path &filePath)
+{
+    return computeDigest(filePath, Algorithm::SHA256);
+}
+
+const char *ChecksumVerifier::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case Algorithm::MD5:
+        return "md5";
+    case Algorithm::SHA1:
+        return "sha1";
+    case Algorithm::SHA256:
+        break;
+    }
+    return "sha256";
+}
+
+std::string ChecksumVerifier::computeDigest(const std::filesystem::path &filePath, Algorithm algorithm)
 {
     // Step 1: Open file in binary mode
     std::ifstream file(filePath, std::ios::binary);
@@ -37,10 +56,13 @@ std::string ChecksumVerifier::computeSHA256(const std::filesystem::path &filePat
     };
     std::unique_ptr<EVP_MD_CTX, decltype(contextDeleter)> contextGuard(context, contextDeleter);
 
-    // Step 3: Initialize digest operation for SHA-256
-    if (EVP_DigestInit_ex(context, EVP_sha256(), nullptr) != 1)
+    // Step 3: Initialize digest operation for the requested algorithm
+    const EVP_MD *digest = algorithm == Algorithm::MD5    ? EVP_md5()
+                           : algorithm == Algorithm::SHA1 ? EVP_sha1()
+                                                          : EVP_sha256();
+    if (EVP_DigestInit_ex(context, digest, nullptr) != 1)
     {
-        throw std::runtime_error("Failed to initialize SHA-256 digest");
+        throw std::runtime_error(fmt::format("Failed to initialize {} digest", algorithmName(algorithm)));
     }
 
     // Step 4: Read file in chunks and update digest
@@ -52,7 +74,7 @@ std::string ChecksumVerifier::computeSHA256(const std::filesystem::path &filePat
         size_t bytesRead = static_cast<size_t>(file.gcount());
         if (EVP_DigestUpdate(context, buffer.data(), bytesRead) != 1)
         {
-            throw std::runtime_error("Failed to update SHA-256 digest");
+            throw std::runtime_error(fmt::format("Failed to update {} digest", algorithmName(algorithm)));
         }
     }
 
@@ -62,7 +84,7 @@ std::string ChecksumVerifier::computeSHA256(const std::filesystem::path &filePat
 
     if (EVP_DigestFinal_ex(context, hash, &hashLength) != 1)
     {
-        throw std::runtime_error("Failed to finalize SHA-256 digest");
+        throw std::runtime_error(fmt::format("Failed to finalize {} digest", algorithmName(algorithm)));
     }
 
     // Step 6: Convert binary hash to hexadecimal string
@@ -76,14 +98,8 @@ bool ChecksumVerifier::verify(const std::filesystem::path &filePath,
     // Parse the checksum string to get algorithm and hash
     auto [algorithm, expectedHash] = parseChecksum(expectedChecksum);
 
-    // Only SHA-256 is implemented for now
-    if (algorithm != Algorithm::SHA256)
-    {
-        throw std::runtime_error("Only SHA-256 is currently supported");
-    }
-
     // Compute the actual checksum
-    std::string actualChecksum = computeSHA256(filePath);
+    std::string actualChecksum = computeDigest(filePath, algorithm);
 
     // Normalize both checksums (lowercase, no whitespace)
     std::string normalizedExpected = normalizeHex(expectedHash);
@@ -163,6 +179,16 @@ ChecksumVerifier::parseChecksum(const std::string &checksumString)
     return {algorithm, normalizedHex};
 }
 
+std::filesystem::path ChecksumVerifier::quarantine(const std::filesystem::path &filePath)
+{
+    std::filesystem::path quarantinePath = filePath.parent_path() / "quarantine";
+    std::filesystem::create_directories(quarantinePath);
+
+    std::filesystem::path quarantineFile = quarantinePath / filePath.filename();
+    std::filesystem::rename(filePath, quarantineFile);
+    return quarantineFile;
+}
+
 std::string ChecksumVerifier::toHex(const std::vector<unsigned char> &data)
 {
     std::ostringstream oss;
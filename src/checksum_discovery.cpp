@@ -0,0 +1,373 @@
+#include "checksum_discovery.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+
+#include <openssl/evp.h>
+
+#include <fmt/core.h>
+
+namespace
+{
+    std::string lowerCase(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    std::string trim(const std::string &text)
+    {
+        const size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+        {
+            return "";
+        }
+        return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+    bool isHex(const std::string &text, size_t length)
+    {
+        return text.size() == length &&
+               std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isxdigit(c) != 0; });
+    }
+
+    // Preference among offered algorithms (higher wins); 0 = not supported
+    int rankOf(const std::string &algorithm)
+    {
+        return algorithm == "sha256" ? 3 : algorithm == "sha1" ? 2 : algorithm == "md5" ? 1 : 0;
+    }
+
+    size_t digestBytes(const std::string &algorithm)
+    {
+        return algorithm == "sha256" ? 32 : algorithm == "sha1" ? 20 : 16;
+    }
+
+    // "sha-256" (RFC 9530), "SHA-256" (RFC 3230), "SHA" ... -> our checksum names
+    std::string checksumName(const std::string &token)
+    {
+        const std::string name = lowerCase(token);
+        if (name == "sha-256")
+        {
+            return "sha256";
+        }
+        if (name == "sha")
+        {
+            return "sha1";
+        }
+        return name == "md5" ? "md5" : "";
+    }
+
+    std::string percentDecode(const std::string &text)
+    {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] == '%' && i + 2 < text.size() && std::isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+                std::isxdigit(static_cast<unsigned char>(text[i + 2])))
+            {
+                decoded.push_back(static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else
+            {
+                decoded.push_back(text[i]);
+            }
+        }
+        return decoded;
+    }
+
+    size_t writeToString(char *ptr, size_t size, size_t nmemb, void *userdata)
+    {
+        static_cast<std::string *>(userdata)->append(ptr, size * nmemb);
+        return size * nmemb;
+    }
+}
+
+std::string base64ToHex(const std::string &text, size_t bytes)
+{
+    if (text.empty() || text.size() % 4 != 0)
+    {
+        return "";
+    }
+    std::string decoded(text.size() / 4 * 3, '\0');
+    const int length = EVP_DecodeBlock(reinterpret_cast<unsigned char *>(decoded.data()),
+                                       reinterpret_cast<const unsigned char *>(text.data()),
+                                       static_cast<int>(text.size()));
+    // EVP_DecodeBlock counts the padding as zero bytes
+    const size_t padding = static_cast<size_t>(std::count(text.end() - 2, text.end(), '='));
+    if (length < 0 || static_cast<size_t>(length) - padding != bytes)
+    {
+        return "";
+    }
+    static const char HEX[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(bytes * 2);
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        const auto byte = static_cast<unsigned char>(decoded[i]);
+        hex.push_back(HEX[byte >> 4]);
+        hex.push_back(HEX[byte & 0x0f]);
+    }
+    return hex;
+}
+
+std::optional<std::string> parseDigestHeader(const std::string &name, const std::string &value)
+{
+    const std::string header = lowerCase(name);
+    if (header == "content-md5")
+    {
+        const std::string hex = base64ToHex(trim(value), 16);
+        return hex.empty() ? std::nullopt : std::optional<std::string>("md5:" + hex);
+    }
+
+    const bool structured = header == "repr-digest" || header == "content-digest";
+    if (!structured && header != "digest")
+    {
+        return std::nullopt;
+    }
+
+    // "alg=:BASE64:, alg=:BASE64:" (structured) or "ALG=BASE64,ALG=BASE64"
+    std::optional<std::string> best;
+    int bestRank = 0;
+    std::stringstream members(value);
+    std::string member;
+    while (std::getline(members, member, ','))
+    {
+        const size_t equals = member.find('=');
+        if (equals == std::string::npos)
+        {
+            continue;
+        }
+        const std::string algorithm = checksumName(trim(member.substr(0, equals)));
+        std::string encoded = trim(member.substr(equals + 1));
+        if (structured)
+        {
+            encoded = encoded.substr(0, encoded.find(';')); // Parameters follow the byte sequence
+            if (encoded.size() < 2 || encoded.front() != ':' || encoded.back() != ':')
+            {
+                continue;
+            }
+            encoded = encoded.substr(1, encoded.size() - 2);
+        }
+        const int rank = rankOf(algorithm);
+        if (rank <= bestRank)
+        {
+            continue;
+        }
+        const std::string hex = base64ToHex(encoded, digestBytes(algorithm));
+        if (!hex.empty())
+        {
+            best = algorithm + ":" + hex;
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+std::optional<std::string> announcedDigest(CURL *easy, bool partial)
+{
+    std::optional<std::string> best;
+    int bestRank = 0;
+    for (const char *name : {"Repr-Digest", "Content-Digest", "Digest", "Content-MD5"})
+    {
+        if (partial && (std::strcmp(name, "Content-Digest") == 0 || std::strcmp(name, "Content-MD5") == 0))
+        {
+            continue;
+        }
+        struct curl_header *header = nullptr;
+        if (curl_easy_header(easy, name, 0, CURLH_HEADER, -1, &header) != CURLHE_OK || !header->value)
+        {
+            continue;
+        }
+        std::optional<std::string> digest = parseDigestHeader(name, header->value);
+        if (!digest)
+        {
+            continue;
+        }
+        const int rank = rankOf(digest->substr(0, digest->find(':')));
+        if (rank > bestRank)
+        {
+            best = std::move(digest);
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+std::map<std::string, std::string> parseSumsFile(const std::string &text)
+{
+    std::map<std::string, std::string> sums;
+    std::stringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::string name;
+        std::string hash;
+        if (line.rfind("SHA256 (", 0) == 0)
+        {
+            // BSD: "SHA256 (name) = hash"
+            const size_t close = line.rfind(") = ");
+            if (close == std::string::npos)
+            {
+                continue;
+            }
+            name = line.substr(8, close - 8);
+            hash = trim(line.substr(close + 4));
+        }
+        else
+        {
+            // GNU: "hash  name" (text mode) or "hash *name" (binary mode)
+            const size_t space = line.find_first_of(" \t");
+            if (space == std::string::npos)
+            {
+                continue;
+            }
+            hash = line.substr(0, space);
+            if (!hash.empty() && hash[0] == '\\')
+            {
+                hash.erase(0, 1); // sha256sum escapes lines whose name has a backslash or newline
+            }
+            name = line.substr(space + 1);
+            if (!name.empty() && (name[0] == ' ' || name[0] == '*'))
+            {
+                name.erase(0, 1);
+            }
+        }
+
+        if (name.rfind("./", 0) == 0)
+        {
+            name.erase(0, 2);
+        }
+        if (!name.empty() && isHex(hash, 64))
+        {
+            sums[name] = lowerCase(hash);
+        }
+    }
+    return sums;
+}
+
+ChecksumDiscovery::ChecksumDiscovery(int timeoutSeconds, std::string caCertFile,
+                                     std::shared_ptr<NetworkCache> networkCache)
+    : timeoutSeconds_(timeoutSeconds), caCertFile_(std::move(caCertFile)), networkCache_(std::move(networkCache))
+{
+}
+
+size_t ChecksumDiscovery::fill(std::vector<DownloadJob> &jobs)
+{
+    // Directory URL -> jobs in it that need a checksum (sorted, so directories are asked in order)
+    std::map<std::string, std::vector<size_t>> byDirectory;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const std::string &url = jobs[i].url;
+        const size_t slash = url.rfind('/');
+        if (jobs[i].expectedChecksum || slash == std::string::npos || slash + 1 == url.size() ||
+            url.find_first_of("?#", slash) != std::string::npos)
+        {
+            continue; // Already known, or not a plain file URL
+        }
+        byDirectory[url.substr(0, slash + 1)].push_back(i);
+    }
+    if (byDirectory.empty())
+    {
+        return 0;
+    }
+
+    std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(), curl_easy_cleanup);
+    if (!curl)
+    {
+        return 0;
+    }
+    curl_easy_setopt(curl.get(), CURLOPT_USERAGENT, "DownloadManager/1.90");
+    curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl.get(), CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl.get(), CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, static_cast<long>(timeoutSeconds_));
+    curl_easy_setopt(curl.get(), CURLOPT_ACCEPT_ENCODING, ""); // Sums files compress well
+    curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, writeToString);
+    if (!caCertFile_.empty())
+    {
+        curl_easy_setopt(curl.get(), CURLOPT_CAINFO, caCertFile_.c_str());
+    }
+    if (networkCache_)
+    {
+        networkCache_->applyTo(curl.get());
+    }
+
+    const size_t before = stats_.found;
+    for (const auto &[directory, waiting] : byDirectory)
+    {
+        ++stats_.directories;
+        if (std::optional<std::string> body = fetch(curl.get(), directory + "SHA256SUMS"))
+        {
+            ++stats_.sumsFiles;
+            const std::map<std::string, std::string> sums = parseSumsFile(*body);
+            for (size_t index : waiting)
+            {
+                DownloadJob &job = jobs[index];
+                auto found = sums.find(percentDecode(job.url.substr(directory.size())));
+                if (found != sums.end())
+                {
+                    job.expectedChecksum = "sha256:" + found->second;
+                    ++stats_.found;
+                }
+            }
+            continue;
+        }
+
+        // No directory-wide file: look for per-file ones while they keep turning up
+        size_t misses = 0;
+        for (size_t index : waiting)
+        {
+            if (misses >= PER_FILE_PROBES)
+            {
+                break;
+            }
+            DownloadJob &job = jobs[index];
+            ++stats_.perFileProbes;
+            std::optional<std::string> body = fetch(curl.get(), job.url + ".sha256");
+            std::string hash;
+            if (body)
+            {
+                // "hash  name", or just the hash
+                const std::map<std::string, std::string> sums = parseSumsFile(*body);
+                const std::string first = trim(body->substr(0, body->find_first_of(" \t\r\n")));
+                hash = !sums.empty() ? sums.begin()->second : isHex(first, 64) ? lowerCase(first) : "";
+            }
+            if (hash.empty())
+            {
+                ++misses;
+                continue;
+            }
+            misses = 0;
+            job.expectedChecksum = "sha256:" + hash;
+            ++stats_.found;
+        }
+    }
+    return stats_.found - before;
+}
+
+std::optional<std::string> ChecksumDiscovery::fetch(CURL *curl, const std::string &url)
+{
+    std::string body;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    if (curl_easy_perform(curl) != CURLE_OK)
+    {
+        return std::nullopt;
+    }
+    if (networkCache_)
+    {
+        networkCache_->captureFrom(curl, url);
+    }
+    return body;
+}
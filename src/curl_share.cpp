@@ -0,0 +1,39 @@
+#include "curl_share.hpp"
+
+#include <stdexcept>
+
+CurlShare::CurlShare() : share_(curl_share_init(), curl_share_cleanup)
+{
+    if (!share_)
+    {
+        throw std::runtime_error("Failed to initialize CURL share handle");
+    }
+
+    curl_share_setopt(share_.get(), CURLSHOPT_LOCKFUNC, lockCallback);
+    curl_share_setopt(share_.get(), CURLSHOPT_UNLOCKFUNC, unlockCallback);
+    curl_share_setopt(share_.get(), CURLSHOPT_USERDATA, this);
+
+    curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+void CurlShare::attach(CURL *curl) const
+{
+    curl_easy_setopt(curl, CURLOPT_SHARE, share_.get());
+}
+
+void CurlShare::lockCallback(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access; // Shared and exclusive access both take the mutex (simple and correct)
+
+    static_cast<CurlShare *>(userptr)->mutexes_[data].lock();
+}
+
+void CurlShare::unlockCallback(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+
+    static_cast<CurlShare *>(userptr)->mutexes_[data].unlock();
+}
@@ -0,0 +1,216 @@
+#include "destination_pool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "disk_admission.hpp"
+
+DestinationPool::DestinationPool(std::vector<std::filesystem::path> roots, std::filesystem::path indexPath)
+{
+    if (roots.empty())
+    {
+        throw std::invalid_argument("DestinationPool needs at least one root");
+    }
+
+    for (std::filesystem::path &root : roots)
+    {
+        std::filesystem::create_directories(root);
+        Root entry;
+        entry.stats.root = std::filesystem::absolute(root).lexically_normal().string();
+        roots_.push_back(std::move(entry));
+    }
+    if (indexPath.empty())
+    {
+        indexPath = std::filesystem::path(roots_.front().stats.root) / ".placement-index";
+    }
+
+    // "root<TAB>relative path" per line; entries for roots no longer in the pool are dropped
+    std::ifstream in(indexPath);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            continue;
+        }
+        const std::string root = line.substr(0, tab);
+        auto found = std::find_if(roots_.begin(), roots_.end(), [&](const Root &entry)
+                                  { return entry.stats.root == root; });
+        if (found != roots_.end())
+        {
+            index_[line.substr(tab + 1)] = static_cast<size_t>(found - roots_.begin());
+        }
+    }
+
+    indexOut_.open(indexPath, std::ios::app);
+    if (!indexOut_)
+    {
+        throw std::runtime_error(fmt::format("Cannot open placement index {}", indexPath.string()));
+    }
+}
+
+std::optional<std::filesystem::path> DestinationPool::place(const std::string &destination, DiskAdmission *disks)
+{
+    // lexically_normal() keeps leading "..": "../../etc/x" would land outside every root
+    const std::filesystem::path normal = std::filesystem::path(destination).relative_path().lexically_normal();
+    if (normal.empty() || normal == "." ||
+        std::any_of(normal.begin(), normal.end(), [](const std::filesystem::path &part)
+                    { return part == ".."; }))
+    {
+        return std::nullopt;
+    }
+    const std::string relative = normal.string();
+
+    long root = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(relative);
+        if (found != index_.end())
+        {
+            root = static_cast<long>(found->second);
+        }
+    }
+    if (root < 0)
+    {
+        root = findOnDisk(relative);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (root < 0)
+    {
+        auto found = index_.find(relative); // Another thread may have placed it meanwhile
+        if (found != index_.end())
+        {
+            root = static_cast<long>(found->second);
+        }
+        else
+        {
+            root = static_cast<long>(chooseRoot(disks));
+            index_[relative] = static_cast<size_t>(root);
+            indexOut_ << roots_[static_cast<size_t>(root)].stats.root << '\t' << relative << '\n';
+        }
+    }
+    Root &entry = roots_[static_cast<size_t>(root)];
+    ++entry.stats.files;
+    return std::filesystem::path(entry.stats.root) / relative;
+}
+
+long DestinationPool::findOnDisk(const std::string &relative) const
+{
+    for (size_t i = 0; i < roots_.size(); ++i)
+    {
+        std::error_code error;
+        const std::filesystem::path path = std::filesystem::path(roots_[i].stats.root) / relative;
+        if (std::filesystem::exists(path, error) || std::filesystem::exists(path.string() + ".part", error))
+        {
+            return static_cast<long>(i);
+        }
+    }
+    return -1;
+}
+
+void DestinationPool::refresh(DiskAdmission *disks)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (refreshedAt_ && now - *refreshedAt_ < REFRESH_INTERVAL)
+    {
+        return;
+    }
+    refreshedAt_ = now;
+    indexOut_.flush();
+
+    std::vector<DiskAdmission::VolumeStats> volumes;
+    if (disks)
+    {
+        volumes = disks->snapshot();
+    }
+    for (Root &root : roots_)
+    {
+        std::error_code error;
+        const std::filesystem::space_info space = std::filesystem::space(root.stats.root, error);
+        root.stats.availableBytes = error ? 0 : space.available;
+        root.stats.bytesPerSecond = 0.0;
+        if (disks)
+        {
+            if (!root.volume)
+            {
+                root.volume = disks->volumeFor(root.stats.root);
+            }
+            if (*root.volume < volumes.size())
+            {
+                root.stats.bytesPerSecond = volumes[*root.volume].bytesPerSecond;
+            }
+        }
+    }
+}
+
+size_t DestinationPool::chooseRoot(DiskAdmission *disks)
+{
+    refresh(disks);
+
+    double bestRate = 0.0;
+    unsigned long long mostFree = 0;
+    for (const Root &root : roots_)
+    {
+        bestRate = std::max(bestRate, root.stats.bytesPerSecond);
+        mostFree = std::max(mostFree, root.stats.availableBytes);
+    }
+
+    // Weight = throughput x share of free space; unmeasured roots are assumed
+    // as fast as the best one so they get tried
+    std::vector<double> weights(roots_.size(), 0.0);
+    double total = 0.0;
+    for (size_t i = 0; i < roots_.size(); ++i)
+    {
+        const RootStats &stats = roots_[i].stats;
+        if (stats.availableBytes < MIN_FREE_BYTES)
+        {
+            continue;
+        }
+        const double rate = stats.bytesPerSecond > 0.0 ? stats.bytesPerSecond : (bestRate > 0.0 ? bestRate : 1.0);
+        weights[i] = rate * static_cast<double>(stats.availableBytes) / static_cast<double>(mostFree);
+        total += weights[i];
+    }
+
+    if (total <= 0.0)
+    {
+        // Every root is nearly full: the emptiest one reports the error
+        auto emptiest = std::max_element(roots_.begin(), roots_.end(), [](const Root &a, const Root &b)
+                                         { return a.stats.availableBytes < b.stats.availableBytes; });
+        return static_cast<size_t>(emptiest - roots_.begin());
+    }
+
+    size_t best = roots_.size();
+    for (size_t i = 0; i < roots_.size(); ++i)
+    {
+        if (weights[i] <= 0.0)
+        {
+            continue;
+        }
+        roots_[i].credit += weights[i];
+        if (best == roots_.size() || roots_[i].credit > roots_[best].credit)
+        {
+            best = i;
+        }
+    }
+    roots_[best].credit -= total;
+    return best;
+}
+
+std::vector<DestinationPool::RootStats> DestinationPool::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<RootStats> result;
+    result.reserve(roots_.size());
+    for (const Root &root : roots_)
+    {
+        result.push_back(root.stats);
+        std::error_code error;
+        const std::filesystem::space_info space = std::filesystem::space(root.stats.root, error);
+        result.back().availableBytes = error ? 0 : space.available;
+    }
+    return result;
+}
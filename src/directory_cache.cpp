@@ -0,0 +1,180 @@
+#include "directory_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace
+{
+    std::filesystem::path directoryOf(const std::filesystem::path &path)
+    {
+        return path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    }
+}
+
+DirectoryCache::Directory::~Directory()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+DirectoryCache::DirectoryCache(size_t capacity) : capacity_(std::max<size_t>(1, capacity))
+{
+}
+
+DirectoryCache::DirectoryPtr DirectoryCache::get(const std::filesystem::path &path)
+{
+    const std::filesystem::path directory = path.empty() ? std::filesystem::path(".") : path.lexically_normal();
+    const std::string key = directory.string();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = directories_.find(key);
+        if (found != directories_.end())
+        {
+            return found->second;
+        }
+    }
+
+    auto entry = std::make_shared<Directory>();
+    size_t mkdirs = 0;
+    size_t opens = 1;
+    entry->fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    const std::filesystem::path parentPath = directoryOf(directory);
+    if (entry->fd < 0 && errno == ENOENT && parentPath != directory)
+    {
+        // Create it inside its (cached) parent, which is created first if need be
+        DirectoryPtr parent = get(parentPath);
+        if (!parent)
+        {
+            return nullptr;
+        }
+        const std::string leaf = directory.filename().string();
+        if (::mkdirat(parent->fd, leaf.c_str(), 0755) != 0 && errno != EEXIST)
+        {
+            return nullptr;
+        }
+        ++mkdirs;
+        ++opens;
+        entry->fd = ::openat(parent->fd, leaf.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (entry->fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat info{};
+    ++opens;
+    if (::fstat(entry->fd, &info) == 0)
+    {
+        entry->device = info.st_dev;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.mkdirs += mkdirs;
+    stats_.directoryOpens += opens;
+    auto [found, inserted] = directories_.emplace(key, entry);
+    if (!inserted)
+    {
+        return found->second; // Another thread got there first; ours closes on return
+    }
+    if (directories_.size() > capacity_)
+    {
+        // Any other entry will do: users hold their own reference while they need it
+        auto victim = directories_.begin();
+        if (victim->first == key)
+        {
+            ++victim;
+        }
+        directories_.erase(victim);
+        ++stats_.evictions;
+    }
+    return entry;
+}
+
+bool DirectoryCache::ensure(const std::filesystem::path &directory)
+{
+    return get(directory) != nullptr;
+}
+
+int DirectoryCache::openFile(const std::filesystem::path &path, int flags, mode_t mode)
+{
+    DirectoryPtr directory = get(directoryOf(path));
+    if (!directory)
+    {
+        return -1;
+    }
+    const int fd = ::openat(directory->fd, path.filename().c_str(), flags | O_CLOEXEC, mode);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.fileOpens;
+    if (fd >= 0 && (flags & O_CREAT))
+    {
+        ++stats_.files;
+    }
+    return fd;
+}
+
+bool DirectoryCache::rename(const std::filesystem::path &from, const std::filesystem::path &to)
+{
+    DirectoryPtr fromDirectory = get(directoryOf(from));
+    DirectoryPtr toDirectory = fromDirectory;
+    if (directoryOf(to) != directoryOf(from))
+    {
+        toDirectory = get(directoryOf(to));
+    }
+    if (!fromDirectory || !toDirectory)
+    {
+        return false;
+    }
+    const bool ok =
+        ::renameat(fromDirectory->fd, from.filename().c_str(), toDirectory->fd, to.filename().c_str()) == 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.renames;
+    return ok;
+}
+
+bool DirectoryCache::claimSpace(const std::filesystem::path &path, unsigned long long bytes)
+{
+    DirectoryPtr directory = get(path);
+    if (!directory)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsigned long long &granted = granted_[directory->device];
+        if (granted >= bytes)
+        {
+            granted -= bytes;
+            return true;
+        }
+    }
+
+    // Grant exhausted: ask the filesystem again
+    struct statvfs info{};
+    const bool queried = ::fstatvfs(directory->fd, &info) == 0;
+    const unsigned long long available =
+        queried ? static_cast<unsigned long long>(info.f_bavail) * static_cast<unsigned long long>(info.f_frsize) : 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.spaceQueries;
+    if (available < bytes)
+    {
+        return false;
+    }
+    granted_[directory->device] = std::min(available, std::max(SPACE_GRANT, bytes)) - bytes;
+    return true;
+}
+
+DirectoryCache::Stats DirectoryCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
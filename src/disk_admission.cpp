@@ -0,0 +1,168 @@
+#include "disk_admission.hpp"
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+DiskAdmission::DiskAdmission(size_t maxActive, std::chrono::milliseconds latencyTarget)
+    : maxActive_(std::max<size_t>(1, maxActive)), latencyTargetMs_(static_cast<double>(latencyTarget.count()))
+{
+}
+
+size_t DiskAdmission::volumeFor(const std::filesystem::path &directory)
+{
+    {
+        // Batches of small files share a few directories: stat each only once
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto known = directories_.find(directory.string());
+        if (known != directories_.end())
+        {
+            return known->second;
+        }
+    }
+
+    // The directory may not exist yet; its nearest existing ancestor is on the same volume
+    std::filesystem::path probe = directory.empty() ? std::filesystem::path(".") : directory;
+    struct stat info{};
+    while (::stat(probe.c_str(), &info) != 0)
+    {
+        if (!probe.has_parent_path() || probe.parent_path() == probe)
+        {
+            probe = ".";
+            if (::stat(probe.c_str(), &info) != 0)
+            {
+                info.st_dev = 0;
+            }
+            break;
+        }
+        probe = probe.parent_path();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < volumes_.size(); ++i)
+    {
+        if (volumes_[i].device == info.st_dev)
+        {
+            directories_[directory.string()] = i;
+            return i;
+        }
+    }
+
+    Volume volume;
+    volume.device = info.st_dev;
+    volume.stats.example = probe.string();
+    volume.stats.limit = maxActive_;
+    volume.windowStart = std::chrono::steady_clock::now();
+    volumes_.push_back(std::move(volume));
+    directories_[directory.string()] = volumes_.size() - 1;
+    return volumes_.size() - 1;
+}
+
+bool DiskAdmission::tryAdmit(size_t volume)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Volume &entry = volumes_[volume];
+    if (entry.active >= entry.stats.limit)
+    {
+        return false;
+    }
+    ++entry.active;
+    entry.stats.peakActive = std::max(entry.stats.peakActive, entry.active);
+    return true;
+}
+
+void DiskAdmission::release(size_t volume)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Volume &entry = volumes_[volume];
+    if (entry.active > 0)
+    {
+        --entry.active;
+    }
+}
+
+void DiskAdmission::recordWrite(size_t volume, unsigned long long bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Volume &entry = volumes_[volume];
+    entry.stats.bytes += bytes;
+    entry.windowBytes += bytes;
+    closeWindowIfDue(entry);
+}
+
+void DiskAdmission::recordSync(size_t volume, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Volume &entry = volumes_[volume];
+    entry.windowSyncSeconds += seconds;
+    ++entry.windowSyncs;
+    closeWindowIfDue(entry);
+}
+
+void DiskAdmission::closeWindowIfDue(Volume &volume)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now - volume.windowStart < WINDOW)
+    {
+        return;
+    }
+    const double elapsed = std::chrono::duration<double>(now - volume.windowStart).count();
+    const double rate = static_cast<double>(volume.windowBytes) / elapsed;
+
+    VolumeStats &stats = volume.stats;
+    stats.bytesPerSecond = volume.measured ? EWMA_WEIGHT * rate + (1.0 - EWMA_WEIGHT) * stats.bytesPerSecond : rate;
+    volume.measured = true;
+
+    // A window without syncs says nothing against the disk
+    double latencyMs = 0.0;
+    if (volume.windowSyncs > 0)
+    {
+        latencyMs = volume.windowSyncSeconds * 1000.0 / static_cast<double>(volume.windowSyncs);
+        stats.latencyMs =
+            volume.latencyMeasured ? EWMA_WEIGHT * latencyMs + (1.0 - EWMA_WEIGHT) * stats.latencyMs : latencyMs;
+        volume.latencyMeasured = true;
+    }
+
+    if (latencyTargetMs_ > 0.0)
+    {
+        if (latencyMs > latencyTargetMs_ && stats.limit > 1)
+        {
+            // Syncs are stalling: back off quickly
+            stats.limit -= std::max<size_t>(1, stats.limit / 4);
+            ++stats.throttles;
+        }
+        else if (latencyMs <= latencyTargetMs_ && volume.active >= stats.limit && stats.limit < maxActive_)
+        {
+            // Keeping up with every slot busy: probe for one more
+            ++stats.limit;
+        }
+    }
+
+    volume.windowStart = now;
+    volume.windowBytes = 0;
+    volume.windowSyncs = 0;
+    volume.windowSyncSeconds = 0.0;
+}
+
+std::vector<DiskAdmission::VolumeStats> DiskAdmission::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<VolumeStats> result;
+    result.reserve(volumes_.size());
+    for (const Volume &volume : volumes_)
+    {
+        result.push_back(volume.stats);
+        // Short run: report the partial first window rather than nothing
+        if (!volume.measured && volume.windowBytes > 0)
+        {
+            const double elapsed =
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - volume.windowStart).count();
+            result.back().bytesPerSecond = static_cast<double>(volume.windowBytes) / elapsed;
+        }
+        if (!volume.latencyMeasured && volume.windowSyncs > 0)
+        {
+            result.back().latencyMs = volume.windowSyncSeconds * 1000.0 / static_cast<double>(volume.windowSyncs);
+        }
+    }
+    return result;
+}
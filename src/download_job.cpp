@@ -0,0 +1,79 @@
+#include "download_job.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include "checksum.hpp"
+#include "pipeline.hpp"
+
+std::vector<DownloadJob> loadManifest(const std::filesystem::path &manifestPath)
+{
+    std::ifstream in(manifestPath);
+    if (!in)
+    {
+        throw std::runtime_error(
+            fmt::format("Cannot open manifest: {}", manifestPath.string()));
+    }
+
+    std::vector<DownloadJob> jobs;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        ++lineNumber;
+
+        std::istringstream fields(line);
+        DownloadJob job;
+        if (!(fields >> job.url) || job.url[0] == '#')
+        {
+            continue; // Blank line or comment
+        }
+
+        if (job.url.rfind("http://", 0) != 0 && job.url.rfind("https://", 0) != 0)
+        {
+            throw std::runtime_error(
+                fmt::format("{}:{}: URL must start with http:// or https://",
+                            manifestPath.string(), lineNumber));
+        }
+
+        if (!(fields >> job.destination))
+        {
+            throw std::runtime_error(
+                fmt::format("{}:{}: missing destination", manifestPath.string(), lineNumber));
+        }
+
+        std::string field;
+        while (fields >> field)
+        {
+            try
+            {
+                if (field.rfind("pipeline=", 0) == 0)
+                {
+                    job.pipeline = field.substr(9);
+                    parsePipeline(job.pipeline); // Validate now, not after the download
+                }
+                else if (!job.expectedChecksum)
+                {
+                    ChecksumVerifier::parseChecksum(field);
+                    job.expectedChecksum = field;
+                }
+                else
+                {
+                    throw std::runtime_error(fmt::format("unexpected field '{}'", field));
+                }
+            }
+            catch (const std::exception &e)
+            {
+                throw std::runtime_error(
+                    fmt::format("{}:{}: {}", manifestPath.string(), lineNumber, e.what()));
+            }
+        }
+
+        jobs.push_back(std::move(job));
+    }
+
+    return jobs;
+}
@@ -0,0 +1,272 @@
+#include "durability.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "disk_admission.hpp"
+#include "staging.hpp"
+
+namespace
+{
+    // fsync a directory so a rename inside it survives a crash (best effort)
+    bool fsyncPath(const std::filesystem::path &path, int flags)
+    {
+        int fd = ::open(path.empty() ? "." : path.c_str(), flags | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+}
+
+const char *durabilityModeName(DurabilityMode mode)
+{
+    switch (mode)
+    {
+    case DurabilityMode::None:
+        return "none";
+    case DurabilityMode::PerFile:
+        return "per-file";
+    case DurabilityMode::Batched:
+        return "batched";
+    }
+    return "unknown";
+}
+
+Durability::Durability(DurabilityMode mode, size_t batchFiles, std::chrono::milliseconds batchWindow)
+    : mode_(mode), batchFiles_(std::max<size_t>(1, batchFiles)), batchWindow_(batchWindow)
+{
+    if (mode_ == DurabilityMode::Batched)
+    {
+        committer_ = std::thread([this]
+                                 { commitLoop(); });
+    }
+}
+
+Durability::~Durability()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (committer_.joinable())
+    {
+        committer_.join();
+    }
+}
+
+bool Durability::publish(const std::filesystem::path &staged, const std::filesystem::path &to, std::string &error)
+{
+    std::filesystem::path from = staged;
+    if (!stage(from, to, error))
+    {
+        return false;
+    }
+    if (mode_ != DurabilityMode::None && !syncFile(from, error))
+    {
+        return false;
+    }
+
+    std::error_code renameError;
+    std::filesystem::rename(from, to, renameError);
+    if (renameError)
+    {
+        error = fmt::format("Failed to rename {} to {}: {}", from.string(), to.string(), renameError.message());
+        return false;
+    }
+
+    if (mode_ != DurabilityMode::None)
+    {
+        syncDirectory(to.parent_path());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.files;
+    return true;
+}
+
+void Durability::publishAsync(const std::filesystem::path &staged, const std::filesystem::path &to, DoneFn done)
+{
+    std::string error;
+    if (mode_ != DurabilityMode::Batched)
+    {
+        const bool ok = publish(staged, to, error);
+        done(ok, error);
+        return;
+    }
+
+    std::filesystem::path from = staged;
+    if (!stage(from, to, error))
+    {
+        done(false, error);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(Pending{from, to, std::move(done), std::chrono::steady_clock::now()});
+    }
+    wake_.notify_all();
+}
+
+Durability::Stats Durability::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Durability::commitLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        if (queue_.empty())
+        {
+            if (stopping_)
+            {
+                return;
+            }
+            wake_.wait(lock);
+            continue;
+        }
+
+        // Wait for a full batch, the window to expire, or shutdown
+        const auto deadline = queue_.front().queuedAt + batchWindow_;
+        if (queue_.size() < batchFiles_ && !stopping_ && std::chrono::steady_clock::now() < deadline)
+        {
+            wake_.wait_until(lock, deadline);
+            continue;
+        }
+
+        std::deque<Pending> batch;
+        const size_t take = std::min(queue_.size(), batchFiles_);
+        std::move(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(take), std::back_inserter(batch));
+        queue_.erase(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(take));
+
+        lock.unlock();
+        commitBatch(batch);
+        lock.lock();
+    }
+}
+
+void Durability::commitBatch(std::deque<Pending> &batch)
+{
+    std::vector<std::string> errors(batch.size());
+    std::vector<bool> synced(batch.size(), false);
+
+#ifdef __linux__
+    // Start writeback of every file before waiting on any: the fdatasync() calls
+    // below then mostly find their data already on its way to the device
+    for (const Pending &pending : batch)
+    {
+        int fd = ::open(pending.from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ::sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+            ::close(fd);
+        }
+    }
+#endif
+    // Only these files are waited for, not every dirty page on their volumes
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        synced[i] = syncFile(batch[i].from, errors[i]);
+    }
+
+    // Only now may the final names appear
+    std::set<std::filesystem::path> directories;
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        if (!synced[i])
+        {
+            continue;
+        }
+        std::error_code renameError;
+        std::filesystem::rename(batch[i].from, batch[i].to, renameError);
+        if (renameError)
+        {
+            errors[i] = fmt::format("Failed to rename {} to {}: {}", batch[i].from.string(), batch[i].to.string(),
+                                    renameError.message());
+            synced[i] = false;
+            continue;
+        }
+        directories.insert(batch[i].to.parent_path());
+    }
+    for (const std::filesystem::path &directory : directories)
+    {
+        syncDirectory(directory);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.files += static_cast<size_t>(std::count(synced.begin(), synced.end(), true));
+        ++stats_.batches;
+    }
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        batch[i].done(synced[i], errors[i]);
+    }
+}
+
+bool Durability::stage(std::filesystem::path &from, const std::filesystem::path &to, std::string &error)
+{
+    const std::filesystem::path original = from;
+    if (!bringAlongside(from, to, error))
+    {
+        return false;
+    }
+    if (from != original)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.copiedAcross;
+    }
+    return true;
+}
+
+bool Durability::syncFile(const std::filesystem::path &path, std::string &error)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = fmt::format("Cannot open {} to sync it: {}", path.string(), std::strerror(errno));
+        return false;
+    }
+    const auto started = std::chrono::steady_clock::now();
+#ifdef __APPLE__
+    const bool ok = ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0; // fsync alone skips the drive cache
+#else
+    const bool ok = ::fdatasync(fd) == 0;
+#endif
+    if (disks_)
+    {
+        disks_->recordSync(disks_->volumeFor(path.parent_path()),
+                           std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    }
+    if (!ok)
+    {
+        error = fmt::format("Failed to sync {}: {}", path.string(), std::strerror(errno));
+    }
+    ::close(fd);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.dataSyncs;
+    return ok;
+}
+
+void Durability::syncDirectory(const std::filesystem::path &directory)
+{
+    fsyncPath(directory, O_RDONLY | O_DIRECTORY);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.directorySyncs;
+}
@@ -0,0 +1,393 @@
+#include "event_stream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // JSON string contents, escaped
+    void appendEscaped(fmt::memory_buffer &line, std::string_view text)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                line.append(std::string_view("\\\""));
+                break;
+            case '\\':
+                line.append(std::string_view("\\\\"));
+                break;
+            case '\n':
+                line.append(std::string_view("\\n"));
+                break;
+            case '\r':
+                line.append(std::string_view("\\r"));
+                break;
+            case '\t':
+                line.append(std::string_view("\\t"));
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char escaped[] = {'\\', 'u', '0', '0', HEX[(c >> 4) & 0x0f], HEX[c & 0x0f]};
+                    line.append(escaped, escaped + sizeof(escaped));
+                }
+                else
+                {
+                    line.push_back(c);
+                }
+            }
+        }
+    }
+
+    void appendString(fmt::memory_buffer &line, const char *key, std::string_view value)
+    {
+        fmt::format_to(std::back_inserter(line), ",\"{}\":\"", key);
+        appendEscaped(line, value);
+        line.push_back('"');
+    }
+
+#ifndef F_SETNOSIGPIPE
+    // write() that can't kill the process with SIGPIPE, without touching the
+    // process-wide disposition: the signal is blocked on this thread for the
+    // call, and one the call raised is taken off the thread's pending set
+    ssize_t writeWithoutSigpipe(int fd, const char *data, size_t length)
+    {
+        sigset_t pipeSignal;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        sigset_t pending;
+        sigpending(&pending);
+        const bool alreadyPending = sigismember(&pending, SIGPIPE) == 1;
+
+        sigset_t previous;
+        pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+        const ssize_t written = ::write(fd, data, length);
+        const int writeError = errno;
+        if (written < 0 && writeError == EPIPE && !alreadyPending)
+        {
+            const timespec noWait{0, 0};
+            while (sigtimedwait(&pipeSignal, nullptr, &noWait) < 0 && errno == EINTR)
+            {
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        errno = writeError;
+        return written;
+    }
+#endif
+
+    int connectUnix(const std::string &path)
+    {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw std::runtime_error(fmt::format("Event socket path too long: {}", path));
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            const std::string reason = std::strerror(errno);
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            throw std::runtime_error(fmt::format("Cannot connect to event socket {}: {}", path, reason));
+        }
+        return fd;
+    }
+}
+
+EventStream::EventStream(const std::string &target, std::chrono::milliseconds interval)
+    : interval_(interval), opened_(std::chrono::steady_clock::now())
+{
+    if (target.rfind("fd:", 0) == 0)
+    {
+        try
+        {
+            size_t used = 0;
+            fd_ = std::stoi(target.substr(3), &used);
+            if (used != target.size() - 3)
+            {
+                fd_ = -1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            fd_ = -1;
+        }
+        if (fd_ < 0 || ::fcntl(fd_, F_GETFD) < 0)
+        {
+            throw std::runtime_error(fmt::format("Not an open file descriptor: {}", target));
+        }
+    }
+    else if (target.rfind("unix:", 0) == 0)
+    {
+        fd_ = connectUnix(target.substr(5));
+        ownsFd_ = true;
+    }
+    else
+    {
+        fd_ = ::open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error(fmt::format("Cannot open event stream {}: {}", target, std::strerror(errno)));
+        }
+        ownsFd_ = true;
+    }
+
+    // A consumer that goes away must cost us the stream, not the process:
+    // sockets are written with MSG_NOSIGNAL, anything else without SIGPIPE
+    struct stat info{};
+    isSocket_ = ::fstat(fd_, &info) == 0 && S_ISSOCK(info.st_mode);
+#ifdef F_SETNOSIGPIPE
+    if (!isSocket_)
+    {
+        ::fcntl(fd_, F_SETNOSIGPIPE, 1);
+    }
+#endif
+
+    filling_.data = std::make_unique<char[]>(BUFFER_BYTES);
+    draining_.data = std::make_unique<char[]>(BUFFER_BYTES);
+    writer_ = std::thread([this] { writerLoop(); });
+}
+
+EventStream::~EventStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+    flush();
+    if (ownsFd_)
+    {
+        ::close(fd_);
+    }
+}
+
+void EventStream::beginBatch(std::vector<size_t> jobIds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobIds_ = std::move(jobIds);
+}
+
+void EventStream::start(size_t slot, std::string_view url, std::string_view destination)
+{
+    Line line;
+    openLine(line, "start", slot);
+    appendString(line, "url", url);
+    appendString(line, "destination", destination);
+    line.append(std::string_view("}\n"));
+    emit(line);
+}
+
+void EventStream::retry(size_t slot, int attempt, long delayMs, std::string_view error)
+{
+    Line line;
+    openLine(line, "retry", slot);
+    fmt::format_to(std::back_inserter(line), ",\"attempt\":{},\"delay_ms\":{}", attempt, delayMs);
+    appendString(line, "error", error);
+    line.append(std::string_view("}\n"));
+    emit(line);
+}
+
+void EventStream::verify(size_t slot, bool ok, std::string_view checksum, bool streamed)
+{
+    Line line;
+    openLine(line, "verify", slot);
+    fmt::format_to(std::back_inserter(line), ",\"ok\":{}", ok);
+    appendString(line, "checksum", checksum);
+    fmt::format_to(std::back_inserter(line), ",\"streamed\":{}}}\n", streamed);
+    emit(line);
+}
+
+void EventStream::sample(const ProgressSample &sample)
+{
+    const long long now = elapsedMs();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < sample.transfers.size(); ++i)
+    {
+        const TransferProgress &transfer = sample.transfers[i];
+        char *out = filling_.data.get() + filling_.used;
+        const size_t room = BUFFER_BYTES - filling_.used;
+        const auto written = fmt::format_to_n(
+            out, room,
+            "{{\"event\":\"progress\",\"ms\":{},\"job\":{},\"bytes\":{},\"total\":{},"
+            "\"bytes_per_sec\":{},\"eta_ms\":{}}}\n",
+            now, jobId(transfer.slot), transfer.bytes, transfer.total,
+            static_cast<long long>(transfer.bytesPerSecond),
+            transfer.etaSeconds < 0.0 ? -1 : static_cast<long long>(transfer.etaSeconds * 1000.0));
+        if (written.size > room)
+        {
+            // Full: the rest of this sample is dropped; the next one reports the same transfers
+            stats_.dropped += sample.transfers.size() - i;
+            break;
+        }
+        filling_.used += written.size;
+    }
+    wakeWriterIfFilling();
+}
+
+void EventStream::complete(size_t slot, bool ok, long long bytes, int retries, std::string_view location,
+                           std::string_view error)
+{
+    Line line;
+    openLine(line, "complete", slot);
+    fmt::format_to(std::back_inserter(line), ",\"ok\":{},\"bytes\":{},\"retries\":{}", ok, bytes, retries);
+    appendString(line, "location", location);
+    appendString(line, "error", error);
+    line.append(std::string_view("}\n"));
+    emit(line);
+}
+
+void EventStream::finish(size_t succeeded, size_t failed)
+{
+    Line line;
+    fmt::format_to(std::back_inserter(line), "{{\"event\":\"done\",\"ms\":{},\"succeeded\":{},\"failed\":{}}}\n",
+                   elapsedMs(), succeeded, failed);
+    // Not through emit(): a full buffer would drop the one line a consumer waits for
+    std::lock_guard<std::mutex> writing(writeMutex_);
+    drain();
+    writeAll(line.data(), line.size());
+}
+
+EventStream::Stats EventStream::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void EventStream::openLine(Line &line, const char *name, size_t slot) const
+{
+    fmt::format_to(std::back_inserter(line), "{{\"event\":\"{}\",\"ms\":{},\"job\":{}", name, elapsedMs(),
+                   jobId(slot));
+}
+
+void EventStream::emit(const Line &line)
+{
+    if (line.size() > BUFFER_BYTES)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.dropped;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (filling_.used + line.size() > BUFFER_BYTES)
+    {
+        // A burst filled the buffer before the writer got to it
+        ++stats_.dropped;
+    }
+    else
+    {
+        std::memcpy(filling_.data.get() + filling_.used, line.data(), line.size());
+        filling_.used += line.size();
+    }
+    wakeWriterIfFilling();
+}
+
+void EventStream::wakeWriterIfFilling()
+{
+    if (filling_.used >= BUFFER_BYTES / 2 && !flushWanted_)
+    {
+        flushWanted_ = true;
+        wake_.notify_one();
+    }
+}
+
+void EventStream::flush()
+{
+    std::lock_guard<std::mutex> writing(writeMutex_);
+    drain();
+}
+
+void EventStream::drain()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(filling_, draining_);
+    }
+    if (draining_.used > 0)
+    {
+        writeAll(draining_.data.get(), draining_.used);
+        draining_.used = 0;
+    }
+}
+
+void EventStream::writeAll(const char *data, size_t length)
+{
+    const size_t lines = static_cast<size_t>(std::count(data, data + length, '\n'));
+    bool ok = !broken_;
+    for (size_t done = 0; ok && done < length;)
+    {
+#ifdef F_SETNOSIGPIPE
+        const ssize_t n = isSocket_ ? ::send(fd_, data + done, length - done, MSG_NOSIGNAL)
+                                    : ::write(fd_, data + done, length - done);
+#else
+        const ssize_t n = isSocket_ ? ::send(fd_, data + done, length - done, MSG_NOSIGNAL)
+                                    : writeWithoutSigpipe(fd_, data + done, length - done);
+#endif
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        ok = n > 0;
+        done += ok ? static_cast<size_t>(n) : 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    broken_ = !ok;
+    if (ok)
+    {
+        stats_.events += lines;
+        stats_.bytes += length;
+    }
+    else
+    {
+        stats_.dropped += lines;
+    }
+}
+
+long long EventStream::elapsedMs() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - opened_).count();
+}
+
+size_t EventStream::jobId(size_t slot) const
+{
+    return slot < jobIds_.size() ? jobIds_[slot] : slot;
+}
+
+void EventStream::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_)
+    {
+        wake_.wait_for(lock, interval_, [this] { return stopping_ || flushWanted_; });
+        if (stopping_)
+        {
+            break;
+        }
+        flushWanted_ = false;
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
@@ -0,0 +1,206 @@
+#include "fd_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+FdCache::FdCache(size_t capacity, PageCachePolicy policy, std::shared_ptr<DirectoryCache> directories)
+    : capacity_(std::max<size_t>(1, capacity)), policy_(policy), directories_(std::move(directories))
+{
+}
+
+FdCache::~FdCache()
+{
+    for (auto &[path, entry] : entries_)
+    {
+        closeEntry(entry);
+    }
+}
+
+FdCache::Entry *FdCache::acquire(const std::string &path, off_t offset)
+{
+    auto found = entries_.find(path);
+    if (found != entries_.end())
+    {
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, found->second.position);
+        return &found->second;
+    }
+
+    if (entries_.size() >= capacity_)
+    {
+        const std::string &victim = lru_.back();
+        closeEntry(entries_[victim]);
+        entries_.erase(victim);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+
+    Entry entry;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (policy_ == PageCachePolicy::Direct)
+    {
+        entry.fd = openFile(path, flags | O_DIRECT);
+        entry.directCapable = entry.directOn = entry.fd >= 0;
+    }
+#endif
+    if (entry.fd < 0)
+    {
+        // Not asked for, or the filesystem refuses O_DIRECT (tmpfs): drop behind instead
+        entry.fd = openFile(path, flags);
+    }
+    if (entry.fd < 0)
+    {
+        return nullptr;
+    }
+#ifdef __APPLE__
+    if (policy_ != PageCachePolicy::Normal)
+    {
+        ::fcntl(entry.fd, F_NOCACHE, 1); // Darwin's closest equivalent of both policies
+    }
+#endif
+    ++stats_.opens;
+
+    entry.behind = WriteBehind(policy_);
+    entry.behind.reset(offset);
+    lru_.push_front(path);
+    entry.position = lru_.begin();
+    return &(entries_[path] = entry);
+}
+
+int FdCache::openFile(const std::string &path, int flags)
+{
+    return directories_ ? directories_->openFile(path, flags) : ::open(path.c_str(), flags, 0644);
+}
+
+void FdCache::closeEntry(Entry &entry)
+{
+    if (policy_ != PageCachePolicy::Normal)
+    {
+        const auto started = std::chrono::steady_clock::now();
+        entry.behind.finish(entry.fd);
+        syncSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+    ::close(entry.fd);
+}
+
+bool FdCache::writeAt(const std::string &path, const char *data, size_t length, off_t offset)
+{
+    Entry *entry = acquire(path, offset);
+    if (!entry)
+    {
+        return false;
+    }
+
+#ifdef O_DIRECT
+    if (entry->directCapable)
+    {
+        // O_DIRECT only takes aligned blocks; anything else goes through the page cache
+        const bool aligned = reinterpret_cast<uintptr_t>(data) % DIRECT_ALIGNMENT == 0 &&
+                             length % DIRECT_ALIGNMENT == 0 && offset % DIRECT_ALIGNMENT == 0;
+        if (aligned != entry->directOn)
+        {
+            const int flags = ::fcntl(entry->fd, F_GETFL);
+            if (flags >= 0 && ::fcntl(entry->fd, F_SETFL, aligned ? flags | O_DIRECT : flags & ~O_DIRECT) == 0)
+            {
+                entry->directOn = aligned;
+            }
+        }
+    }
+#endif
+
+    while (length > 0)
+    {
+        ssize_t written = ::pwrite(entry->fd, data, length, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += written;
+    }
+    if (entry->behind.due(offset))
+    {
+        const auto started = std::chrono::steady_clock::now();
+        entry->behind.wrote(entry->fd, offset);
+        syncSeconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+    return true;
+}
+
+bool FdCache::truncate(const std::string &path, off_t length)
+{
+    Entry *entry = acquire(path, length);
+    if (!entry || ::ftruncate(entry->fd, length) != 0)
+    {
+        return false;
+    }
+    entry->behind.reset(length); // Writing starts over from here
+    return true;
+}
+
+bool FdCache::reserve(const std::string &path, off_t offset, off_t length)
+{
+#ifdef __linux__
+    Entry *entry = acquire(path, offset);
+    if (!entry)
+    {
+        return false;
+    }
+    if (::fallocate(entry->fd, FALLOC_FL_KEEP_SIZE, offset, length) != 0 && errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        return false;
+    }
+#else
+    (void)path;
+    (void)offset;
+    (void)length;
+#endif
+    return true;
+}
+
+void FdCache::close(const std::string &path)
+{
+    auto found = entries_.find(path);
+    if (found == entries_.end())
+    {
+        return;
+    }
+    closeEntry(found->second);
+    lru_.erase(found->second.position);
+    entries_.erase(found);
+}
+
+size_t FdCache::raiseOpenFileLimit()
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return 0;
+    }
+
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        rlimit raised = limit;
+        raised.rlim_cur = limit.rlim_max;
+#ifdef __APPLE__
+        raised.rlim_cur = std::min<rlim_t>(raised.rlim_cur, OPEN_MAX); // Darwin rejects more
+#endif
+        if (setrlimit(RLIMIT_NOFILE, &raised) == 0)
+        {
+            limit = raised;
+        }
+    }
+    return limit.rlim_cur == RLIM_INFINITY ? static_cast<size_t>(-1) : static_cast<size_t>(limit.rlim_cur);
+}
@@ -4,13 +4,88 @@
 #include <cstdio>
 #include <fstream>
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include <fmt/core.h>
 #include <thread>
 #include <random>
 
-HttpClient::HttpClient() : curl_(curl_easy_init(), curl_easy_cleanup)
+#include "progress_display.hpp"
+#include "staging.hpp"
+
+namespace
+{
+    // CPU time consumed by the calling thread (user + system), in seconds
+    double threadCpuSeconds()
+    {
+        rusage usage{};
+#ifdef RUSAGE_THREAD
+        getrusage(RUSAGE_THREAD, &usage);
+#else
+        getrusage(RUSAGE_SELF, &usage);
+#endif
+        auto toSeconds = [](const timeval &tv)
+        { return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6; };
+        return toSeconds(usage.ru_utime) + toSeconds(usage.ru_stime);
+    }
+
+    // Reports a download's end to the progress aggregator however downloadFile returns
+    struct ProgressScope
+    {
+        ProgressAggregator *progress;
+        ProgressAggregator::Counter *counter;
+
+        ~ProgressScope()
+        {
+            if (progress)
+            {
+                progress->end(counter);
+                progress->reportEnded();
+            }
+        }
+    };
+
+    // What writeCallback writes to: the .part stream, plus a second descriptor
+    // on the same file through which the page-cache policy is applied
+    struct BodySink
+    {
+        std::ofstream *file = nullptr;
+        int fd = -1;
+        off_t end = 0; // Bytes handed to the stream so far (file offset, some maybe still in its buffer)
+        WriteBehind behind;
+        ProgressAggregator *progress = nullptr; // Told end after every chunk (may be null)
+        ProgressAggregator::Counter *counter = nullptr;
+
+        ~BodySink()
+        {
+            if (fd >= 0)
+            {
+                behind.finish(fd);
+                ::close(fd);
+            }
+        }
+    };
+}
+
+std::string formatTransferStats(const TransferStats &stats)
+{
+    const char *receivePath = stats.zeroCopyActive  ? "native splice (zero-copy)"
+                              : stats.kernelTlsActive ? "native + kTLS"
+                              : stats.nativePath      ? "native"
+                                                      : "libcurl";
+    return fmt::format("{:.2f} MB received, CPU {:.3f} s ({:.2f} s/GB), receive path: {}",
+                       static_cast<double>(stats.bytes) / (1024.0 * 1024.0),
+                       stats.cpuSeconds, stats.cpuSecondsPerGB(), receivePath);
+}
+
+HttpClient::HttpClient() : HttpClient(nullptr)
+{
+}
+
+HttpClient::HttpClient(std::shared_ptr<NetworkCache> networkCache)
+    : curl_(curl_easy_init(), curl_easy_cleanup), networkCache_(std::move(networkCache))
 {
 
     if (!curl_)
@@ -22,8 +97,12 @@ HttpClient::HttpClient() : curl_(curl_easy_init(), curl_easy_cleanup)
     // Set a user-agent (some servers block requests without one)
     curl_easy_setopt(curl_.get(), CURLOPT_USERAGENT, "DownloadManager/1.90");
 
-    // Detect if stdout is a terminal to decide how we render the progress bar
-    isTerminalOutput_ = ::isatty(fileno(stdout));
+    // Warm start: pin known addresses and load TLS sessions / Alt-Svc / HSTS
+    if (networkCache_)
+    {
+        networkCache_->applyTo(curl_.get());
+        setResolveEntries(networkCache_->resolveEntries());
+    }
 }
 
 // Destructor: unique_ptr handles cleanup automatically
@@ -35,31 +114,48 @@ size_t HttpClient::writeCallback(char *ptr, size_t size, size_t nmemb, void *use
     // Calculate total bytes in this chunk
     size_t totalSize = size * nmemb;
 
-    // userdata is our std::ofstream* (we pass it in downloadFile)
-    auto *outFile = static_cast<std::ofstream *>(userdata);
+    // userdata is our BodySink (we pass it in downloadFile)
+    auto *sink = static_cast<BodySink *>(userdata);
 
     // Write chunk to file
-    outFile->write(ptr, static_cast<std::streamsize>(totalSize));
-    if (!outFile->good())
+    sink->file->write(ptr, static_cast<std::streamsize>(totalSize));
+    if (!sink->file->good())
     {
         return 0; // Abort transfer if write fails
     }
+    sink->end += static_cast<off_t>(totalSize);
+    if (sink->fd >= 0 && sink->behind.due(sink->end))
+    {
+        // The stream's buffer first: writeback ranges must cover bytes that are in the file
+        if (!sink->file->flush())
+        {
+            return 0;
+        }
+        sink->behind.wrote(sink->fd, sink->end);
+    }
+    if (sink->progress)
+    {
+        sink->progress->update(sink->counter, sink->end);
+    }
 
     // If we return 0 or a different value, libcurl aborts the transfer
     return totalSize;
 }
 
-bool HttpClient::downloadFile(const std::string &url, const std::string &destination, int timeoutSeconds)
+bool HttpClient::downloadFile(const std::string &url, const std::string &destination, int timeoutSeconds,
+                              const RemoteMetadata *prefetched)
 {
     // Convert to filesystem path for easier manipulation
     std::filesystem::path finalPath(destination);
     std::filesystem::path partPath = makePartPath(finalPath);
 
-    // Reset retry count for this download
+    // Reset retry count and cost statistics for this download
     retryCount_ = 0;
+    lastFailureWasNetwork_ = false;
+    lastStats_ = TransferStats{};
 
-    // 1. Ensure destination directory exists
-    if (!ensureDirectoryExists(finalPath))
+    // 1. Ensure destination (and scratch) directory exists
+    if (!ensureDirectoryExists(finalPath) || !ensureDirectoryExists(partPath))
     {
         return false; // Error already set in lastError_
     }
@@ -99,6 +195,44 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
         resumeOffset_ = 0;
     }
 
+    // Counted from here on; its end is reported however we return
+    if (progress_)
+    {
+        progressCounter_ = progress_->begin(progressSlot_, resumeOffset_, -1);
+    }
+    ProgressScope progressScope{progress_.get(), progressCounter_};
+
+    // A server that ignores our Range header sends the whole file: the .part
+    // is dropped and the download starts over (once; there is no range then)
+    bool restart = false;
+    bool ok = false;
+    do
+    {
+        ok = transferToPart(url, partPath, finalPath, timeoutSeconds, prefetched, restart);
+    } while (restart);
+    return ok;
+}
+
+bool HttpClient::transferToPart(const std::string &url, const std::filesystem::path &partPath,
+                                const std::filesystem::path &finalPath, int timeoutSeconds,
+                                const RemoteMetadata *prefetched, bool &restart)
+{
+    restart = false;
+
+    // Opt-in native paths: kernel TLS receive offload / zero-copy plain HTTP
+    if (wantsNativePath(url))
+    {
+        if (auto outcome = downloadNative(url, partPath, finalPath, timeoutSeconds))
+        {
+            return *outcome;
+        }
+
+        // Fall back to libcurl, resuming from whatever the native path wrote
+        std::error_code ec;
+        auto written = std::filesystem::file_size(partPath, ec);
+        resumeOffset_ = ec ? 0 : static_cast<curl_off_t>(written);
+    }
+
     // 3. Open .part file for writing
     // If resuming (resumeOffset_ > 0), open in APPEND mode to continue writing
     // If starting fresh (resumeOffset_ == 0), open in TRUNCATE mode (default)
@@ -115,12 +249,38 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
         return false;
     }
 
-    // 1. Set URL
-    curl_easy_setopt(curl_.get(), CURLOPT_URL, url.c_str());
+    // Drop-behind works on the file, not the stream; "direct" can't apply to
+    // libcurl's small unaligned chunks and is treated as drop-behind here
+    BodySink sink;
+    sink.file = &outFile;
+    sink.end = static_cast<off_t>(resumeOffset_);
+    sink.progress = progress_.get();
+    sink.counter = progressCounter_;
+    if (pageCachePolicy_ != PageCachePolicy::Normal)
+    {
+        sink.fd = ::open(partPath.c_str(), O_RDONLY | O_CLOEXEC);
+        sink.behind = WriteBehind(pageCachePolicy_);
+        sink.behind.reset(sink.end);
+    }
+
+    // 1. Set URL (skip the redirect hop if a previous run learned the target)
+    std::string requestUrl = url;
+    if (prefetched && !prefetched->effectiveUrl.empty())
+    {
+        requestUrl = prefetched->effectiveUrl; // Probe already followed the redirects
+    }
+    else if (networkCache_)
+    {
+        if (auto cachedTarget = networkCache_->lookupRedirect(url))
+        {
+            requestUrl = *cachedTarget;
+        }
+    }
+    curl_easy_setopt(curl_.get(), CURLOPT_URL, requestUrl.c_str());
 
     // 2. Set write callback and pass file stream as context
     curl_easy_setopt(curl_.get(), CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl_.get(), CURLOPT_WRITEDATA, &outFile);
+    curl_easy_setopt(curl_.get(), CURLOPT_WRITEDATA, &sink);
 
     // 3. HTTPS settings (CRITICAL for security)
     curl_easy_setopt(curl_.get(), CURLOPT_SSL_VERIFYPEER, 1L); // Verify server certificate
@@ -134,41 +294,65 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
     curl_easy_setopt(curl_.get(), CURLOPT_TIMEOUT, static_cast<long>(timeoutSeconds));
     curl_easy_setopt(curl_.get(), CURLOPT_CONNECTTIMEOUT, 30L); // 30s to establish connection
 
-    // 6. Enable progress tracking
-    curl_easy_setopt(curl_.get(), CURLOPT_NOPROGRESS, 0L); // Enable progress meter
+    // 6. Progress callback: only needed while the size is unknown (enabled after step 7)
+    curl_easy_setopt(curl_.get(), CURLOPT_NOPROGRESS, 1L);
     curl_easy_setopt(curl_.get(), CURLOPT_XFERINFOFUNCTION, progressCallback);
     curl_easy_setopt(curl_.get(), CURLOPT_XFERINFODATA, this);
 
-    startTime_ = std::chrono::steady_clock::now();
-    lastDownloaded_ = 0;
-    lastProgressTime_ = startTime_;
-    lastPrintedTime_ = startTime_;
-    lastPrintedPercentage_ = -1.0;
     diskSpaceChecked_ = false;
-    currentDestination_ = finalPath;
+    currentDestination_ = partPath; // Space is needed where the bytes land
 
     // 7. Try to get content length for disk space check
     // Note: This is set BEFORE download starts via headers
-    curl_easy_setopt(curl_.get(), CURLOPT_NOBODY, 1L); // HEAD request to get size
-    CURLcode headRes = curl_easy_perform(curl_.get());
-
     curl_off_t contentLength = 0;
-    if (headRes == CURLE_OK)
+    if (prefetched)
     {
-        curl_easy_getinfo(curl_.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        // Look-ahead already probed this job: no HEAD round trip needed
+        contentLength = prefetched->contentLength;
+    }
+    else
+    {
+        curl_easy_setopt(curl_.get(), CURLOPT_NOBODY, 1L); // HEAD request to get size
+        CURLcode headRes = curl_easy_perform(curl_.get());
+
+        if (requestUrl != url)
+        {
+            long headCode = 0;
+            curl_easy_getinfo(curl_.get(), CURLINFO_RESPONSE_CODE, &headCode);
+            if (headRes != CURLE_OK || headCode >= 400)
+            {
+                // Cached target went stale (expired signed URL, moved edge): use the original
+                networkCache_->forgetRedirect(url);
+                requestUrl = url;
+                curl_easy_setopt(curl_.get(), CURLOPT_URL, requestUrl.c_str());
+                headRes = curl_easy_perform(curl_.get());
+            }
+        }
+
+        long headCode = 0;
+        curl_easy_getinfo(curl_.get(), CURLINFO_RESPONSE_CODE, &headCode);
+        if (headRes == CURLE_OK && headCode < 400) // An error page's length isn't the file's
+        {
+            curl_easy_getinfo(curl_.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        }
     }
 
     // Check disk space if we know the size (from HEAD or we'll check in progress callback)
     if (contentLength > 0)
     {
-        if (!checkDiskSpace(finalPath, contentLength))
+        if (!checkDiskSpace(partPath, contentLength))
         {
             outFile.close();
             std::filesystem::remove(partPath); // Clean up .part file
             return false;
         }
         diskSpaceChecked_ = true; // Mark as checked
+        if (progress_)
+        {
+            progress_->setTotal(progressCounter_, contentLength);
+        }
     }
+    curl_easy_setopt(curl_.get(), CURLOPT_NOPROGRESS, diskSpaceChecked_ ? 1L : 0L);
 
     // Reset to actual download (not HEAD request)
     curl_easy_setopt(curl_.get(), CURLOPT_NOBODY, 0L);
@@ -187,6 +371,8 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
     }
 
     // Perform the download with retry logic
+    const double cpuStart = threadCpuSeconds();
+    const curl_off_t sizeBefore = resumeOffset_;
     CURLcode res;
     int attemptCount = 0;
     bool shouldRetry = false;
@@ -199,15 +385,18 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
         // Close file after each attempt (ensures data is flushed)
         outFile.close();
 
-        // Print newline after progress bar
-        fmt::print("\n");
-
         // Check if download succeeded
         if (res == CURLE_OK)
         {
             break; // Success - exit retry loop
         }
 
+        // Print newline after progress bar
+        if (!events_)
+        {
+            fmt::print("\n");
+        }
+
         // Download failed - classify error
         long httpCode = 0;
         curl_easy_getinfo(curl_.get(), CURLINFO_RESPONSE_CODE, &httpCode);
@@ -215,6 +404,15 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
         ErrorType errorType = classifyError(res, httpCode);
         attemptCount++;
 
+        // A pinned address that refuses connections is stale: resolve normally next time
+        if (res == CURLE_COULDNT_CONNECT && networkCache_)
+        {
+            if (auto staleKey = networkCache_->forgetAddress(requestUrl))
+            {
+                setResolveEntries({"-" + *staleKey});
+            }
+        }
+
         // Determine if we should retry
         shouldRetry = (errorType == ErrorType::Transient || errorType == ErrorType::Unknown) &&
                       (attemptCount < maxRetryAttempts_);
@@ -236,6 +434,10 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
                        attemptCount, maxRetryAttempts_,
                        curl_easy_strerror(res),
                        delayMs / 1000);
+            if (events_)
+            {
+                events_->retry(progressSlot_, attemptCount, delayMs, curl_easy_strerror(res));
+            }
 
             // Wait before retry
             std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
@@ -252,6 +454,7 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
             try
             {
                 curl_off_t currentSize = std::filesystem::file_size(partPath);
+                sink.end = static_cast<off_t>(currentSize);
                 if (currentSize > resumeOffset_)
                 {
                     // We made some progress, resume from current position
@@ -262,10 +465,13 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
             {
                 // If we can't get file size, just retry from current offset
             }
+            // Write-behind windows restart at the new write position (finish() drops the rest)
+            sink.behind.reset(sink.end);
         }
         else
         {
             // Permanent error or max retries exceeded
+            lastFailureWasNetwork_ = errorType == ErrorType::Transient && httpCode == 0;
             if (errorType == ErrorType::Permanent)
             {
                 lastError_ = fmt::format("Download failed permanently: {}", curl_easy_strerror(res));
@@ -313,9 +519,14 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
             // Ignore cleanup errors
         }
 
-        // Retry download from scratch (no range request this time)
+        // Retry download from scratch (no range request this time), on the same counter
         resumeOffset_ = 0;
-        return downloadFile(url, destination); // Recursive call
+        if (progress_)
+        {
+            progress_->update(progressCounter_, 0);
+        }
+        restart = true;
+        return false;
     }
     else if (resumeOffset_ > 0 && httpCode == 206)
     {
@@ -330,275 +541,266 @@ bool HttpClient::downloadFile(const std::string &url, const std::string &destina
     }
 
     // 8. Verify file size (optional but recommended for integrity)
-    try
-    {
-        curl_off_t finalSize = static_cast<curl_off_t>(std::filesystem::file_size(partPath));
-        curl_off_t expectedSize = 0;
-        curl_easy_getinfo(curl_.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &expectedSize);
+    curl_off_t expectedSize = 0;
+    curl_easy_getinfo(curl_.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &expectedSize);
+    curl_off_t totalExpected = (expectedSize > 0) ? resumeOffset_ + expectedSize : 0;
 
-        // Only check if server provided Content-Length
-        if (expectedSize > 0)
-        {
-            curl_off_t totalExpected = (resumeOffset_ > 0) ? resumeOffset_ + expectedSize : expectedSize;
+    lastStats_.cpuSeconds = threadCpuSeconds() - cpuStart;
+    std::error_code sizeError;
+    auto finalSize = std::filesystem::file_size(partPath, sizeError);
+    lastStats_.bytes = sizeError ? 0 : static_cast<curl_off_t>(finalSize) - sizeBefore;
 
-            if (finalSize != totalExpected)
-            {
-                lastError_ = fmt::format("File size mismatch: expected {} but got {}",
-                                         formatBytes(totalExpected),
-                                         formatBytes(finalSize));
-                // Leave .part file for debugging
-                return false;
-            }
-        }
-    }
-    catch (const std::filesystem::filesystem_error &e)
+    // Remember resolved address, redirect target and TLS sessions for the next run
+    if (networkCache_)
     {
-        // If we can't verify size, log warning but continue
-        fmt::print(stderr, "Warning: Could not verify file size: {}\n", e.what());
+        networkCache_->captureFrom(curl_.get(), url);
     }
 
     // 9. Success! Rename .part to final filename (atomic operation)
-    try
+    return finalizeDownload(partPath, finalPath, totalExpected);
+}
+
+std::optional<bool> HttpClient::downloadNative(const std::string &url,
+                                               const std::filesystem::path &partPath,
+                                               const std::filesystem::path &finalPath,
+                                               int timeoutSeconds)
+{
+    // Positioned at the end rather than O_APPEND: splice() rejects append-mode files
+    int fd = ::open(partPath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
     {
-        std::filesystem::rename(partPath, finalPath);
+        return std::nullopt; // libcurl path will report the open error
     }
-    catch (const std::filesystem::filesystem_error &e)
+    if (::lseek(fd, resumeOffset_, SEEK_SET) != resumeOffset_)
     {
-        lastError_ = fmt::format("Download succeeded but failed to rename {} to {}: {}",
-                                 partPath.string(), finalPath.string(), e.what());
-        return false;
+        ::close(fd);
+        return std::nullopt;
     }
 
-    return true;
-}
-
-int HttpClient::progressCallback(void *clientp,
-                                 curl_off_t dltotal,
-                                 curl_off_t dlnow,
-                                 curl_off_t ultotal,
-                                 curl_off_t ulnow)
-{
-    // Suppress unused parameter warnings
-    (void)ultotal;
-    (void)ulnow;
-
-    // clientp is our HttpClient* (we pass it in downloadFile)
-    auto *client = static_cast<HttpClient *>(clientp);
+    NativeHttpClient::Options options;
+    options.kernelTls = kernelTls_;
+    options.zeroCopy = zeroCopy_;
+    options.caCertFile = caCertFile_;
+    options.timeoutSeconds = timeoutSeconds;
+    NativeHttpClient native(options);
 
-    // If we haven't checked disk space yet and now know the total size, check it
-    // Do this FIRST before throttling to ensure safety checks happen immediately
-    if (!client->diskSpaceChecked_ && dltotal > 0)
-    {
-        if (!client->checkDiskSpace(client->currentDestination_, dltotal))
+    // Same progress reporting and space check as libcurl transfers
+    diskSpaceChecked_ = false;
+    currentDestination_ = partPath; // Space is needed where the bytes land
+
+    const double cpuStart = threadCpuSeconds();
+    NativeHttpClient::Response response;
+    bool ok = native.fetch(url, fd, resumeOffset_, response,
+                           [this](curl_off_t total, curl_off_t now)
+                           {
+                               if (progress_)
+                               {
+                                   progress_->update(progressCounter_, resumeOffset_ + now);
+                               }
+                               return progressCallback(this, total, now, 0, 0) == 0;
+                           });
+    ::close(fd);
+
+    if (!ok)
+    {
+        if (response.bytesWritten > 0 && !events_)
         {
-            // Abort download by returning non-zero
-            return 1;
+            fmt::print("\n");
         }
-        client->diskSpaceChecked_ = true;
+        fmt::print(stderr, "Native path unavailable ({}); using libcurl.\n", native.getLastError());
+        return std::nullopt;
     }
-
-    auto now = std::chrono::steady_clock::now();
-    auto timeSinceStart = std::chrono::duration_cast<std::chrono::milliseconds>(
-                              now - client->startTime_)
-                              .count();
-    bool isComplete = (dltotal > 0 && dlnow >= dltotal);
-
-    if (client->isTerminalOutput_)
+    if (resumeOffset_ > 0)
     {
-        auto timeSinceLastUpdate = std::chrono::duration_cast<std::chrono::milliseconds>(now - client->lastProgressTime_).count();
+        fmt::print("\nResume successful! Continued from byte {}.\n", resumeOffset_);
+    }
 
-        // Throttle updates for terminal output
-        if (!isComplete)
-        {
-            // Don't show progress in the first 500ms (prevents flashing for instant downloads)
-            if (timeSinceStart < 500)
-            {
-                return 0;
-            }
+    lastStats_.bytes = response.bytesWritten;
+    lastStats_.cpuSeconds = threadCpuSeconds() - cpuStart;
+    lastStats_.nativePath = true;
+    lastStats_.kernelTlsActive = response.kernelTlsActive;
+    lastStats_.zeroCopyActive = response.zeroCopyActive;
 
-            // Update at most 5 times per second (200ms interval)
-            if (timeSinceLastUpdate < 200)
-            {
-                return 0;
-            }
-        }
+    curl_off_t totalExpected = response.contentLength >= 0 ? resumeOffset_ + response.contentLength : 0;
+    return finalizeDownload(partPath, finalPath, totalExpected);
+}
 
-        client->lastProgressTime_ = now;
-    }
-    else
+bool HttpClient::wantsNativePath(const std::string &url) const
+{
+    if (!NativeHttpClient::supports(url) || !interface_.empty())
     {
-        auto timeSinceLastPrint = std::chrono::duration_cast<std::chrono::milliseconds>(now - client->lastPrintedTime_).count();
-
-        // For non-terminal output (e.g., piped to file), print less frequently
-        if (!isComplete && timeSinceLastPrint < 1000)
-        {
-            return 0;
-        }
+        return false;
     }
+    bool isHttps = url.rfind("https://", 0) == 0;
+    return isHttps ? kernelTls_ : zeroCopy_;
+}
 
-    // If we don't know the total size, show basic progress
-    if (dltotal == 0)
+bool HttpClient::finalizeDownload(const std::filesystem::path &partPath,
+                                  const std::filesystem::path &finalPath,
+                                  curl_off_t expectedTotal)
+{
+    try
     {
-        // For resumed downloads, add the resume offset to show total progress
-        curl_off_t totalDownloaded = dlnow + client->resumeOffset_;
+        curl_off_t finalSize = static_cast<curl_off_t>(std::filesystem::file_size(partPath));
 
-        if (client->isTerminalOutput_)
-        {
-            fmt::print("\rDownloaded: {} | Speed: calculating...\033[K", client->formatBytes(totalDownloaded));
-            std::fflush(stdout);
-        }
-        else
+        // Only check if server provided Content-Length
+        if (expectedTotal > 0 && finalSize != expectedTotal)
         {
-            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - client->startTime_).count();
-            fmt::print("Downloaded: {} | Elapsed: {}\n",
-                       client->formatBytes(totalDownloaded),
-                       client->formatDuration(static_cast<long>(elapsed)));
-            client->lastPrintedTime_ = now;
+            lastError_ = fmt::format("File size mismatch: expected {} but got {}",
+                                     formatBytes(expectedTotal),
+                                     formatBytes(finalSize));
+            // Leave .part file for debugging
+            return false;
         }
-        return 0;
     }
-
-    // For resumed downloads:
-    // - dltotal = size of THIS request (remaining bytes)
-    // - dlnow = bytes downloaded in THIS session
-    // We need to add resumeOffset_ to show actual total progress
-    curl_off_t totalDownloaded = dlnow + client->resumeOffset_;
-    curl_off_t totalSize = dltotal + client->resumeOffset_;
-
-    double percentage = (static_cast<double>(totalDownloaded) / totalSize) * 100.0;
-
-    // Avoid over-printing in non-terminal environments
-    if (!client->isTerminalOutput_ && !isComplete)
+    catch (const std::filesystem::filesystem_error &e)
     {
-        if (client->lastPrintedPercentage_ >= 0.0 && percentage < client->lastPrintedPercentage_ + 1.0)
-        {
-            return 0;
-        }
+        // If we can't verify size, log warning but continue
+        fmt::print(stderr, "Warning: Could not verify file size: {}\n", e.what());
     }
 
-    // Calculate elapsed time (reuse 'now' from throttling check above)
-    auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - client->startTime_).count();
-
-    // Calculate download speed (bytes per second) - use dlnow for current session speed
-    double speed = (elapsed > 0) ? static_cast<double>(dlnow) / elapsed : 0.0;
-
-    // Calculate ETA - use remaining bytes (totalSize - totalDownloaded)
-    long eta = (speed > 0) ? static_cast<long>((totalSize - totalDownloaded) / speed) : 0;
+    if (leavePartFile_)
+    {
+        lastOutputPath_ = partPath;
+        return true;
+    }
 
-    // Create progress bar (50 characters wide)
-    int barWidth = 50;
-    int filled = static_cast<int>((percentage / 100.0) * barWidth);
-    std::string bar = "[";
-    for (int i = 0; i < barWidth; ++i)
+    if (durability_)
     {
-        if (i < filled)
-        {
-            bar += "=";
-        }
-        else if (i == filled)
-        {
-            bar += ">";
-        }
-        else
+        std::string error;
+        if (!durability_->publish(partPath, finalPath, error))
         {
-            bar += " ";
+            lastError_ = fmt::format("Download succeeded but could not be published: {}", error);
+            return false;
         }
+        lastOutputPath_ = finalPath;
+        return true;
     }
-    bar += "]";
 
-    // Format speed (KB/s or MB/s)
-    std::string speedStr;
-    if (speed >= 1024 * 1024)
-    {
-        speedStr = fmt::format("{:.2f} MB/s", speed / (1024.0 * 1024.0));
-    }
-    else if (speed >= 1024)
+    std::filesystem::path stagedPath = partPath;
+    std::string stageError;
+    if (!bringAlongside(stagedPath, finalPath, stageError))
     {
-        speedStr = fmt::format("{:.2f} KB/s", speed / 1024.0);
-    }
-    else
-    {
-        speedStr = fmt::format("{:.0f} B/s", speed);
+        lastError_ = fmt::format("Download succeeded but could not be moved from scratch: {}", stageError);
+        return false;
     }
 
-    if (client->isTerminalOutput_)
+    try
     {
-        fmt::print("\r{} {:.1f}% | {} / {} | {} | ETA: {}\033[K",
-                   bar,
-                   percentage,
-                   client->formatBytes(totalDownloaded),
-                   client->formatBytes(totalSize),
-                   speedStr,
-                   client->formatDuration(eta));
-        std::fflush(stdout);
-        client->lastPrintedTime_ = now;
+        std::filesystem::rename(stagedPath, finalPath);
     }
-    else
+    catch (const std::filesystem::filesystem_error &e)
     {
-        fmt::print("{} {:.1f}% | {} / {} | {} | ETA: {}\n",
-                   bar,
-                   percentage,
-                   client->formatBytes(totalDownloaded),
-                   client->formatBytes(totalSize),
-                   speedStr,
-                   client->formatDuration(eta));
-        client->lastPrintedTime_ = now;
+        lastError_ = fmt::format("Download succeeded but failed to rename {} to {}: {}",
+                                 stagedPath.string(), finalPath.string(), e.what());
+        return false;
     }
 
-    client->lastPrintedPercentage_ = percentage;
+    lastOutputPath_ = finalPath;
+    return true;
+}
 
-    // Return 0 to continue download (non-zero would abort)
-    return 0;
+void HttpClient::setCaCertFile(const std::string &path)
+{
+    caCertFile_ = path;
+    curl_easy_setopt(curl_.get(), CURLOPT_CAINFO, path.empty() ? nullptr : path.c_str());
 }
 
-// Format bytes into human-readable string
-std::string HttpClient::formatBytes(curl_off_t bytes) const
+void HttpClient::setInterface(const std::string &interfaceName)
 {
-    constexpr double KB = 1024.0;
-    constexpr double MB = KB * 1024.0;
-    constexpr double GB = MB * 1024.0;
+    interface_ = interfaceName;
+    curl_easy_setopt(curl_.get(), CURLOPT_INTERFACE, interface_.empty() ? nullptr : interface_.c_str());
+}
 
-    if (bytes >= GB)
+bool HttpClient::probe(const std::string &url, RemoteMetadata &metadata, int timeoutSeconds)
+{
+    // Same cache and security settings as a real download, but headers only
+    std::string requestUrl = url;
+    if (networkCache_)
     {
-        return fmt::format("{:.2f} GB", bytes / GB);
+        if (auto cachedTarget = networkCache_->lookupRedirect(url))
+        {
+            requestUrl = *cachedTarget;
+        }
     }
-    else if (bytes >= MB)
+
+    curl_easy_setopt(curl_.get(), CURLOPT_URL, requestUrl.c_str());
+    curl_easy_setopt(curl_.get(), CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl_.get(), CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl_.get(), CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl_.get(), CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(curl_.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl_.get(), CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl_.get(), CURLOPT_TIMEOUT, static_cast<long>(timeoutSeconds));
+    curl_easy_setopt(curl_.get(), CURLOPT_CONNECTTIMEOUT, 30L);
+
+    CURLcode res = curl_easy_perform(curl_.get());
+    long httpCode = 0;
+    curl_easy_getinfo(curl_.get(), CURLINFO_RESPONSE_CODE, &httpCode);
+
+    if ((res != CURLE_OK || httpCode >= 400) && requestUrl != url)
     {
-        return fmt::format("{:.2f} MB", bytes / MB);
+        networkCache_->forgetRedirect(url);
+        return probe(url, metadata, timeoutSeconds); // Retry once without the cached hop
     }
-    else if (bytes >= KB)
+
+    if (res != CURLE_OK || httpCode >= 400)
     {
-        return fmt::format("{:.2f} KB", bytes / KB);
+        lastError_ = res != CURLE_OK ? curl_easy_strerror(res)
+                                     : fmt::format("HTTP error {}: {}", httpCode, getHttpStatusText(httpCode));
+        return false;
     }
-    else
+
+    char *effectiveUrl = nullptr;
+    curl_easy_getinfo(curl_.get(), CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    metadata.effectiveUrl = effectiveUrl ? effectiveUrl : url;
+    curl_easy_getinfo(curl_.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &metadata.contentLength);
+
+#if LIBCURL_VERSION_NUM >= 0x075400
+    curl_header *header = nullptr;
+    metadata.acceptsRanges =
+        curl_easy_header(curl_.get(), "Accept-Ranges", 0, CURLH_HEADER, -1, &header) == CURLHE_OK &&
+        std::string(header->value).find("bytes") != std::string::npos;
+#endif
+
+    if (networkCache_)
     {
-        return fmt::format("{} B", bytes);
+        networkCache_->captureFrom(curl_.get(), url);
     }
+    return true;
 }
 
-// Format duration into human-readable string
-std::string HttpClient::formatDuration(long seconds) const
+int HttpClient::progressCallback(void *clientp,
+                                 curl_off_t dltotal,
+                                 curl_off_t dlnow,
+                                 curl_off_t ultotal,
+                                 curl_off_t ulnow)
 {
-    if (seconds < 0)
-    {
-        return "unknown";
-    }
-    else if (seconds < 60)
-    {
-        return fmt::format("{}s", seconds);
-    }
-    else if (seconds < 3600)
-    {
-        long minutes = seconds / 60;
-        long secs = seconds % 60;
-        return fmt::format("{}m {}s", minutes, secs);
-    }
-    else
+    // Suppress unused parameter warnings
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+
+    // clientp is our HttpClient* (we pass it in downloadFile)
+    auto *client = static_cast<HttpClient *>(clientp);
+
+    // If we haven't checked disk space yet and now know the total size, check it
+    if (!client->diskSpaceChecked_ && dltotal > 0)
     {
-        long hours = seconds / 3600;
-        long minutes = (seconds % 3600) / 60;
-        return fmt::format("{}h {}m", hours, minutes);
+        if (!client->checkDiskSpace(client->currentDestination_, dltotal))
+        {
+            // Abort download by returning non-zero
+            return 1;
+        }
+        client->diskSpaceChecked_ = true;
+
+        // For resumed downloads dltotal is only the size of THIS request
+        if (client->progress_)
+        {
+            client->progress_->setTotal(client->progressCounter_, dltotal + client->resumeOffset_);
+        }
     }
+    return 0;
 }
 
 // Helper: Get human-readable HTTP status text
@@ -712,14 +914,12 @@ bool HttpClient::checkDiskSpace(const std::filesystem::path &filePath, curl_off_
 // Generate .part filename
 std::filesystem::path HttpClient::makePartPath(const std::filesystem::path &destination) const
 {
-    // Simply append ".part" to the filename
-    std::filesystem::path partPath = destination;
-    partPath += ".part";
-    return partPath;
+    // "<destination>.part", or a stable name inside the scratch directory
+    return stagingPath(destination, scratchDir_);
 }
 
 // Classify error for retry logic
-HttpClient::ErrorType HttpClient::classifyError(CURLcode code, long httpCode) const
+HttpClient::ErrorType HttpClient::classifyError(CURLcode code, long httpCode)
 {
     // First, check CURL-level errors (network, DNS, etc.)
     switch (code)
@@ -763,4 +963,22 @@ HttpClient::ErrorType HttpClient::classifyError(CURLcode code, long httpCode) co
     default:
         return ErrorType::Unknown;
     }
-}
\ No newline at end of file
+}
+
+// Replace the CURLOPT_RESOLVE list on the handle
+void HttpClient::setResolveEntries(const std::vector<std::string> &entries)
+{
+    curl_slist *list = nullptr;
+    for (const auto &entry : entries)
+    {
+        curl_slist *appended = curl_slist_append(list, entry.c_str());
+        if (!appended)
+        {
+            break; // Out of memory: use what we have so far
+        }
+        list = appended;
+    }
+
+    curl_easy_setopt(curl_.get(), CURLOPT_RESOLVE, list);
+    resolveList_.reset(list);
+}
@@ -1,9 +1,32 @@
 #include <iostream>
+#include <map>
 #include <fmt/core.h>
 #include <CLI/CLI.hpp> // CLI11 main header
 #include "http_client.hpp"
 #include "config.hpp"
 #include "checksum.hpp"
+#include "network_cache.hpp"
+#include "batch_runner.hpp"
+#include "download_job.hpp"
+#include "event_stream.hpp"
+#include "progress_display.hpp"
+#include "buffer_arena.hpp"
+#include "fd_cache.hpp"
+#include "mirror.hpp"
+#include "pipeline.hpp"
+#include "tail_follower.hpp"
+
+// Load what previous runs learned about the network (saved again on destruction)
+static std::shared_ptr<NetworkCache> makeNetworkCache(const DownloadConfig &config)
+{
+    if (config.disableNetworkCache)
+    {
+        return nullptr;
+    }
+    return std::make_shared<NetworkCache>(
+        config.cacheDir.empty() ? NetworkCache::defaultDirectory()
+                                : std::filesystem::path(config.cacheDir));
+}
 
 int main(int argc, char *argv[])
 {
@@ -30,9 +53,8 @@ int main(int argc, char *argv[])
     // DEFINE ARGUMENTS
     // ====================================================================
 
-    // Required positional argument: URL
+    // Positional argument: URL (required unless --input-file is given)
     app.add_option("URL", config.url, "HTTP/HTTPS URL to download")
-        ->required()
         ->check([](const std::string &url) -> std::string {
             // Custom validator: check if URL starts with http:// or https://
             if (url.rfind("http://", 0) == 0 || url.rfind("https://", 0) == 0) {
@@ -41,9 +63,129 @@ int main(int argc, char *argv[])
             return "URL must start with http:// or https://";
         });
 
-    // Required positional argument: DESTINATION
-    app.add_option("DESTINATION", config.destination, "Local file path to save")
-        ->required();
+    // Positional argument: DESTINATION (required unless --input-file is given)
+    app.add_option("DESTINATION", config.destination, "Local file path to save");
+
+    // Optional flag: --input-file (batch mode)
+    app.add_option("-i,--input-file", config.inputFile,
+                   "Manifest with one 'URL DESTINATION [checksum]' per line (batch mode)")
+        ->check(CLI::ExistingFile);
+
+    // Optional flag: --prefetch (batch look-ahead depth)
+    app.add_option("--prefetch", config.prefetchDepth,
+                   "Max number of queued jobs to probe and pre-connect ahead (0 = off)")
+        ->check(CLI::Range(0, 64))
+        ->default_val(4);
+
+    // Optional flags: follow a growing remote file (logs, append-only data)
+    app.add_flag("-f,--follow", config.follow,
+                 "Keep DESTINATION in sync with a growing remote file: poll with range requests "
+                 "from the local size and append what's new (like tail -f)");
+    app.add_option("--follow-min-interval-ms", config.followMinIntervalMs,
+                   "Shortest poll interval, used while the file keeps growing")
+        ->check(CLI::Range(50, 86400000))
+        ->default_val(1000);
+    app.add_option("--follow-max-interval-ms", config.followMaxIntervalMs,
+                   "Longest poll interval, backed off to while the file doesn't change")
+        ->check(CLI::Range(50, 86400000))
+        ->default_val(60000);
+    app.add_option("--follow-for", config.followForSeconds, "Stop following after this many seconds (0 = never)")
+        ->check(CLI::NonNegativeNumber)
+        ->default_val(0);
+
+    // Optional flags: mirror an HTTP directory index
+    app.add_flag("--mirror", config.mirror,
+                 "Treat URL as an autoindex directory listing and mirror the tree into DESTINATION; "
+                 "later runs fetch only new or changed files (batch options apply to the downloads)");
+    app.add_option("--mirror-parallel", config.mirrorParallel, "Listing pages crawled at once")
+        ->check(CLI::Range(1, 256))
+        ->default_val(8);
+
+    // Optional flags: sharded engine for batch mode
+    app.add_option("--shards", config.shards,
+                   "Download the batch on N event-loop threads, jobs assigned by host (0 = sequential)")
+        ->check(CLI::Range(0, 256))
+        ->default_val(0);
+    app.add_option("--per-shard", config.transfersPerShard,
+                   "Concurrent transfers per shard")
+        ->check(CLI::Range(1, 256))
+        ->default_val(8);
+    app.add_flag("--pin-cpus", config.pinThreads,
+                 "Pin each shard thread to its own CPU core (Linux)");
+    app.add_option("--post-threads", config.postProcessThreads,
+                   "Worker threads for the post-download pipeline (0 = one per core)")
+        ->check(CLI::Range(0, 256))
+        ->default_val(0);
+
+    // Optional flags: post-download pipeline for batch mode
+    app.add_option("--pipeline", config.pipelineSpec,
+                   "Stages run on each downloaded file, e.g. 'verify,decompress,extract,move:DIR,notify:CMD'")
+        ->check([](const std::string &spec) -> std::string {
+            try {
+                parsePipeline(spec);
+                return "";
+            } catch (const std::exception &e) {
+                return e.what();
+            }
+        });
+    app.add_option("--stage-limit", config.stageLimits,
+                   "Max concurrent runs of a stage, e.g. --stage-limit extract=2 (repeatable)")
+        ->check([](const std::string &limit) -> std::string {
+            try {
+                Pipeline::parseStageLimits({limit});
+                return "";
+            } catch (const std::exception &e) {
+                return e.what();
+            }
+        });
+    app.add_option("--max-open-files", config.maxOpenFiles,
+                   "Output files the sharded engine keeps open at once; idle ones are closed "
+                   "and reopened on demand (0 = half the open-file limit)")
+        ->check(CLI::Range(0, 1000000))
+        ->default_val(0);
+    app.add_option("--memory-budget", config.memoryBudgetMb,
+                   "Cap in MB on all receive, write and post-processing buffers; transfers "
+                   "pause when it is reached (0 = unlimited)")
+        ->check(CLI::Range(0, 1048576))
+        ->default_val(0);
+    app.add_option("--disk-latency-ms", config.diskLatencyMs,
+                   "Run fewer transfers on a destination filesystem while its average sync latency "
+                   "(file syncs, drop-behind writeback waits) is above this (0 = never throttle)")
+        ->check(CLI::Range(0, 60000))
+        ->default_val(0);
+    app.add_option("--page-cache", config.pageCache,
+                   "Page-cache use of downloaded data: normal, drop-behind (write back and evict "
+                   "behind the write frontier) or direct (O_DIRECT where possible)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, PageCachePolicy>{
+            {"normal", PageCachePolicy::Normal},
+            {"drop-behind", PageCachePolicy::DropBehind},
+            {"direct", PageCachePolicy::Direct}}))
+        ->default_val("normal");
+    app.add_option("--durability", config.durability,
+                   "Crash safety of finished files: none (plain rename), per-file (fdatasync, "
+                   "rename, fsync the directory) or batched (group commit of many files)")
+        ->transform(CLI::CheckedTransformer(std::map<std::string, DurabilityMode>{
+            {"none", DurabilityMode::None},
+            {"per-file", DurabilityMode::PerFile},
+            {"batched", DurabilityMode::Batched}}))
+        ->default_val("none");
+    app.add_option("--durability-batch", config.durabilityBatch,
+                   "Batched durability: commit as soon as this many files are waiting")
+        ->check(CLI::Range(1, 100000))
+        ->default_val(256);
+    app.add_option("--durability-window-ms", config.durabilityWindowMs,
+                   "Batched durability: longest a finished file waits for its group to fill")
+        ->check(CLI::Range(0, 60000))
+        ->default_val(200);
+    app.add_option("--scratch-dir", config.scratchDir,
+                   "Download into this directory (e.g. local NVMe or tmpfs) and move each finished "
+                   "file to its destination: a rename on the same filesystem, a copy otherwise");
+    app.add_flag("--huge-pages", config.hugePages,
+                 "Carve transfer and pipeline buffers out of huge pages where the OS allows it");
+    app.add_option("--pipeline-backlog", config.pipelineBacklog,
+                   "Stop starting downloads while this many files wait for post-processing")
+        ->check(CLI::Range(1, 100000))
+        ->default_val(32);
 
     // Optional flag: --retry-count (or --max-retries)
     app.add_option("-r,--retry-count,--max-retries", config.maxRetries,
@@ -70,6 +212,82 @@ int main(int argc, char *argv[])
             }
         });
 
+    // Optional flags: native receive paths (kTLS, splice) and transfer cost reporting
+    app.add_flag("--ktls", config.kernelTls,
+                 "Use kernel TLS receive offload for HTTPS when available (implies --stats)");
+    app.add_flag("--zero-copy", config.zeroCopy,
+                 "Receive plain http:// bodies with splice() instead of copying through userspace");
+    app.add_option("--cacert", config.caCertFile,
+                   "CA certificate bundle to trust instead of the system store (peer verification stays on)")
+        ->check(CLI::ExistingFile);
+    app.add_flag("--stats", config.showStats,
+                 "Print bytes, CPU per GB and TLS offload state for each transfer");
+
+    // Optional flag: --interface (repeatable; batch mode balances across them)
+    app.add_option("--interface", config.interfaces,
+                   "Local interface or source address to download through, e.g. eth1 or 10.0.0.2 "
+                   "(repeat to spread batch transfers over several paths)");
+
+    // Optional flags: pack mode for huge numbers of small objects
+    app.add_option("--pack", config.packDir,
+                   "Store batch downloads as objects appended to large segment files in this "
+                   "directory instead of one file each (list/extract with pack_tool)");
+    app.add_option("--pack-segment-mb", config.packSegmentMb, "Size at which --pack starts a new segment file")
+        ->check(CLI::Range(1, 1048576))
+        ->default_val(1024);
+    app.add_flag("--bulk", config.bulk,
+                 "Tune batch mode for many small files: create and open each directory once, "
+                 "open/rename relative to it, and skip per-file resume and free-space checks");
+
+    // Optional flags: compressed storage
+    app.add_flag("--store-zstd", config.storeZstd,
+                 "Compress batch downloads with multi-threaded zstd while writing them, as "
+                 "<destination>.zst in seekable format (sha256 of the original stored inside)");
+    app.add_option("--zstd-level", config.zstdLevel, "zstd compression level for --store-zstd")
+        ->check(CLI::Range(1, 19))
+        ->default_val(3);
+    app.add_option("--zstd-threads", config.zstdThreads,
+                   "zstd compression threads shared by all transfers (0 = one per hardware thread)")
+        ->check(CLI::Range(0, 256))
+        ->default_val(0);
+    app.add_option("--zstd-frame-kb", config.zstdFrameKb,
+                   "Uncompressed size of each seekable frame, the unit of random access")
+        ->check(CLI::Range(64, 1048576))
+        ->default_val(2048);
+
+    // Optional flag: fetch duplicate URLs once
+    app.add_flag("--single-flight", config.singleFlight,
+                 "Fetch each URL of a batch once and link or copy it to every destination that lists it; "
+                 "wait for other processes already writing the same destination instead of refetching it");
+
+    // Optional flag: checksums published next to the files or in response headers
+    app.add_flag("--discover-checksums", config.discoverChecksums,
+                 "Verify batch jobs without a checksum against SHA256SUMS or <file>.sha256 found next to "
+                 "them (fetched once per directory) or a digest header on the response");
+
+    // Optional flags: machine-readable events instead of the progress bar
+    app.add_option("--events", config.eventStream,
+                   "Write start/progress/retry/verify/complete events as NDJSON to fd:N, unix:PATH "
+                   "(a listening socket) or a file, instead of drawing a progress bar");
+    app.add_option("--progress-interval-ms", config.progressIntervalMs,
+                   "How often transfer progress is sampled for the progress bar and --events")
+        ->check(CLI::Range(10, 60000))
+        ->default_val(250);
+
+    // Optional flag: --dest-root (repeatable; batch mode places each file on one of them)
+    app.add_option("--dest-root", config.destinationRoots,
+                   "Root directory on one disk of a destination pool (repeat for each disk); batch "
+                   "destinations become relative paths placed by free space and write throughput");
+    app.add_option("--placement-index", config.placementIndex,
+                   "File recording which root each pooled file went to (default: "
+                   ".placement-index in the first --dest-root)");
+
+    // Optional flags: network metadata cache location / opt-out
+    app.add_option("--cache-dir", config.cacheDir,
+                   "Directory for the persistent DNS/redirect/TLS session cache");
+    app.add_flag("--no-net-cache", config.disableNetworkCache,
+                 "Do not load or save cached network metadata");
+
     // Optional flag: --version (for help display only, actual handling is done above)
     app.add_flag("-v,--version", config.showVersion, "Display version information");
 
@@ -87,6 +305,33 @@ int main(int argc, char *argv[])
         return app.exit(e);
     }
 
+    if (config.inputFile.empty() && (config.url.empty() || config.destination.empty()))
+    {
+        return app.exit(CLI::RequiredError("URL and DESTINATION (or --input-file)"));
+    }
+    if (config.follow && !config.inputFile.empty())
+    {
+        return app.exit(CLI::ValidationError("--follow", "follows a single URL, not an --input-file batch"));
+    }
+    if (config.mirror && (config.follow || !config.inputFile.empty()))
+    {
+        return app.exit(CLI::ValidationError("--mirror", "takes URL and DESTINATION, without --follow or --input-file"));
+    }
+
+    // Thousands of concurrent transfers need more descriptors than the usual soft limit of 1024
+    FdCache::raiseOpenFileLimit();
+    BufferArena::instance().useHugePages(config.hugePages);
+
+    if (config.kernelTls)
+    {
+        config.showStats = true;
+        if (!NativeHttpClient::kernelTlsAvailable())
+        {
+            fmt::print(stderr, "Warning: kernel TLS is not available (try 'modprobe tls'); "
+                               "downloads will decrypt in userspace.\n");
+        }
+    }
+
     // ====================================================================
     // DISPLAY CONFIGURATION
     // ====================================================================
@@ -94,6 +339,116 @@ int main(int argc, char *argv[])
     fmt::print("Download Manager v1.0\n");
     fmt::print("====================================\n\n");
 
+    // ====================================================================
+    // BATCH MODE
+    // ====================================================================
+
+    if (!config.inputFile.empty())
+    {
+        try
+        {
+            std::vector<DownloadJob> jobs = loadManifest(config.inputFile);
+            fmt::print("Batch: {} jobs from {}\n\n", jobs.size(), config.inputFile);
+
+            BatchRunner runner(config, makeNetworkCache(config));
+            BatchSummary summary = runner.run(jobs);
+
+            fmt::print("\nBatch finished: {} succeeded, {} failed\n", summary.succeeded, summary.failed);
+            return summary.failed == 0 ? 0 : 1;
+        }
+        catch (const std::exception &e)
+        {
+            fmt::print(stderr, "✗ Fatal error: {}\n", e.what());
+            return 1;
+        }
+    }
+
+    // ====================================================================
+    // MIRROR MODE
+    // ====================================================================
+
+    if (config.mirror)
+    {
+        try
+        {
+            MirrorOptions options;
+            options.parallel = static_cast<size_t>(config.mirrorParallel);
+            options.maxRetries = config.maxRetries;
+            options.caCertFile = config.caCertFile;
+
+            std::shared_ptr<NetworkCache> networkCache = makeNetworkCache(config);
+            Mirror mirror(config.url, config.destination, options, networkCache);
+            fmt::print("Crawling {} ...\n", config.url);
+            std::vector<DownloadJob> jobs = mirror.plan();
+
+            const Mirror::Stats &stats = mirror.stats();
+            fmt::print("Listed {} files in {} directories ({} pages, {} failed): {} new or changed, "
+                       "{} unchanged, {} adopted, {} gone\n\n",
+                       stats.files, stats.directories + 1, stats.pages, stats.pageFailures, stats.queued,
+                       stats.unchanged, stats.adopted, stats.removed);
+
+            BatchSummary summary;
+            if (!jobs.empty())
+            {
+                BatchRunner runner(config, networkCache);
+                summary = runner.run(jobs);
+            }
+            if (!mirror.commit(summary.failedJobs))
+            {
+                fmt::print(stderr, "✗ Cannot save the mirror state; the next run will re-check everything\n");
+            }
+
+            fmt::print("\nMirror finished: {} downloaded, {} failed\n", summary.succeeded, summary.failed);
+            return summary.failed == 0 && stats.pageFailures == 0 ? 0 : 1;
+        }
+        catch (const std::exception &e)
+        {
+            fmt::print(stderr, "✗ Fatal error: {}\n", e.what());
+            return 1;
+        }
+    }
+
+    // ====================================================================
+    // FOLLOW MODE
+    // ====================================================================
+
+    if (config.follow)
+    {
+        try
+        {
+            FollowOptions options;
+            options.minInterval = std::chrono::milliseconds(config.followMinIntervalMs);
+            options.maxInterval =
+                std::chrono::milliseconds(std::max(config.followMinIntervalMs, config.followMaxIntervalMs));
+            options.duration = std::chrono::seconds(config.followForSeconds);
+            options.maxFailures = config.maxRetries;
+            options.timeoutSeconds = config.timeoutSeconds;
+            options.caCertFile = config.caCertFile;
+
+            fmt::print("Following {} -> {}\n\n", config.url, config.destination);
+            TailFollower follower(config.url, config.destination, options, makeNetworkCache(config));
+            std::string error;
+            const bool ok = follower.run(error);
+
+            const TailFollower::Stats &stats = follower.stats();
+            fmt::print("\n{} polls: {} with new data, {} unchanged, {} rotations, {} failed; "
+                       "{:.2f} MB appended over {} connection(s)\n",
+                       stats.polls, stats.grew, stats.unchanged, stats.rotations, stats.failures,
+                       static_cast<double>(stats.bytes) / (1024.0 * 1024.0), stats.connections);
+            if (!ok)
+            {
+                fmt::print(stderr, "✗ Follow stopped: {}\n", error);
+                return 1;
+            }
+            return 0;
+        }
+        catch (const std::exception &e)
+        {
+            fmt::print(stderr, "✗ Fatal error: {}\n", e.what());
+            return 1;
+        }
+    }
+
     fmt::print("Configuration:\n");
     fmt::print("  URL:         {}\n", config.url);
     fmt::print("  Destination: {}\n", config.destination);
@@ -111,10 +466,50 @@ int main(int argc, char *argv[])
     try
     {
         // Create HTTP client (RAII ensures cleanup)
-        HttpClient client;
+        HttpClient client(makeNetworkCache(config));
 
         // Apply configuration
         client.setMaxRetries(config.maxRetries);
+        client.setKernelTls(config.kernelTls);
+        client.setZeroCopy(config.zeroCopy);
+        client.setPageCachePolicy(config.pageCache);
+        client.setScratchDir(config.scratchDir);
+        if (config.durability != DurabilityMode::None)
+        {
+            client.setDurability(std::make_shared<Durability>(config.durability));
+        }
+        client.setCaCertFile(config.caCertFile);
+        if (!config.interfaces.empty())
+        {
+            client.setInterface(config.interfaces.front());
+        }
+
+        // One-job event stream: same events as a batch, job 0
+        std::shared_ptr<EventStream> events;
+        auto progress = std::make_shared<ProgressAggregator>(std::chrono::milliseconds(config.progressIntervalMs));
+        if (!config.eventStream.empty())
+        {
+            events = std::make_shared<EventStream>(config.eventStream,
+                                                   std::chrono::milliseconds(config.progressIntervalMs));
+            events->beginBatch();
+            events->start(0, config.url, config.destination);
+            progress->addFrontend([events](const ProgressSample &sample) { events->sample(sample); });
+        }
+        else
+        {
+            auto display = std::make_shared<ProgressDisplay>();
+            progress->addFrontend([display](const ProgressSample &sample) { display->render(sample); });
+        }
+        client.setProgress(progress, events, 0);
+        auto reportOutcome = [&](bool ok, const std::string &error)
+        {
+            if (events)
+            {
+                events->complete(0, ok, ok ? client.getLastTransferStats().bytes : 0, client.getRetryCount(),
+                                 ok ? config.destination : "", error);
+                events->finish(ok ? 1 : 0, ok ? 0 : 1);
+            }
+        };
 
         fmt::print("Starting download...\n\n");
 
@@ -131,6 +526,11 @@ int main(int argc, char *argv[])
             }
             fmt::print("!\n");
 
+            if (config.showStats)
+            {
+                fmt::print("  {}\n", formatTransferStats(client.getLastTransferStats()));
+            }
+
             // Verify checksum if provided
             if (config.expectedChecksum)
             {
@@ -141,6 +541,10 @@ int main(int argc, char *argv[])
                     bool isValid = ChecksumVerifier::verify(
                         config.destination,
                         config.expectedChecksum.value());
+                    if (events)
+                    {
+                        events->verify(0, isValid, config.expectedChecksum.value(), false);
+                    }
 
                     if (isValid)
                     {
@@ -153,31 +557,29 @@ int main(int argc, char *argv[])
                         fmt::print(stderr, "  File may be corrupted or incomplete.\n");
                         
                         // Move file to quarantine
-                        std::filesystem::path quarantinePath = 
-                            std::filesystem::path(config.destination).parent_path() / "quarantine";
-                        std::filesystem::create_directories(quarantinePath);
-                        
-                        std::filesystem::path quarantineFile = 
-                            quarantinePath / std::filesystem::path(config.destination).filename();
-                        
-                        std::filesystem::rename(config.destination, quarantineFile);
+                        std::filesystem::path quarantineFile =
+                            ChecksumVerifier::quarantine(config.destination);
                         fmt::print(stderr, "  File moved to: {}\n", quarantineFile.string());
-                        
+                        reportOutcome(false, "Checksum verification FAILED (moved to " +
+                                                 quarantineFile.string() + ")");
                         return 1;
                     }
                 }
                 catch (const std::exception &e)
                 {
                     fmt::print(stderr, "✗ Checksum verification error: {}\n", e.what());
+                    reportOutcome(false, e.what());
                     return 1;
                 }
             }
 
+            reportOutcome(true, "");
             return 0;
         }
         else
         {
             fmt::print(stderr, "✗ Download failed: {}\n", client.getLastError());
+            reportOutcome(false, client.getLastError());
             return 1;
         }
     }
@@ -0,0 +1,102 @@
+#include "memory_budget.hpp"
+
+#include <algorithm>
+
+MemoryBudget::Reservation::Reservation(MemoryBudget *budget, Stage stage, size_t bytes)
+    : budget_(budget), stage_(stage), bytes_(budget ? budget->acquire(stage, bytes) : 0)
+{
+}
+
+MemoryBudget::Reservation::~Reservation()
+{
+    if (budget_)
+    {
+        budget_->release(stage_, bytes_);
+    }
+}
+
+MemoryBudget::MemoryBudget(size_t limit) : limit_(limit)
+{
+}
+
+bool MemoryBudget::tryAcquire(Stage stage, size_t bytes, size_t headroom)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (limit_ != 0 && inUse_ + bytes + headroom > limit_)
+    {
+        return false;
+    }
+
+    charge(stage, bytes);
+    return true;
+}
+
+size_t MemoryBudget::acquire(Stage stage, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (limit_ != 0)
+    {
+        bytes = std::min(bytes, limit_);
+        released_.wait(lock, [&]
+                       { return inUse_ + bytes <= limit_; });
+    }
+
+    charge(stage, bytes);
+    return bytes;
+}
+
+void MemoryBudget::charge(Stage stage, size_t bytes)
+{
+    const auto index = static_cast<size_t>(stage);
+    inUse_ += bytes;
+    current_[index] += bytes;
+    peak_[index] = std::max(peak_[index], current_[index]);
+}
+
+void MemoryBudget::release(Stage stage, size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto index = static_cast<size_t>(stage);
+        inUse_ -= bytes;
+        current_[index] -= bytes;
+    }
+    released_.notify_all();
+}
+
+void MemoryBudget::countPause()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pauses_;
+}
+
+size_t MemoryBudget::pauses() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pauses_;
+}
+
+std::vector<MemoryBudget::StageUsage> MemoryBudget::usage() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StageUsage> result;
+    for (size_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        result.push_back(StageUsage{stageName(static_cast<Stage>(i)), current_[i], peak_[i]});
+    }
+    return result;
+}
+
+const char *MemoryBudget::stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Receive:
+        return "receive";
+    case Stage::WriteBuffer:
+        return "write-buffer";
+    case Stage::PostProcess:
+        return "post-process";
+    }
+    return "unknown";
+}
@@ -0,0 +1,482 @@
+#include "mirror.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <curl/curl.h>
+#include <fmt/core.h>
+
+#include "curl_share.hpp"
+
+namespace
+{
+    size_t findNoCase(const std::string &text, const char *needle, size_t from)
+    {
+        auto found = std::search(text.begin() + static_cast<std::ptrdiff_t>(std::min(from, text.size())), text.end(),
+                                 needle, needle + std::strlen(needle),
+                                 [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) ==
+                                                             std::tolower(static_cast<unsigned char>(b)); });
+        return found == text.end() ? std::string::npos : static_cast<size_t>(found - text.begin());
+    }
+
+    // The few entities that show up in autoindex hrefs and names
+    std::string decodeEntities(std::string text)
+    {
+        static const std::pair<const char *, const char *> entities[] = {
+            {"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&#39;", "'"}, {"&nbsp;", " "}};
+        for (const auto &[entity, replacement] : entities)
+        {
+            for (size_t at = text.find(entity); at != std::string::npos; at = text.find(entity, at + 1))
+            {
+                text.replace(at, std::strlen(entity), replacement);
+            }
+        }
+        return text;
+    }
+
+    std::string percentDecode(const std::string &text)
+    {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] == '%' && i + 2 < text.size() && std::isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+                std::isxdigit(static_cast<unsigned char>(text[i + 2])))
+            {
+                decoded.push_back(static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else
+            {
+                decoded.push_back(text[i]);
+            }
+        }
+        return decoded;
+    }
+
+    std::string stripTags(const std::string &html)
+    {
+        std::string text;
+        bool inTag = false;
+        for (char c : html)
+        {
+            if (c == '<')
+            {
+                inTag = true;
+                text.push_back(' '); // "</td><td>" separates columns
+            }
+            else if (c == '>')
+            {
+                inTag = false;
+            }
+            else if (!inTag)
+            {
+                text.push_back(c);
+            }
+        }
+        return decodeEntities(text);
+    }
+
+    bool looksLikeDate(const std::string &token)
+    {
+        return std::any_of(token.begin(), token.end(), ::isdigit) &&
+               (token.find('-') != std::string::npos || token.find('/') != std::string::npos);
+    }
+
+    bool looksLikeTime(const std::string &token)
+    {
+        return token.find(':') != std::string::npos && std::any_of(token.begin(), token.end(), ::isdigit);
+    }
+
+    // href="..." (or '...', or bare) of an <a ...> tag; "" if none
+    std::string hrefOf(const std::string &tag)
+    {
+        size_t at = findNoCase(tag, "href", 0);
+        while (at != std::string::npos)
+        {
+            size_t value = tag.find_first_not_of(" \t\r\n", at + 4);
+            if (value != std::string::npos && tag[value] == '=')
+            {
+                value = tag.find_first_not_of(" \t\r\n", value + 1);
+                if (value == std::string::npos)
+                {
+                    return "";
+                }
+                if (tag[value] == '"' || tag[value] == '\'')
+                {
+                    const size_t end = tag.find(tag[value], value + 1);
+                    return end == std::string::npos ? "" : tag.substr(value + 1, end - value - 1);
+                }
+                const size_t end = tag.find_first_of(" \t\r\n>", value);
+                return tag.substr(value, end == std::string::npos ? std::string::npos : end - value);
+            }
+            at = findNoCase(tag, "href", at + 4);
+        }
+        return "";
+    }
+
+    size_t writeToString(char *ptr, size_t size, size_t nmemb, void *userdata)
+    {
+        static_cast<std::string *>(userdata)->append(ptr, size * nmemb);
+        return size * nmemb;
+    }
+}
+
+std::vector<IndexEntry> parseIndexPage(const std::string &html)
+{
+    std::vector<IndexEntry> entries;
+    size_t position = 0;
+    while ((position = findNoCase(html, "<a ", position)) != std::string::npos)
+    {
+        const size_t tagEnd = html.find('>', position);
+        const size_t close = tagEnd == std::string::npos ? std::string::npos : findNoCase(html, "</a>", tagEnd);
+        if (close == std::string::npos)
+        {
+            break;
+        }
+        std::string href = decodeEntities(hrefOf(html.substr(position, tagEnd - position)));
+        position = close + 4;
+
+        // Only links to children of this directory: no parent, absolute, query or fragment links
+        IndexEntry entry;
+        entry.directory = !href.empty() && href.back() == '/';
+        if (entry.directory)
+        {
+            href.pop_back();
+        }
+        if (href.rfind("./", 0) == 0)
+        {
+            href.erase(0, 2);
+        }
+        if (href.empty() || href.find_first_of("/?#:") != std::string::npos)
+        {
+            continue;
+        }
+        entry.href = href;
+        entry.name = percentDecode(href);
+        if (entry.name == "." || entry.name == ".." || entry.name.find_first_of("/\t\r\n") != std::string::npos)
+        {
+            continue;
+        }
+
+        // Date and size follow the link on its line (nginx, Apache <pre>) or in its table row (Apache, lighttpd)
+        const size_t lineEnd = std::min({html.find('\n', position), findNoCase(html, "<a ", position),
+                                         findNoCase(html, "</tr>", position)});
+        std::istringstream columns(stripTags(html.substr(position, lineEnd == std::string::npos
+                                                                       ? std::string::npos
+                                                                       : lineEnd - position)));
+        std::vector<std::string> tokens;
+        for (std::string token; columns >> token;)
+        {
+            tokens.push_back(token);
+        }
+        if (tokens.size() >= 2 && looksLikeDate(tokens[0]) && looksLikeTime(tokens[1]))
+        {
+            entry.modified = tokens[0] + " " + tokens[1];
+            if (tokens.size() >= 3 && !entry.directory && tokens[2] != "-")
+            {
+                entry.size = tokens[2];
+            }
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+bool listedSizeMatches(const std::string &listed, std::uintmax_t bytes)
+{
+    char *end = nullptr;
+    const double value = std::strtod(listed.c_str(), &end);
+    if (end == listed.c_str() || value < 0)
+    {
+        return false;
+    }
+    static const std::string units = "KMGTP";
+    const char suffix = static_cast<char>(std::toupper(static_cast<unsigned char>(*end)));
+    if (suffix == '\0')
+    {
+        return static_cast<double>(bytes) == value; // Exact byte count
+    }
+    const size_t power = units.find(suffix);
+    if (power == std::string::npos)
+    {
+        return false;
+    }
+    // "1.2M" is within a tenth of a unit, "12M" within one (servers round either way)
+    const double unit = std::pow(1024.0, static_cast<double>(power + 1));
+    const double tolerance = (listed.find('.') != std::string::npos ? 0.1 : 1.0) * unit;
+    return std::fabs(static_cast<double>(bytes) - value * unit) <= tolerance;
+}
+
+struct Mirror::Crawl
+{
+    struct Directory
+    {
+        std::string path; // Relative, decoded, "" or ending in '/'
+        std::string url;
+        size_t depth = 0;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Directory> queue;
+    size_t busy = 0; // Pages being fetched (they may add directories)
+    std::vector<ListedFile> files;
+    CurlShare share;
+};
+
+Mirror::Mirror(std::string baseUrl, std::filesystem::path root, MirrorOptions options,
+               std::shared_ptr<NetworkCache> networkCache)
+    : baseUrl_(std::move(baseUrl)), root_(std::move(root)), options_(std::move(options)),
+      networkCache_(std::move(networkCache))
+{
+    if (baseUrl_.empty() || baseUrl_.back() != '/')
+    {
+        baseUrl_ += '/';
+    }
+    if (options_.statePath.empty())
+    {
+        options_.statePath = root_ / ".mirror-state";
+    }
+    options_.parallel = std::max<size_t>(1, options_.parallel);
+    loadState();
+}
+
+std::vector<DownloadJob> Mirror::plan()
+{
+    stats_ = Stats{};
+    next_.clear();
+    planned_.clear();
+
+    Crawl crawl;
+    crawl.queue.push_back(Crawl::Directory{"", baseUrl_, 0});
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options_.parallel; ++i)
+    {
+        workers.emplace_back([this, &crawl] { crawlWorker(crawl); });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Diff the listing against the state and the local tree
+    std::sort(crawl.files.begin(), crawl.files.end(),
+              [](const ListedFile &a, const ListedFile &b) { return a.path < b.path; });
+    std::vector<DownloadJob> jobs;
+    for (ListedFile &file : crawl.files)
+    {
+        ++stats_.files;
+        const std::filesystem::path local = root_ / std::filesystem::u8path(file.path);
+        std::error_code error;
+        const std::uintmax_t localSize = std::filesystem::file_size(local, error);
+        const bool present = !error;
+
+        auto known = state_.find(file.path);
+        if (present && known != state_.end() && !known->second.pending && known->second == file.listed)
+        {
+            ++stats_.unchanged;
+            next_[file.path] = file.listed;
+            continue;
+        }
+        // Never a path an earlier run planned: that one has a state entry, pending if it failed
+        if (present && known == state_.end() && listedSizeMatches(file.listed.size, localSize))
+        {
+            ++stats_.adopted; // Mirrored before there was a state (or by another tool)
+            next_[file.path] = file.listed;
+            continue;
+        }
+
+        ++stats_.queued;
+        DownloadJob job;
+        job.url = file.url;
+        job.destination = local.string();
+        jobs.push_back(std::move(job));
+        planned_.push_back(std::move(file));
+    }
+
+    std::set<std::string> queued;
+    for (const ListedFile &file : planned_)
+    {
+        queued.insert(file.path);
+    }
+    for (const auto &[path, fingerprint] : state_)
+    {
+        if (next_.count(path) == 0 && queued.count(path) == 0)
+        {
+            ++stats_.removed;
+        }
+    }
+    return jobs;
+}
+
+bool Mirror::commit(const std::vector<size_t> &failedJobs)
+{
+    std::vector<bool> failed(planned_.size(), false);
+    for (size_t index : failedJobs)
+    {
+        if (index < failed.size())
+        {
+            failed[index] = true;
+        }
+    }
+    for (size_t i = 0; i < planned_.size(); ++i)
+    {
+        Fingerprint &entry = next_[planned_[i].path];
+        entry = planned_[i].listed;
+        entry.pending = failed[i]; // Fetched again next time, whatever is on disk
+    }
+
+    // Written aside and renamed, so an interrupted run keeps the previous state
+    std::error_code error;
+    if (options_.statePath.has_parent_path())
+    {
+        std::filesystem::create_directories(options_.statePath.parent_path(), error);
+    }
+    const std::filesystem::path temporary = options_.statePath.string() + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        for (const auto &[path, fingerprint] : next_)
+        {
+            out << path << '\t' << fingerprint.modified << '\t' << fingerprint.size
+                << (fingerprint.pending ? "\tpending" : "") << '\n';
+        }
+        if (!out)
+        {
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, options_.statePath, error);
+    if (error)
+    {
+        return false;
+    }
+    state_ = next_;
+    return true;
+}
+
+void Mirror::crawlWorker(Crawl &crawl)
+{
+    // One handle per thread keeps its connection; the share lets threads reuse each other's
+    std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(), curl_easy_cleanup);
+    if (!curl)
+    {
+        return;
+    }
+    crawl.share.attach(curl.get());
+    curl_easy_setopt(curl.get(), CURLOPT_USERAGENT, "DownloadManager/1.90");
+    curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl.get(), CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl.get(), CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, static_cast<long>(options_.timeoutSeconds));
+    curl_easy_setopt(curl.get(), CURLOPT_ACCEPT_ENCODING, ""); // Listings compress well
+    curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, writeToString);
+    if (!options_.caCertFile.empty())
+    {
+        curl_easy_setopt(curl.get(), CURLOPT_CAINFO, options_.caCertFile.c_str());
+    }
+    if (networkCache_)
+    {
+        networkCache_->applyTo(curl.get());
+    }
+
+    for (;;)
+    {
+        Crawl::Directory directory;
+        {
+            std::unique_lock<std::mutex> lock(crawl.mutex);
+            crawl.wake.wait(lock, [&] { return !crawl.queue.empty() || crawl.busy == 0; });
+            if (crawl.queue.empty())
+            {
+                return; // Nothing queued and nobody left who could queue more
+            }
+            directory = std::move(crawl.queue.front());
+            crawl.queue.pop_front();
+            ++crawl.busy;
+        }
+
+        std::string page;
+        CURLcode result = CURLE_OK;
+        for (int attempt = 0; attempt <= options_.maxRetries; ++attempt)
+        {
+            page.clear();
+            curl_easy_setopt(curl.get(), CURLOPT_URL, directory.url.c_str());
+            curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &page);
+            result = curl_easy_perform(curl.get());
+            long httpCode = 0;
+            curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &httpCode);
+            if (result == CURLE_OK || (httpCode >= 400 && httpCode < 500))
+            {
+                break; // Done, or a client error that won't go away
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(500 << attempt));
+        }
+
+        // Parsed before taking the lock, so the threads parse their pages side by side
+        std::vector<Crawl::Directory> directories;
+        std::vector<ListedFile> files;
+        if (result == CURLE_OK)
+        {
+            for (const IndexEntry &entry : parseIndexPage(page))
+            {
+                if (entry.directory)
+                {
+                    if (directory.depth + 1 <= options_.maxDepth)
+                    {
+                        directories.push_back(Crawl::Directory{directory.path + entry.name + "/",
+                                                               directory.url + entry.href + "/", directory.depth + 1});
+                    }
+                    continue;
+                }
+                files.push_back(ListedFile{directory.path + entry.name, directory.url + entry.href,
+                                           Fingerprint{entry.modified, entry.size}});
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(crawl.mutex);
+        --crawl.busy;
+        if (result != CURLE_OK)
+        {
+            ++stats_.pageFailures;
+            fmt::print(stderr, "✗ Listing {}: {}\n", directory.url, curl_easy_strerror(result));
+        }
+        else
+        {
+            ++stats_.pages;
+            stats_.directories += directories.size();
+            std::move(directories.begin(), directories.end(), std::back_inserter(crawl.queue));
+            std::move(files.begin(), files.end(), std::back_inserter(crawl.files));
+        }
+        crawl.wake.notify_all();
+    }
+}
+
+void Mirror::loadState()
+{
+    std::ifstream in(options_.statePath);
+    for (std::string line; std::getline(in, line);)
+    {
+        const size_t first = line.find('\t');
+        const size_t second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+        if (second == std::string::npos)
+        {
+            continue; // Torn last line of an interrupted write: that file is simply fetched again
+        }
+        const size_t third = line.find('\t', second + 1);
+        Fingerprint &fingerprint = state_[line.substr(0, first)];
+        fingerprint.modified = line.substr(first + 1, second - first - 1);
+        fingerprint.size = line.substr(second + 1, third == std::string::npos ? std::string::npos : third - second - 1);
+        fingerprint.pending = third != std::string::npos && line.compare(third + 1, std::string::npos, "pending") == 0;
+    }
+}
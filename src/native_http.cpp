@@ -0,0 +1,647 @@
+#include "native_http.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+namespace
+{
+    // Owns a POSIX file descriptor (closed on destruction)
+    class FileDescriptor
+    {
+    public:
+        explicit FileDescriptor(int fd = -1) : fd_(fd) {}
+        ~FileDescriptor()
+        {
+            if (fd_ >= 0)
+                ::close(fd_);
+        }
+        FileDescriptor(const FileDescriptor &) = delete;
+        FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+        int get() const { return fd_; }
+
+    private:
+        int fd_;
+    };
+
+    struct ParsedUrl
+    {
+        std::string scheme;
+        std::string host; // Without IPv6 brackets
+        std::string port;
+        std::string target; // Path plus query, as sent in the request line
+        std::string hostHeader;
+    };
+
+    bool parseUrl(const std::string &url, ParsedUrl &out)
+    {
+        std::unique_ptr<CURLU, decltype(&curl_url_cleanup)> handle(curl_url(), curl_url_cleanup);
+        if (!handle || curl_url_set(handle.get(), CURLUPART_URL, url.c_str(), 0) != CURLUE_OK)
+        {
+            return false;
+        }
+
+        auto part = [&](CURLUPart which, unsigned flags, std::string &value) -> bool
+        {
+            char *text = nullptr;
+            CURLUcode rc = curl_url_get(handle.get(), which, &text, flags);
+            if (rc == CURLUE_OK)
+            {
+                value = text;
+                curl_free(text);
+                return true;
+            }
+            return false;
+        };
+
+        std::string path, query;
+        if (!part(CURLUPART_SCHEME, 0, out.scheme) || !part(CURLUPART_HOST, 0, out.host) ||
+            !part(CURLUPART_PORT, CURLU_DEFAULT_PORT, out.port) || !part(CURLUPART_PATH, 0, path))
+        {
+            return false;
+        }
+        part(CURLUPART_QUERY, 0, query);
+
+        out.target = path.empty() ? "/" : path;
+        if (!query.empty())
+        {
+            out.target += "?" + query;
+        }
+
+        // Host header carries the port only when it isn't the scheme default
+        std::string explicitPort;
+        out.hostHeader = out.host;
+        if (part(CURLUPART_PORT, 0, explicitPort))
+        {
+            out.hostHeader += ":" + explicitPort;
+        }
+
+        if (out.host.size() > 2 && out.host.front() == '[' && out.host.back() == ']')
+        {
+            out.host = out.host.substr(1, out.host.size() - 2);
+        }
+        return true;
+    }
+
+    bool isIpLiteral(const std::string &host)
+    {
+        unsigned char buffer[sizeof(in6_addr)];
+        return inet_pton(AF_INET, host.c_str(), buffer) == 1 ||
+               inet_pton(AF_INET6, host.c_str(), buffer) == 1;
+    }
+
+    int connectTo(const ParsedUrl &url, int timeoutSeconds, std::string &error)
+    {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        addrinfo *results = nullptr;
+        int rc = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &results);
+        if (rc != 0)
+        {
+            error = fmt::format("Cannot resolve {}: {}", url.host, gai_strerror(rc));
+            return -1;
+        }
+        std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> guard(results, freeaddrinfo);
+
+        // Idle timeout for connect/send/recv (on Linux SO_SNDTIMEO also bounds connect)
+        timeval timeout{std::min(timeoutSeconds, 30), 0};
+
+        for (addrinfo *ai = results; ai; ai = ai->ai_next)
+        {
+            int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0)
+            {
+                continue;
+            }
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+            if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            {
+                return fd;
+            }
+            error = fmt::format("Cannot connect to {}:{}: {}", url.host, url.port, std::strerror(errno));
+            ::close(fd);
+        }
+        return -1;
+    }
+
+    // Plain or TLS byte stream over a connected socket
+    class Connection
+    {
+    public:
+        Connection(int fd, SSL *ssl) : fd_(fd), ssl_(ssl, SSL_free) {}
+
+        // Bytes read, 0 on orderly EOF, -1 on error
+        long read(char *buffer, size_t length)
+        {
+            if (!ssl_)
+            {
+                ssize_t n;
+                do
+                {
+                    n = ::recv(fd_, buffer, length, 0);
+                } while (n < 0 && errno == EINTR);
+                return static_cast<long>(n);
+            }
+
+            size_t n = 0;
+            if (SSL_read_ex(ssl_.get(), buffer, length, &n) == 1)
+            {
+                return static_cast<long>(n);
+            }
+            return SSL_get_error(ssl_.get(), 0) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+        }
+
+        bool writeAll(const std::string &data)
+        {
+            size_t offset = 0;
+            while (offset < data.size())
+            {
+                if (ssl_)
+                {
+                    size_t n = 0;
+                    if (SSL_write_ex(ssl_.get(), data.data() + offset, data.size() - offset, &n) != 1)
+                    {
+                        return false;
+                    }
+                    offset += n;
+                }
+                else
+                {
+                    ssize_t n = ::send(fd_, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+                    offset += static_cast<size_t>(n);
+                }
+            }
+            return true;
+        }
+
+        SSL *ssl() const { return ssl_.get(); }
+
+    private:
+        int fd_;
+        std::unique_ptr<SSL, decltype(&SSL_free)> ssl_;
+    };
+
+    bool writeAllToFile(int fd, const char *data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t n = ::write(fd, data, length);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    std::string toLower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    std::string trim(const std::string &text)
+    {
+        size_t begin = text.find_first_not_of(" \t");
+        size_t end = text.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+    }
+
+    std::string openSslError()
+    {
+        unsigned long code = ERR_get_error();
+        if (code == 0)
+        {
+            return "unknown TLS error";
+        }
+        char text[256];
+        ERR_error_string_n(code, text, sizeof(text));
+        return text;
+    }
+}
+
+NativeHttpClient::NativeHttpClient(Options options)
+    : options_(std::move(options)), sslContext_(nullptr, SSL_CTX_free)
+{
+}
+
+NativeHttpClient::~NativeHttpClient() = default;
+
+bool NativeHttpClient::supports(const std::string &url)
+{
+    return url.rfind("https://", 0) == 0 || url.rfind("http://", 0) == 0;
+}
+
+bool NativeHttpClient::kernelTlsAvailable()
+{
+    // Lists ULPs the kernel can attach right now ("tls" once the module is loaded)
+    std::ifstream ulps("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string name;
+    while (ulps >> name)
+    {
+        if (name == "tls")
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NativeHttpClient::fetch(const std::string &url, int fd, curl_off_t &resumeOffset,
+                             Response &response, const ProgressFn &progress)
+{
+    response = Response{};
+
+    ParsedUrl target;
+    if (!parseUrl(url, target))
+    {
+        lastError_ = "Cannot parse URL";
+        return false;
+    }
+    bool useTls = target.scheme == "https";
+
+    if (useTls && !sslContext_)
+    {
+        sslContext_.reset(SSL_CTX_new(TLS_client_method()));
+        if (!sslContext_)
+        {
+            lastError_ = openSslError();
+            return false;
+        }
+
+        // Same trust policy as the libcurl path: always verify the peer
+        SSL_CTX_set_verify(sslContext_.get(), SSL_VERIFY_PEER, nullptr);
+        bool trustLoaded = options_.caCertFile.empty()
+                               ? SSL_CTX_set_default_verify_paths(sslContext_.get()) == 1
+                               : SSL_CTX_load_verify_locations(sslContext_.get(),
+                                                               options_.caCertFile.c_str(), nullptr) == 1;
+        if (!trustLoaded)
+        {
+            lastError_ = fmt::format("Cannot load CA certificates: {}", openSslError());
+            sslContext_.reset();
+            return false;
+        }
+
+        if (options_.kernelTls)
+        {
+            SSL_CTX_set_options(sslContext_.get(), SSL_OP_ENABLE_KTLS);
+        }
+    }
+
+    FileDescriptor socketFd(connectTo(target, options_.timeoutSeconds, lastError_));
+    if (socketFd.get() < 0)
+    {
+        return false;
+    }
+
+    SSL *ssl = nullptr;
+    if (useTls)
+    {
+        ssl = SSL_new(sslContext_.get());
+        if (!ssl)
+        {
+            lastError_ = openSslError();
+            return false;
+        }
+    }
+    Connection connection(socketFd.get(), ssl);
+
+    if (ssl)
+    {
+        // A socket BIO (not a custom one) is what lets OpenSSL hand keys to the kernel
+        SSL_set_fd(ssl, socketFd.get());
+        if (isIpLiteral(target.host))
+        {
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), target.host.c_str());
+        }
+        else
+        {
+            SSL_set_tlsext_host_name(ssl, target.host.c_str());
+            SSL_set1_host(ssl, target.host.c_str());
+        }
+
+        if (SSL_connect(ssl) != 1)
+        {
+            lastError_ = fmt::format("TLS handshake failed: {}", openSslError());
+            return false;
+        }
+        response.kernelTlsActive = BIO_get_ktls_recv(SSL_get_rbio(ssl)) != 0;
+    }
+
+    std::string request = fmt::format("GET {} HTTP/1.1\r\n"
+                                      "Host: {}\r\n"
+                                      "User-Agent: DownloadManager/1.90\r\n"
+                                      "Accept: */*\r\n"
+                                      "Connection: close\r\n",
+                                      target.target, target.hostHeader);
+    if (resumeOffset > 0)
+    {
+        request += fmt::format("Range: bytes={}-\r\n", resumeOffset);
+    }
+    request += "\r\n";
+
+    if (!connection.writeAll(request))
+    {
+        lastError_ = "Failed to send request";
+        return false;
+    }
+
+    // Read until the end of the header block; keep any body bytes that came along
+    std::vector<char> buffer(BUFFER_SIZE);
+    std::string head;
+    size_t headerEnd = std::string::npos;
+    while (headerEnd == std::string::npos)
+    {
+        long n = connection.read(buffer.data(), buffer.size());
+        if (n <= 0)
+        {
+            lastError_ = "Connection closed before response headers";
+            return false;
+        }
+        head.append(buffer.data(), static_cast<size_t>(n));
+        headerEnd = head.find("\r\n\r\n");
+        if (headerEnd == std::string::npos && head.size() > MAX_HEADER_BYTES)
+        {
+            lastError_ = "Response headers too large";
+            return false;
+        }
+    }
+    std::string leftover = head.substr(headerEnd + 4);
+    head.resize(headerEnd);
+
+    // Status line: "HTTP/1.1 206 Partial Content"
+    size_t lineEnd = head.find("\r\n");
+    std::string statusLine = head.substr(0, lineEnd);
+    if (statusLine.rfind("HTTP/1.", 0) != 0 || statusLine.size() < 12)
+    {
+        lastError_ = "Malformed status line";
+        return false;
+    }
+    response.httpCode = std::strtol(statusLine.c_str() + 9, nullptr, 10);
+
+    std::map<std::string, std::string> headers;
+    size_t pos = lineEnd == std::string::npos ? head.size() : lineEnd + 2;
+    while (pos < head.size())
+    {
+        size_t next = head.find("\r\n", pos);
+        std::string line = head.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+            headers[toLower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+        }
+        pos = next == std::string::npos ? head.size() : next + 2;
+    }
+
+    // Leave redirects, errors and anything unusual to libcurl
+    if (response.httpCode != 200 && response.httpCode != 206)
+    {
+        lastError_ = fmt::format("HTTP status {}", response.httpCode);
+        return false;
+    }
+    if (headers.count("transfer-encoding") && toLower(headers["transfer-encoding"]) != "identity")
+    {
+        lastError_ = "Chunked transfer encoding";
+        return false;
+    }
+    if (headers.count("content-length"))
+    {
+        response.contentLength = std::strtoll(headers["content-length"].c_str(), nullptr, 10);
+    }
+    if (ssl && response.contentLength >= 0)
+    {
+        // The body length is checked against Content-Length here, so a peer that closes without
+        // close_notify after the last byte is fine. A close-delimited body needs close_notify:
+        // without it a truncation would look like the end of the file
+        SSL_set_options(ssl, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    }
+
+    if (response.httpCode == 206)
+    {
+        // Content-Range must start exactly where our file ends
+        const std::string &range = headers["content-range"];
+        if (range.rfind("bytes ", 0) != 0 ||
+            std::strtoll(range.c_str() + 6, nullptr, 10) != resumeOffset)
+        {
+            lastError_ = "Unexpected Content-Range";
+            return false;
+        }
+    }
+    else if (resumeOffset > 0)
+    {
+        // Server ignored Range and sent the whole file: start over
+        if (::ftruncate(fd, 0) != 0 || ::lseek(fd, 0, SEEK_SET) != 0)
+        {
+            lastError_ = fmt::format("Cannot truncate partial file: {}", std::strerror(errno));
+            return false;
+        }
+        resumeOffset = 0;
+    }
+
+    // Stream the body straight to the file
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(options_.timeoutSeconds);
+    const curl_off_t total = response.contentLength > 0 ? response.contentLength : 0;
+
+    if (response.contentLength >= 0 && static_cast<curl_off_t>(leftover.size()) > response.contentLength)
+    {
+        leftover.resize(static_cast<size_t>(response.contentLength)); // Peer sent more than it announced
+    }
+    if (!leftover.empty())
+    {
+        if (!writeAllToFile(fd, leftover.data(), leftover.size()))
+        {
+            lastError_ = fmt::format("Write failed: {}", std::strerror(errno));
+            return false;
+        }
+        response.bytesWritten = static_cast<curl_off_t>(leftover.size());
+    }
+
+#ifdef __linux__
+    if (!ssl && options_.zeroCopy)
+    {
+        curl_off_t remaining = response.contentLength < 0 ? -1 : response.contentLength - response.bytesWritten;
+        return spliceBody(socketFd.get(), fd, remaining, response, progress, deadline);
+    }
+#endif
+
+    while (response.contentLength < 0 || response.bytesWritten < response.contentLength)
+    {
+        if (progress && !progress(total, response.bytesWritten))
+        {
+            lastError_ = "Aborted by progress callback";
+            return false;
+        }
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            lastError_ = "Operation timed out";
+            return false;
+        }
+
+        size_t want = buffer.size();
+        if (response.contentLength >= 0)
+        {
+            want = static_cast<size_t>(std::min<curl_off_t>(
+                static_cast<curl_off_t>(want), response.contentLength - response.bytesWritten));
+        }
+
+        long n = connection.read(buffer.data(), want);
+        if (n == 0 && response.contentLength < 0)
+        {
+            break; // Close-delimited body complete (over TLS: close_notify received)
+        }
+        if (n < 0 && ssl && response.contentLength < 0)
+        {
+            lastError_ = fmt::format("TLS connection closed without close_notify after {} body bytes "
+                                     "(body may be truncated)",
+                                     response.bytesWritten);
+            return false;
+        }
+        if (n <= 0)
+        {
+            lastError_ = fmt::format("Connection lost after {} body bytes", response.bytesWritten);
+            return false;
+        }
+        if (!writeAllToFile(fd, buffer.data(), static_cast<size_t>(n)))
+        {
+            lastError_ = fmt::format("Write failed: {}", std::strerror(errno));
+            return false;
+        }
+        response.bytesWritten += n;
+    }
+
+    if (progress)
+    {
+        progress(response.contentLength < 0 ? response.bytesWritten : total, response.bytesWritten);
+    }
+    return true;
+}
+
+bool NativeHttpClient::spliceBody(int socketFd, int fd, curl_off_t length, Response &response,
+                                  const ProgressFn &progress, std::chrono::steady_clock::time_point deadline)
+{
+#ifdef __linux__
+    int pipeFds[2];
+    if (::pipe2(pipeFds, O_CLOEXEC) != 0)
+    {
+        lastError_ = fmt::format("pipe2 failed: {}", std::strerror(errno));
+        return false;
+    }
+    FileDescriptor pipeRead(pipeFds[0]);
+    FileDescriptor pipeWrite(pipeFds[1]);
+
+    // A bigger pipe means fewer splice round trips (best effort; default is 64 KB)
+    ::fcntl(pipeWrite.get(), F_SETPIPE_SZ, PIPE_SIZE);
+
+    const curl_off_t bodyTotal = length < 0 ? 0 : response.bytesWritten + length;
+    curl_off_t remaining = length;
+    while (remaining != 0)
+    {
+        if (progress && !progress(bodyTotal, response.bytesWritten))
+        {
+            lastError_ = "Aborted by progress callback";
+            return false;
+        }
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            lastError_ = "Operation timed out";
+            return false;
+        }
+
+        size_t want = static_cast<size_t>(PIPE_SIZE);
+        if (remaining > 0)
+        {
+            want = static_cast<size_t>(std::min<curl_off_t>(remaining, PIPE_SIZE));
+        }
+
+        // Socket -> pipe: pages move within the kernel
+        ssize_t in = ::splice(socketFd, nullptr, pipeWrite.get(), nullptr, want,
+                              SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (in == 0 && remaining < 0)
+        {
+            break; // Close-delimited body complete
+        }
+        if (in == 0)
+        {
+            lastError_ = fmt::format("Connection closed {} bytes short of Content-Length", remaining);
+            return false;
+        }
+        if (in < 0)
+        {
+            lastError_ = fmt::format("Connection lost after {} body bytes", response.bytesWritten);
+            return false;
+        }
+
+        // Pipe -> file: drain everything we just queued
+        size_t pending = static_cast<size_t>(in);
+        while (pending > 0)
+        {
+            ssize_t out = ::splice(pipeRead.get(), nullptr, fd, nullptr, pending, SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (out <= 0)
+            {
+                lastError_ = fmt::format("Write failed: {}", std::strerror(errno));
+                return false;
+            }
+            pending -= static_cast<size_t>(out);
+        }
+
+        response.bytesWritten += in;
+        if (remaining > 0)
+        {
+            remaining = std::max<curl_off_t>(0, remaining - in);
+        }
+    }
+
+    response.zeroCopyActive = true;
+    if (progress)
+    {
+        progress(length < 0 ? response.bytesWritten : bodyTotal, response.bytesWritten);
+    }
+    return true;
+#else
+    (void)socketFd;
+    (void)fd;
+    (void)length;
+    (void)response;
+    (void)progress;
+    (void)deadline;
+    lastError_ = "splice() is not available on this platform";
+    return false;
+#endif
+}
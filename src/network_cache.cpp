@@ -0,0 +1,420 @@
+#include "network_cache.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+namespace
+{
+    constexpr const char *CACHE_FILE_NAME = "netcache.tsv";
+    constexpr const char *ALTSVC_FILE_NAME = "altsvc.txt";
+    constexpr const char *HSTS_FILE_NAME = "hsts.txt";
+    constexpr const char *CACHE_HEADER = "# DownloadManager network cache v1";
+
+    std::string toHex(const unsigned char *data, size_t len)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(len * 2);
+        for (size_t i = 0; i < len; ++i)
+        {
+            out += digits[data[i] >> 4];
+            out += digits[data[i] & 0x0F];
+        }
+        return out;
+    }
+
+    std::vector<unsigned char> fromHex(const std::string &hex)
+    {
+        auto nibble = [](char c) -> int
+        {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            return -1;
+        };
+
+        std::vector<unsigned char> out;
+        if (hex.size() % 2 != 0)
+        {
+            return out;
+        }
+        out.reserve(hex.size() / 2);
+        for (size_t i = 0; i < hex.size(); i += 2)
+        {
+            int hi = nibble(hex[i]);
+            int lo = nibble(hex[i + 1]);
+            if (hi < 0 || lo < 0)
+            {
+                return {};
+            }
+            out.push_back(static_cast<unsigned char>((hi << 4) | lo));
+        }
+        return out;
+    }
+}
+
+NetworkCache::NetworkCache(std::filesystem::path cacheDir)
+    : cacheDir_(std::move(cacheDir)), cacheFile_(cacheDir_ / CACHE_FILE_NAME)
+{
+    load();
+}
+
+NetworkCache::~NetworkCache()
+{
+    save();
+}
+
+std::filesystem::path NetworkCache::defaultDirectory()
+{
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    {
+        return std::filesystem::path(xdg) / "download_manager";
+    }
+    if (const char *home = std::getenv("HOME"); home && *home)
+    {
+        return std::filesystem::path(home) / ".cache" / "download_manager";
+    }
+    return std::filesystem::temp_directory_path() / "download_manager";
+}
+
+std::int64_t NetworkCache::nowSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Extract "host:port" from a URL using libcurl's URL parser
+std::optional<std::string> NetworkCache::hostKey(const std::string &url)
+{
+    std::unique_ptr<CURLU, decltype(&curl_url_cleanup)> handle(curl_url(), curl_url_cleanup);
+    if (!handle || curl_url_set(handle.get(), CURLUPART_URL, url.c_str(), 0) != CURLUE_OK)
+    {
+        return std::nullopt;
+    }
+
+    char *host = nullptr;
+    char *port = nullptr;
+    std::optional<std::string> key;
+    if (curl_url_get(handle.get(), CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        curl_url_get(handle.get(), CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK)
+    {
+        key = fmt::format("{}:{}", host, port);
+    }
+    curl_free(host);
+    curl_free(port);
+    return key;
+}
+
+void NetworkCache::load()
+{
+    std::ifstream in(cacheFile_);
+    if (!in)
+    {
+        return; // First run: nothing cached yet
+    }
+
+    const std::int64_t now = nowSeconds();
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        // kind \t key \t value \t expiresAt
+        std::istringstream fields(line);
+        std::string kind, key, value, expires;
+        if (!std::getline(fields, kind, '\t') || !std::getline(fields, key, '\t') ||
+            !std::getline(fields, value, '\t') || !std::getline(fields, expires))
+        {
+            continue; // Malformed line: skip rather than fail the whole cache
+        }
+
+        Entry entry{value, std::strtoll(expires.c_str(), nullptr, 10)};
+        if (entry.expiresAt <= now)
+        {
+            continue;
+        }
+
+        if (kind == "dns")
+            addresses_[key] = std::move(entry);
+        else if (kind == "redirect")
+            redirects_[key] = std::move(entry);
+        else if (kind == "tls")
+            sessions_[key] = std::move(entry);
+    }
+}
+
+void NetworkCache::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_)
+    {
+        return;
+    }
+
+    try
+    {
+        std::filesystem::create_directories(cacheDir_);
+
+        const std::int64_t now = nowSeconds();
+        std::ostringstream out;
+        out << CACHE_HEADER << '\n';
+        auto writeMap = [&](const char *kind, const EntryMap &map)
+        {
+            for (const auto &[key, entry] : map)
+            {
+                if (entry.expiresAt > now)
+                {
+                    out << kind << '\t' << key << '\t' << entry.value << '\t' << entry.expiresAt << '\n';
+                }
+            }
+        };
+        writeMap("dns", addresses_);
+        writeMap("redirect", redirects_);
+        writeMap("tls", sessions_);
+        const std::string content = out.str();
+
+        // TLS session tickets are secrets: owner-only file (mkstemp creates it 0600), and a
+        // unique name so concurrent processes saving at once don't clobber each other's temp file
+        std::string tmpName = cacheFile_.string() + ".XXXXXX";
+        const int fd = ::mkstemp(tmpName.data());
+        if (fd < 0)
+        {
+            fmt::print(stderr, "Warning: Cannot write network cache: {}: {}\n", tmpName, std::strerror(errno));
+            return;
+        }
+        const std::filesystem::path tmpPath = tmpName;
+        size_t written = 0;
+        while (written < content.size())
+        {
+            const ssize_t n = ::write(fd, content.data() + written, content.size() - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+        const bool complete = written == content.size();
+        if (::close(fd) != 0 || !complete)
+        {
+            fmt::print(stderr, "Warning: Cannot write network cache: {}\n", tmpPath.string());
+            std::filesystem::remove(tmpPath);
+            return;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tmpPath, cacheFile_, error);
+        if (error)
+        {
+            fmt::print(stderr, "Warning: Cannot save network cache: {}\n", error.message());
+            std::filesystem::remove(tmpPath, error);
+            return;
+        }
+        dirty_ = false;
+    }
+    catch (const std::filesystem::filesystem_error &e)
+    {
+        fmt::print(stderr, "Warning: Cannot save network cache: {}\n", e.what());
+    }
+}
+
+void NetworkCache::applyTo(CURL *curl)
+{
+    try
+    {
+        std::filesystem::create_directories(cacheDir_);
+    }
+    catch (const std::filesystem::filesystem_error &)
+    {
+        return; // Unwritable cache dir: run without persisted hints
+    }
+
+    // libcurl reads these files on first use and rewrites them on cleanup
+    std::string altSvcPath = (cacheDir_ / ALTSVC_FILE_NAME).string();
+    std::string hstsPath = (cacheDir_ / HSTS_FILE_NAME).string();
+    curl_easy_setopt(curl, CURLOPT_ALTSVC, altSvcPath.c_str());
+    curl_easy_setopt(curl, CURLOPT_ALTSVC_CTRL,
+                     static_cast<long>(CURLALTSVC_H1 | CURLALTSVC_H2 | CURLALTSVC_H3));
+    curl_easy_setopt(curl, CURLOPT_HSTS, hstsPath.c_str());
+    curl_easy_setopt(curl, CURLOPT_HSTS_CTRL, static_cast<long>(CURLHSTS_ENABLE));
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::int64_t now = nowSeconds();
+    for (const auto &[key, entry] : sessions_)
+    {
+        if (entry.expiresAt <= now)
+        {
+            continue;
+        }
+        auto colon = entry.value.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+        auto shmac = fromHex(entry.value.substr(0, colon));
+        auto sdata = fromHex(entry.value.substr(colon + 1));
+        if (sdata.empty())
+        {
+            continue;
+        }
+        // CURLE_NOT_BUILT_IN when libcurl lacks SSLS-EXPORT: nothing else to do
+        if (curl_easy_ssls_import(curl, key.c_str(), shmac.data(), shmac.size(),
+                                  sdata.data(), sdata.size()) == CURLE_NOT_BUILT_IN)
+        {
+            break;
+        }
+    }
+#endif
+}
+
+std::vector<std::string> NetworkCache::resolveEntries() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::int64_t now = nowSeconds();
+
+    std::vector<std::string> entries;
+    entries.reserve(addresses_.size());
+    for (const auto &[key, entry] : addresses_)
+    {
+        if (entry.expiresAt > now)
+        {
+            entries.push_back(fmt::format("{}:{}", key, entry.value));
+        }
+    }
+    return entries;
+}
+
+std::optional<std::string> NetworkCache::lookupRedirect(const std::string &url) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = redirects_.find(url);
+    if (it == redirects_.end() || it->second.expiresAt <= nowSeconds())
+    {
+        return std::nullopt;
+    }
+    return it->second.value;
+}
+
+void NetworkCache::captureFrom(CURL *curl, const std::string &requestedUrl)
+{
+    char *effectiveUrl = nullptr;
+    char *primaryIp = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &primaryIp);
+
+    const std::int64_t now = nowSeconds();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Remember the address the effective host resolved to
+        if (effectiveUrl && primaryIp && *primaryIp)
+        {
+            if (auto key = hostKey(effectiveUrl))
+            {
+                // IPv6 literals must be bracketed in CURLOPT_RESOLVE entries
+                std::string address = primaryIp;
+                if (address.find(':') != std::string::npos)
+                {
+                    address = fmt::format("[{}]", address);
+                }
+                addresses_[*key] = Entry{address, now + ADDRESS_TTL_SECONDS};
+                dirty_ = true;
+            }
+        }
+
+        // Remember where the URL redirected to, so the next run skips the hop
+        if (effectiveUrl && requestedUrl != effectiveUrl)
+        {
+            redirects_[requestedUrl] = Entry{effectiveUrl, now + REDIRECT_TTL_SECONDS};
+            dirty_ = true;
+        }
+    }
+
+    exportTlsSessions(curl);
+}
+
+std::optional<std::string> NetworkCache::forgetAddress(const std::string &url)
+{
+    auto key = hostKey(url);
+    if (!key)
+    {
+        return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (addresses_.erase(*key) == 0)
+    {
+        return std::nullopt;
+    }
+    dirty_ = true;
+    return key;
+}
+
+void NetworkCache::forgetRedirect(const std::string &url)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (redirects_.erase(url) > 0)
+    {
+        dirty_ = true;
+    }
+}
+
+void NetworkCache::exportTlsSessions(CURL *curl)
+{
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    curl_easy_ssls_export(curl, exportSessionCallback, this);
+#else
+    (void)curl; // Session export needs libcurl 8.12+
+#endif
+}
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+CURLcode NetworkCache::exportSessionCallback(CURL *handle, void *userptr,
+                                             const char *sessionKey,
+                                             const unsigned char *shmac, size_t shmacLen,
+                                             const unsigned char *sdata, size_t sdataLen,
+                                             curl_off_t validUntil, int ietfTlsId,
+                                             const char *alpn, size_t earlydataMax)
+{
+    (void)handle;
+    (void)ietfTlsId;
+    (void)alpn;
+    (void)earlydataMax;
+
+    auto *cache = static_cast<NetworkCache *>(userptr);
+    const std::int64_t now = nowSeconds();
+
+    // Trust the server-provided ticket lifetime, capped by our own TTL
+    std::int64_t expiresAt = now + SESSION_TTL_SECONDS;
+    if (validUntil > 0 && static_cast<std::int64_t>(validUntil) < expiresAt)
+    {
+        expiresAt = static_cast<std::int64_t>(validUntil);
+    }
+    if (expiresAt <= now)
+    {
+        return CURLE_OK;
+    }
+
+    std::lock_guard<std::mutex> lock(cache->mutex_);
+    cache->sessions_[sessionKey] =
+        Entry{toHex(shmac, shmacLen) + ":" + toHex(sdata, sdataLen), expiresAt};
+    cache->dirty_ = true;
+    return CURLE_OK;
+}
+#endif
@@ -0,0 +1,410 @@
+#include "pack.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+#include <openssl/evp.h>
+
+namespace
+{
+    constexpr const char *INDEX_NAME = "index";
+
+    bool writeAll(int fd, const char *data, size_t length, off_t offset)
+    {
+        while (length > 0)
+        {
+            const ssize_t written = ::pwrite(fd, data, length, offset);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+            offset += written;
+        }
+        return true;
+    }
+
+    std::string sha256Hex(const std::string &data)
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha256(), nullptr) != 1)
+        {
+            return {};
+        }
+        std::string hex;
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            hex += fmt::format("{:02x}", digest[i]);
+        }
+        return hex;
+    }
+}
+
+std::string packSegmentName(std::uint32_t segment)
+{
+    return fmt::format("segment-{:06}.pack", segment);
+}
+
+bool parsePackIndexLine(const std::string &line, PackEntry &entry)
+{
+    // The name is last and may contain spaces (but never tabs or newlines)
+    std::istringstream in(line);
+    std::string segment, offset, length;
+    if (!std::getline(in, segment, '\t') || !std::getline(in, offset, '\t') || !std::getline(in, length, '\t') ||
+        !std::getline(in, entry.sha256, '\t') || !std::getline(in, entry.name) || entry.name.empty())
+    {
+        return false;
+    }
+    try
+    {
+        entry.segment = static_cast<std::uint32_t>(std::stoul(segment));
+        entry.offset = std::stoull(offset);
+        entry.length = std::stoull(length);
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return entry.segment > 0;
+}
+
+PackWriter::PackWriter(std::filesystem::path directory, std::uint64_t segmentBytes, size_t commitEvery)
+    : directory_(std::move(directory)), segmentBytes_(std::max<std::uint64_t>(1, segmentBytes)),
+      commitEvery_(std::max<size_t>(1, commitEvery))
+{
+    std::filesystem::create_directories(directory_);
+
+    std::ifstream in(directory_ / INDEX_NAME, std::ios::binary);
+    std::string line;
+    bool endsWithNewline = true;
+    while (std::getline(in, line))
+    {
+        endsWithNewline = !in.eof();
+        PackEntry entry;
+        if (parsePackIndexLine(line, entry))
+        {
+            index_[entry.name] = std::move(entry);
+        }
+    }
+
+    // Continue filling the newest segment
+    for (const auto &file : std::filesystem::directory_iterator(directory_))
+    {
+        unsigned number = 0;
+        if (std::sscanf(file.path().filename().c_str(), "segment-%u.pack", &number) == 1 && number > current_)
+        {
+            current_ = number;
+            currentSize_ = file.file_size();
+        }
+    }
+
+    indexFd_ = ::open((directory_ / INDEX_NAME).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (indexFd_ < 0)
+    {
+        throw std::runtime_error(fmt::format("Cannot open pack index in {}: {}", directory_.string(),
+                                             std::strerror(errno)));
+    }
+    if (!endsWithNewline && ::write(indexFd_, "\n", 1) != 1)
+    {
+        // A torn last line (crash mid-commit) must not swallow the next entry
+        ::close(indexFd_);
+        throw std::runtime_error(fmt::format("Cannot repair pack index in {}", directory_.string()));
+    }
+}
+
+PackWriter::~PackWriter()
+{
+    std::string error;
+    if (!commit(error))
+    {
+        fmt::print(stderr, "Warning: {}\n", error);
+    }
+    for (int fd : segmentFds_)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    ::close(indexFd_);
+}
+
+bool PackWriter::contains(const std::string &name) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.count(name) > 0;
+}
+
+int PackWriter::reserve(size_t length, std::uint32_t &segment, std::uint64_t &offset, std::string &error)
+{
+    if (current_ == 0 || (currentSize_ > 0 && currentSize_ + length > segmentBytes_))
+    {
+        ++current_;
+        currentSize_ = 0;
+    }
+    if (segmentFds_.size() <= current_)
+    {
+        segmentFds_.resize(current_ + 1, -1);
+        dirty_.resize(current_ + 1, false);
+    }
+    if (segmentFds_[current_] < 0)
+    {
+        const std::filesystem::path path = directory_ / packSegmentName(current_);
+        segmentFds_[current_] = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (segmentFds_[current_] < 0)
+        {
+            error = fmt::format("Cannot open pack segment {}: {}", path.string(), std::strerror(errno));
+            return -1;
+        }
+        ++stats_.segments;
+    }
+
+    segment = current_;
+    offset = currentSize_;
+    currentSize_ += length;
+    return segmentFds_[current_];
+}
+
+bool PackWriter::append(const std::string &name, const char *data, size_t length, const std::string &sha256,
+                        DoneFn done, std::string &error)
+{
+    if (name.empty() || name.find_first_of("\t\n") != std::string::npos)
+    {
+        error = fmt::format("Name '{}' cannot be stored in a pack", name);
+        return false;
+    }
+
+    PackEntry entry;
+    entry.name = name;
+    entry.length = length;
+    entry.sha256 = sha256;
+
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        fd = reserve(length, entry.segment, entry.offset, error);
+    }
+    // Writers fill their reserved ranges in parallel
+    if (fd < 0 || !writeAll(fd, data, length, static_cast<off_t>(entry.offset)))
+    {
+        if (error.empty())
+        {
+            error = fmt::format("Write to pack segment {} failed: {}", entry.segment, std::strerror(errno));
+        }
+        return false;
+    }
+
+    bool commitNow = false;
+    {
+        // Dirty only once the bytes are written: a commit in between must not
+        // sync the segment and miss them
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_[entry.segment] = true;
+        index_[name] = entry;
+        queued_.push_back({std::move(entry), std::move(done)});
+        ++unreported_;
+        ++stats_.objects;
+        stats_.bytes += length;
+        commitNow = queued_.size() >= commitEvery_;
+    }
+    if (commitNow)
+    {
+        // Its outcome reaches every appender through done
+        std::string commitError;
+        commit(commitError);
+    }
+    return true;
+}
+
+bool PackWriter::commit(std::string &error)
+{
+    std::lock_guard<std::mutex> commitLock(commitMutex_);
+
+    std::vector<Queued> batch;
+    std::vector<std::uint32_t> dirtySegments;
+    std::vector<int> dirtyFds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.swap(queued_);
+        unreported_ = 0;
+        for (size_t i = 0; i < dirty_.size(); ++i)
+        {
+            if (dirty_[i])
+            {
+                dirtySegments.push_back(static_cast<std::uint32_t>(i));
+                dirtyFds.push_back(segmentFds_[i]);
+                dirty_[i] = false;
+            }
+        }
+    }
+    if (batch.empty())
+    {
+        return true;
+    }
+
+    std::vector<PackEntry> entries;
+    std::vector<DoneFn> callbacks;
+    entries.reserve(batch.size());
+    for (Queued &queued : batch)
+    {
+        entries.push_back(std::move(queued.entry));
+        if (queued.done)
+        {
+            callbacks.push_back(std::move(queued.done));
+        }
+    }
+
+    const bool ok = writeIndex(entries, dirtyFds, error);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok)
+        {
+            ++stats_.commits;
+        }
+        else
+        {
+            // Still in index_ and in the segments: the next commit retries them,
+            // ahead of anything appended meanwhile
+            for (std::uint32_t segment : dirtySegments)
+            {
+                dirty_[segment] = true;
+            }
+            std::vector<Queued> retry;
+            retry.reserve(entries.size() + queued_.size());
+            for (PackEntry &entry : entries)
+            {
+                retry.push_back({std::move(entry), nullptr});
+            }
+            std::move(queued_.begin(), queued_.end(), std::back_inserter(retry));
+            queued_.swap(retry);
+        }
+    }
+
+    for (const DoneFn &done : callbacks)
+    {
+        done(ok, ok ? std::string() : error);
+    }
+    return ok;
+}
+
+bool PackWriter::writeIndex(const std::vector<PackEntry> &entries, const std::vector<int> &dirtyFds,
+                            std::string &error)
+{
+    // Data first, then the index lines that point at it
+    for (int fd : dirtyFds)
+    {
+        if (::fdatasync(fd) != 0)
+        {
+            error = fmt::format("Syncing pack segment failed: {}", std::strerror(errno));
+            return false;
+        }
+    }
+
+    // After a torn write, start on a line of our own
+    std::string lines = indexTorn_ ? "\n" : "";
+    for (const PackEntry &entry : entries)
+    {
+        lines += fmt::format("{}\t{}\t{}\t{}\t{}\n", entry.segment, entry.offset, entry.length, entry.sha256,
+                             entry.name);
+    }
+    size_t written = 0;
+    while (written < lines.size())
+    {
+        const ssize_t n = ::write(indexFd_, lines.data() + written, lines.size() - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            error = fmt::format("Writing pack index failed: {}", std::strerror(errno));
+            indexTorn_ = indexTorn_ || written > 0;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    indexTorn_ = false;
+    if (::fdatasync(indexFd_) != 0)
+    {
+        error = fmt::format("Syncing pack index failed: {}", std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+size_t PackWriter::unreported() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return unreported_;
+}
+
+PackWriter::Stats PackWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+PackReader::PackReader(std::filesystem::path directory) : directory_(std::move(directory))
+{
+    std::ifstream in(directory_ / INDEX_NAME, std::ios::binary);
+    if (!in)
+    {
+        throw std::runtime_error(fmt::format("No pack index in {}", directory_.string()));
+    }
+
+    // Later lines replace earlier ones with the same name
+    std::unordered_map<std::string, size_t> positions;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        PackEntry entry;
+        if (!parsePackIndexLine(line, entry))
+        {
+            continue;
+        }
+        auto [found, inserted] = positions.emplace(entry.name, entries_.size());
+        if (inserted)
+        {
+            entries_.push_back(std::move(entry));
+        }
+        else
+        {
+            entries_[found->second] = std::move(entry);
+        }
+    }
+}
+
+bool PackReader::read(const PackEntry &entry, std::string &data, std::string &error) const
+{
+    const std::filesystem::path path = directory_ / packSegmentName(entry.segment);
+    std::ifstream in(path, std::ios::binary);
+    data.resize(static_cast<size_t>(entry.length));
+    if (!in || !in.seekg(static_cast<std::streamoff>(entry.offset)) ||
+        !in.read(data.data(), static_cast<std::streamsize>(data.size())))
+    {
+        error = fmt::format("Cannot read {} from {}", entry.name, path.string());
+        return false;
+    }
+    if (!entry.sha256.empty() && sha256Hex(data) != entry.sha256)
+    {
+        error = fmt::format("Checksum mismatch for {} in {}", entry.name, path.string());
+        return false;
+    }
+    return true;
+}
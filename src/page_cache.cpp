@@ -0,0 +1,52 @@
+#include "page_cache.hpp"
+
+#include <fcntl.h>
+
+void WriteBehind::reset(off_t offset)
+{
+    dropped_ = offset;
+    started_ = offset;
+}
+
+void WriteBehind::wrote(int fd, off_t end)
+{
+#ifdef __linux__
+    if (!due(end))
+    {
+        return;
+    }
+
+    // Start writeback of the newest window; don't wait for it
+    ::sync_file_range(fd, started_, end - started_, SYNC_FILE_RANGE_WRITE);
+
+    // The window before it has had time to reach the disk: wait, then evict
+    if (started_ > dropped_)
+    {
+        ::sync_file_range(fd, dropped_, started_ - dropped_,
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(fd, dropped_, started_ - dropped_, POSIX_FADV_DONTNEED);
+    }
+    dropped_ = started_;
+    started_ = end;
+#else
+    (void)fd;
+    (void)end;
+#endif
+}
+
+void WriteBehind::finish(int fd)
+{
+#ifdef __linux__
+    if (policy_ == PageCachePolicy::Normal)
+    {
+        return;
+    }
+
+    // Length 0 means "to the end of the file"
+    ::sync_file_range(fd, dropped_, 0,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+#endif
+}
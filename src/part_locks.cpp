@@ -0,0 +1,130 @@
+#include "part_locks.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    std::filesystem::path lockPathFor(const std::filesystem::path &partPath)
+    {
+        return partPath.string() + ".lock";
+    }
+}
+
+PartLocks::~PartLocks()
+{
+    for (const auto &[partPath, fd] : held_)
+    {
+        ::unlink(lockPathFor(partPath).c_str());
+        ::close(fd);
+    }
+}
+
+PartLocks::Claim PartLocks::tryClaim(const std::filesystem::path &partPath, const std::filesystem::path &destination)
+{
+    const std::string key = partPath.string();
+    const std::filesystem::path lockPath = lockPathFor(partPath);
+
+    for (;;)
+    {
+        int fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 && errno == ENOENT && lockPath.has_parent_path())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(lockPath.parent_path(), error);
+            fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        }
+        if (fd < 0)
+        {
+            return Claim::Owned; // Can't coordinate here; the transfer reports its own open errors
+        }
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            const int lockError = errno;
+            ::close(fd);
+            if (lockError != EWOULDBLOCK)
+            {
+                return Claim::Owned; // No flock on this filesystem
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (waiting_.emplace(key, look(destination)).second)
+            {
+                ++stats_.waits;
+            }
+            return Claim::Busy;
+        }
+
+        // The previous holder may have removed the file between our open and our lock
+        struct stat locked{};
+        struct stat named{};
+        if (::fstat(fd, &locked) != 0 || ::stat(lockPath.c_str(), &named) != 0 || locked.st_ino != named.st_ino ||
+            locked.st_dev != named.st_dev)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto waited = waiting_.find(key);
+        if (waited != waiting_.end())
+        {
+            const Seen before = waited->second;
+            waiting_.erase(waited);
+            const Seen now = look(destination);
+            if (now.exists && (!before.exists || now.device != before.device || now.inode != before.inode ||
+                               now.modified.tv_sec != before.modified.tv_sec ||
+                               now.modified.tv_nsec != before.modified.tv_nsec))
+            {
+                ++stats_.finished;
+                ::unlink(lockPath.c_str());
+                ::close(fd);
+                return Claim::Finished;
+            }
+        }
+        ++stats_.claims;
+        held_[key] = fd;
+        return Claim::Owned;
+    }
+}
+
+void PartLocks::release(const std::filesystem::path &partPath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = held_.find(partPath.string());
+    if (found == held_.end())
+    {
+        return;
+    }
+    // Removed while still locked: a waiter that opened it notices the swap and opens afresh
+    ::unlink(lockPathFor(partPath).c_str());
+    ::close(found->second);
+    held_.erase(found);
+}
+
+PartLocks::Stats PartLocks::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+PartLocks::Seen PartLocks::look(const std::filesystem::path &path)
+{
+    Seen seen;
+    struct stat info{};
+    if (::stat(path.c_str(), &info) == 0)
+    {
+        seen.exists = true;
+        seen.device = info.st_dev;
+        seen.inode = info.st_ino;
+#ifdef __APPLE__
+        seen.modified = info.st_mtimespec;
+#else
+        seen.modified = info.st_mtim;
+#endif
+    }
+    return seen;
+}
@@ -0,0 +1,109 @@
+#include "path_selector.hpp"
+
+#include <stdexcept>
+#include <string>
+
+PathSelector::PathSelector(std::vector<std::string> interfaces)
+{
+    if (interfaces.empty())
+    {
+        throw std::invalid_argument("PathSelector needs at least one interface");
+    }
+
+    paths_.resize(interfaces.size());
+    for (size_t i = 0; i < interfaces.size(); ++i)
+    {
+        // libcurl only keeps connections apart by interface when it is given in
+        // plain form; with "host!"/"if!" a connection opened through one path is
+        // silently reused for another
+        std::string &name = interfaces[i];
+        for (const char *prefix : {"host!", "if!"})
+        {
+            if (name.rfind(prefix, 0) == 0)
+            {
+                name.erase(0, std::char_traits<char>::length(prefix));
+            }
+        }
+        paths_[i].stats.name = std::move(name);
+    }
+}
+
+size_t PathSelector::choose()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Explore: an idle path we know nothing about yet
+    for (size_t i = 0; i < paths_.size(); ++i)
+    {
+        if (!paths_[i].measured && paths_[i].active == 0)
+        {
+            ++paths_[i].active;
+            return i;
+        }
+    }
+
+    // Exploit: best expected throughput for one more transfer on the path
+    size_t best = 0;
+    double bestScore = -1.0;
+    for (size_t i = 0; i < paths_.size(); ++i)
+    {
+        const double score = paths_[i].stats.bytesPerSecond / static_cast<double>(paths_[i].active + 1);
+        if (score > bestScore)
+        {
+            best = i;
+            bestScore = score;
+        }
+    }
+    ++paths_[best].active;
+    return best;
+}
+
+void PathSelector::record(size_t path, curl_off_t bytes, double seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Path &entry = paths_[path];
+    if (entry.active > 0)
+    {
+        --entry.active;
+    }
+    ++entry.stats.transfers;
+    entry.stats.bytes += bytes;
+
+    if (seconds <= 0.0 || bytes <= 0)
+    {
+        return;
+    }
+    const double sample = static_cast<double>(bytes) / seconds;
+    entry.stats.bytesPerSecond = entry.measured
+                                     ? EWMA_WEIGHT * sample + (1.0 - EWMA_WEIGHT) * entry.stats.bytesPerSecond
+                                     : sample;
+    entry.measured = true;
+}
+
+void PathSelector::recordFailure(size_t path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Path &entry = paths_[path];
+    if (entry.active > 0)
+    {
+        --entry.active;
+    }
+    ++entry.stats.failures;
+    entry.stats.bytesPerSecond /= 2.0;
+    if (entry.stats.failures >= MAX_EXPLORE_FAILURES)
+    {
+        entry.measured = true; // Stop "exploring" a path that keeps failing
+    }
+}
+
+std::vector<PathSelector::PathStats> PathSelector::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<PathStats> result;
+    result.reserve(paths_.size());
+    for (const Path &entry : paths_)
+    {
+        result.push_back(entry.stats);
+    }
+    return result;
+}
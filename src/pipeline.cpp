@@ -0,0 +1,687 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fmt/core.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#include "buffer_arena.hpp"
+#include "checksum.hpp"
+#include "staging.hpp"
+
+extern char **environ;
+
+namespace
+{
+    std::string trim(const std::string &text)
+    {
+        auto begin = std::find_if_not(text.begin(), text.end(), [](unsigned char c)
+                                      { return std::isspace(c); });
+        auto end = std::find_if_not(text.rbegin(), text.rend(), [](unsigned char c)
+                                    { return std::isspace(c); })
+                       .base();
+        return begin < end ? std::string(begin, end) : std::string();
+    }
+
+    // Tar numeric field: octal text, or base-256 when the high bit is set
+    std::uint64_t parseTarNumber(const char *field, size_t length)
+    {
+        std::uint64_t value = 0;
+        if (static_cast<unsigned char>(field[0]) & 0x80)
+        {
+            for (size_t i = 1; i < length; ++i)
+            {
+                value = (value << 8) | static_cast<unsigned char>(field[i]);
+            }
+            return value;
+        }
+        for (size_t i = 0; i < length && field[i] != '\0'; ++i)
+        {
+            if (field[i] >= '0' && field[i] <= '7')
+            {
+                value = value * 8 + static_cast<std::uint64_t>(field[i] - '0');
+            }
+        }
+        return value;
+    }
+
+    std::string tarString(const char *field, size_t length)
+    {
+        return std::string(field, strnlen(field, length));
+    }
+
+    std::optional<PipelineStage::Kind> stageFromName(std::string name)
+    {
+        static const std::map<std::string, PipelineStage::Kind> KINDS = {
+            {"verify", PipelineStage::Kind::Verify},
+            {"land", PipelineStage::Kind::Land},
+            {"decompress", PipelineStage::Kind::Decompress},
+            {"extract", PipelineStage::Kind::Extract},
+            {"move", PipelineStage::Kind::Move},
+            {"notify", PipelineStage::Kind::Notify},
+        };
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        auto found = KINDS.find(trim(name));
+        if (found == KINDS.end())
+        {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    // Archive member names must stay inside the extraction directory
+    bool isSafeMemberPath(const std::filesystem::path &path)
+    {
+        if (path.empty() || path.is_absolute() || path.has_root_name())
+        {
+            return false;
+        }
+        return std::none_of(path.begin(), path.end(), [](const std::filesystem::path &part)
+                            { return part == ".."; });
+    }
+
+    // Move a file or directory, copying when rename can't cross filesystems
+    void moveEntry(const std::filesystem::path &from, const std::filesystem::path &to)
+    {
+        std::error_code error;
+        std::filesystem::rename(from, to, error);
+        if (!error)
+        {
+            return;
+        }
+        std::filesystem::copy(from, to, std::filesystem::copy_options::recursive);
+        std::filesystem::remove_all(from);
+    }
+}
+
+const char *stageName(PipelineStage::Kind kind)
+{
+    switch (kind)
+    {
+    case PipelineStage::Kind::Verify:
+        return "verify";
+    case PipelineStage::Kind::Land:
+        return "land";
+    case PipelineStage::Kind::Decompress:
+        return "decompress";
+    case PipelineStage::Kind::Extract:
+        return "extract";
+    case PipelineStage::Kind::Move:
+        return "move";
+    case PipelineStage::Kind::Notify:
+        return "notify";
+    }
+    return "unknown";
+}
+
+std::vector<PipelineStage> parsePipeline(const std::string &spec)
+{
+    // Every job is verified and landed before anything else touches it
+    std::vector<PipelineStage> stages = {{PipelineStage::Kind::Verify, ""}, {PipelineStage::Kind::Land, ""}};
+
+    std::istringstream in(spec);
+    std::string token;
+    while (std::getline(in, token, ','))
+    {
+        token = trim(token);
+        if (token.empty())
+        {
+            continue;
+        }
+
+        const size_t colon = token.find(':');
+        const std::string name = trim(token.substr(0, colon));
+        std::string argument = colon == std::string::npos ? "" : trim(token.substr(colon + 1));
+
+        std::optional<PipelineStage::Kind> kind = stageFromName(name);
+        if (!kind)
+        {
+            throw std::runtime_error(fmt::format("Unknown pipeline stage: '{}'", name));
+        }
+        if (*kind == PipelineStage::Kind::Verify || *kind == PipelineStage::Kind::Land)
+        {
+            continue; // Always run first anyway
+        }
+        if ((*kind == PipelineStage::Kind::Move || *kind == PipelineStage::Kind::Notify) && argument.empty())
+        {
+            throw std::runtime_error(fmt::format("Pipeline stage '{}' needs an argument ({}:...)", name, name));
+        }
+        stages.push_back({*kind, argument});
+    }
+    return stages;
+}
+
+Pipeline::Pipeline(WorkStealingPool &pool, const std::string &defaultSpec,
+                   std::map<PipelineStage::Kind, size_t> stageLimits, DoneFn onDone,
+                   std::shared_ptr<MemoryBudget> memory, std::shared_ptr<Durability> durability,
+                   std::shared_ptr<DirectoryCache> directories)
+    : pool_(pool), defaultStages_(parsePipeline(defaultSpec)), onDone_(std::move(onDone)),
+      memory_(std::move(memory)), durability_(std::move(durability)), directories_(std::move(directories))
+{
+    for (auto kind : {PipelineStage::Kind::Verify, PipelineStage::Kind::Land, PipelineStage::Kind::Decompress,
+                      PipelineStage::Kind::Extract, PipelineStage::Kind::Move, PipelineStage::Kind::Notify})
+    {
+        auto limit = stageLimits.find(kind);
+        stages_[kind].limit = limit != stageLimits.end() ? std::max<size_t>(1, limit->second)
+                                                          : pool_.threadCount();
+    }
+}
+
+std::map<PipelineStage::Kind, size_t> Pipeline::parseStageLimits(const std::vector<std::string> &limits)
+{
+    std::map<PipelineStage::Kind, size_t> result;
+    for (const std::string &entry : limits)
+    {
+        const size_t equals = entry.find('=');
+        if (equals == std::string::npos)
+        {
+            throw std::runtime_error(fmt::format("Stage limit must look like 'stage=N', got '{}'", entry));
+        }
+
+        std::optional<PipelineStage::Kind> kind = stageFromName(entry.substr(0, equals));
+        if (!kind)
+        {
+            throw std::runtime_error(fmt::format("Unknown pipeline stage in limit: '{}'", entry));
+        }
+
+        try
+        {
+            result[*kind] = static_cast<size_t>(std::stoul(entry.substr(equals + 1)));
+        }
+        catch (const std::exception &)
+        {
+            throw std::runtime_error(fmt::format("Invalid stage limit: '{}'", entry));
+        }
+    }
+    return result;
+}
+
+void Pipeline::submit(const DownloadJob &job, TransferResult result, const std::filesystem::path &current,
+                      bool verifyOnly)
+{
+    Item item;
+    item.job = &job;
+    item.result = std::move(result);
+    item.current = current;
+    try
+    {
+        item.stages = verifyOnly             ? std::vector<PipelineStage>{{PipelineStage::Kind::Verify, ""}}
+                      : job.pipeline.empty() ? defaultStages_
+                                             : parsePipeline(job.pipeline);
+    }
+    catch (const std::exception &e)
+    {
+        item.result.success = false;
+        item.result.error = e.what();
+        item.result.location = current.string();
+        onDone_(std::move(item.result));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++backlog_;
+    PipelineStage::Kind first = item.stages.front().kind;
+    stages_[first].waiting.push_back(std::move(item));
+    dispatch(first);
+}
+
+size_t Pipeline::backlog() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return backlog_;
+}
+
+void Pipeline::waitForBacklogBelow(size_t limit)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    drained_.wait(lock, [&]
+                  { return backlog_ < limit; });
+}
+
+void Pipeline::dispatch(PipelineStage::Kind kind)
+{
+    StageQueue &queue = stages_[kind];
+    while (queue.running < queue.limit && !queue.waiting.empty())
+    {
+        ++queue.running;
+        pool_.submit([this, item = std::move(queue.waiting.front())]() mutable
+                     { runStage(std::move(item)); });
+        queue.waiting.pop_front();
+    }
+}
+
+void Pipeline::runStage(Item item)
+{
+    const PipelineStage &stage = item.stages[item.next];
+    const PipelineStage::Kind kind = stage.kind;
+    if (kind == PipelineStage::Kind::Land && durability_ && durability_->mode() == DurabilityMode::Batched &&
+        item.current != std::filesystem::path(item.job->destination))
+    {
+        // A copy off the scratch filesystem is the expensive part: it runs inside the Land slot,
+        // only the wait for the group commit doesn't
+        std::string error;
+        const bool staged = durability_->stage(item.current, item.job->destination, error);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --stages_[kind].running;
+            dispatch(kind);
+        }
+        if (!staged)
+        {
+            item.result.error = error;
+            advance(std::move(item), false);
+            return;
+        }
+        landDeferred(std::move(item));
+        return;
+    }
+
+    bool ok = false;
+    try
+    {
+        switch (stage.kind)
+        {
+        case PipelineStage::Kind::Verify:
+            ok = verify(item);
+            break;
+        case PipelineStage::Kind::Land:
+            ok = land(item);
+            break;
+        case PipelineStage::Kind::Decompress:
+            ok = decompress(item);
+            break;
+        case PipelineStage::Kind::Extract:
+            ok = extract(item, stage.argument);
+            break;
+        case PipelineStage::Kind::Move:
+            ok = move(item, stage.argument);
+            break;
+        case PipelineStage::Kind::Notify:
+            ok = notify(item, stage.argument);
+            break;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        item.result.error = fmt::format("{} failed: {}", stageName(stage.kind), e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --stages_[kind].running;
+        dispatch(kind); // A slot just freed up
+    }
+    advance(std::move(item), ok);
+}
+
+void Pipeline::advance(Item item, bool ok)
+{
+    if (!ok)
+    {
+        item.result.success = false;
+    }
+    if (!ok || ++item.next == item.stages.size())
+    {
+        finish(item);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    PipelineStage::Kind nextKind = item.stages[item.next].kind;
+    stages_[nextKind].waiting.push_back(std::move(item));
+    dispatch(nextKind);
+}
+
+void Pipeline::finish(Item &item)
+{
+    item.result.location = item.current.string();
+    onDone_(std::move(item.result));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --backlog_;
+    drained_.notify_all();
+}
+
+bool Pipeline::verify(Item &item)
+{
+    const DownloadJob &job = *item.job;
+    // Without one from the manifest, the server may have announced one
+    const std::string expected = job.expectedChecksum.value_or(item.result.announcedChecksum);
+    if (expected.empty())
+    {
+        return true;
+    }
+
+    auto [algorithm, expectedHex] = ChecksumVerifier::parseChecksum(expected);
+    std::string streamedHex; // Hashed while streaming, if it was in this algorithm
+    if (algorithm == ChecksumVerifier::Algorithm::SHA256)
+    {
+        streamedHex = item.result.sha256;
+    }
+    else if (item.result.streamedChecksum.rfind(ChecksumVerifier::algorithmName(algorithm) + std::string(":"), 0) == 0)
+    {
+        streamedHex = item.result.streamedChecksum.substr(item.result.streamedChecksum.find(':') + 1);
+    }
+    const bool matches =
+        !streamedHex.empty() ? streamedHex == expectedHex : ChecksumVerifier::verify(item.current, expected);
+    if (events_)
+    {
+        events_->verify(item.result.jobIndex, matches, expected, !streamedHex.empty());
+    }
+    if (!matches)
+    {
+        item.current = ChecksumVerifier::quarantine(item.current);
+        item.result.error = fmt::format("Checksum verification FAILED{} (moved to {})",
+                                        job.expectedChecksum ? "" : " against the server's digest header",
+                                        item.current.string());
+        return false;
+    }
+    return true;
+}
+
+bool Pipeline::land(Item &item)
+{
+    const std::filesystem::path destination(item.job->destination);
+    if (item.current == destination)
+    {
+        return true; // Already in place
+    }
+
+    if (durability_)
+    {
+        std::string error;
+        if (!durability_->publish(item.current, destination, error))
+        {
+            item.result.error = error;
+            return false;
+        }
+        item.current = destination;
+        return true;
+    }
+
+    std::string stageError;
+    if (!bringAlongside(item.current, destination, stageError))
+    {
+        item.result.error = stageError;
+        return false;
+    }
+
+    if (directories_)
+    {
+        if (!directories_->rename(item.current, destination))
+        {
+            item.result.error = fmt::format("Failed to rename file: {}", std::strerror(errno));
+            return false;
+        }
+        item.current = destination;
+        return true;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(item.current, destination, error);
+    if (error)
+    {
+        item.result.error = fmt::format("Failed to rename file: {}", error.message());
+        return false;
+    }
+    item.current = destination;
+    return true;
+}
+
+void Pipeline::landDeferred(Item item)
+{
+    const std::filesystem::path from = item.current;
+    const std::filesystem::path to(item.job->destination);
+    auto pending = std::make_shared<Item>(std::move(item));
+    durability_->publishAsync(from, to, [this, pending, to](bool ok, const std::string &error)
+                              {
+        if (ok)
+        {
+            pending->current = to;
+        }
+        else
+        {
+            pending->result.error = error;
+        }
+        // Later stages go back to the pool rather than the commit thread
+        pool_.submit([this, pending, ok]
+                     { advance(std::move(*pending), ok); }); });
+}
+
+bool Pipeline::decompress(Item &item)
+{
+    std::filesystem::path output = item.current;
+    const std::string extension = item.current.extension().string();
+    if (extension == ".gz")
+    {
+        output.replace_extension();
+    }
+    else if (extension == ".tgz")
+    {
+        output.replace_extension(".tar");
+    }
+    else
+    {
+        return true; // Not compressed: nothing to do
+    }
+
+    // May wait for downloads to give memory back
+    MemoryBudget::Reservation reservation(memory_.get(), MemoryBudget::Stage::PostProcess,
+                                          GZIP_BUFFER_SIZE + COPY_BUFFER_SIZE);
+
+    gzFile input = gzopen(item.current.string().c_str(), "rb");
+    if (!input)
+    {
+        item.result.error = fmt::format("Cannot open {} for decompression", item.current.string());
+        return false;
+    }
+    gzbuffer(input, GZIP_BUFFER_SIZE);
+
+    ArenaBuffer buffer = BufferArena::instance().allocate(COPY_BUFFER_SIZE);
+    if (buffer.empty())
+    {
+        gzclose(input);
+        item.result.error = fmt::format("Out of memory decompressing {}", item.current.string());
+        return false;
+    }
+
+    std::filesystem::path partial = output;
+    partial += ".part";
+    std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+    int bytesRead = 0;
+    while ((bytesRead = gzread(input, buffer.data(), static_cast<unsigned>(buffer.size()))) > 0 && out)
+    {
+        out.write(buffer.data(), bytesRead);
+    }
+
+    int status = Z_OK;
+    const char *message = gzerror(input, &status);
+    gzclose(input);
+    out.close();
+
+    if (bytesRead < 0 || status != Z_OK || !out)
+    {
+        std::filesystem::remove(partial);
+        item.result.error = fmt::format("Decompression of {} failed: {}", item.current.string(),
+                                        bytesRead < 0 ? message : "write error");
+        return false;
+    }
+
+    std::filesystem::rename(partial, output);
+    std::filesystem::remove(item.current);
+    item.current = output;
+    return true;
+}
+
+bool Pipeline::extract(Item &item, const std::string &targetDir)
+{
+    if (item.current.extension() != ".tar")
+    {
+        return true; // Not an archive: nothing to do
+    }
+
+    const std::filesystem::path target = targetDir.empty()
+                                             ? item.current.parent_path() / item.current.stem()
+                                             : std::filesystem::path(targetDir);
+    std::filesystem::create_directories(target);
+
+    MemoryBudget::Reservation reservation(memory_.get(), MemoryBudget::Stage::PostProcess, COPY_BUFFER_SIZE);
+    std::ifstream in(item.current, std::ios::binary);
+    if (!in)
+    {
+        item.result.error = fmt::format("Cannot open archive {}", item.current.string());
+        return false;
+    }
+
+    std::array<char, TAR_BLOCK> header{};
+    ArenaBuffer buffer = BufferArena::instance().allocate(COPY_BUFFER_SIZE);
+    if (buffer.empty())
+    {
+        item.result.error = fmt::format("Out of memory extracting {}", item.current.string());
+        return false;
+    }
+    std::string longName;
+    size_t skipped = 0;
+
+    while (in.read(header.data(), TAR_BLOCK))
+    {
+        if (std::all_of(header.begin(), header.end(), [](char c)
+                        { return c == '\0'; }))
+        {
+            break; // End-of-archive marker
+        }
+
+        // Header checksum: byte sum with the checksum field read as spaces
+        std::uint64_t sum = 0;
+        for (size_t i = 0; i < TAR_BLOCK; ++i)
+        {
+            sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(header[i]);
+        }
+        if (sum != parseTarNumber(&header[148], 8))
+        {
+            item.result.error = fmt::format("Corrupt tar header in {}", item.current.string());
+            return false;
+        }
+
+        const std::uint64_t size = parseTarNumber(&header[124], 12);
+        const std::uint64_t padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+        const char type = header[156];
+
+        std::string name = longName;
+        longName.clear();
+        if (name.empty())
+        {
+            const std::string prefix = tarString(&header[345], 155);
+            name = tarString(&header[0], 100);
+            if (!prefix.empty())
+            {
+                name = prefix + "/" + name;
+            }
+        }
+
+        if (type == 'L') // GNU long name for the next member
+        {
+            longName.resize(static_cast<size_t>(size));
+            in.read(longName.data(), static_cast<std::streamsize>(size));
+            longName.resize(strnlen(longName.data(), longName.size()));
+            in.seekg(static_cast<std::streamoff>(padded - size), std::ios::cur);
+            continue;
+        }
+
+        const std::filesystem::path member = std::filesystem::path(name).lexically_normal();
+        const bool regular = (type == '0' || type == '\0' || type == '7');
+        if ((type == '5' || regular) && !isSafeMemberPath(member))
+        {
+            item.result.error = fmt::format("Refusing unsafe archive member '{}'", name);
+            return false;
+        }
+
+        if (type == '5')
+        {
+            std::filesystem::create_directories(target / member);
+        }
+        else if (regular)
+        {
+            const std::filesystem::path outPath = target / member;
+            std::filesystem::create_directories(outPath.parent_path());
+            std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+
+            std::uint64_t left = size;
+            while (left > 0 && in && out)
+            {
+                const auto chunk = static_cast<std::streamsize>(std::min<std::uint64_t>(left, buffer.size()));
+                in.read(buffer.data(), chunk);
+                out.write(buffer.data(), in.gcount());
+                left -= static_cast<std::uint64_t>(in.gcount());
+            }
+            if (left > 0 || !out)
+            {
+                item.result.error = fmt::format("Failed to extract '{}' from {}", name, item.current.string());
+                return false;
+            }
+            in.seekg(static_cast<std::streamoff>(padded - size), std::ios::cur);
+            continue;
+        }
+        else
+        {
+            ++skipped; // Links, devices, pax headers: not recreated
+        }
+
+        in.seekg(static_cast<std::streamoff>(padded), std::ios::cur);
+    }
+
+    if (skipped > 0)
+    {
+        fmt::print(stderr, "Note: skipped {} non-regular members of {}\n", skipped, item.current.string());
+    }
+    item.current = target;
+    return true;
+}
+
+bool Pipeline::move(Item &item, const std::string &targetDir)
+{
+    const std::filesystem::path directory(targetDir);
+    std::filesystem::create_directories(directory);
+
+    const std::filesystem::path target = directory / item.current.filename();
+    moveEntry(item.current, target);
+    item.current = target;
+    return true;
+}
+
+bool Pipeline::notify(Item &item, const std::string &command)
+{
+    // No shell: the command gets the output path and the URL as plain arguments
+    std::string path = item.current.string();
+    std::string url = item.job->url;
+    std::string program = command;
+    char *argv[] = {program.data(), path.data(), url.data(), nullptr};
+
+    pid_t pid = 0;
+    int spawnError = posix_spawnp(&pid, program.c_str(), nullptr, nullptr, argv, environ);
+    if (spawnError != 0)
+    {
+        item.result.error = fmt::format("Cannot run notify command '{}': {}", command, std::strerror(spawnError));
+        return false;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        item.result.error = fmt::format("Notify command '{}' failed (status {})", command, status);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+#include "prefetcher.hpp"
+
+#include <algorithm>
+
+Prefetcher::Prefetcher(const std::vector<DownloadJob> &jobs, const CurlShare &share,
+                       std::shared_ptr<NetworkCache> networkCache, size_t maxLookahead,
+                       std::string caCertFile)
+    : jobs_(jobs),
+      share_(share),
+      networkCache_(std::move(networkCache)),
+      maxLookahead_(std::max<size_t>(maxLookahead, 1)),
+      caCertFile_(std::move(caCertFile)),
+      slots_(jobs.size()),
+      lookahead_(std::min<size_t>(2, maxLookahead_))
+{
+    size_t workerCount = std::min(maxLookahead_, MAX_WORKERS);
+    workers_.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i)
+    {
+        workers_.emplace_back(&Prefetcher::workerLoop, this);
+    }
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    workAvailable_.notify_all();
+
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+std::optional<RemoteMetadata> Prefetcher::take(size_t index)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    consumed_ = std::max(consumed_, index + 1);
+
+    if (index >= slots_.size())
+    {
+        return std::nullopt;
+    }
+
+    Slot &slot = slots_[index];
+    probeDone_.wait(lock, [&]
+                    { return slot.state != SlotState::Probing; });
+
+    std::optional<RemoteMetadata> result;
+    switch (slot.state)
+    {
+    case SlotState::Pending:
+        // Drained faster than we look ahead: probe further next time
+        lookahead_ = std::min(lookahead_ * 2, maxLookahead_);
+        break;
+    case SlotState::Ready:
+        if (std::chrono::steady_clock::now() - slot.readyAt > STALE_AFTER && lookahead_ > 1)
+        {
+            // Probed too early: the warm connection has likely been dropped
+            --lookahead_;
+        }
+        result = std::move(slot.metadata);
+        break;
+    default:
+        break;
+    }
+    slot.state = SlotState::Taken;
+
+    lock.unlock();
+    workAvailable_.notify_all(); // Window moved forward
+    return result;
+}
+
+size_t Prefetcher::lookahead() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lookahead_;
+}
+
+void Prefetcher::workerLoop()
+{
+    // Each worker owns a client; the share makes its connections reusable
+    HttpClient client(networkCache_);
+    client.setShare(share_);
+    client.setCaCertFile(caCertFile_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        // Lowest unprobed job inside the window [consumed_, consumed_ + K)
+        size_t target = slots_.size();
+        workAvailable_.wait(lock, [&]
+                            {
+            if (stopping_)
+            {
+                return true;
+            }
+            size_t end = std::min(consumed_ + lookahead_, slots_.size());
+            for (size_t i = consumed_; i < end; ++i)
+            {
+                if (slots_[i].state == SlotState::Pending)
+                {
+                    target = i;
+                    return true;
+                }
+            }
+            return false; });
+
+        if (stopping_)
+        {
+            return;
+        }
+
+        slots_[target].state = SlotState::Probing;
+        const std::string url = jobs_[target].url;
+        lock.unlock();
+
+        RemoteMetadata metadata;
+        bool ok = client.probe(url, metadata, PROBE_TIMEOUT_SECONDS);
+
+        lock.lock();
+        Slot &slot = slots_[target];
+        slot.state = ok ? SlotState::Ready : SlotState::Failed;
+        slot.metadata = std::move(metadata);
+        slot.readyAt = std::chrono::steady_clock::now();
+        probeDone_.notify_all();
+    }
+}
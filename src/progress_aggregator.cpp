@@ -0,0 +1,206 @@
+#include "progress_aggregator.hpp"
+
+ProgressAggregator::ProgressAggregator(std::chrono::milliseconds interval, double smoothing)
+    : interval_(interval), smoothing_(smoothing), started_(std::chrono::steady_clock::now()),
+      lastSample_(started_)
+{
+    sampler_ = std::thread([this] { samplerLoop(); });
+}
+
+ProgressAggregator::~ProgressAggregator()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    sampler_.join();
+}
+
+void ProgressAggregator::addFrontend(Frontend frontend)
+{
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    frontends_.push_back(std::move(frontend));
+}
+
+ProgressAggregator::Counter *ProgressAggregator::begin(size_t slot, long long bytes, long long total)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t index;
+    if (idle_.empty())
+    {
+        index = counters_.size();
+        counters_.emplace_back(index);
+        tracks_.emplace_back();
+    }
+    else
+    {
+        index = idle_.back();
+        idle_.pop_back();
+    }
+    Counter &counter = counters_[index];
+    counter.bytes.store(bytes, std::memory_order_relaxed);
+    counter.total.store(total, std::memory_order_relaxed);
+
+    Track &track = tracks_[index];
+    track = Track{};
+    track.slot = slot;
+    track.running = true;
+    track.fresh = true;
+    track.activeAt = active_.size();
+    track.lastBytes = bytes; // Resumed bytes aren't received ones
+    track.begun = std::chrono::steady_clock::now();
+    active_.push_back(index);
+    return &counter;
+}
+
+void ProgressAggregator::end(Counter *counter)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t index = counter->index;
+    Track &track = tracks_[index];
+    if (!track.running)
+    {
+        return;
+    }
+
+    // Without touching its rate: the time since the last sample may be tiny.
+    // One that ended before its first sample gets its average rate instead
+    const double seconds =
+        track.measured ? 0.0 : std::chrono::duration<double>(std::chrono::steady_clock::now() - track.begun).count();
+    measure(index, seconds, true, ended_);
+
+    track.running = false;
+    const size_t last = active_.back();
+    active_[track.activeAt] = last;
+    tracks_[last].activeAt = track.activeAt;
+    active_.pop_back();
+    idle_.push_back(index);
+}
+
+void ProgressAggregator::reportEnded()
+{
+    std::lock_guard<std::mutex> publishing(publishMutex_);
+    publishEnded();
+}
+
+double ProgressAggregator::eta(long long bytes, long long total, double bytesPerSecond)
+{
+    if (total > 0 && bytes >= total)
+    {
+        return 0.0;
+    }
+    if (total > 0 && bytesPerSecond > 0.0)
+    {
+        return static_cast<double>(total - bytes) / bytesPerSecond;
+    }
+    return -1.0;
+}
+
+void ProgressAggregator::samplerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_)
+    {
+        wake_.wait_for(lock, interval_, [this] { return stopping_; });
+        if (!stopping_)
+        {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> publishing(publishMutex_);
+                sampleAll();
+            }
+            lock.lock();
+        }
+    }
+}
+
+void ProgressAggregator::sampleAll()
+{
+    publishEnded();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - lastSample_).count();
+        lastSample_ = now;
+
+        const long long before = received_;
+        sample_.transfers.clear();
+        sample_.periodic = true;
+        for (const size_t index : active_)
+        {
+            measure(index, seconds, false, sample_.transfers);
+        }
+        if (seconds > 0.0)
+        {
+            bytesPerSecond_ = smooth(bytesPerSecond_, static_cast<double>(received_ - before) / seconds, smoothing_);
+        }
+        fillTotals();
+    }
+    publish();
+}
+
+void ProgressAggregator::publishEnded()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ended_.empty())
+        {
+            return;
+        }
+        sample_.transfers.clear();
+        sample_.transfers.swap(ended_);
+        sample_.periodic = false;
+        fillTotals();
+    }
+    publish();
+}
+
+void ProgressAggregator::measure(size_t index, double seconds, bool finished, std::vector<TransferProgress> &out)
+{
+    const Counter &counter = counters_[index];
+    Track &track = tracks_[index];
+    const long long bytes = counter.bytes.load(std::memory_order_relaxed);
+    const long long total = counter.total.load(std::memory_order_relaxed);
+
+    const long long delta = bytes >= track.lastBytes ? bytes - track.lastBytes : 0; // Less: it started over
+    track.lastBytes = bytes;
+    received_ += delta;
+    if (seconds > 0.0)
+    {
+        const double rate = static_cast<double>(delta) / seconds;
+        track.bytesPerSecond = track.measured ? smooth(track.bytesPerSecond, rate, smoothing_) : rate;
+        track.measured = true;
+    }
+    if (delta == 0 && !finished && !track.fresh)
+    {
+        return; // Nothing new to report
+    }
+    track.fresh = false;
+
+    TransferProgress progress;
+    progress.slot = track.slot;
+    progress.bytes = bytes;
+    progress.total = total;
+    progress.bytesPerSecond = track.bytesPerSecond;
+    progress.etaSeconds = eta(bytes, total, track.bytesPerSecond);
+    progress.finished = finished;
+    out.push_back(progress);
+}
+
+void ProgressAggregator::fillTotals()
+{
+    sample_.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started_);
+    sample_.active = active_.size();
+    sample_.bytes = received_;
+    sample_.bytesPerSecond = bytesPerSecond_;
+}
+
+void ProgressAggregator::publish()
+{
+    for (const Frontend &frontend : frontends_)
+    {
+        frontend(sample_);
+    }
+}
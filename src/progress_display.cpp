@@ -0,0 +1,143 @@
+#include "progress_display.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace
+{
+    constexpr int BAR_WIDTH = 50;
+
+    std::string formatRate(double bytesPerSecond)
+    {
+        if (bytesPerSecond >= 1024 * 1024)
+        {
+            return fmt::format("{:.2f} MB/s", bytesPerSecond / (1024.0 * 1024.0));
+        }
+        if (bytesPerSecond >= 1024)
+        {
+            return fmt::format("{:.2f} KB/s", bytesPerSecond / 1024.0);
+        }
+        return fmt::format("{:.0f} B/s", bytesPerSecond);
+    }
+}
+
+std::string formatBytes(long long bytes)
+{
+    constexpr double KB = 1024.0;
+    constexpr double MB = KB * 1024.0;
+    constexpr double GB = MB * 1024.0;
+
+    if (bytes >= GB)
+    {
+        return fmt::format("{:.2f} GB", bytes / GB);
+    }
+    else if (bytes >= MB)
+    {
+        return fmt::format("{:.2f} MB", bytes / MB);
+    }
+    else if (bytes >= KB)
+    {
+        return fmt::format("{:.2f} KB", bytes / KB);
+    }
+    else
+    {
+        return fmt::format("{} B", bytes);
+    }
+}
+
+std::string formatDuration(long seconds)
+{
+    if (seconds < 0)
+    {
+        return "unknown";
+    }
+    else if (seconds < 60)
+    {
+        return fmt::format("{}s", seconds);
+    }
+    else if (seconds < 3600)
+    {
+        long minutes = seconds / 60;
+        long secs = seconds % 60;
+        return fmt::format("{}m {}s", minutes, secs);
+    }
+    else
+    {
+        long hours = seconds / 3600;
+        long minutes = (seconds % 3600) / 60;
+        return fmt::format("{}h {}m", hours, minutes);
+    }
+}
+
+ProgressDisplay::ProgressDisplay() : isTerminalOutput_(::isatty(fileno(stdout)))
+{
+}
+
+void ProgressDisplay::render(const ProgressSample &sample)
+{
+    if (sample.transfers.empty())
+    {
+        return;
+    }
+    // Piped output: one line a second, plus the last one of each transfer
+    if (!isTerminalOutput_ && sample.periodic && sample.elapsed - lastPrinted_ < PIPED_INTERVAL)
+    {
+        return;
+    }
+    lastPrinted_ = sample.elapsed;
+
+    fmt::memory_buffer line;
+    auto out = std::back_inserter(line);
+    bool finished = false;
+    if (sample.transfers.size() == 1 && sample.active <= 1)
+    {
+        const TransferProgress &transfer = sample.transfers.front();
+        if (transfer.bytes == 0 && transfer.total < 0)
+        {
+            return; // Nothing to show yet (or a connection that never got through)
+        }
+        finished = transfer.finished;
+        if (transfer.total > 0)
+        {
+            const double percentage =
+                std::min(100.0, static_cast<double>(transfer.bytes) * 100.0 / static_cast<double>(transfer.total));
+            const int filled = static_cast<int>(percentage / 100.0 * BAR_WIDTH);
+            line.push_back('[');
+            for (int i = 0; i < BAR_WIDTH; ++i)
+            {
+                line.push_back(i < filled ? '=' : i == filled ? '>' : ' ');
+            }
+            line.push_back(']');
+            fmt::format_to(out, " {:.1f}% | {} / {} | {} | ETA: {}", percentage, formatBytes(transfer.bytes),
+                           formatBytes(transfer.total), formatRate(transfer.bytesPerSecond),
+                           formatDuration(static_cast<long>(transfer.etaSeconds)));
+        }
+        else
+        {
+            fmt::format_to(out, "Downloaded: {} | Speed: {}", formatBytes(transfer.bytes),
+                           formatRate(transfer.bytesPerSecond));
+        }
+    }
+    else
+    {
+        fmt::format_to(out, "{} active | {} received | {}", sample.active, formatBytes(sample.bytes),
+                       formatRate(sample.bytesPerSecond));
+    }
+
+    const std::string_view text(line.data(), line.size());
+    if (isTerminalOutput_)
+    {
+        fmt::print("\r{}\033[K{}", text, finished ? "\n" : "");
+        std::fflush(stdout);
+    }
+    else
+    {
+        fmt::print("{}\n", text);
+    }
+}
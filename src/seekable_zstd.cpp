@@ -0,0 +1,234 @@
+#include "seekable_zstd.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <fmt/core.h>
+
+#include "work_stealing_pool.hpp"
+
+namespace
+{
+    void appendLittleEndian(std::string &out, std::uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+}
+
+ZstdFramePool::ZstdFramePool(const Options &options)
+    : level_(options.level), frameBytes_(std::clamp<size_t>(options.frameBytes, 1, 1 << 30))
+{
+#ifdef HAVE_ZSTD
+    // One context up front: a bad level fails here, not in the middle of a download
+    Context context(ZSTD_createCCtx(), ZSTD_freeCCtx);
+    if (!context)
+    {
+        throw std::runtime_error("Failed to create zstd compressor");
+    }
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, level_)))
+    {
+        throw std::runtime_error(fmt::format("Unsupported zstd level {}", level_));
+    }
+    // The seek table repeats each frame's content checksum
+    ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1);
+    idle_.push_back(std::move(context));
+    created_ = 1;
+    threads_ = std::make_unique<WorkStealingPool>(options.threads);
+#else
+    throw std::runtime_error("Built without zstd support");
+#endif
+}
+
+ZstdFramePool::~ZstdFramePool() = default;
+
+void ZstdFramePool::submit(std::shared_ptr<Frame> frame, std::function<void()> onDone)
+{
+    threads_->submit([this, frame = std::move(frame), onDone = std::move(onDone)]
+                     {
+                         compress(*frame);
+                         frame->done.store(true, std::memory_order_release);
+                         if (onDone)
+                         {
+                             onDone();
+                         }
+                     });
+}
+
+size_t ZstdFramePool::contexts() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return created_;
+}
+
+void ZstdFramePool::compress(Frame &frame)
+{
+#ifdef HAVE_ZSTD
+    Context context(nullptr, ZSTD_freeCCtx);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty())
+        {
+            context = std::move(idle_.back());
+            idle_.pop_back();
+        }
+    }
+    if (!context)
+    {
+        // Same parameters as the first one, which the level already passed
+        context.reset(ZSTD_createCCtx());
+        if (!context)
+        {
+            frame.error = "Failed to create zstd compressor";
+            return;
+        }
+        ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, level_);
+        ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++created_;
+    }
+
+    frame.output.resize(ZSTD_compressBound(frame.input.size()));
+    const size_t written = ZSTD_compress2(context.get(), frame.output.data(), frame.output.size(),
+                                          frame.input.data(), frame.input.size());
+    if (ZSTD_isError(written))
+    {
+        frame.error = fmt::format("zstd compression failed: {}", ZSTD_getErrorName(written));
+        frame.output.clear();
+        ZSTD_CCtx_reset(context.get(), ZSTD_reset_session_only);
+    }
+    else
+    {
+        frame.output.resize(written);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(context));
+#else
+    frame.error = "Built without zstd support";
+#endif
+}
+
+SeekableZstdWriter::SeekableZstdWriter(std::shared_ptr<ZstdFramePool> pool, std::function<void()> onFrameDone)
+    : pool_(std::move(pool)), onFrameDone_(std::move(onFrameDone))
+{
+}
+
+SeekableZstdWriter::~SeekableZstdWriter() = default;
+
+bool SeekableZstdWriter::write(const char *data, size_t length, std::string &out, std::string &error)
+{
+    if (sealed_)
+    {
+        error = "zstd stream already finished";
+        return false;
+    }
+    const size_t frameBytes = pool_->frameBytes();
+    while (length > 0)
+    {
+        // Never let a frame run past frameBytes: it would no longer be the unit of access
+        if (input_.capacity() < frameBytes)
+        {
+            input_.reserve(frameBytes);
+        }
+        const size_t take = std::min(length, frameBytes - input_.size());
+        input_.append(data, take);
+        inputBytes_ += take;
+        data += take;
+        length -= take;
+        if (input_.size() == frameBytes)
+        {
+            submitFrame();
+        }
+    }
+    return collect(out, error);
+}
+
+void SeekableZstdWriter::seal(const std::string &sha256)
+{
+    if (sealed_)
+    {
+        return;
+    }
+    // An empty download still gets one (empty) frame so that it decodes to an empty file
+    if (!input_.empty() || (entries_.empty() && inFlight_.empty()))
+    {
+        submitFrame();
+    }
+    sha256_ = sha256;
+    sealed_ = true;
+}
+
+bool SeekableZstdWriter::collect(std::string &out, std::string &error)
+{
+    while (!inFlight_.empty() && inFlight_.front()->done.load(std::memory_order_acquire))
+    {
+        const ZstdFramePool::Frame &frame = *inFlight_.front();
+        if (!frame.error.empty())
+        {
+            error = frame.error;
+            return false;
+        }
+        // A frame ends with its content checksum: the low 32 bits of XXH64, little-endian
+        Entry entry;
+        entry.compressedBytes = static_cast<std::uint32_t>(frame.output.size());
+        entry.uncompressedBytes = static_cast<std::uint32_t>(frame.input.size());
+        const char *tail = frame.output.data() + frame.output.size() - std::min<size_t>(4, frame.output.size());
+        for (int i = 3; i >= 0 && frame.output.size() >= 4; --i)
+        {
+            entry.checksum = (entry.checksum << 8) | static_cast<unsigned char>(tail[i]);
+        }
+        entries_.push_back(entry);
+        out += frame.output;
+        outputBytes_ += frame.output.size();
+        inFlight_.pop_front();
+    }
+    if (!sealed_ || !inFlight_.empty() || trailerWritten_)
+    {
+        return true;
+    }
+    trailerWritten_ = true;
+
+    if (!sha256_.empty())
+    {
+        appendSkippableFrame(CHECKSUM_FRAME_MAGIC, "sha256:" + sha256_, out);
+    }
+
+    // Seek table: per frame its compressed size, uncompressed size and checksum, then the footer
+    std::string table;
+    table.reserve(entries_.size() * 12 + 9);
+    for (const Entry &entry : entries_)
+    {
+        appendLittleEndian(table, entry.compressedBytes);
+        appendLittleEndian(table, entry.uncompressedBytes);
+        appendLittleEndian(table, entry.checksum);
+    }
+    appendLittleEndian(table, static_cast<std::uint32_t>(entries_.size()));
+    table.push_back(static_cast<char>(0x80)); // Descriptor: checksums present
+    appendLittleEndian(table, SEEKABLE_MAGIC);
+    appendSkippableFrame(SEEK_TABLE_MAGIC, table, out);
+    return true;
+}
+
+void SeekableZstdWriter::submitFrame()
+{
+    auto frame = std::make_shared<ZstdFramePool::Frame>();
+    frame->input.swap(input_);
+    inFlight_.push_back(frame);
+    pool_->submit(std::move(frame), onFrameDone_);
+}
+
+void SeekableZstdWriter::appendSkippableFrame(std::uint32_t magic, const std::string &payload, std::string &out)
+{
+    appendLittleEndian(out, magic);
+    appendLittleEndian(out, static_cast<std::uint32_t>(payload.size()));
+    out += payload;
+    outputBytes_ += 8 + payload.size();
+}
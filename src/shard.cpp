@@ -0,0 +1,1310 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fmt/core.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "checksum.hpp"
+#include "checksum_discovery.hpp"
+#include "http_client.hpp"
+#include "staging.hpp"
+
+namespace
+{
+    std::string digestToHex(const unsigned char *digest, unsigned int length)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            hex.push_back(HEX[digest[i] >> 4]);
+            hex.push_back(HEX[digest[i] & 0x0f]);
+        }
+        return hex;
+    }
+
+    // success stays false; the caller sets it for completed jobs
+    TransferResult makeResult(size_t index, std::string error, curl_off_t bytes = 0, int retries = 0)
+    {
+        TransferResult result;
+        result.jobIndex = index;
+        result.error = std::move(error);
+        result.bytes = bytes;
+        result.retries = retries;
+        return result;
+    }
+
+    using DigestContext = std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)>;
+
+    // Streaming hash only pays off when the manifest wants SHA-256
+    bool wantsSha256(const DownloadJob &job)
+    {
+        return job.expectedChecksum && job.expectedChecksum->rfind("sha256:", 0) == 0;
+    }
+
+    // Fresh "sha256", "sha1" or "md5" context, or null if OpenSSL refuses (verification then reads the file)
+    DigestContext newDigest(const std::string &algorithm)
+    {
+        const EVP_MD *type = algorithm == "md5" ? EVP_md5() : algorithm == "sha1" ? EVP_sha1() : EVP_sha256();
+        DigestContext context(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+        if (context && EVP_DigestInit_ex(context.get(), type, nullptr) != 1)
+        {
+            context.reset();
+        }
+        return context;
+    }
+
+    DigestContext newSha256()
+    {
+        return newDigest("sha256");
+    }
+}
+
+/**
+ * Per-job state, owned by the shard thread for the whole life of the job
+ * (across retries).
+ */
+struct Shard::Transfer
+{
+    size_t index = 0;
+    DownloadJob job;
+    std::filesystem::path finalPath;
+    std::filesystem::path partPath;
+
+    Shard *owner = nullptr;
+    std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> easy{nullptr, curl_easy_cleanup};
+    ArenaBuffer buffer; // Write coalescing; drawn from the memory budget per attempt
+    size_t buffered = 0;
+    bool paused = false; // Waiting in paused_ for write-buffer memory
+    bool compressing = false; // Waiting in compressing_ for frames to come back
+    curl_off_t writeOffset = 0; // File offset of the next flushed byte (positional writes)
+
+    curl_off_t resumeOffset = 0; // Bytes on disk when the current attempt started
+    curl_off_t received = 0;     // Body bytes over all attempts
+    curl_off_t position = 0;     // Bytes of the file received so far (resumed ones included)
+    bool firstChunk = true;
+    bool started = false;        // Start reported (event stream, progress)
+    ProgressAggregator::Counter *progress = nullptr; // From begin(); ended when the result is published
+    int attempts = 0;
+    std::chrono::steady_clock::time_point retryAt;
+    size_t path = 0;   // PathSelector index of the current attempt (if paths are used)
+    size_t volume = 0; // DiskAdmission id of the destination filesystem
+    std::string writeError; // Set by the write callback; makes the failure permanent
+    std::string body;       // Pack mode: the object received so far
+    size_t bodyCharged = 0; // Pack mode: memory budget drawn for body (given back with it)
+    std::unique_ptr<SeekableZstdWriter> zstd; // Compressed output: the current attempt's stream
+    std::string compressed;                   // Compressed output: bytes produced by the last call
+    std::string uncompressedSha256;           // Compressed output: digest taken before the stream ended
+    bool claimed = false;                              // Holds the cross-process lock on partPath
+    std::chrono::steady_clock::time_point peerCheckAt; // Another process has it: when to ask again
+
+    DigestContext hash{nullptr, EVP_MD_CTX_free};
+    std::string hashAlgorithm = "sha256"; // Of hash: the manifest's, or the announced checksum's
+    // Pack mode: hash stays SHA-256 for the index; a checksum in another algorithm is taken here
+    DigestContext checkHash{nullptr, EVP_MD_CTX_free};
+    std::string checkAlgorithm;
+    std::string announcedChecksum;        // From the response headers when the job had none
+
+    ~Transfer()
+    {
+        if (bodyCharged > 0)
+        {
+            owner->options_.memory->release(MemoryBudget::Stage::WriteBuffer, bodyCharged);
+        }
+    }
+};
+
+/**
+ * curl_multi_wakeup for threads that may outlive the shard (frame-pool
+ * workers finishing a failed transfer's frame).
+ */
+struct Shard::Wakeup
+{
+    std::mutex mutex;
+    CURLM *multi = nullptr;
+
+    void ring()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (multi)
+        {
+            curl_multi_wakeup(multi);
+        }
+    }
+};
+
+Shard::Shard(size_t id, const EngineOptions &options, std::shared_ptr<NetworkCache> networkCache,
+             std::function<void()> onResultReady)
+    : id_(id), options_(options), networkCache_(std::move(networkCache)),
+      onResultReady_(std::move(onResultReady)), inbox_(QUEUE_CAPACITY), outbox_(QUEUE_CAPACITY),
+      multi_(curl_multi_init(), curl_multi_cleanup), resolveList_(nullptr, curl_slist_free_all),
+      fileCache_(std::max<size_t>(1, options_.maxOpenFiles / std::max<size_t>(1, options_.shardCount)),
+                 options_.pageCache, options_.directories)
+{
+    if (!multi_)
+    {
+        throw std::runtime_error("Failed to create CURL multi handle");
+    }
+
+    wakeup_ = std::make_shared<Wakeup>();
+    wakeup_->multi = multi_.get();
+
+    // Keep per-host connections alive across the shard's queue of jobs
+    curl_multi_setopt(multi_.get(), CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(options_.maxActivePerShard));
+
+    if (networkCache_)
+    {
+        for (const std::string &entry : networkCache_->resolveEntries())
+        {
+            resolveList_.reset(curl_slist_append(resolveList_.release(), entry.c_str()));
+        }
+    }
+}
+
+Shard::~Shard()
+{
+    join();
+    {
+        std::lock_guard<std::mutex> lock(wakeup_->mutex);
+        wakeup_->multi = nullptr;
+    }
+
+    // Handles must leave the multi before either is cleaned up
+    for (auto &[easy, transfer] : active_)
+    {
+        curl_multi_remove_handle(multi_.get(), easy);
+    }
+}
+
+void Shard::start()
+{
+    thread_ = std::thread([this]
+                          { eventLoop(); });
+}
+
+bool Shard::trySubmit(ShardJob &job)
+{
+    if (!inbox_.tryPush(job))
+    {
+        return false;
+    }
+    curl_multi_wakeup(multi_.get());
+    return true;
+}
+
+std::optional<TransferResult> Shard::tryPopResult()
+{
+    return outbox_.tryPop();
+}
+
+void Shard::finish()
+{
+    finishing_.store(true, std::memory_order_release);
+    curl_multi_wakeup(multi_.get());
+}
+
+void Shard::join()
+{
+    finish();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void Shard::pinToCore() const
+{
+#ifdef __linux__
+    const unsigned cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(id_ % cores, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fmt::print(stderr, "Warning: could not pin shard {} to CPU {}\n", id_, id_ % cores);
+    }
+#endif
+}
+
+void Shard::eventLoop()
+{
+    if (options_.pinThreads)
+    {
+        pinToCore();
+    }
+
+    for (;;)
+    {
+        admissionBlocked_ = false;
+        driveCompressors();
+        resumePaused();
+        acceptJobs();
+        startDueRetries();
+        startPending();
+
+        int running = 0;
+        curl_multi_perform(multi_.get(), &running);
+
+        int queued = 0;
+        while (CURLMsg *message = curl_multi_info_read(multi_.get(), &queued))
+        {
+            if (message->msg == CURLMSG_DONE)
+            {
+                completeTransfer(message->easy_handle, message->data.result);
+            }
+        }
+
+        flushUnsent();
+        foldDiskBytes(false);
+
+        // Check the flag before the queues: a job pushed before finish() is seen below
+        const bool finishing = finishing_.load(std::memory_order_acquire);
+        if (finishing && inbox_.sizeApprox() == 0 && pending_.empty() && active_.empty() &&
+            sealing_.empty() && waitingRetry_.empty() && unsent_.empty())
+        {
+            foldDiskBytes(true);
+            return;
+        }
+
+        // Sleeps in poll(); trySubmit()/finish() interrupt it with curl_multi_wakeup
+        curl_multi_poll(multi_.get(), nullptr, 0, static_cast<int>(pollTimeoutMs()), nullptr);
+    }
+}
+
+long Shard::pollTimeoutMs() const
+{
+    long timeoutMs = MAX_POLL_MS;
+    if (!unsent_.empty())
+    {
+        return 1; // Engine is behind on draining results; retry soon
+    }
+    if (!paused_.empty() || admissionBlocked_)
+    {
+        timeoutMs = BUDGET_RETRY_MS; // Memory is released by other threads without waking us
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto &transfer : waitingRetry_)
+    {
+        auto untilRetry = std::chrono::duration_cast<std::chrono::milliseconds>(transfer->retryAt - now).count();
+        timeoutMs = std::min<long>(timeoutMs, std::max<long>(0, untilRetry));
+    }
+    return timeoutMs;
+}
+
+void Shard::acceptJobs()
+{
+    // Everything in the inbox is prepared now; startPending() decides when each one runs
+    while (std::optional<ShardJob> next = inbox_.tryPop())
+    {
+        auto transfer = std::make_unique<Transfer>();
+        transfer->owner = this;
+        transfer->index = next->index;
+        transfer->job = std::move(next->job);
+        transfer->finalPath = transfer->job.destination;
+
+        if (options_.pack)
+        {
+            // No directories, .part files or renames: the object goes into a segment
+            if (options_.pack->contains(transfer->job.destination))
+            {
+                TransferResult done = makeResult(transfer->index, "");
+                done.success = true;
+                done.location = fmt::format("{}:{} (already packed)", options_.pack->directory().string(),
+                                            transfer->job.destination);
+                publish(*transfer, std::move(done));
+                continue;
+            }
+            transfer->volume = options_.disks->volumeFor(options_.pack->directory());
+            pending_.push_back(std::move(transfer));
+            continue;
+        }
+
+        // The file on disk is compressed; only the digest taken while streaming can vouch for the content
+        if (options_.storeZstd && transfer->job.expectedChecksum && !wantsSha256(transfer->job))
+        {
+            publish(*transfer, makeResult(transfer->index, "Compressed output verifies sha256 checksums only"));
+            continue;
+        }
+
+        transfer->partPath = stagingPath(transfer->finalPath, options_.scratchDir);
+
+        std::error_code error;
+        for (const std::filesystem::path *path : {&transfer->finalPath, &transfer->partPath})
+        {
+            if (!path->has_parent_path())
+            {
+                continue;
+            }
+            if (options_.directories)
+            {
+                options_.directories->ensure(path->parent_path()); // Created and opened once per directory
+            }
+            else
+            {
+                std::filesystem::create_directories(path->parent_path(), error);
+            }
+        }
+        transfer->volume = options_.disks->volumeFor(transfer->partPath.parent_path()); // Where the writes go
+        probeResume(*transfer);
+        pending_.push_back(std::move(transfer)); // The easy handle comes when it starts: waiting jobs stay cheap
+    }
+}
+
+void Shard::probeResume(Transfer &transfer)
+{
+    // Resume a .part left behind by an earlier run. Bulk mode doesn't ask:
+    // small files are cheaper to fetch again than to stat one by one. A
+    // compressed stream can't be continued at a byte offset at all.
+    transfer.resumeOffset = 0;
+    if (!options_.directories && !options_.storeZstd)
+    {
+        std::error_code error;
+        auto existing = std::filesystem::file_size(transfer.partPath, error);
+        transfer.resumeOffset = error ? 0 : static_cast<curl_off_t>(existing);
+    }
+
+    // Hash only what this run sees from byte 0; resumed files are verified from disk
+    transfer.hash.reset();
+    transfer.hashAlgorithm = "sha256";
+    transfer.announcedChecksum.clear();
+    if (wantsSha256(transfer.job) && transfer.resumeOffset == 0 && !options_.storeZstd)
+    {
+        transfer.hash = newSha256();
+    }
+}
+
+PartLocks::Claim Shard::claimPart(Transfer &transfer)
+{
+    if (!options_.partLocks || options_.pack || transfer.claimed)
+    {
+        return PartLocks::Claim::Owned;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now < transfer.peerCheckAt)
+    {
+        return PartLocks::Claim::Busy;
+    }
+
+    const PartLocks::Claim claim = options_.partLocks->tryClaim(transfer.partPath, transfer.finalPath);
+    switch (claim)
+    {
+    case PartLocks::Claim::Busy:
+        transfer.peerCheckAt = now + std::chrono::milliseconds(PartLocks::POLL_INTERVAL_MS);
+        break;
+
+    case PartLocks::Claim::Finished:
+    {
+        if (options_.storeZstd && transfer.job.expectedChecksum)
+        {
+            // A compressed file can't be checked against the checksum from disk:
+            // fetch it again rather than trust it (the next claim is ours)
+            return claimPart(transfer);
+        }
+        // Landed by the other process: reported as done; the engine verifies it
+        // if the job has a checksum, but doesn't post-process it again
+        TransferResult done = makeResult(transfer.index, "");
+        done.success = true;
+        done.location = transfer.finalPath.string();
+        publish(transfer, std::move(done));
+        break;
+    }
+
+    case PartLocks::Claim::Owned:
+        // Another process may have written or landed the .part since the job was accepted
+        transfer.claimed = true;
+        probeResume(transfer);
+        break;
+    }
+    return claim;
+}
+
+void Shard::startPending()
+{
+    // In order, but a job for a busy volume doesn't hold up jobs for other volumes,
+    // and one that another process is fetching doesn't hold up the rest.
+    // A volume that refused a slot isn't asked again this pass (tryAdmit takes a global lock)
+    std::vector<size_t> fullVolumes;
+    size_t waitingForDisk = 0;
+    for (auto it = pending_.begin(); it != pending_.end() && active_.size() < options_.maxActivePerShard;)
+    {
+        const PartLocks::Claim claim = claimPart(**it);
+        if (claim == PartLocks::Claim::Busy)
+        {
+            ++it;
+            continue;
+        }
+        if (claim == PartLocks::Claim::Finished)
+        {
+            it = pending_.erase(it);
+            continue;
+        }
+        const size_t volume = (*it)->volume;
+        if (std::find(fullVolumes.begin(), fullVolumes.end(), volume) != fullVolumes.end())
+        {
+            ++waitingForDisk;
+            ++it;
+            continue;
+        }
+        if (!options_.disks->tryAdmit(volume))
+        {
+            fullVolumes.push_back(volume);
+            admissionBlocked_ = true;
+            ++waitingForDisk;
+            ++it;
+            continue;
+        }
+        if (!reserveReceiveBuffer())
+        {
+            options_.disks->release(volume);
+            break; // Out of memory: nothing else can start either
+        }
+
+        std::unique_ptr<Transfer> transfer = std::move(*it);
+        it = pending_.erase(it);
+        if (!transfer->easy)
+        {
+            transfer->easy.reset(curl_easy_init());
+        }
+        if (!transfer->easy || !startAttempt(*transfer))
+        {
+            releaseAdmission(*transfer);
+            publish(*transfer, makeResult(transfer->index, transfer->writeError.empty() ? "Failed to start transfer"
+                                                                                        : transfer->writeError));
+            continue;
+        }
+
+        CURL *easy = transfer->easy.get();
+        active_.emplace(easy, std::move(transfer));
+    }
+    waitingForDisk_.store(waitingForDisk, std::memory_order_relaxed);
+}
+
+void Shard::startDueRetries()
+{
+    const auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < waitingRetry_.size();)
+    {
+        if (waitingRetry_[i]->retryAt > now || active_.size() >= options_.maxActivePerShard ||
+            !admit(*waitingRetry_[i]))
+        {
+            ++i;
+            continue;
+        }
+
+        std::unique_ptr<Transfer> transfer = std::move(waitingRetry_[i]);
+        waitingRetry_.erase(waitingRetry_.begin() + static_cast<std::ptrdiff_t>(i));
+
+        // Continue from whatever made it to disk
+        std::error_code error;
+        auto onDisk = std::filesystem::file_size(transfer->partPath, error);
+        transfer->resumeOffset = error ? 0 : static_cast<curl_off_t>(onDisk);
+
+        if (!startAttempt(*transfer))
+        {
+            releaseAdmission(*transfer);
+            publish(*transfer, makeResult(transfer->index, transfer->writeError, transfer->received, transfer->attempts));
+            continue;
+        }
+        CURL *easy = transfer->easy.get();
+        active_.emplace(easy, std::move(transfer));
+    }
+}
+
+bool Shard::startAttempt(Transfer &transfer)
+{
+    if (options_.pack)
+    {
+        // Objects are small: every attempt starts over (keeping the memory it drew)
+        transfer.body.clear();
+        transfer.hash = newSha256();
+        transfer.checkHash.reset();
+        const std::string expected = transfer.job.expectedChecksum.value_or(transfer.announcedChecksum);
+        if (!expected.empty())
+        {
+            transfer.checkAlgorithm =
+                ChecksumVerifier::algorithmName(ChecksumVerifier::parseChecksum(expected).first); // Validated
+            if (transfer.checkAlgorithm != "sha256")
+            {
+                transfer.checkHash = newDigest(transfer.checkAlgorithm);
+            }
+        }
+    }
+    else
+    {
+        if (options_.storeZstd)
+        {
+            // Every attempt writes a fresh stream, hashed from byte 0
+            transfer.resumeOffset = 0;
+            transfer.hash = newSha256();
+            transfer.uncompressedSha256.clear();
+            transfer.zstd = std::make_unique<SeekableZstdWriter>(options_.zstdFrames, [wakeup = wakeup_]
+                                                                 { wakeup->ring(); });
+        }
+        // Descriptors come from the LRU cache on demand; only a fresh start touches the file now
+        if (transfer.resumeOffset == 0 && !fileCache_.truncate(transfer.partPath.string(), 0))
+        {
+            transfer.writeError = fmt::format("Cannot open file for writing: {} ({})",
+                                              transfer.partPath.string(), std::strerror(errno));
+            return false;
+        }
+    }
+    transfer.firstChunk = true;
+    transfer.buffered = 0;
+    transfer.writeOffset = transfer.resumeOffset;
+    transfer.position = options_.pack ? 0 : transfer.resumeOffset;
+    if (!transfer.started)
+    {
+        transfer.started = true;
+        if (options_.events)
+        {
+            options_.events->start(transfer.index, transfer.job.url, transfer.finalPath.string());
+        }
+        if (options_.progress)
+        {
+            transfer.progress = options_.progress->begin(transfer.index, transfer.position, -1);
+        }
+    }
+
+    CURL *easy = transfer.easy.get();
+    curl_easy_reset(easy);
+    curl_easy_setopt(easy, CURLOPT_URL, transfer.job.url.c_str());
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, "DownloadManager/1.90");
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfer);
+    curl_easy_setopt(easy, CURLOPT_BUFFERSIZE, static_cast<long>(RECEIVE_BUFFER_SIZE)); // As budgeted
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, &transfer);
+    curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(easy, CURLOPT_SSL_VERIFYHOST, 2L);
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(easy, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT, static_cast<long>(options_.timeoutSeconds));
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L); // HTTP >= 400 must not land in the .part file
+    curl_easy_setopt(easy, CURLOPT_RESUME_FROM_LARGE, transfer.resumeOffset);
+    if (!options_.caCertFile.empty())
+    {
+        curl_easy_setopt(easy, CURLOPT_CAINFO, options_.caCertFile.c_str());
+    }
+    if (resolveList_)
+    {
+        curl_easy_setopt(easy, CURLOPT_RESOLVE, resolveList_.get());
+    }
+    if (options_.paths)
+    {
+        // Each attempt may leave through a different interface
+        transfer.path = options_.paths->choose();
+        curl_easy_setopt(easy, CURLOPT_INTERFACE, options_.paths->interfaceName(transfer.path).c_str());
+    }
+
+    ++transfer.attempts;
+    if (curl_multi_add_handle(multi_.get(), easy) != CURLM_OK)
+    {
+        if (options_.paths)
+        {
+            options_.paths->recordFailure(transfer.path);
+        }
+        closeFile(transfer);
+        transfer.writeError = "Failed to add transfer to event loop";
+        return false;
+    }
+    return true;
+}
+
+bool Shard::admit(Transfer &transfer)
+{
+    if (!options_.disks->tryAdmit(transfer.volume))
+    {
+        admissionBlocked_ = true;
+        return false;
+    }
+    if (!reserveReceiveBuffer())
+    {
+        options_.disks->release(transfer.volume);
+        return false;
+    }
+    return true;
+}
+
+bool Shard::reserveReceiveBuffer()
+{
+    // Admit only while a write buffer (pack mode: a whole body) still fits next to
+    // every receive buffer: then at least one paused transfer can always resume
+    const size_t headroom = options_.pack ? PackWriter::MAX_OBJECT_BYTES : WRITE_BUFFER_SIZE;
+    if (!options_.memory->tryAcquire(MemoryBudget::Stage::Receive, RECEIVE_BUFFER_SIZE, headroom))
+    {
+        admissionBlocked_ = true;
+        return false;
+    }
+    return true;
+}
+
+void Shard::releaseAdmission(Transfer &transfer)
+{
+    options_.memory->release(MemoryBudget::Stage::Receive, RECEIVE_BUFFER_SIZE);
+    options_.disks->release(transfer.volume);
+}
+
+bool Shard::allocateWriteBuffer(Transfer &transfer)
+{
+    if (!options_.memory->tryAcquire(MemoryBudget::Stage::WriteBuffer, WRITE_BUFFER_SIZE))
+    {
+        return false;
+    }
+    transfer.buffer = BufferArena::instance().allocate(WRITE_BUFFER_SIZE);
+    if (transfer.buffer.empty())
+    {
+        // Within budget but the arena couldn't map a slab: waiting won't help
+        options_.memory->release(MemoryBudget::Stage::WriteBuffer, WRITE_BUFFER_SIZE);
+        transfer.writeError = "Out of memory for a write buffer";
+        return false;
+    }
+    return true;
+}
+
+void Shard::freeWriteBuffer(Transfer &transfer)
+{
+    if (transfer.buffer.empty())
+    {
+        return;
+    }
+    transfer.buffer.reset();
+    options_.memory->release(MemoryBudget::Stage::WriteBuffer, WRITE_BUFFER_SIZE);
+}
+
+void Shard::resumePaused()
+{
+    for (size_t i = 0; i < paused_.size();)
+    {
+        Transfer &transfer = *paused_[i];
+        const bool resumed = options_.pack ? reserveBody(transfer, fullBodyBytes(transfer))
+                                           : allocateWriteBuffer(transfer);
+        if (!resumed && transfer.writeError.empty())
+        {
+            return; // Budget still exhausted; keep FIFO order
+        }
+        // Got a buffer, or failed for good: either way the held chunk is delivered (and refused)
+        paused_.erase(paused_.begin() + static_cast<std::ptrdiff_t>(i));
+        transfer.paused = false;
+        curl_easy_pause(transfer.easy.get(), CURLPAUSE_CONT); // May deliver the held chunk right away
+    }
+}
+
+bool Shard::writeOut(Transfer &transfer, const char *data, size_t length)
+{
+    if (!fileCache_.writeAt(transfer.partPath.string(), data, length, static_cast<off_t>(transfer.writeOffset)))
+    {
+        transfer.writeError = fmt::format("Write to {} failed: {}", transfer.partPath.string(), std::strerror(errno));
+        return false;
+    }
+    if (diskBytes_.size() <= transfer.volume)
+    {
+        diskBytes_.resize(transfer.volume + 1, 0);
+    }
+    diskBytes_[transfer.volume] += length; // Reported from the event loop, not per write
+    reportDisk(transfer.volume);
+    transfer.writeOffset += static_cast<curl_off_t>(length);
+    return true;
+}
+
+void Shard::closeFile(Transfer &transfer)
+{
+    fileCache_.close(transfer.partPath.string());
+    reportDisk(transfer.volume);
+}
+
+void Shard::reportDisk(size_t volume)
+{
+    // Writeback waits are the disk's latency; plain writes only fill the page cache
+    const double waited = fileCache_.takeSyncSeconds();
+    if (waited > 0.0)
+    {
+        options_.disks->recordSync(volume, waited);
+    }
+}
+
+void Shard::foldDiskBytes(bool force)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (!force && now - diskReportedAt_ < std::chrono::milliseconds(DISK_REPORT_MS))
+    {
+        return;
+    }
+    diskReportedAt_ = now;
+    for (size_t volume = 0; volume < diskBytes_.size(); ++volume)
+    {
+        if (diskBytes_[volume] > 0)
+        {
+            options_.disks->recordWrite(volume, std::exchange(diskBytes_[volume], 0));
+        }
+    }
+}
+
+bool Shard::flushBuffer(Transfer &transfer)
+{
+    if (transfer.buffered == 0)
+    {
+        return true;
+    }
+    const size_t length = transfer.buffered;
+    transfer.buffered = 0;
+    return writeOut(transfer, transfer.buffer.data(), length);
+}
+
+size_t Shard::writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    auto &transfer = *static_cast<Transfer *>(userdata);
+    const size_t totalSize = size * nmemb;
+    Shard &shard = *transfer.owner;
+    if (shard.options_.pack)
+    {
+        return shard.receivePacked(transfer, ptr, totalSize);
+    }
+
+    // No memory for a write buffer: libcurl holds this chunk and stops reading
+    // the socket until resumePaused() gets one
+    if (!transfer.writeError.empty())
+    {
+        return 0; // The transfer fails with writeError
+    }
+    if (transfer.buffer.empty() && !shard.allocateWriteBuffer(transfer))
+    {
+        if (!transfer.writeError.empty())
+        {
+            return 0;
+        }
+        transfer.paused = true;
+        shard.paused_.push_back(&transfer);
+        shard.options_.memory->countPause();
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    // Frames still compressing: libcurl holds this chunk until driveCompressors() collects them
+    if (transfer.zstd && transfer.zstd->busy())
+    {
+        if (!shard.collectCompressed(transfer))
+        {
+            return 0;
+        }
+        if (transfer.zstd->busy())
+        {
+            transfer.compressing = true;
+            shard.compressing_.push_back(&transfer);
+            return CURL_WRITEFUNC_PAUSE;
+        }
+    }
+
+    if (transfer.firstChunk)
+    {
+        transfer.firstChunk = false;
+
+        // The headers are all in by the first body byte
+        if (shard.options_.discoverChecksums && !transfer.job.expectedChecksum && transfer.announcedChecksum.empty())
+        {
+            shard.adoptAnnouncedChecksum(transfer);
+        }
+
+        curl_off_t contentLength = -1;
+        curl_easy_getinfo(transfer.easy.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        if (contentLength > 0)
+        {
+            if (shard.options_.progress)
+            {
+                shard.options_.progress->setTotal(transfer.progress, transfer.resumeOffset + contentLength);
+            }
+            const std::filesystem::path directory = transfer.partPath.parent_path().empty()
+                                                        ? std::filesystem::path(".")
+                                                        : transfer.partPath.parent_path();
+            if (shard.options_.directories)
+            {
+                // Bulk mode: drawn from the filesystem's ledger, one statvfs per gigabyte
+                if (!shard.options_.directories->claimSpace(directory, static_cast<unsigned long long>(contentLength)))
+                {
+                    transfer.writeError =
+                        fmt::format("Insufficient disk space: need {} bytes in {}", contentLength, directory.string());
+                    return 0;
+                }
+            }
+            else
+            {
+                std::error_code error;
+                auto space = std::filesystem::space(directory, error);
+                if (!error && static_cast<curl_off_t>(space.available) < contentLength)
+                {
+                    transfer.writeError = fmt::format("Insufficient disk space: need {} bytes, {} available",
+                                                      contentLength, space.available);
+                    return 0;
+                }
+            }
+            if (shard.options_.preallocate && !transfer.zstd &&
+                !shard.fileCache_.reserve(transfer.partPath.string(), static_cast<off_t>(transfer.writeOffset),
+                                          static_cast<off_t>(contentLength)))
+            {
+                transfer.writeError = fmt::format("Cannot preallocate {} bytes for {}: {}", contentLength,
+                                                  transfer.partPath.string(), std::strerror(errno));
+                return 0;
+            }
+        }
+    }
+
+    if (transfer.hash)
+    {
+        EVP_DigestUpdate(transfer.hash.get(), ptr, totalSize);
+    }
+    transfer.received += static_cast<curl_off_t>(totalSize);
+    transfer.position += static_cast<curl_off_t>(totalSize);
+    if (shard.options_.progress)
+    {
+        shard.options_.progress->update(transfer.progress, transfer.position);
+    }
+
+    if (transfer.zstd)
+    {
+        // Only the compressed bytes reach the write buffer and the disk
+        transfer.compressed.clear();
+        if (!transfer.zstd->write(ptr, totalSize, transfer.compressed, transfer.writeError) ||
+            !shard.bufferOut(transfer, transfer.compressed.data(), transfer.compressed.size()))
+        {
+            return 0;
+        }
+        return totalSize;
+    }
+    return shard.bufferOut(transfer, ptr, totalSize) ? totalSize : 0;
+}
+
+void Shard::adoptAnnouncedChecksum(Transfer &transfer)
+{
+    // A range response's Content-Digest and Content-MD5 cover the range only
+    std::optional<std::string> digest = announcedDigest(transfer.easy.get(), transfer.resumeOffset > 0);
+    if (!digest)
+    {
+        return;
+    }
+    const std::string algorithm = digest->substr(0, digest->find(':'));
+    if (transfer.zstd && algorithm != "sha256")
+    {
+        return; // The compressed file on disk can't be re-hashed afterwards
+    }
+    transfer.announcedChecksum = std::move(*digest);
+    if (options_.pack)
+    {
+        // The pack index still needs the SHA-256; another algorithm gets its own context
+        transfer.checkAlgorithm = algorithm;
+        if (algorithm != "sha256")
+        {
+            transfer.checkHash = newDigest(algorithm);
+        }
+        return;
+    }
+    transfer.hashAlgorithm = algorithm;
+    if (transfer.resumeOffset == 0 && !transfer.zstd)
+    {
+        transfer.hash = newDigest(algorithm); // Resumed files are verified from disk
+    }
+}
+
+bool Shard::bufferOut(Transfer &transfer, const char *data, size_t length)
+{
+    if (transfer.buffer.empty())
+    {
+        return writeOut(transfer, data, length); // An empty body never drew a buffer (zstd trailer)
+    }
+
+    // Coalesce network reads into full-buffer file writes that end on an
+    // alignment boundary, so O_DIRECT can take all but a resume's first write
+    // and the tail
+    size_t consumed = 0;
+    while (consumed < length)
+    {
+        const size_t misalignment = static_cast<size_t>(transfer.writeOffset) % FdCache::DIRECT_ALIGNMENT;
+        const size_t fill = transfer.buffer.size() - misalignment;
+        const size_t take = std::min(length - consumed, fill - transfer.buffered);
+        std::memcpy(transfer.buffer.data() + transfer.buffered, data + consumed, take);
+        transfer.buffered += take;
+        consumed += take;
+        if (transfer.buffered == fill && !flushBuffer(transfer))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Shard::collectCompressed(Transfer &transfer)
+{
+    transfer.compressed.clear();
+    return transfer.zstd->collect(transfer.compressed, transfer.writeError) &&
+           bufferOut(transfer, transfer.compressed.data(), transfer.compressed.size());
+}
+
+void Shard::sealCompressed(Transfer &transfer)
+{
+    // The digest of the uncompressed stream goes into the file as well as into the result
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (transfer.hash && EVP_DigestFinal_ex(transfer.hash.get(), digest, &length) == 1)
+    {
+        transfer.uncompressedSha256 = digestToHex(digest, length);
+    }
+    transfer.hash.reset();
+    transfer.zstd->seal(transfer.uncompressedSha256);
+}
+
+void Shard::driveCompressors()
+{
+    for (size_t i = 0; i < compressing_.size();)
+    {
+        Transfer &transfer = *compressing_[i];
+        if (collectCompressed(transfer) && transfer.zstd->busy())
+        {
+            ++i;
+            continue;
+        }
+        // Room for more input, or failed for good: either way the held chunk is delivered (and refused)
+        compressing_.erase(compressing_.begin() + static_cast<std::ptrdiff_t>(i));
+        transfer.compressing = false;
+        curl_easy_pause(transfer.easy.get(), CURLPAUSE_CONT);
+    }
+
+    for (size_t i = 0; i < sealing_.size();)
+    {
+        auto &[transfer, result] = sealing_[i];
+        const bool collected = collectCompressed(*transfer);
+        if (collected && !transfer->zstd->done())
+        {
+            ++i;
+            continue;
+        }
+        std::unique_ptr<Transfer> sealed = std::move(transfer);
+        const CURLcode finalResult = collected ? result : CURLE_WRITE_ERROR;
+        sealing_.erase(sealing_.begin() + static_cast<std::ptrdiff_t>(i));
+        finishTransfer(std::move(sealed), finalResult);
+    }
+}
+
+void Shard::completeTransfer(CURL *easy, CURLcode result)
+{
+    auto found = active_.find(easy);
+    if (found == active_.end())
+    {
+        curl_multi_remove_handle(multi_.get(), easy);
+        return;
+    }
+    std::unique_ptr<Transfer> transfer = std::move(found->second);
+    active_.erase(found);
+    curl_multi_remove_handle(multi_.get(), easy);
+    if (transfer->compressing)
+    {
+        compressing_.erase(std::find(compressing_.begin(), compressing_.end(), transfer.get()));
+        transfer->compressing = false;
+    }
+
+    // A compressed file is only complete once its last frame and seek table are out.
+    // Frames still compressing are waited for by driveCompressors(), not here
+    if (transfer->zstd && result == CURLE_OK)
+    {
+        sealCompressed(*transfer);
+        if (!collectCompressed(*transfer))
+        {
+            result = CURLE_WRITE_ERROR;
+        }
+        else if (!transfer->zstd->done())
+        {
+            sealing_.emplace_back(std::move(transfer), result);
+            return;
+        }
+    }
+    finishTransfer(std::move(transfer), result);
+}
+
+void Shard::finishTransfer(std::unique_ptr<Transfer> transfer, CURLcode result)
+{
+    CURL *easy = transfer->easy.get();
+    // Whatever arrived is kept on disk so a retry can resume from it
+    if (!flushBuffer(*transfer) && result == CURLE_OK)
+    {
+        result = CURLE_WRITE_ERROR;
+    }
+    // Closed before the pipeline renames it or while waiting to retry
+    closeFile(*transfer);
+
+    // Memory and the volume slot are held per attempt, not while waiting to retry
+    freeWriteBuffer(*transfer);
+    releaseAdmission(*transfer);
+    if (transfer->paused)
+    {
+        paused_.erase(std::find(paused_.begin(), paused_.end(), transfer.get()));
+        transfer->paused = false;
+    }
+
+    long httpCode = 0;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &httpCode);
+
+    if (options_.paths)
+    {
+        // HTTP errors and local failures say nothing about the path; only transient network
+        // failures count against it (the sequential runner uses the same rule)
+        if (HttpClient::classifyError(result == CURLE_HTTP_RETURNED_ERROR ? CURLE_OK : result, 0) !=
+            HttpClient::ErrorType::Transient)
+        {
+            curl_off_t bytes = 0;
+            curl_off_t totalMicros = 0;
+            curl_easy_getinfo(easy, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+            curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &totalMicros);
+            options_.paths->record(transfer->path, bytes, static_cast<double>(totalMicros) / 1e6);
+        }
+        else
+        {
+            options_.paths->recordFailure(transfer->path);
+        }
+    }
+
+    // Server ignored our Range header (answered 200): start over from byte 0
+    if (result == CURLE_RANGE_ERROR && transfer->resumeOffset > 0)
+    {
+        std::error_code error;
+        std::filesystem::remove(transfer->partPath, error);
+        if (wantsSha256(transfer->job) || !transfer->announcedChecksum.empty())
+        {
+            transfer->hash = newDigest(transfer->hashAlgorithm);
+        }
+        transfer->retryAt = std::chrono::steady_clock::now();
+        --transfer->attempts; // Not a failure of the transfer itself
+        waitingRetry_.push_back(std::move(transfer));
+        return;
+    }
+
+    if (result != CURLE_OK)
+    {
+        // CURLOPT_FAILONERROR turns HTTP errors into CURLE_HTTP_RETURNED_ERROR;
+        // classify those by status like the sequential client does
+        HttpClient::ErrorType errorType = HttpClient::classifyError(
+            result == CURLE_HTTP_RETURNED_ERROR ? CURLE_OK : result, httpCode);
+        if (!transfer->writeError.empty())
+        {
+            errorType = HttpClient::ErrorType::Permanent;
+        }
+
+        // The buffer was flushed above, so the hashed bytes are exactly the bytes
+        // on disk and the retry can resume both the file and the hash
+        if (errorType != HttpClient::ErrorType::Permanent && transfer->attempts < options_.maxRetries)
+        {
+            int delayMs = INITIAL_RETRY_DELAY_MS * (1 << (transfer->attempts - 1));
+            static thread_local std::mt19937 gen(std::random_device{}());
+            std::uniform_int_distribution<> dis(-20, 20);
+            delayMs += delayMs * dis(gen) / 100;
+
+            fmt::print(stderr, "Transfer failed (attempt {}/{}): {} - retrying in {} ms\n",
+                       transfer->attempts, options_.maxRetries, curl_easy_strerror(result), delayMs);
+            if (options_.events)
+            {
+                options_.events->retry(transfer->index, transfer->attempts, delayMs, curl_easy_strerror(result));
+            }
+            transfer->retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+            waitingRetry_.push_back(std::move(transfer));
+            return;
+        }
+
+        std::string error = !transfer->writeError.empty() ? transfer->writeError
+                            : httpCode >= 400            ? fmt::format("HTTP error {}", httpCode)
+                                                         : std::string(curl_easy_strerror(result));
+
+        // Keep partial data for a later resume, but don't litter empty .part files
+        // (or compressed ones, which can't be resumed)
+        std::error_code sizeError;
+        if ((std::filesystem::file_size(transfer->partPath, sizeError) == 0 && !sizeError) || transfer->zstd)
+        {
+            std::filesystem::remove(transfer->partPath, sizeError);
+        }
+        publish(*transfer, makeResult(transfer->index, std::move(error), transfer->received, transfer->attempts - 1));
+        return;
+    }
+
+    // Size check against what the server announced for this response
+    curl_off_t contentLength = -1;
+    curl_easy_getinfo(easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+    std::error_code error;
+    auto actualSize = options_.pack   ? static_cast<curl_off_t>(transfer->body.size())
+                      : transfer->zstd ? static_cast<curl_off_t>(transfer->zstd->inputBytes())
+                                       : static_cast<curl_off_t>(std::filesystem::file_size(transfer->partPath, error));
+    if (!error && contentLength > 0 && actualSize != transfer->resumeOffset + contentLength)
+    {
+        publish(*transfer, makeResult(transfer->index,
+                                      fmt::format("Size mismatch: expected {} bytes, got {}",
+                                                  transfer->resumeOffset + contentLength, actualSize),
+                                      transfer->received, transfer->attempts - 1));
+        return;
+    }
+
+    // Verification and the rename into place run on the engine's post-processing
+    // pool, so this thread goes straight back to moving bytes
+    if (networkCache_)
+    {
+        networkCache_->captureFrom(easy, transfer->job.url);
+    }
+
+    TransferResult done = makeResult(transfer->index, "", transfer->received, transfer->attempts - 1);
+    done.success = true;
+    if (transfer->hash)
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_DigestFinal_ex(transfer->hash.get(), digest, &length) == 1)
+        {
+            std::string hex = digestToHex(digest, length);
+            if (transfer->hashAlgorithm == "sha256")
+            {
+                done.sha256 = std::move(hex);
+            }
+            else
+            {
+                done.streamedChecksum = transfer->hashAlgorithm + ":" + hex;
+            }
+        }
+    }
+    if (transfer->checkHash)
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_DigestFinal_ex(transfer->checkHash.get(), digest, &length) == 1)
+        {
+            done.streamedChecksum = transfer->checkAlgorithm + ":" + digestToHex(digest, length);
+        }
+    }
+    if (!transfer->uncompressedSha256.empty())
+    {
+        done.sha256 = transfer->uncompressedSha256;
+    }
+    done.announcedChecksum = transfer->announcedChecksum;
+    if (options_.pack)
+    {
+        // Appended on the engine's pool: a commit's fdatasync must not stall this loop
+        done.packedBody.swap(transfer->body);
+        done.packedCharge = std::exchange(transfer->bodyCharged, 0);
+    }
+    publish(*transfer, std::move(done));
+}
+
+size_t Shard::receivePacked(Transfer &transfer, const char *data, size_t length)
+{
+    if (!transfer.writeError.empty())
+    {
+        return 0;
+    }
+    if (transfer.body.size() + length > PackWriter::MAX_OBJECT_BYTES)
+    {
+        transfer.writeError = fmt::format("Object larger than {} MB; download it without --pack",
+                                          PackWriter::MAX_OBJECT_BYTES / (1024 * 1024));
+        return 0;
+    }
+    // The body stands in for the write buffer, drawn whole before its first byte:
+    // out of memory, libcurl holds this chunk until resumePaused() can draw it.
+    // A transfer waiting here holds no body, so the ones that do can always finish
+    if (transfer.bodyCharged == 0 && !reserveBody(transfer, fullBodyBytes(transfer)))
+    {
+        transfer.paused = true;
+        paused_.push_back(&transfer);
+        options_.memory->countPause();
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    // Longer than announced: partway through an object it must not wait for memory
+    if (!reserveBody(transfer, transfer.body.size() + length))
+    {
+        transfer.writeError = "Out of memory: body longer than its announced length";
+        return 0;
+    }
+    if (transfer.firstChunk)
+    {
+        transfer.firstChunk = false;
+        if (options_.discoverChecksums && !transfer.job.expectedChecksum && transfer.announcedChecksum.empty())
+        {
+            adoptAnnouncedChecksum(transfer);
+        }
+    }
+    if (transfer.hash)
+    {
+        EVP_DigestUpdate(transfer.hash.get(), data, length);
+    }
+    if (transfer.checkHash)
+    {
+        EVP_DigestUpdate(transfer.checkHash.get(), data, length);
+    }
+    transfer.received += static_cast<curl_off_t>(length);
+    transfer.position += static_cast<curl_off_t>(length);
+    if (options_.progress)
+    {
+        options_.progress->update(transfer.progress, transfer.position);
+    }
+    transfer.body.append(data, length);
+    return length;
+}
+
+bool Shard::reserveBody(Transfer &transfer, size_t bytes)
+{
+    if (bytes <= transfer.bodyCharged)
+    {
+        return true;
+    }
+    // Whole write buffers at a time, so small chunks don't each take the budget lock
+    const size_t more = (bytes - transfer.bodyCharged + WRITE_BUFFER_SIZE - 1) / WRITE_BUFFER_SIZE * WRITE_BUFFER_SIZE;
+    if (!options_.memory->tryAcquire(MemoryBudget::Stage::WriteBuffer, more))
+    {
+        return false;
+    }
+    transfer.bodyCharged += more;
+    return true;
+}
+
+size_t Shard::fullBodyBytes(Transfer &transfer) const
+{
+    curl_off_t contentLength = -1;
+    curl_easy_getinfo(transfer.easy.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+    if (contentLength <= 0)
+    {
+        return PackWriter::MAX_OBJECT_BYTES;
+    }
+    return std::min(static_cast<size_t>(contentLength), PackWriter::MAX_OBJECT_BYTES);
+}
+
+void Shard::publish(Transfer &transfer, TransferResult result)
+{
+    if (transfer.progress)
+    {
+        // Final numbers taken before the result is out; the engine reports them ahead of it
+        options_.progress->end(std::exchange(transfer.progress, nullptr));
+    }
+    unsent_.push_back(std::move(result));
+    flushUnsent();
+}
+
+void Shard::flushUnsent()
+{
+    bool published = false;
+    while (!unsent_.empty() && outbox_.tryPush(unsent_.front()))
+    {
+        unsent_.pop_front();
+        published = true;
+    }
+    if (published)
+    {
+        onResultReady_();
+    }
+}
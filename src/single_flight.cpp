@@ -0,0 +1,114 @@
+#include "single_flight.hpp"
+
+#include <numeric>
+#include <unordered_map>
+
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "pipeline.hpp"
+
+namespace
+{
+    // Stages after which the landed file is the whole result
+    bool endsWithLandedFile(const std::string &spec)
+    {
+        try
+        {
+            for (const PipelineStage &stage : parsePipeline(spec))
+            {
+                if (stage.kind != PipelineStage::Kind::Verify && stage.kind != PipelineStage::Kind::Land)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        catch (const std::exception &)
+        {
+            return false; // Reported when the job itself runs
+        }
+    }
+}
+
+size_t FlightPlan::duplicates() const
+{
+    return std::accumulate(followers.begin(), followers.end(), size_t{0},
+                           [](size_t sum, const std::vector<size_t> &served) { return sum + served.size(); });
+}
+
+FlightPlan coalesceJobs(const std::vector<DownloadJob> &jobs, const std::string &defaultSpec)
+{
+    FlightPlan plan;
+    std::unordered_map<std::string, size_t> byKey; // Fetch key -> leader
+    std::unordered_map<std::string, bool> groupable; // Pipeline spec -> endsWithLandedFile
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const DownloadJob &job = jobs[i];
+        const std::string &spec = job.pipeline.empty() ? defaultSpec : job.pipeline;
+        auto verdict = groupable.find(spec);
+        if (verdict == groupable.end())
+        {
+            verdict = groupable.emplace(spec, endsWithLandedFile(spec)).first;
+        }
+
+        if (verdict->second)
+        {
+            std::string key = job.url;
+            key += '\n';
+            key += job.expectedChecksum.value_or("");
+            key += '\n';
+            key += spec;
+            auto [found, inserted] = byKey.emplace(std::move(key), plan.leaders.size());
+            if (!inserted)
+            {
+                plan.followers[found->second].push_back(i);
+                continue;
+            }
+        }
+        plan.leaders.push_back(job);
+        plan.leaderJob.push_back(i);
+        plan.followers.emplace_back();
+    }
+    return plan;
+}
+
+bool shareDownload(const std::filesystem::path &source, const std::filesystem::path &target, bool &linked,
+                   std::string &error)
+{
+    std::error_code ec;
+    if (target.has_parent_path())
+    {
+        std::filesystem::create_directories(target.parent_path(), ec);
+    }
+    if (std::filesystem::equivalent(source, target, ec))
+    {
+        linked = true; // Same job listed twice
+        return true;
+    }
+
+    const std::filesystem::path aside = target.string() + ".part";
+    std::filesystem::remove(aside, ec);
+    linked = ::link(source.c_str(), aside.c_str()) == 0;
+    if (!linked)
+    {
+        // Another filesystem, or one without hard links
+        std::filesystem::copy_file(source, aside, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            error = fmt::format("Cannot copy {} to {}: {}", source.string(), aside.string(), ec.message());
+            std::filesystem::remove(aside, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(aside, target, ec);
+    if (ec)
+    {
+        error = fmt::format("Cannot rename {} to {}: {}", aside.string(), target.string(), ec.message());
+        std::filesystem::remove(aside, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,168 @@
+#include "staging.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+#include "buffer_arena.hpp"
+
+namespace
+{
+    constexpr size_t COPY_CHUNK = 1024 * 1024;
+
+    // Device of path, or of its directory's nearest existing ancestor
+    bool deviceOf(std::filesystem::path path, dev_t &device)
+    {
+        struct stat info{};
+        while (::stat(path.empty() ? "." : path.c_str(), &info) != 0)
+        {
+            if (path.empty() || !path.has_parent_path() || path.parent_path() == path)
+            {
+                return false;
+            }
+            path = path.parent_path();
+        }
+        device = info.st_dev;
+        return true;
+    }
+
+    bool copyContents(int in, int out, off_t size)
+    {
+        off_t copied = 0;
+#ifdef __linux__
+        // In-kernel copy; may be refused across filesystems (EXDEV) or unsupported
+        while (copied < size)
+        {
+            const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, static_cast<size_t>(size - copied), 0);
+            if (n <= 0)
+            {
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0 && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP && errno != EINVAL)
+                {
+                    return false;
+                }
+                break;
+            }
+            copied += n;
+        }
+        if (copied == size)
+        {
+            return true;
+        }
+#endif
+        ArenaBuffer buffer = BufferArena::instance().allocate(COPY_CHUNK);
+        if (buffer.empty())
+        {
+            return false;
+        }
+        while (copied < size)
+        {
+            const ssize_t n = ::pread(in, buffer.data(), buffer.size(), copied);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            for (ssize_t written = 0; written < n;)
+            {
+                const ssize_t w = ::pwrite(out, buffer.data() + written, static_cast<size_t>(n - written),
+                                           copied + written);
+                if (w < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (w <= 0)
+                {
+                    return false;
+                }
+                written += w;
+            }
+            copied += n;
+        }
+        return true;
+    }
+}
+
+std::filesystem::path stagingPath(const std::filesystem::path &destination, const std::filesystem::path &scratchDir)
+{
+    if (scratchDir.empty())
+    {
+        std::filesystem::path partPath = destination;
+        partPath += ".part";
+        return partPath;
+    }
+
+    // Same destination -> same scratch name, distinct destinations don't collide. FNV-1a, not
+    // std::hash: the name must not change with the build, or an upgrade orphans every .part
+    const std::string key = std::filesystem::absolute(destination).lexically_normal().string();
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char c : key)
+    {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    return scratchDir / fmt::format("{}.{:016x}.part", destination.filename().string(), hash);
+}
+
+bool bringAlongside(std::filesystem::path &from, const std::filesystem::path &to, std::string &error)
+{
+    if (from.parent_path() == to.parent_path())
+    {
+        return true; // Same directory, same filesystem: no need to ask
+    }
+
+    dev_t fromDevice = 0;
+    dev_t toDevice = 0;
+    if (!deviceOf(from, fromDevice) || !deviceOf(to.parent_path(), toDevice) || fromDevice == toDevice)
+    {
+        return true; // Same filesystem (or unknown): rename will tell
+    }
+
+    std::filesystem::path local = to;
+    local += ".part";
+
+    int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info{};
+    if (in < 0 || ::fstat(in, &info) != 0)
+    {
+        error = fmt::format("Cannot open staged file {}: {}", from.string(), std::strerror(errno));
+        if (in >= 0)
+        {
+            ::close(in);
+        }
+        return false;
+    }
+    int out = ::open(local.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0)
+    {
+        error = fmt::format("Cannot create {}: {}", local.string(), std::strerror(errno));
+        ::close(in);
+        return false;
+    }
+
+    const bool ok = copyContents(in, out, info.st_size);
+    const int copyErrno = errno;
+    ::close(in);
+    if (::close(out) != 0 || !ok)
+    {
+        error = fmt::format("Copying {} to {} failed: {}", from.string(), local.string(),
+                            std::strerror(ok ? errno : copyErrno));
+        ::unlink(local.c_str());
+        return false;
+    }
+
+    ::unlink(from.c_str());
+    from = local;
+    return true;
+}
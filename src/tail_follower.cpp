@@ -0,0 +1,413 @@
+#include "tail_follower.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+namespace
+{
+    // Case-insensitive "Name:" prefix match; returns the trimmed value or nullopt
+    std::optional<std::string> headerValue(const std::string &line, const char *name)
+    {
+        const size_t length = std::strlen(name);
+        if (line.size() <= length || line[length] != ':' ||
+            !std::equal(name, name + length, line.begin(),
+                        [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) ==
+                                                    std::tolower(static_cast<unsigned char>(b)); }))
+        {
+            return std::nullopt;
+        }
+        const size_t begin = line.find_first_not_of(" \t", length + 1);
+        const size_t end = line.find_last_not_of(" \t\r\n");
+        return begin == std::string::npos || end < begin ? std::string() : line.substr(begin, end - begin + 1);
+    }
+
+    // "bytes 100-199/1000" -> first = 100, total = 1000; "bytes */1000" -> first = -1; unknown total = -1
+    bool parseContentRange(const std::string &value, curl_off_t &first, curl_off_t &total)
+    {
+        if (value.rfind("bytes ", 0) != 0)
+        {
+            return false;
+        }
+        const size_t slash = value.find('/');
+        if (slash == std::string::npos)
+        {
+            return false;
+        }
+        first = value[6] == '*' ? -1 : std::strtoll(value.c_str() + 6, nullptr, 10);
+        total = value.compare(slash + 1, 1, "*") == 0 ? -1 : std::strtoll(value.c_str() + slash + 1, nullptr, 10);
+        return true;
+    }
+}
+
+TailFollower::TailFollower(std::string url, std::filesystem::path destination, FollowOptions options,
+                           std::shared_ptr<NetworkCache> networkCache)
+    : url_(std::move(url)), destination_(std::move(destination)), options_(std::move(options)),
+      networkCache_(std::move(networkCache)), curl_(curl_easy_init(), curl_easy_cleanup),
+      interval_(options_.minInterval)
+{
+    if (!curl_)
+    {
+        throw std::runtime_error("Failed to initialize CURL");
+    }
+
+    // One handle for every poll: its connection cache keeps the connection between them
+    CURL *curl = curl_.get();
+    curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "DownloadManager/1.90");
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(options_.timeoutSeconds));
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, headerCallback);
+    if (!options_.caCertFile.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, options_.caCertFile.c_str());
+    }
+    if (networkCache_)
+    {
+        networkCache_->applyTo(curl);
+    }
+    loadState();
+}
+
+bool TailFollower::run(std::string &error)
+{
+    const auto started = std::chrono::steady_clock::now();
+    const auto deadline = options_.duration.count() > 0 ? started + options_.duration
+                                                        : std::chrono::steady_clock::time_point::max();
+    int failures = 0;
+    for (;;)
+    {
+        const curl_off_t before = stats_.bytes;
+        std::string pollError;
+        if (pollOnce(pollError))
+        {
+            failures = 0;
+            if (stats_.bytes > before)
+            {
+                std::error_code sizeError;
+                fmt::print("+{} bytes ({} total), next poll in {:.1f}s\n", stats_.bytes - before,
+                           std::filesystem::file_size(destination_, sizeError),
+                           static_cast<double>(interval_.count()) / 1000.0);
+            }
+        }
+        else
+        {
+            fmt::print(stderr, "Poll failed: {} - next poll in {:.1f}s\n", pollError,
+                       static_cast<double>(interval_.count()) / 1000.0);
+            if (++failures > options_.maxFailures)
+            {
+                error = pollError;
+                return false;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto now = std::chrono::steady_clock::now();
+        const auto wakeAt = deadline - now < interval_ ? deadline : now + interval_;
+        if (wake_.wait_until(lock, wakeAt, [this] { return stopping_; }) ||
+            std::chrono::steady_clock::now() >= deadline)
+        {
+            return true;
+        }
+    }
+}
+
+void TailFollower::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+}
+
+bool TailFollower::pollOnce(std::string &error)
+{
+    ++stats_.polls;
+    const std::string knownEtag = etag_;
+
+    std::error_code sizeError;
+    const auto size = std::filesystem::file_size(destination_, sizeError);
+    const curl_off_t localSize = sizeError ? 0 : static_cast<curl_off_t>(size);
+
+    Outcome outcome = Outcome::Unchanged;
+    bool ok = request(localSize, outcome, error);
+    if (ok && outcome == Outcome::Replaced)
+    {
+        ++stats_.rotations;
+        etag_.clear();
+        ok = rotateLocal(error) && request(0, outcome, error);
+    }
+    if (!ok)
+    {
+        ++stats_.failures;
+        interval_ = std::min(options_.maxInterval, interval_ * 2);
+        return false;
+    }
+
+    // Growing files are polled faster, quiet ones back off
+    if (outcome == Outcome::Grew)
+    {
+        ++stats_.grew;
+        interval_ = std::max(options_.minInterval, interval_ / 2);
+    }
+    else
+    {
+        ++stats_.unchanged;
+        interval_ = std::min(options_.maxInterval, interval_ * 2);
+    }
+    if (etag_ != knownEtag)
+    {
+        saveState();
+    }
+    return true;
+}
+
+bool TailFollower::request(curl_off_t localSize, Outcome &outcome, std::string &error)
+{
+    Poll poll;
+    poll.owner = this;
+    poll.localSize = localSize;
+    poll.local.resize(64 * 1024);
+    if (destination_.has_parent_path())
+    {
+        std::error_code ignored;
+        std::filesystem::create_directories(destination_.parent_path(), ignored);
+    }
+    poll.fd = ::open(destination_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (poll.fd < 0)
+    {
+        error = fmt::format("Cannot open {}: {}", destination_.string(), std::strerror(errno));
+        return false;
+    }
+
+    // Re-read a little of what we have, so a replaced file can't pass for a grown one
+    const curl_off_t start = std::max<curl_off_t>(0, localSize - OVERLAP_BYTES);
+    const std::string range = fmt::format("{}-", start);
+    std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)> headers(nullptr, curl_slist_free_all);
+    if (localSize > 0 && !etag_.empty())
+    {
+        headers.reset(curl_slist_append(nullptr, ("If-None-Match: " + etag_).c_str()));
+    }
+
+    CURL *curl = curl_.get();
+    curl_easy_setopt(curl, CURLOPT_RANGE, localSize > 0 ? range.c_str() : nullptr);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.get());
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &poll);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &poll);
+    const CURLcode result = curl_easy_perform(curl);
+    ::close(poll.fd);
+
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    stats_.connections += static_cast<size_t>(connects);
+    stats_.bytes += poll.appended;
+
+    if (result != CURLE_OK && !poll.mismatch)
+    {
+        error = !poll.writeError.empty() ? poll.writeError : curl_easy_strerror(result);
+        return false;
+    }
+    if (networkCache_)
+    {
+        networkCache_->captureFrom(curl, url_);
+    }
+
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_off_t first = -1;
+    curl_off_t total = -1;
+    parseContentRange(poll.contentRange, first, total);
+
+    if (status == 304)
+    {
+        outcome = Outcome::Unchanged;
+        return true;
+    }
+    if (status == 416)
+    {
+        // Nothing at or after our start: fine if the file simply hasn't grown
+        outcome = total >= 0 && total < localSize ? Outcome::Replaced : Outcome::Unchanged;
+        return true;
+    }
+    if (status != 200 && status != 206)
+    {
+        error = fmt::format("HTTP error {}", status);
+        return false;
+    }
+
+    if (poll.position < 0)
+    {
+        poll.position = status == 206 ? std::max<curl_off_t>(first, 0) : 0; // Empty body
+    }
+    if (poll.mismatch || poll.position < localSize)
+    {
+        outcome = Outcome::Replaced; // Different bytes, or the remote file ends before ours does
+        return true;
+    }
+    if (!poll.etag.empty())
+    {
+        etag_ = poll.etag;
+    }
+    outcome = poll.appended > 0 ? Outcome::Grew : Outcome::Unchanged;
+    return true;
+}
+
+size_t TailFollower::receive(Poll &poll, const char *data, size_t length)
+{
+    if (poll.position < 0)
+    {
+        long status = 0;
+        curl_easy_getinfo(curl_.get(), CURLINFO_RESPONSE_CODE, &status);
+        curl_off_t first = -1;
+        curl_off_t total = -1;
+        if (status == 206 && parseContentRange(poll.contentRange, first, total) && first >= 0 &&
+            first <= poll.localSize)
+        {
+            poll.position = first;
+        }
+        else if (status == 200)
+        {
+            poll.position = 0; // Range ignored: the whole file, checked against all of ours
+        }
+        else if (status == 206)
+        {
+            poll.writeError = fmt::format("Unexpected Content-Range '{}'", poll.contentRange);
+            return 0;
+        }
+        else
+        {
+            return length; // Error or 416 body: not file data
+        }
+    }
+
+    // Bytes we already have must match our copy
+    size_t consumed = 0;
+    while (consumed < length && poll.position < poll.localSize)
+    {
+        const size_t chunk = std::min({length - consumed, poll.local.size(),
+                                       static_cast<size_t>(poll.localSize - poll.position)});
+        if (::pread(poll.fd, poll.local.data(), chunk, static_cast<off_t>(poll.position)) !=
+            static_cast<ssize_t>(chunk))
+        {
+            poll.writeError = fmt::format("Cannot read back {}: {}", destination_.string(), std::strerror(errno));
+            return 0;
+        }
+        if (std::memcmp(poll.local.data(), data + consumed, chunk) != 0)
+        {
+            poll.mismatch = true;
+            return 0; // Abort: the rest comes from a fresh fetch
+        }
+        poll.position += static_cast<curl_off_t>(chunk);
+        consumed += chunk;
+    }
+
+    // The rest is new
+    while (consumed < length)
+    {
+        const ssize_t written = ::pwrite(poll.fd, data + consumed, length - consumed, static_cast<off_t>(poll.position));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            poll.writeError = fmt::format("Write to {} failed: {}", destination_.string(), std::strerror(errno));
+            return 0;
+        }
+        poll.position += written;
+        poll.appended += written;
+        consumed += static_cast<size_t>(written);
+    }
+    return length;
+}
+
+bool TailFollower::rotateLocal(std::string &error)
+{
+    std::error_code fsError;
+    if (!std::filesystem::exists(destination_, fsError))
+    {
+        return true;
+    }
+    for (int n = 1;; ++n)
+    {
+        const std::filesystem::path kept = destination_.string() + "." + std::to_string(n);
+        if (std::filesystem::exists(kept, fsError))
+        {
+            continue;
+        }
+        std::filesystem::rename(destination_, kept, fsError);
+        if (fsError)
+        {
+            error = fmt::format("Cannot keep the old copy as {}: {}", kept.string(), fsError.message());
+            return false;
+        }
+        fmt::print("Remote file was truncated or replaced; previous copy kept as {}\n", kept.string());
+        return true;
+    }
+}
+
+void TailFollower::loadState()
+{
+    std::error_code sizeError;
+    if (std::filesystem::file_size(destination_, sizeError) == 0 || sizeError)
+    {
+        return; // Nothing local for an ETag to describe
+    }
+    std::ifstream state(destination_.string() + ".follow");
+    std::getline(state, etag_);
+}
+
+void TailFollower::saveState() const
+{
+    const std::string path = destination_.string() + ".follow";
+    {
+        std::ofstream state(path + ".tmp", std::ios::trunc);
+        state << etag_ << '\n';
+        if (!state)
+        {
+            return; // Only costs a full overlap check next run
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(path + ".tmp", path, error);
+}
+
+size_t TailFollower::writeCallback(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    auto &poll = *static_cast<Poll *>(userdata);
+    return poll.owner->receive(poll, ptr, size * nmemb);
+}
+
+size_t TailFollower::headerCallback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    auto &poll = *static_cast<Poll *>(userdata);
+    const std::string line(buffer, size * nitems);
+    if (line.rfind("HTTP/", 0) == 0)
+    {
+        // A new response (after a redirect): forget the previous one's headers
+        poll.contentRange.clear();
+        poll.etag.clear();
+    }
+    else if (auto value = headerValue(line, "Content-Range"))
+    {
+        poll.contentRange = *value;
+    }
+    else if (auto value = headerValue(line, "ETag"))
+    {
+        poll.etag = *value;
+    }
+    return size * nitems;
+}
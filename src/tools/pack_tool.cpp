@@ -0,0 +1,113 @@
+// pack_tool: list and extract objects stored by download_manager --pack
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+#include <CLI/CLI.hpp>
+
+#include "pack.hpp"
+
+namespace
+{
+    bool matches(const PackEntry &entry, const std::vector<std::string> &names)
+    {
+        return names.empty() || std::find(names.begin(), names.end(), entry.name) != names.end();
+    }
+
+    // Member names must stay inside the output directory
+    bool isSafeName(const std::filesystem::path &path)
+    {
+        return !path.empty() && !path.has_root_path() &&
+               std::none_of(path.begin(), path.end(), [](const std::filesystem::path &part)
+                            { return part == ".."; });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CLI::App app{"List and extract download_manager pack directories"};
+    app.require_subcommand(1);
+
+    std::string packDir;
+    std::vector<std::string> names;
+    std::string outputDir = ".";
+
+    CLI::App *list = app.add_subcommand("list", "Print name, size, segment and SHA-256 of every object");
+    list->add_option("pack", packDir, "Pack directory")->required();
+    list->add_option("names", names, "Only these objects");
+
+    CLI::App *extract = app.add_subcommand("extract", "Write objects out as files, verifying their SHA-256");
+    extract->add_option("pack", packDir, "Pack directory")->required();
+    extract->add_option("names", names, "Only these objects (default: all)");
+    extract->add_option("-o,--output", outputDir, "Directory to extract into (absolute names are made relative)");
+
+    try
+    {
+        app.parse(argc, argv);
+    }
+    catch (const CLI::ParseError &e)
+    {
+        return app.exit(e);
+    }
+
+    try
+    {
+        PackReader reader(packDir);
+
+        if (*list)
+        {
+            for (const PackEntry &entry : reader.entries())
+            {
+                if (matches(entry, names))
+                {
+                    fmt::print("{}\t{}\t{}@{}\t{}\n", entry.name, entry.length, packSegmentName(entry.segment),
+                               entry.offset, entry.sha256);
+                }
+            }
+            return 0;
+        }
+
+        size_t extracted = 0;
+        size_t failed = 0;
+        std::string data;
+        for (const PackEntry &entry : reader.entries())
+        {
+            if (!matches(entry, names))
+            {
+                continue;
+            }
+
+            const std::filesystem::path relative = std::filesystem::path(entry.name).relative_path().lexically_normal();
+            std::string error;
+            if (!isSafeName(relative))
+            {
+                error = fmt::format("Refusing unsafe name '{}'", entry.name);
+            }
+            else if (reader.read(entry, data, error))
+            {
+                const std::filesystem::path target = std::filesystem::path(outputDir) / relative;
+                std::filesystem::create_directories(target.parent_path());
+                std::ofstream out(target, std::ios::binary | std::ios::trunc);
+                out.write(data.data(), static_cast<std::streamsize>(data.size()));
+                if (out)
+                {
+                    ++extracted;
+                    continue;
+                }
+                error = fmt::format("Cannot write {}", target.string());
+            }
+            fmt::print(stderr, "✗ {}\n", error);
+            ++failed;
+        }
+
+        fmt::print("Extracted {} object(s){}\n", extracted, failed > 0 ? fmt::format(", {} failed", failed) : "");
+        return failed > 0 ? 1 : 0;
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "Error: {}\n", e.what());
+        return 1;
+    }
+}
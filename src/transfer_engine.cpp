@@ -0,0 +1,386 @@
+#include "transfer_engine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "checksum.hpp"
+#include "pipeline.hpp"
+#include "shard.hpp"
+#include "staging.hpp"
+#include "work_stealing_pool.hpp"
+
+TransferEngine::TransferEngine(EngineOptions options, std::shared_ptr<NetworkCache> networkCache)
+    : options_(std::move(options)), networkCache_(std::move(networkCache))
+{
+    if (options_.shardCount == 0)
+    {
+        options_.shardCount = 1;
+    }
+    if (options_.maxActivePerShard == 0)
+    {
+        options_.maxActivePerShard = 1;
+    }
+    if (options_.pipelineBacklog == 0)
+    {
+        options_.pipelineBacklog = 1;
+    }
+    if (options_.maxOpenFiles == 0)
+    {
+        // Leave the other half for sockets, pipes and everything else
+        options_.maxOpenFiles = std::min<size_t>(FdCache::raiseOpenFileLimit() / 2, MAX_DEFAULT_OPEN_FILES);
+    }
+    options_.maxOpenFiles = std::max(options_.maxOpenFiles, options_.shardCount);
+    if (!options_.memory)
+    {
+        options_.memory = std::make_shared<MemoryBudget>(0);
+    }
+    if (options_.pack && options_.memory->limit() != 0 && options_.memory->limit() < Shard::MIN_PACK_BUDGET)
+    {
+        // Transfers would wait forever for room for a whole body
+        throw std::invalid_argument(fmt::format("--pack needs a memory budget of at least {} MB",
+                                                (Shard::MIN_PACK_BUDGET + 1024 * 1024 - 1) / (1024 * 1024)));
+    }
+    if (!options_.disks)
+    {
+        // Never throttles below what the shards could run anyway
+        options_.disks = std::make_shared<DiskAdmission>(options_.shardCount * options_.maxActivePerShard,
+                                                         options_.diskLatencyTarget);
+    }
+    if (options_.durability)
+    {
+        options_.durability->setDiskAdmission(options_.disks);
+    }
+    if (options_.storeZstd && !options_.zstdFrames)
+    {
+        options_.zstdFrames = std::make_shared<ZstdFramePool>(options_.zstd);
+    }
+}
+
+size_t TransferEngine::shardFor(const std::string &url) const
+{
+    std::string host;
+    if (CURLU *handle = curl_url())
+    {
+        char *part = nullptr;
+        if (curl_url_set(handle, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK &&
+            curl_url_get(handle, CURLUPART_HOST, &part, 0) == CURLUE_OK)
+        {
+            host = part;
+            curl_free(part);
+        }
+        curl_url_cleanup(handle);
+    }
+    return std::hash<std::string>{}(host.empty() ? url : host) % options_.shardCount;
+}
+
+void TransferEngine::run(const std::vector<DownloadJob> &jobs, const ResultHandler &onResult)
+{
+    auto ringDoorbell = [this]
+    {
+        std::lock_guard<std::mutex> lock(doorbellMutex_);
+        doorbell_.notify_one();
+    };
+
+    // With a destination pool each job gets its root when it is handed to a
+    // shard, so placement sees the throughput measured so far. Compressed
+    // output lands as "<destination>.zst".
+    const bool rewritesDestinations = options_.destinations || options_.storeZstd;
+    std::vector<DownloadJob> placed;
+    if (rewritesDestinations)
+    {
+        placed = jobs;
+    }
+    const std::vector<DownloadJob> &work = rewritesDestinations ? placed : jobs;
+
+    // Results that left the post-processing pipeline, waiting to be reported here
+    std::mutex finalizedMutex;
+    std::vector<TransferResult> finalized;
+    std::atomic<size_t> packing{0};        // Objects queued for (or in) a pack append
+    std::atomic<size_t> awaitingCommit{0}; // Appended, reported once a commit indexes them
+    std::atomic<bool> packCommitting{false};
+    const size_t packVolume = options_.pack ? options_.disks->volumeFor(options_.pack->directory()) : 0;
+    WorkStealingPool pool(options_.postProcessThreads);
+    Pipeline pipeline(pool, options_.pipelineSpec, Pipeline::parseStageLimits(options_.stageLimits),
+                      [&](TransferResult result)
+                      {
+                          {
+                              std::lock_guard<std::mutex> lock(finalizedMutex);
+                              finalized.push_back(std::move(result));
+                          }
+                          ringDoorbell();
+                      },
+                      options_.memory, options_.durability, options_.directories);
+    pipeline.setEventStream(options_.events);
+
+    // The .part has landed (or the job failed): another process may have it now
+    auto releasePart = [&](size_t jobIndex)
+    {
+        if (options_.partLocks && !options_.pack)
+        {
+            options_.partLocks->release(stagingPath(work[jobIndex].destination, options_.scratchDir));
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    shards.reserve(options_.shardCount);
+    for (size_t i = 0; i < options_.shardCount; ++i)
+    {
+        shards.push_back(std::make_unique<Shard>(i, options_, networkCache_, ringDoorbell));
+        shards.back()->start();
+    }
+
+    size_t submitted = 0;
+    std::optional<ShardJob> next; // Job `submitted`, prepared but not yet accepted by its shard
+    size_t reported = 0;
+    bool finished = false;
+    const size_t downloadWindow = 2 * options_.shardCount * options_.maxActivePerShard;
+    const size_t maxOutstanding = MAX_OUTSTANDING_WINDOWS * downloadWindow;
+
+    while (reported < jobs.size())
+    {
+        bool progress = false;
+
+        // Hand out jobs until a shard's inbox is full, or until post-processing
+        // falls behind: then downloads wait instead of piling up finished files.
+        // Jobs waiting for a throttled volume don't count: one slow disk must not
+        // fill the window and starve the others (they are bounded by maxOutstanding)
+        // Packed objects waiting for their commit hold no memory; they are bounded the same way
+        size_t waitingForDisk = awaitingCommit.load(std::memory_order_relaxed);
+        for (const auto &shard : shards)
+        {
+            waitingForDisk += shard->waitingForDisk();
+        }
+        while (submitted < jobs.size())
+        {
+            const size_t inPipeline = pipeline.backlog() + packing.load(std::memory_order_relaxed);
+            const size_t outstanding = submitted - reported;
+            const size_t downloading =
+                outstanding - std::min(outstanding, inPipeline + waitingForDisk);
+            if (inPipeline >= options_.pipelineBacklog || downloading >= downloadWindow ||
+                outstanding >= maxOutstanding)
+            {
+                break;
+            }
+
+            // Placed once: a job its shard can't take yet is kept for the next pass
+            if (!next)
+            {
+                next = ShardJob{submitted, jobs[submitted]};
+                if (options_.destinations)
+                {
+                    std::optional<std::filesystem::path> target =
+                        options_.destinations->place(jobs[submitted].destination, options_.disks.get());
+                    if (!target)
+                    {
+                        TransferResult refused;
+                        refused.jobIndex = submitted;
+                        refused.error = fmt::format("Destination {} is outside the destination roots",
+                                                    jobs[submitted].destination);
+                        onResult(refused);
+                        next.reset();
+                        ++submitted;
+                        ++reported;
+                        progress = true;
+                        continue;
+                    }
+                    next->job.destination = target->string();
+                }
+                if (options_.storeZstd)
+                {
+                    next->job.destination += ".zst";
+                }
+            }
+            std::string destination = next->job.destination;
+            if (!shards[shardFor(next->job.url)]->trySubmit(*next))
+            {
+                break;
+            }
+            if (rewritesDestinations)
+            {
+                placed[submitted].destination = std::move(destination);
+            }
+            next.reset();
+            ++submitted;
+            progress = true;
+        }
+
+        if (submitted == jobs.size() && !finished)
+        {
+            for (auto &shard : shards)
+            {
+                shard->finish();
+            }
+            finished = true;
+        }
+
+        for (auto &shard : shards)
+        {
+            while (std::optional<TransferResult> result = shard->tryPopResult())
+            {
+                progress = true;
+                if (options_.progress)
+                {
+                    options_.progress->reportEnded(); // Its last bytes go out before anything else about it
+                }
+                // Another process landed it and post-processed it; it is only checked
+                // against the job's checksum, from disk
+                const DownloadJob &landed = work[result->jobIndex];
+                if (result->success && !result->location.empty() && !options_.pack && landed.expectedChecksum)
+                {
+                    const std::filesystem::path location = result->location;
+                    pipeline.submit(landed, std::move(*result), location, true);
+                    continue;
+                }
+
+                // Failures and other files landed elsewhere have nothing left to post-process
+                if (!result->success || !result->location.empty())
+                {
+                    releasePart(result->jobIndex);
+                    onResult(*result);
+                    ++reported;
+                    continue;
+                }
+
+                // Packed objects skip the pipeline; the append (and every commitEvery-th
+                // append's fdatasync) runs on the pool, not here or on a shard thread.
+                // An object is reported once a commit has indexed it
+                if (options_.pack)
+                {
+                    packing.fetch_add(1, std::memory_order_relaxed);
+                    pool.submit([&, packed = std::move(*result)]() mutable
+                                {
+                                    awaitingCommit.fetch_add(1, std::memory_order_relaxed);
+                                    storePacked(work[packed.jobIndex], std::move(packed), packVolume,
+                                                [&](TransferResult stored)
+                                                {
+                                                    {
+                                                        std::lock_guard<std::mutex> lock(finalizedMutex);
+                                                        finalized.push_back(std::move(stored));
+                                                    }
+                                                    awaitingCommit.fetch_sub(1, std::memory_order_relaxed);
+                                                    ringDoorbell();
+                                                });
+                                    packing.fetch_sub(1, std::memory_order_relaxed);
+                                    ringDoorbell();
+                                });
+                    continue;
+                }
+
+                const DownloadJob &job = work[result->jobIndex];
+                pipeline.submit(job, std::move(*result), stagingPath(job.destination, options_.scratchDir));
+            }
+        }
+
+        std::vector<TransferResult> ready;
+        {
+            std::lock_guard<std::mutex> lock(finalizedMutex);
+            ready.swap(finalized);
+        }
+        for (const TransferResult &result : ready)
+        {
+            releasePart(result.jobIndex);
+            onResult(result);
+            ++reported;
+            progress = true;
+        }
+
+        // Nothing else to do: commit the packed objects waiting for one rather
+        // than leave them (and their jobs' reports) until commitEvery appends
+        if (!progress && options_.pack && options_.pack->unreported() > 0 && !packCommitting.exchange(true))
+        {
+            pool.submit([&]
+                        {
+                            std::string error;
+                            const auto started = std::chrono::steady_clock::now();
+                            options_.pack->commit(error); // Failures reach each object's done
+                            options_.disks->recordSync(
+                                packVolume,
+                                std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+                            packCommitting.store(false);
+                            ringDoorbell();
+                        });
+        }
+
+        if (!progress)
+        {
+            // Bounded wait: a doorbell rung between the check above and this wait
+            // is missed, but the result is still collected on the next pass
+            std::unique_lock<std::mutex> lock(doorbellMutex_);
+            doorbell_.wait_for(lock, std::chrono::milliseconds(20));
+        }
+    }
+
+    // Every job is reported, so the loops are idle; the pipeline is drained
+    fileCacheStats_ = FdCache::Stats{};
+    for (auto &shard : shards)
+    {
+        shard->join();
+        fileCacheStats_ += shard->fileCacheStats();
+    }
+}
+
+void TransferEngine::storePacked(const DownloadJob &job, TransferResult result, size_t volume,
+                                 const std::function<void(TransferResult)> &onStored)
+{
+    std::string body;
+    body.swap(result.packedBody);
+
+    // Packed objects skip the pipeline, so they are verified here: against the
+    // manifest's checksum, or else the one the server announced
+    std::string error;
+    const std::string expected = job.expectedChecksum.value_or(result.announcedChecksum);
+    if (!expected.empty())
+    {
+        auto [algorithm, expectedHex] = ChecksumVerifier::parseChecksum(expected);
+        const std::string prefix = std::string(ChecksumVerifier::algorithmName(algorithm)) + ":";
+        const std::string streamedHex = algorithm == ChecksumVerifier::Algorithm::SHA256 ? result.sha256
+                                        : result.streamedChecksum.rfind(prefix, 0) == 0
+                                            ? result.streamedChecksum.substr(prefix.size())
+                                            : std::string();
+        if (streamedHex != expectedHex)
+        {
+            error = fmt::format("Checksum verification FAILED{} (not packed)",
+                                job.expectedChecksum ? "" : " against the server's digest header");
+        }
+    }
+
+    const size_t length = body.size();
+    const size_t charge = std::exchange(result.packedCharge, 0);
+    bool appended = false;
+    if (error.empty())
+    {
+        result.location = fmt::format("{}:{}", options_.pack->directory().string(), job.destination);
+        // Copied into the callback: it may run (on a commit) before append returns
+        auto done = [result, onStored](bool ok, const std::string &commitError) mutable
+        {
+            if (!ok)
+            {
+                result.success = false;
+                result.location.clear();
+                result.error = fmt::format("Pack index commit failed: {}", commitError);
+            }
+            onStored(std::move(result));
+        };
+        appended = options_.pack->append(job.destination, body.data(), length, result.sha256, std::move(done), error);
+    }
+
+    std::string().swap(body);
+    options_.memory->release(MemoryBudget::Stage::WriteBuffer, charge);
+    if (appended)
+    {
+        options_.disks->recordWrite(volume, length);
+        return;
+    }
+    result.success = false;
+    result.location.clear();
+    result.error = std::move(error);
+    onStored(std::move(result));
+}
@@ -0,0 +1,145 @@
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+#include <fmt/core.h>
+
+namespace
+{
+    // Which pool/worker the current thread belongs to (for local submits)
+    thread_local const void *currentPool = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    workers_.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+
+    threads_.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads_.emplace_back([this, i]
+                              { workerLoop(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    for (std::thread &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    const size_t index = (currentPool == this)
+                             ? currentWorker
+                             : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+    // Count first so a worker that grabs the task right away never underflows
+    unfinished_.fetch_add(1, std::memory_order_relaxed);
+    queued_.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders us after any worker's "nothing queued" check
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wakeup_.notify_one();
+}
+
+void WorkStealingPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    idle_.wait(lock, [this]
+               { return unfinished_.load(std::memory_order_acquire) == 0; });
+}
+
+bool WorkStealingPool::popLocal(size_t index, Task &task)
+{
+    Worker &worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+    {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, Task &task)
+{
+    for (size_t offset = 1; offset < workers_.size(); ++offset)
+    {
+        Worker &victim = *workers_[(thief + offset) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            // Oldest task: the victim is least likely to want it soon
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    for (;;)
+    {
+        Task task;
+        if (popLocal(index, task) || steal(index, task))
+        {
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            try
+            {
+                task();
+            }
+            catch (const std::exception &e)
+            {
+                fmt::print(stderr, "Post-processing task failed: {}\n", e.what());
+            }
+
+            if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wakeup_.wait(lock, [this]
+                     { return stopping_ || queued_.load(std::memory_order_acquire) > 0; });
+        if (stopping_ && queued_.load(std::memory_order_acquire) == 0)
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#include "checksum_discovery.hpp"
+#include "test_support.hpp"
+
+#include <map>
+#include <optional>
+#include <string>
+
+#include <fmt/core.h>
+
+namespace
+{
+    // Digests of "" and "abc"
+    const std::string EMPTY_SHA256 = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+    const std::string EMPTY_SHA256_B64 = "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuFU=";
+    const std::string EMPTY_SHA1 = "da39a3ee5e6b4b0d3255bfef95601890afd80709";
+    const std::string EMPTY_SHA1_B64 = "2jmj7l5rSw0yVb/vlWAYkK/YBwk=";
+    const std::string EMPTY_MD5 = "d41d8cd98f00b204e9800998ecf8427e";
+    const std::string EMPTY_MD5_B64 = "1B2M2Y8AsgTpgAmY7PhCfg==";
+    const std::string ABC_SHA256 = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    const std::string ABC_SHA256_B64 = "ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=";
+
+    struct Base64Case
+    {
+        const char *what;
+        std::string text;
+        size_t bytes;
+        std::string hex; // "" = rejected
+    };
+
+    struct HeaderCase
+    {
+        const char *what;
+        std::string name;
+        std::string value;
+        std::optional<std::string> digest;
+    };
+
+    struct SumsCase
+    {
+        const char *what;
+        std::string text;
+        std::map<std::string, std::string> sums;
+    };
+} // namespace
+
+int main()
+{
+    try
+    {
+        // Test 1: base64ToHex
+        const Base64Case base64Cases[] = {
+            {"SHA-256 decodes", EMPTY_SHA256_B64, 32, EMPTY_SHA256},
+            {"MD5 with two padding characters decodes", EMPTY_MD5_B64, 16, EMPTY_MD5},
+            {"SHA-1 with one padding character decodes", EMPTY_SHA1_B64, 20, EMPTY_SHA1},
+            {"Wrong length rejected", EMPTY_SHA256_B64, 20, ""},
+            {"Empty text rejected", "", 32, ""},
+            {"Length not a multiple of 4 rejected", EMPTY_SHA256_B64.substr(1), 32, ""},
+            {"Invalid character rejected", "47DEQpj8HBSa+/TImW+5JCeuQeRkm5NMpJWZG3hSuF!=", 32, ""},
+            {"Hex instead of base64 rejected", EMPTY_MD5, 16, ""},
+        };
+        for (const Base64Case &test : base64Cases)
+        {
+            check(base64ToHex(test.text, test.bytes) == test.hex, test.what);
+        }
+
+        // Test 2: parseDigestHeader
+        const HeaderCase headerCases[] = {
+            {"Repr-Digest (RFC 9530)", "Repr-Digest", "sha-256=:" + ABC_SHA256_B64 + ":", "sha256:" + ABC_SHA256},
+            {"Content-Digest (RFC 9530)", "Content-Digest", "sha-256=:" + EMPTY_SHA256_B64 + ":",
+             "sha256:" + EMPTY_SHA256},
+            {"Header name in any case", "repr-DIGEST", "sha-256=:" + ABC_SHA256_B64 + ":", "sha256:" + ABC_SHA256},
+            {"RFC 9530 prefers SHA-256 over MD5", "Repr-Digest",
+             "md5=:" + EMPTY_MD5_B64 + ":, sha-256=:" + ABC_SHA256_B64 + ":", "sha256:" + ABC_SHA256},
+            {"RFC 9530 parameters ignored", "Repr-Digest", "sha-256=:" + ABC_SHA256_B64 + ":;x=1",
+             "sha256:" + ABC_SHA256},
+            {"RFC 9530 unknown algorithm skipped", "Repr-Digest",
+             "sha-512=:AAAA:, md5=:" + EMPTY_MD5_B64 + ":", "md5:" + EMPTY_MD5},
+            {"RFC 9530 without colons rejected", "Repr-Digest", "sha-256=" + ABC_SHA256_B64, std::nullopt},
+            {"Digest (RFC 3230)", "Digest", "SHA-256=" + ABC_SHA256_B64, "sha256:" + ABC_SHA256},
+            {"RFC 3230 SHA is SHA-1", "Digest", "SHA=" + EMPTY_SHA1_B64, "sha1:" + EMPTY_SHA1},
+            {"RFC 3230 prefers SHA-256", "Digest", "MD5=" + EMPTY_MD5_B64 + ",SHA-256=" + ABC_SHA256_B64,
+             "sha256:" + ABC_SHA256},
+            {"RFC 3230 member without value skipped", "Digest", "UNIXsum,MD5=" + EMPTY_MD5_B64,
+             "md5:" + EMPTY_MD5},
+            {"Content-MD5", "Content-MD5", " " + EMPTY_MD5_B64 + " ", "md5:" + EMPTY_MD5},
+            {"Content-MD5 of the wrong length", "Content-MD5", EMPTY_SHA1_B64, std::nullopt},
+            {"Malformed base64 rejected", "Digest", "SHA-256=not base64!", std::nullopt},
+            {"Truncated digest rejected", "Repr-Digest", "sha-256=:" + EMPTY_MD5_B64 + ":", std::nullopt},
+            {"Other headers ignored", "ETag", "\"" + ABC_SHA256 + "\"", std::nullopt},
+        };
+        for (const HeaderCase &test : headerCases)
+        {
+            check(parseDigestHeader(test.name, test.value) == test.digest, test.what);
+        }
+
+        // Test 3: parseSumsFile
+        const std::string upper = "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD";
+        const SumsCase sumsCases[] = {
+            {"GNU text mode", ABC_SHA256 + "  abc.txt\n", {{"abc.txt", ABC_SHA256}}},
+            {"GNU binary mode", ABC_SHA256 + " *abc.bin\n", {{"abc.bin", ABC_SHA256}}},
+            {"Leading ./ dropped", ABC_SHA256 + "  ./dir/abc.txt\n", {{"dir/abc.txt", ABC_SHA256}}},
+            {"Binary mode with ./", ABC_SHA256 + " *./abc.bin\n", {{"abc.bin", ABC_SHA256}}},
+            {"Name with spaces", ABC_SHA256 + "  my file.txt\n", {{"my file.txt", ABC_SHA256}}},
+            {"Hash lower-cased", upper + "  abc.txt\n", {{"abc.txt", ABC_SHA256}}},
+            {"Escaped line", "\\" + ABC_SHA256 + "  a\\\\b.txt\n", {{"a\\\\b.txt", ABC_SHA256}}},
+            {"BSD format", "SHA256 (abc.txt) = " + ABC_SHA256 + "\n", {{"abc.txt", ABC_SHA256}}},
+            {"BSD format with ./", "SHA256 (./abc.txt) = " + ABC_SHA256 + "\n", {{"abc.txt", ABC_SHA256}}},
+            {"Comments, blank lines and CRLF", "# sums\n\n" + ABC_SHA256 + "  abc.txt\r\n",
+             {{"abc.txt", ABC_SHA256}}},
+            {"Mixed formats", ABC_SHA256 + "  a.txt\nSHA256 (b.txt) = " + EMPTY_SHA256 + "\n",
+             {{"a.txt", ABC_SHA256}, {"b.txt", EMPTY_SHA256}}},
+            {"MD5 lines skipped", EMPTY_MD5 + "  abc.txt\n", {}},
+            {"BSD MD5 lines skipped", "MD5 (abc.txt) = " + EMPTY_MD5 + "\n", {}},
+            {"Non-hex hash skipped", std::string(64, 'g') + "  abc.txt\n", {}},
+            {"Line without a name skipped", ABC_SHA256 + "\n", {}},
+        };
+        for (const SumsCase &test : sumsCases)
+        {
+            check(parseSumsFile(test.text) == test.sums, test.what);
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
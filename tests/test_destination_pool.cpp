@@ -0,0 +1,71 @@
+#include "destination_pool.hpp"
+#include "test_support.hpp"
+
+#include <filesystem>
+#include <string>
+
+#include <fmt/core.h>
+
+namespace
+{
+    bool under(const std::filesystem::path &path, const std::filesystem::path &root)
+    {
+        const std::filesystem::path relative = path.lexically_relative(std::filesystem::absolute(root));
+        return !relative.empty() && *relative.begin() != "..";
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        const ScratchDir scratch("destination_pool");
+        const std::filesystem::path a = scratch.path() / "a";
+        const std::filesystem::path b = scratch.path() / "b";
+
+        {
+            DestinationPool pool({a, b});
+
+            // Test 1: paths that leave the root are refused
+            check(!pool.place("../escape.bin"), "Leading .. rejected");
+            check(!pool.place("dir/../../escape.bin"), "Embedded .. rejected");
+            check(!pool.place("/../escape.bin"), "Absolute .. rejected");
+            check(!pool.place("") && !pool.place("."), "Empty destination rejected");
+
+            // Test 2: absolute destinations are taken relative to a root
+            auto rooted = pool.place("/abs/file.bin");
+            check(rooted && (under(*rooted, a) || under(*rooted, b)) && rooted->filename() == "file.bin",
+                  "Leading / stays inside a root");
+
+            // Test 3: a/./x and a/x are the same file
+            auto first = pool.place("dir/one.bin");
+            auto again = pool.place("dir/./one.bin");
+            check(first && again && *first == *again, "Same relative path, same root");
+
+            // Test 4: equal roots share new files evenly (smooth weighted round-robin)
+            for (int i = 0; i < 6; ++i)
+            {
+                pool.place(fmt::format("spread/{}.bin", i));
+            }
+            auto stats = pool.snapshot();
+            const long long diff = static_cast<long long>(stats[0].files) - static_cast<long long>(stats[1].files);
+            check(stats.size() == 2 && diff >= -1 && diff <= 1, "Files spread over both roots");
+        }
+
+        // Test 5: a new pool finds earlier placements through the index
+        {
+            DestinationPool first({a, b});
+            auto placed = first.place("resume/part.bin");
+            DestinationPool second({a, b});
+            auto found = second.place("resume/part.bin");
+            check(placed && found && *placed == *found, "Placement survives a restart");
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
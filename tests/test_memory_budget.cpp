@@ -0,0 +1,131 @@
+#include "memory_budget.hpp"
+#include "test_support.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+    using Stage = MemoryBudget::Stage;
+
+    MemoryBudget::StageUsage usageOf(const MemoryBudget &budget, Stage stage)
+    {
+        return budget.usage()[static_cast<size_t>(stage)];
+    }
+
+    // True once flag is set, waiting up to a few seconds
+    bool becomes(const std::atomic<bool> &flag)
+    {
+        for (int i = 0; i < 500 && !flag.load(); ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return flag.load();
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        // Test 1: tryAcquire draws only what fits, leaving the headroom unused
+        {
+            MemoryBudget budget(100);
+            check(budget.tryAcquire(Stage::Receive, 60), "Draw within the limit");
+            check(!budget.tryAcquire(Stage::Receive, 50), "Draw past the limit refused");
+            check(!budget.tryAcquire(Stage::Receive, 30, 20), "Draw eating into the headroom refused");
+            check(budget.tryAcquire(Stage::Receive, 30, 10), "Draw leaving the headroom free");
+            check(usageOf(budget, Stage::Receive).current == 90, "Refused draws take nothing");
+
+            budget.release(Stage::Receive, 90);
+            check(budget.tryAcquire(Stage::WriteBuffer, 100), "Released bytes can be drawn again");
+            budget.release(Stage::WriteBuffer, 100);
+        }
+
+        // Test 2: stages share one limit but are tracked apart, peaks included
+        {
+            MemoryBudget budget(100);
+            check(budget.tryAcquire(Stage::Receive, 40), "Receive draws");
+            check(budget.acquire(Stage::PostProcess, 50) == 50, "Post-process draws");
+            check(!budget.tryAcquire(Stage::WriteBuffer, 20), "Other stages' bytes count against the limit");
+            budget.release(Stage::Receive, 40);
+
+            const MemoryBudget::StageUsage receive = usageOf(budget, Stage::Receive);
+            const MemoryBudget::StageUsage post = usageOf(budget, Stage::PostProcess);
+            check(receive.current == 0 && receive.peak == 40, "Peak outlives the release");
+            check(post.current == 50 && post.peak == 50, "Each stage has its own usage");
+            check(std::string(receive.name) == "receive" && std::string(post.name) == "post-process",
+                  "Stages are named");
+            budget.release(Stage::PostProcess, 50);
+        }
+
+        // Test 3: an unlimited budget never refuses but still tracks usage
+        {
+            MemoryBudget budget(0);
+            check(budget.tryAcquire(Stage::Receive, size_t{1} << 40, size_t{1} << 40), "Unlimited tryAcquire");
+            check(budget.acquire(Stage::Receive, 1000) == 1000, "Unlimited acquire");
+            check(usageOf(budget, Stage::Receive).current == (size_t{1} << 40) + 1000, "Unlimited usage tracked");
+        }
+
+        // Test 4: acquire charges an oversized request as the whole budget
+        {
+            MemoryBudget budget(100);
+            const size_t drawn = budget.acquire(Stage::PostProcess, 500);
+            check(drawn == 100, "Oversized request capped at the limit");
+            budget.release(Stage::PostProcess, drawn);
+            check(usageOf(budget, Stage::PostProcess).current == 0, "Capped bytes release cleanly");
+        }
+
+        // Test 5: acquire blocks until another stage releases enough
+        {
+            MemoryBudget budget(100);
+            check(budget.tryAcquire(Stage::Receive, 80), "Receive holds most of the budget");
+
+            std::atomic<bool> acquired{false};
+            std::thread waiter([&]
+                               {
+                                   budget.acquire(Stage::PostProcess, 50);
+                                   acquired = true;
+                               });
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            check(!acquired.load(), "acquire waits while the budget is short");
+
+            budget.release(Stage::Receive, 20);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            check(!acquired.load(), "A release too small to fit keeps it waiting");
+
+            budget.release(Stage::Receive, 30);
+            check(becomes(acquired), "A release that makes room wakes it");
+            waiter.join();
+            check(usageOf(budget, Stage::PostProcess).current == 50 && usageOf(budget, Stage::Receive).current == 30,
+                  "Waiter charged once it fits");
+        }
+
+        // Test 6: a Reservation gives its bytes back when it goes away
+        {
+            MemoryBudget budget(100);
+            {
+                MemoryBudget::Reservation reservation(&budget, Stage::PostProcess, 70);
+                check(!budget.tryAcquire(Stage::Receive, 40), "Reservation holds its bytes");
+            }
+            check(budget.tryAcquire(Stage::Receive, 100), "Reservation released on destruction");
+            budget.release(Stage::Receive, 100);
+
+            budget.countPause();
+            budget.countPause();
+            check(budget.pauses() == 2, "Pauses counted");
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
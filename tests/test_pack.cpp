@@ -0,0 +1,128 @@
+#include "pack.hpp"
+#include "test_support.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <fmt/core.h>
+#include <openssl/evp.h>
+
+namespace
+{
+    std::string sha256Hex(const std::string &data)
+    {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha256(), nullptr);
+        std::string hex;
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            hex += fmt::format("{:02x}", digest[i]);
+        }
+        return hex;
+    }
+
+    // Commit outcomes the done callbacks were given
+    struct Reports
+    {
+        int committed = 0;
+        int failed = 0;
+    };
+
+    bool store(PackWriter &pack, const std::string &name, const std::string &data, Reports &reports)
+    {
+        std::string error;
+        return pack.append(name, data.data(), data.size(), sha256Hex(data),
+                           [&reports](bool ok, const std::string &) { ++(ok ? reports.committed : reports.failed); },
+                           error);
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        const ScratchDir scratch("pack");
+        const std::filesystem::path &dir = scratch.path();
+
+        const std::string first(3000, 'a');
+        const std::string second(3000, 'b');
+        const std::string replaced = "second version";
+
+        // Small segments and commits so both roll over
+        Reports reports;
+        {
+            PackWriter pack(dir, 4096, 2);
+            check(store(pack, "one.bin", first, reports), "Append first object");
+            check(reports.committed == 0 && pack.unreported() == 1, "Not reported before its commit");
+            check(store(pack, "dir/two words.bin", second, reports), "Append name with a space");
+            check(reports.committed == 2 && pack.unreported() == 0, "The commit reports its whole batch");
+            check(store(pack, "one.bin", replaced, reports), "Append replacement");
+            std::string error;
+            check(!pack.append("bad\tname", "x", 1, "", nullptr, error) && !error.empty(), "Tab in name rejected");
+            check(pack.contains("dir/two words.bin") && !pack.contains("three.bin"), "contains() sees queued names");
+            const PackWriter::Stats stats = pack.stats();
+            check(stats.objects == 3 && stats.segments == 2, "Second segment started when the first filled");
+            check(pack.commit(error) && reports.committed == 3 && reports.failed == 0, "Explicit commit reports the rest");
+        }
+
+        // Test: the index reads back with replaced entries dropped
+        {
+            PackReader reader(dir);
+            const std::vector<PackEntry> &entries = reader.entries();
+            check(entries.size() == 2, "Two live entries");
+            std::string data;
+            std::string error;
+            bool roundTrip = entries.size() == 2;
+            for (const PackEntry &entry : entries)
+            {
+                const std::string &expected = entry.name == "one.bin" ? replaced : second;
+                roundTrip = roundTrip && reader.read(entry, data, error) && data == expected;
+            }
+            check(roundTrip, "Objects read back and match their SHA-256");
+
+            PackEntry corrupt = entries.front();
+            corrupt.sha256 = std::string(64, '0');
+            check(!reader.read(corrupt, data, error), "Checksum mismatch detected");
+        }
+
+        // Test: index lines parse, torn ones don't
+        PackEntry entry;
+        check(parsePackIndexLine("2\t10\t5\tabc\tname with space", entry) && entry.segment == 2 && entry.offset == 10 &&
+                  entry.length == 5 && entry.sha256 == "abc" && entry.name == "name with space",
+              "Index line parsed");
+        check(!parsePackIndexLine("2\t10\t5", entry), "Torn index line rejected");
+        check(!parsePackIndexLine("0\t10\t5\tabc\tname", entry), "Segment 0 rejected");
+
+        // Test: a torn last line (crash mid-commit) doesn't swallow the next entry
+        {
+            std::ofstream index(dir / "index", std::ios::app | std::ios::binary);
+            index << "1\t99";
+        }
+        {
+            PackWriter pack(dir, 4096, 2);
+            check(pack.contains("one.bin"), "Reopened pack knows earlier objects");
+            check(store(pack, "three.bin", first, reports), "Append after reopening");
+        } // Destructor commits the rest
+        check(reports.committed == 4, "Destructor's commit reports too");
+        {
+            PackReader reader(dir);
+            std::string data;
+            std::string error;
+            bool found = false;
+            for (const PackEntry &live : reader.entries())
+            {
+                found = found || (live.name == "three.bin" && reader.read(live, data, error) && data == first);
+            }
+            check(reader.entries().size() == 3 && found, "Entry after a torn line survives");
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,80 @@
+#include "part_locks.hpp"
+#include "test_support.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+
+namespace
+{
+    void writeFile(const std::filesystem::path &path, const std::string &content)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << content;
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        const ScratchDir scratch("part_locks");
+        const std::filesystem::path &dir = scratch.path();
+
+        // Two PartLocks stand in for two processes: flock() locks conflict between open file descriptions
+        PartLocks first;
+        PartLocks second;
+
+        // Test: one claim at a time
+        const std::filesystem::path destination = dir / "file.bin";
+        const std::filesystem::path part = dir / "file.bin.part";
+        check(first.tryClaim(part, destination) == PartLocks::Claim::Owned, "First claim owns the file");
+        check(second.tryClaim(part, destination) == PartLocks::Claim::Busy, "Second claim waits");
+
+        // Test: released without landing anything, the waiter takes over
+        first.release(part);
+        check(second.tryClaim(part, destination) == PartLocks::Claim::Owned, "Waiter owns it after a release");
+        second.release(part);
+
+        // Test: landed by the holder while the other waited
+        check(first.tryClaim(part, destination) == PartLocks::Claim::Owned, "Claimed again");
+        check(second.tryClaim(part, destination) == PartLocks::Claim::Busy, "Waiting again");
+        writeFile(destination, "landed");
+        first.release(part);
+        check(second.tryClaim(part, destination) == PartLocks::Claim::Finished, "Waiter sees it finished");
+        check(!std::filesystem::exists(part.string() + ".lock"), "No lock file left behind");
+
+        // Test: a destination that existed before the wait and wasn't touched is fetched again
+        const std::filesystem::path old = dir / "old.bin";
+        const std::filesystem::path oldPart = dir / "old.bin.part";
+        writeFile(old, "stale");
+        check(first.tryClaim(oldPart, old) == PartLocks::Claim::Owned, "Existing file claimed");
+        check(second.tryClaim(oldPart, old) == PartLocks::Claim::Busy, "Existing file busy");
+        first.release(oldPart);
+        check(second.tryClaim(oldPart, old) == PartLocks::Claim::Owned, "Untouched file is fetched, not finished");
+        second.release(oldPart);
+
+        // Test: replaced (new inode) while waiting counts as finished
+        check(first.tryClaim(oldPart, old) == PartLocks::Claim::Owned, "Existing file claimed again");
+        check(second.tryClaim(oldPart, old) == PartLocks::Claim::Busy, "Existing file busy again");
+        writeFile(dir / "old.bin.new", "fresh");
+        std::filesystem::rename(dir / "old.bin.new", old);
+        first.release(oldPart);
+        check(second.tryClaim(oldPart, old) == PartLocks::Claim::Finished, "Replaced file is finished");
+
+        const PartLocks::Stats stats = second.stats();
+        check(stats.waits == 4 && stats.finished == 2 && stats.claims == 2, "Second's claims, waits and finishes counted");
+        first.release(dir / "never-claimed.part"); // No-op
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
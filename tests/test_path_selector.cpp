@@ -0,0 +1,141 @@
+#include "path_selector.hpp"
+#include "test_support.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+    bool near(double a, double b)
+    {
+        return std::fabs(a - b) < 1e-9;
+    }
+
+    // Transfers each path was given out of count concurrent choose() calls
+    // (all still active), then finished without changing the estimates
+    std::vector<size_t> spread(PathSelector &selector, size_t paths, size_t count)
+    {
+        std::vector<size_t> chosen;
+        std::vector<size_t> perPath(paths, 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            chosen.push_back(selector.choose());
+            ++perPath[chosen.back()];
+        }
+        for (const size_t path : chosen)
+        {
+            selector.record(path, 0, 0.0); // No sample: only drops the active count
+        }
+        return perPath;
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        // Test 1: construction
+        {
+            PathSelector selector({"if!eth1", "host!10.0.0.2", "eth2"});
+            check(selector.interfaceName(0) == "eth1" && selector.interfaceName(1) == "10.0.0.2" &&
+                      selector.interfaceName(2) == "eth2",
+                  "if!/host! prefixes stripped");
+            bool threw = false;
+            try
+            {
+                PathSelector empty({});
+            }
+            catch (const std::invalid_argument &)
+            {
+                threw = true;
+            }
+            check(threw, "Empty interface list rejected");
+        }
+
+        // Test 2: untried paths are tried first, one transfer each
+        {
+            PathSelector selector({"a", "b", "c"});
+            check(selector.choose() == 0 && selector.choose() == 1 && selector.choose() == 2,
+                  "Each untried path explored in turn");
+            selector.record(0, 1000, 1.0);
+            selector.record(1, 500, 1.0);
+            selector.record(2, 100, 1.0);
+            check(selector.choose() == 0, "Once all are measured, the fastest is chosen");
+            selector.record(0, 0, 0.0);
+        }
+
+        // Test 3: record() folds throughput into an EWMA
+        {
+            PathSelector selector({"a"});
+            selector.record(selector.choose(), 1000, 1.0);
+            check(near(selector.snapshot()[0].bytesPerSecond, 1000.0), "First sample taken as is");
+            selector.record(selector.choose(), 4000, 2.0);
+            check(near(selector.snapshot()[0].bytesPerSecond, 0.3 * 2000.0 + 0.7 * 1000.0),
+                  "Later samples weighted by the EWMA");
+
+            const PathSelector::PathStats stats = selector.snapshot()[0];
+            check(stats.transfers == 2 && stats.bytes == 5000 && stats.failures == 0, "Transfers and bytes counted");
+        }
+
+        // Test 4: concurrent transfers split in proportion to throughput
+        {
+            PathSelector selector({"fast", "slow"});
+            selector.choose();
+            selector.choose();
+            selector.record(0, 2000, 1.0);
+            selector.record(1, 1000, 1.0);
+            const std::vector<size_t> perPath = spread(selector, 2, 30);
+            check(perPath[0] == 20 && perPath[1] == 10, "Twice the throughput, twice the transfers");
+
+            // The slow path speeds up: the weights follow
+            for (int i = 0; i < 10; ++i)
+            {
+                selector.record(1, 8000, 1.0);
+            }
+            const std::vector<size_t> shifted = spread(selector, 2, 30);
+            check(shifted[1] > 20 && shifted[0] < 10, "Work shifts toward the faster path");
+        }
+
+        // Test 5: failures halve the estimate and move work away
+        {
+            PathSelector selector({"a", "b"});
+            selector.choose();
+            selector.choose();
+            selector.record(0, 1000, 1.0);
+            selector.record(1, 1000, 1.0);
+            const std::vector<size_t> even = spread(selector, 2, 20);
+            check(even[0] == 10 && even[1] == 10, "Equal paths share evenly");
+
+            selector.recordFailure(selector.choose());
+            const PathSelector::PathStats failed = selector.snapshot()[0];
+            check(failed.failures == 1 && near(failed.bytesPerSecond, 500.0), "Failure halves the estimate");
+            const std::vector<size_t> perPath = spread(selector, 2, 30);
+            check(perPath[0] == 10 && perPath[1] == 20, "Failing path gets half the work");
+        }
+
+        // Test 6: an untried path that keeps failing stops being explored
+        {
+            PathSelector selector({"broken", "good"});
+            check(selector.choose() == 0 && selector.choose() == 1, "Both paths explored");
+            selector.record(1, 1000, 1.0);
+            selector.recordFailure(0);
+            check(selector.choose() == 0, "Unmeasured path retried after a failure");
+            selector.recordFailure(0);
+            check(selector.choose() == 0, "Still retried after two");
+            selector.recordFailure(0);
+            check(selector.choose() == 1, "Given up on after three failures");
+            selector.record(1, 0, 0.0);
+            check(selector.snapshot()[0].failures == 3, "Failures counted");
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
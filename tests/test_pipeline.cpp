@@ -0,0 +1,264 @@
+#include "pipeline.hpp"
+#include "test_support.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+    const std::string ABC_SHA256 = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+    void writeFile(const std::filesystem::path &path, const std::string &content)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << content;
+    }
+
+    std::string readFile(const std::filesystem::path &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // A ustar archive with one regular file
+    std::string tarOf(const std::string &name, const std::string &content)
+    {
+        char header[512] = {};
+        std::strncpy(header, name.c_str(), 99);
+        std::snprintf(header + 100, 8, "%07o", 0644);
+        std::snprintf(header + 124, 12, "%011o", static_cast<unsigned>(content.size()));
+        std::snprintf(header + 136, 12, "%011o", 0u);
+        header[156] = '0';
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+        std::memset(header + 148, ' ', 8); // The checksum counts its own field as spaces
+        unsigned sum = 0;
+        for (unsigned char c : header)
+        {
+            sum += c;
+        }
+        std::snprintf(header + 148, 8, "%06o", sum);
+
+        std::string archive(header, sizeof(header));
+        archive += content;
+        archive.append((512 - content.size() % 512) % 512, '\0');
+        archive.append(1024, '\0'); // End-of-archive marker
+        return archive;
+    }
+
+    // Results handed to onDone
+    struct Results
+    {
+        std::mutex mutex;
+        std::vector<TransferResult> done;
+
+        Pipeline::DoneFn onDone()
+        {
+            return [this](TransferResult result)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.push_back(std::move(result));
+            };
+        }
+    };
+
+    TransferResult downloaded(size_t jobIndex, const std::string &sha256 = "")
+    {
+        TransferResult result;
+        result.jobIndex = jobIndex;
+        result.success = true;
+        result.sha256 = sha256;
+        return result;
+    }
+
+    // Notify command that records how many copies of itself were running when it started
+    std::filesystem::path writeProbe(const std::filesystem::path &dir)
+    {
+        const std::filesystem::path script = dir / "probe.sh";
+        writeFile(script, "#!/bin/sh\n"
+                          "dir=$(dirname \"$0\")\n"
+                          "mkdir \"$dir/running.$$\"\n"
+                          "ls -d \"$dir\"/running.* | wc -l >> \"$dir/peaks\"\n"
+                          "sleep 0.2\n"
+                          "rmdir \"$dir/running.$$\"\n");
+        std::filesystem::permissions(script, std::filesystem::perms::owner_all);
+        return script;
+    }
+
+    // Most copies of the probe seen running at once
+    int peakOf(const std::filesystem::path &dir)
+    {
+        std::ifstream in(dir / "peaks");
+        int peak = 0;
+        for (int count = 0; in >> count;)
+        {
+            peak = std::max(peak, count);
+        }
+        return peak;
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        const ScratchDir scratch("pipeline");
+        const std::filesystem::path &dir = scratch.path();
+
+        // Test 1: verify and land always come first; stages need their arguments
+        {
+            const std::vector<PipelineStage> stages = parsePipeline("decompress, extract:/x ,verify");
+            const bool ordered = stages.size() == 4 && stages[0].kind == PipelineStage::Kind::Verify &&
+                                 stages[1].kind == PipelineStage::Kind::Land &&
+                                 stages[2].kind == PipelineStage::Kind::Decompress &&
+                                 stages[3].kind == PipelineStage::Kind::Extract && stages[3].argument == "/x";
+            check(ordered, "Verify and land run first, listed or not");
+
+            bool threw = false;
+            try
+            {
+                parsePipeline("verify,unpack");
+            }
+            catch (const std::runtime_error &)
+            {
+                threw = true;
+            }
+            check(threw, "Unknown stage rejected");
+            threw = false;
+            try
+            {
+                parsePipeline("notify");
+            }
+            catch (const std::runtime_error &)
+            {
+                threw = true;
+            }
+            check(threw, "Notify without a command rejected");
+        }
+
+        // Test 2: --stage-limit values
+        {
+            const auto limits = Pipeline::parseStageLimits({"extract=2", "Notify=1"});
+            check(limits.size() == 2 && limits.at(PipelineStage::Kind::Extract) == 2 &&
+                      limits.at(PipelineStage::Kind::Notify) == 1,
+                  "Stage limits parsed");
+            for (const std::string bad : {"extract", "unpack=2", "extract=lots"})
+            {
+                bool threw = false;
+                try
+                {
+                    Pipeline::parseStageLimits({bad});
+                }
+                catch (const std::runtime_error &)
+                {
+                    threw = true;
+                }
+                check(threw, fmt::format("Stage limit '{}' rejected", bad));
+            }
+        }
+
+        // Test 3: a stage limit caps concurrent runs, and the backlog counts queued jobs
+        for (const size_t limit : {size_t{1}, size_t{0}})
+        {
+            const std::filesystem::path work = dir / fmt::format("limit{}", limit);
+            std::filesystem::create_directories(work);
+            const std::filesystem::path probe = writeProbe(work);
+
+            std::vector<DownloadJob> jobs(4);
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                jobs[i].url = fmt::format("http://example.com/{}.bin", i);
+                jobs[i].destination = (work / fmt::format("{}.bin", i)).string();
+                writeFile(jobs[i].destination + ".part", "data");
+            }
+
+            std::map<PipelineStage::Kind, size_t> limits;
+            if (limit > 0)
+            {
+                limits[PipelineStage::Kind::Notify] = limit;
+            }
+            WorkStealingPool pool(4);
+            Results results;
+            Pipeline pipeline(pool, "notify:" + probe.string(), limits, results.onDone());
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                pipeline.submit(jobs[i], downloaded(i), jobs[i].destination + ".part");
+            }
+            check(pipeline.backlog() == jobs.size(), "Backlog counts every job in the pipeline");
+            pipeline.waitForBacklogBelow(1);
+            pool.waitIdle();
+
+            bool landed = results.done.size() == jobs.size();
+            for (const TransferResult &result : results.done)
+            {
+                landed = landed && result.success && std::filesystem::exists(result.location);
+            }
+            check(landed, "Every job landed and was announced");
+            if (limit == 1)
+            {
+                check(peakOf(work) == 1, "notify=1 runs one command at a time");
+            }
+            else
+            {
+                check(peakOf(work) > 1, "Without a limit, commands overlap");
+            }
+        }
+
+        // Test 4: verify quarantines a mismatch; land, then extract a tar next to it
+        {
+            const std::string content = "extracted contents\n";
+            std::vector<DownloadJob> jobs(2);
+            jobs[0].url = "http://example.com/good.tar";
+            jobs[0].destination = (dir / "good.tar").string();
+            jobs[0].expectedChecksum = "sha256:" + ABC_SHA256;
+            jobs[0].pipeline = "extract";
+            jobs[1].url = "http://example.com/bad.bin";
+            jobs[1].destination = (dir / "bad.bin").string();
+            jobs[1].expectedChecksum = "sha256:" + std::string(64, '0');
+            writeFile(jobs[0].destination + ".part", tarOf("inner/file.txt", content));
+            writeFile(jobs[1].destination + ".part", "abc");
+
+            WorkStealingPool pool(2);
+            Results results;
+            Pipeline pipeline(pool, "", {}, results.onDone());
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                // Streaming digests as a shard reports them: verify trusts them over the file
+                pipeline.submit(jobs[i], downloaded(i, ABC_SHA256), jobs[i].destination + ".part");
+            }
+            pipeline.waitForBacklogBelow(1);
+            pool.waitIdle();
+
+            std::sort(results.done.begin(), results.done.end(),
+                      [](const TransferResult &a, const TransferResult &b) { return a.jobIndex < b.jobIndex; });
+            const bool both = results.done.size() == 2;
+            check(both, "Both jobs left the pipeline");
+            if (both)
+            {
+                check(results.done[0].success && readFile(dir / "good" / "inner" / "file.txt") == content,
+                      "Tar extracted next to the archive");
+                check(!results.done[1].success && !std::filesystem::exists(jobs[1].destination) &&
+                          std::filesystem::exists(dir / "quarantine" / "bad.bin.part"),
+                      "Checksum mismatch quarantined, not landed");
+            }
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
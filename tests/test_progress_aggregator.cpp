@@ -0,0 +1,147 @@
+#include "progress_aggregator.hpp"
+#include "test_support.hpp"
+
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+    bool near(double a, double b)
+    {
+        return std::fabs(a - b) < 1e-9;
+    }
+
+    // Keeps every sample a frontend is handed
+    struct Recorder
+    {
+        std::mutex mutex;
+        std::vector<ProgressSample> samples;
+
+        ProgressAggregator::Frontend frontend()
+        {
+            return [this](const ProgressSample &sample)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                samples.push_back(sample);
+            };
+        }
+
+        std::vector<ProgressSample> taken()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::exchange(samples, {});
+        }
+    };
+} // namespace
+
+int main()
+{
+    try
+    {
+        // Test 1: EWMA steps toward the newest rate by the smoothing weight
+        {
+            check(near(ProgressAggregator::smooth(100.0, 200.0, 0.3), 130.0), "EWMA weighs the newest rate");
+            check(near(ProgressAggregator::smooth(100.0, 200.0, 1.0), 200.0), "Smoothing 1 keeps only the newest");
+            double rate = 0.0;
+            for (int i = 0; i < 100; ++i)
+            {
+                rate = ProgressAggregator::smooth(rate, 1000.0, 0.3);
+            }
+            check(std::fabs(rate - 1000.0) < 1e-6, "EWMA converges on a steady rate");
+        }
+
+        // Test 2: ETA from the remaining bytes and the rate
+        {
+            check(near(ProgressAggregator::eta(250, 1000, 50.0), 15.0), "ETA is remaining bytes over rate");
+            check(near(ProgressAggregator::eta(1000, 1000, 0.0), 0.0), "ETA is 0 once complete");
+            check(near(ProgressAggregator::eta(250, -1, 50.0), -1.0), "ETA unknown without a size");
+            check(near(ProgressAggregator::eta(250, 1000, 0.0), -1.0), "ETA unknown without a rate");
+        }
+
+        // Test 3: end() reports on reportEnded(), not from the calling thread's end()
+        {
+            Recorder recorder;
+            ProgressAggregator progress(std::chrono::hours(1));
+            progress.addFrontend(recorder.frontend());
+
+            ProgressAggregator::Counter *counter = progress.begin(7, 100, 1000);
+            progress.update(counter, 1000);
+            progress.end(counter);
+            check(recorder.taken().empty(), "end() runs no frontend");
+            progress.reportEnded();
+
+            const std::vector<ProgressSample> samples = recorder.taken();
+            const bool one = samples.size() == 1 && samples[0].transfers.size() == 1;
+            check(one, "One final sample");
+            if (one)
+            {
+                const ProgressSample &sample = samples[0];
+                const TransferProgress &last = sample.transfers[0];
+                check(!sample.periodic && last.finished, "Final sample is marked finished");
+                check(last.slot == 7 && last.bytes == 1000 && last.total == 1000, "Final sample has the last bytes");
+                check(near(last.etaSeconds, 0.0), "Finished transfer has ETA 0");
+                check(sample.bytes == 900, "Resumed bytes aren't counted as received");
+                check(sample.active == 0, "Ended transfer isn't active");
+            }
+
+            progress.reportEnded();
+            check(recorder.taken().empty(), "Ended transfers are reported once");
+            progress.end(counter);
+            progress.reportEnded();
+            check(recorder.taken().empty(), "A second end() is a no-op");
+        }
+
+        // Test 4: counters are pooled, not one per transfer ever begun
+        {
+            ProgressAggregator progress(std::chrono::hours(1));
+            ProgressAggregator::Counter *first = progress.begin(0, 0, -1);
+            ProgressAggregator::Counter *second = progress.begin(1, 0, -1);
+            check(first != second, "Concurrent transfers get their own counters");
+            progress.end(first);
+            ProgressAggregator::Counter *third = progress.begin(2, 0, -1);
+            check(third == first, "A finished transfer's counter is reused");
+            progress.end(second);
+            progress.end(third);
+        }
+
+        // Test 5: the sampler reports running transfers with a rate and an ETA
+        {
+            Recorder recorder;
+            ProgressAggregator progress(std::chrono::milliseconds(10));
+            progress.addFrontend(recorder.frontend());
+            ProgressAggregator::Counter *counter = progress.begin(3, 0, 1 << 30);
+
+            bool measured = false;
+            long long bytes = 0;
+            for (int i = 0; i < 200 && !measured; ++i)
+            {
+                bytes += 4096;
+                progress.update(counter, bytes);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                for (const ProgressSample &sample : recorder.taken())
+                {
+                    for (const TransferProgress &transfer : sample.transfers)
+                    {
+                        measured = measured || (sample.periodic && sample.active == 1 && transfer.slot == 3 &&
+                                                transfer.bytesPerSecond > 0.0 && transfer.etaSeconds > 0.0);
+                    }
+                }
+            }
+            check(measured, "Periodic sample has a rate and an ETA");
+            progress.end(counter);
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,133 @@
+#include "seekable_zstd.hpp"
+#include "test_support.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fmt/core.h>
+#include <zstd.h>
+
+namespace
+{
+    std::uint32_t readLittleEndian(const std::string &data, size_t offset)
+    {
+        std::uint32_t value = 0;
+        for (int i = 3; i >= 0; --i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(data[offset + static_cast<size_t>(i)]);
+        }
+        return value;
+    }
+
+    // Feed input in network-sized chunks and collect until the seek table is out
+    bool compress(ZstdFramePool::Options options, const std::string &input, const std::string &sha256,
+                  std::string &out)
+    {
+        auto pool = std::make_shared<ZstdFramePool>(options);
+        SeekableZstdWriter writer(pool, nullptr);
+        std::string error;
+        for (size_t offset = 0; offset < input.size(); offset += 10000)
+        {
+            while (writer.busy())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                if (!writer.collect(out, error))
+                {
+                    return false;
+                }
+            }
+            if (!writer.write(input.data() + offset, std::min<size_t>(10000, input.size() - offset), out, error))
+            {
+                return false;
+            }
+        }
+        writer.seal(sha256);
+        while (!writer.done())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (!writer.collect(out, error))
+            {
+                return false;
+            }
+        }
+        return writer.inputBytes() == input.size() && writer.outputBytes() == out.size() &&
+               pool->contexts() <= std::max<size_t>(1, options.threads);
+    }
+} // namespace
+
+int main()
+{
+    try
+    {
+        std::string input;
+        for (size_t i = 0; input.size() < 300000; ++i)
+        {
+            input += fmt::format("line {} of the test stream, value {}\n", i, (i * 2654435761u) % 1000);
+        }
+        input.resize(300000);
+
+        ZstdFramePool::Options options;
+        options.threads = 2;
+        options.frameBytes = 64 * 1024;
+        std::string out;
+        check(compress(options, input, "abc123", out), "Stream compressed on the pool");
+
+        // Test: footer and seek table at the very end
+        const size_t frames = (input.size() + options.frameBytes - 1) / options.frameBytes;
+        const size_t tableBytes = frames * 12 + 9;
+        check(out.size() > tableBytes + 8 &&
+                  readLittleEndian(out, out.size() - 4) == SeekableZstdWriter::SEEKABLE_MAGIC &&
+                  readLittleEndian(out, out.size() - 9) == frames,
+              "Footer holds the frame count");
+        const size_t tableStart = out.size() - tableBytes - 8;
+        check(readLittleEndian(out, tableStart) == SeekableZstdWriter::SEEK_TABLE_MAGIC &&
+                  readLittleEndian(out, tableStart + 4) == tableBytes,
+              "Seek table is a skippable frame");
+
+        // Test: each table entry locates one independently decodable frame
+        std::string decoded;
+        size_t offset = 0;
+        bool entriesMatch = true;
+        for (size_t i = 0; i < frames && entriesMatch; ++i)
+        {
+            const size_t entry = tableStart + 8 + i * 12;
+            const std::uint32_t compressed = readLittleEndian(out, entry);
+            const std::uint32_t uncompressed = readLittleEndian(out, entry + 4);
+            const std::uint32_t checksum = readLittleEndian(out, entry + 8);
+            std::string frame(uncompressed, '\0');
+            const size_t size = ZSTD_decompress(frame.data(), frame.size(), out.data() + offset, compressed);
+            entriesMatch = !ZSTD_isError(size) && size == uncompressed &&
+                           uncompressed == std::min(options.frameBytes, input.size() - decoded.size()) &&
+                           checksum == readLittleEndian(out, offset + compressed - 4);
+            decoded += frame;
+            offset += compressed;
+        }
+        check(entriesMatch, "Entries match frame sizes and checksums");
+        check(decoded == input, "Frames decode to the input");
+
+        // Test: the SHA-256 frame sits between the last frame and the seek table
+        const std::string payload = "sha256:abc123";
+        check(offset + 8 + payload.size() == tableStart &&
+                  readLittleEndian(out, offset) == SeekableZstdWriter::CHECKSUM_FRAME_MAGIC &&
+                  out.compare(offset + 8, payload.size(), payload) == 0,
+              "Checksum frame before the seek table");
+
+        // Test: an empty stream is one empty frame that decodes to nothing
+        std::string empty;
+        check(compress(options, "", "", empty), "Empty stream compressed");
+        const size_t emptyTable = empty.size() - (12 + 9) - 8;
+        const std::uint32_t emptyFrame = readLittleEndian(empty, emptyTable + 8); // First entry: compressed size
+        check(readLittleEndian(empty, empty.size() - 9) == 1 && emptyFrame == emptyTable &&
+                  ZSTD_getFrameContentSize(empty.data(), emptyFrame) == 0,
+              "Empty stream has one empty frame");
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+
+#include <fmt/core.h>
+
+/**
+ * What every unit test shares: PASS/FAIL checks counted into one summary,
+ * and a scratch directory of its own.
+ */
+
+inline int testFailures = 0;
+
+inline void check(bool ok, const std::string &what)
+{
+    fmt::print("{}: {}\n", what, ok ? "PASS" : "FAIL");
+    if (!ok)
+    {
+        ++testFailures;
+    }
+}
+
+// Print the result of every check(); main's exit code
+inline int testSummary()
+{
+    if (testFailures > 0)
+    {
+        fmt::print(stderr, "\n❌ {} test(s) failed\n", testFailures);
+        return 1;
+    }
+    fmt::print("\n✅ All tests passed!\n");
+    return 0;
+}
+
+/**
+ * An empty directory under the system temp directory, named after the test
+ * and this process; removed with everything in it on destruction.
+ */
+class ScratchDir
+{
+public:
+    explicit ScratchDir(const std::string &test)
+        : path_(std::filesystem::temp_directory_path() / fmt::format("test_{}.{}", test, getpid()))
+    {
+        std::filesystem::remove_all(path_);
+        std::filesystem::create_directories(path_);
+    }
+
+    ~ScratchDir()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(path_, error);
+    }
+
+    ScratchDir(const ScratchDir &) = delete;
+    ScratchDir &operator=(const ScratchDir &) = delete;
+
+    const std::filesystem::path &path() const { return path_; }
+
+private:
+    std::filesystem::path path_;
+};
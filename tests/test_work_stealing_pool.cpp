@@ -0,0 +1,136 @@
+#include "work_stealing_pool.hpp"
+#include "test_support.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace
+{
+    // Order in which tasks ran, and on which thread
+    struct Log
+    {
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::vector<int> order;
+        std::vector<std::thread::id> threads;
+
+        void add(int task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(task);
+                threads.push_back(std::this_thread::get_id());
+            }
+            changed.notify_all();
+        }
+
+        // Up to a few seconds for count entries; false on timeout
+        bool waitFor(size_t count)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            return changed.wait_for(lock, std::chrono::seconds(5), [&] { return order.size() >= count; });
+        }
+    };
+} // namespace
+
+int main()
+{
+    try
+    {
+        // Test 1: every submitted task runs before waitIdle() returns
+        {
+            WorkStealingPool pool(4);
+            check(pool.threadCount() == 4, "Pool has the requested workers");
+            std::atomic<int> ran{0};
+            for (int i = 0; i < 1000; ++i)
+            {
+                pool.submit([&ran] { ran.fetch_add(1, std::memory_order_relaxed); });
+            }
+            pool.waitIdle();
+            check(ran.load() == 1000, "waitIdle() returns after every task");
+        }
+
+        // Test 2: a worker runs the tasks it submitted newest first
+        {
+            WorkStealingPool pool(1);
+            Log log;
+            pool.submit([&]
+                        {
+                            for (int i = 1; i <= 3; ++i)
+                            {
+                                pool.submit([&log, i] { log.add(i); });
+                            }
+                        });
+            pool.waitIdle();
+            check(log.order == std::vector<int>({3, 2, 1}), "Own deque is LIFO");
+            check(pool.stealCount() == 0, "A single worker never steals");
+        }
+
+        // Test 3: an idle worker steals a busy one's tasks, oldest first
+        {
+            WorkStealingPool pool(2);
+            Log log;
+            std::thread::id parent;
+            pool.submit([&]
+                        {
+                            parent = std::this_thread::get_id();
+                            for (int i = 1; i <= 5; ++i)
+                            {
+                                pool.submit([&log, i] { log.add(i); });
+                            }
+                            log.waitFor(5); // Blocks this worker: only a thief can run them
+                        });
+            pool.waitIdle();
+            check(log.order == std::vector<int>({1, 2, 3, 4, 5}), "Stolen from the front");
+            bool elsewhere = log.threads.size() == 5;
+            for (const std::thread::id &thread : log.threads)
+            {
+                elsewhere = elsewhere && thread != parent;
+            }
+            check(elsewhere, "Stolen tasks ran on the other worker");
+            check(pool.stealCount() >= 5, "Every steal counted"); // The first task may have been stolen too
+        }
+
+        // Test 4: an exception escaping a task is dropped; the pool keeps going
+        {
+            WorkStealingPool pool(2);
+            std::atomic<int> ran{0};
+            pool.submit([] { throw std::runtime_error("expected by the test"); });
+            pool.submit([&ran] { ran.fetch_add(1); });
+            pool.waitIdle();
+            check(ran.load() == 1, "Task after a throwing one runs");
+        }
+
+        // Test 5: destruction runs every queued task, including ones queued meanwhile
+        {
+            std::atomic<int> ran{0};
+            {
+                WorkStealingPool pool(2);
+                for (int i = 0; i < 20; ++i)
+                {
+                    pool.submit([&]
+                                {
+                                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                                    pool.submit([&ran] { ran.fetch_add(1); });
+                                    ran.fetch_add(1);
+                                });
+                }
+            }
+            check(ran.load() == 40, "Destructor drains the queues before joining");
+        }
+
+        return testSummary();
+    }
+    catch (const std::exception &e)
+    {
+        fmt::print(stderr, "❌ Error: {}\n", e.what());
+        return 1;
+    }
+}